@@ -42,6 +42,36 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_SET
     },
 
+
+
+    /* Operating mode. */
+    {
+      "nofuse",
+      UI_KEY_NOFUSE,
+      0,
+      0,
+      "Evaluate each operator separately on full data.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->nofuse,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "streammem",
+      UI_KEY_STREAMMEM,
+      "INT",
+      0,
+      "Stream images with this many bytes (0: read).",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->streammem,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+
     {0}
   };
 
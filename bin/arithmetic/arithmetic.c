@@ -41,6 +41,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include "main.h"
 
 #include "operands.h"
+#include "expression.h"
 #include "arithmetic.h"
 
 
@@ -164,7 +165,7 @@ arithmetic_filter(void *in_prm)
                                   0, -1, NULL, NULL, NULL);
 
   /* Prepare the tile. */
-  free(tile->array);
+  gal_data_release_array(tile);
   tsize=tile->dsize;
   tile->block=input;
 
@@ -333,7 +334,7 @@ wrapper_for_filter(struct arithmeticparams *p, char *token, int operator)
                   "along dimension %zu is a float", ndim-i);
 
           /* Make sure it isn't negative. */
-          comp=gal_arithmetic(GAL_ARITHMETIC_OP_GT, 0, tmp, zero);
+          comp=gal_arithmetic(GAL_ARITHMETIC_OP_GT, 1, 0, tmp, zero);
           if( *(uint8_t *)(comp->array) == 0 )
             error(EXIT_FAILURE, 0, "lengths of filter along dimensions "
                   "must be positive. The given length in dimension %zu"
@@ -446,9 +447,8 @@ reversepolish(struct arithmeticparams *p)
   char *filename, *hdu;
   unsigned int numop, i;
   gal_list_str_t *token;
-  gal_data_t *d1=NULL, *d2=NULL, *d3=NULL;
-  unsigned char flags = ( GAL_ARITHMETIC_INPLACE | GAL_ARITHMETIC_FREE
-                          | GAL_ARITHMETIC_NUMOK );
+  gal_data_t *d1=NULL, *d2=NULL;
+  struct expression_node *in[3], **inall;
 
 
   /* Prepare the processing: */
@@ -609,31 +609,36 @@ reversepolish(struct arithmeticparams *p)
               switch(nop)
                 {
                 case 1:
-                  d1=operands_pop(p, token->v);
+                  in[0]=operands_pop_node(p, token->v);
                   break;
 
                 case 2:
-                  d2=operands_pop(p, token->v);
-                  d1=operands_pop(p, token->v);
+                  in[1]=operands_pop_node(p, token->v);
+                  in[0]=operands_pop_node(p, token->v);
                   break;
 
                 case 3:
-                  d3=operands_pop(p, token->v);
-                  d2=operands_pop(p, token->v);
-                  d1=operands_pop(p, token->v);
+                  in[2]=operands_pop_node(p, token->v);
+                  in[1]=operands_pop_node(p, token->v);
+                  in[0]=operands_pop_node(p, token->v);
                   break;
 
                 case -1:
                   /* This case is when the number of operands is itself an
                      operand. So the first popped operand must be an
-                     integer number, we will use that to construct a linked
-                     list of any number of operands within the single `d1'
-                     pointer. */
-                  d1=NULL;
-                  numop=pop_number_of_operands(p, operands_pop(p, token->v),
-                                               token->v);
+                     integer number, we will use that to construct an
+                     array of any number of operands (in the order they
+                     are popped). */
+                  d1=operands_pop(p, token->v);
+                  numop=pop_number_of_operands(p, d1, token->v);
+                  gal_data_free(d1);
+                  errno=0;
+                  inall=malloc(numop * sizeof *inall);
+                  if(inall==NULL)
+                    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes "
+                          "for `inall'", __func__, numop * sizeof *inall);
                   for(i=0;i<numop;++i)
-                    gal_list_data_add(&d1, operands_pop(p, token->v));
+                    inall[i]=operands_pop_node(p, token->v);
                   break;
 
                 default:
@@ -642,12 +647,18 @@ reversepolish(struct arithmeticparams *p)
                 }
 
 
-              /* Run the arithmetic operation. Note that `gal_arithmetic'
-                 is a variable argument function (like printf). So the
-                 number of arguments it uses depend on the operator. So
-                 when the operator doesn't need three operands, the extra
-                 arguments will be ignored. */
-              operands_add(p, NULL, gal_arithmetic(op, flags, d1, d2, d3));
+              /* Add the operator (with its operands) to the stack. The
+                 pixel-wise operators aren't evaluated here, they are
+                 kept in an expression tree, which is evaluated when its
+                 result is necessary (see `expression.c'). */
+              if(nop==-1)
+                {
+                  operands_add_node(p, expression_make(p, op, 1, inall,
+                                                       numop));
+                  free(inall);
+                }
+              else
+                operands_add_node(p, expression_make(p, op, 0, in, nop));
             }
 
           /* No need to call the arithmetic library, call the proper
@@ -677,6 +688,19 @@ reversepolish(struct arithmeticparams *p)
     error(EXIT_FAILURE, 0, "too many operands");
 
 
+  /* If the final operand is an expression that hasn't been evaluated yet,
+     evaluate it. When streaming, the output is written while the
+     expression is evaluated, so `data' will remain NULL. */
+  if(p->operands->node)
+    {
+      if(p->streammem)
+        expression_stream(p, p->operands->node);
+      else
+        p->operands->data=expression_evaluate(p, p->operands->node);
+      p->operands->node=NULL;
+    }
+
+
   /* If the final operand has a filename, but its `data' element is NULL,
      then the file hasn't actually be read yet. In this case, we need to
      read the contents of the file and put the resulting dataset into the
@@ -690,8 +714,9 @@ reversepolish(struct arithmeticparams *p)
       filename=p->operands->filename;
       if( gal_fits_name_is_fits(filename) )
         {
-          p->operands->data=gal_fits_img_read(filename,hdu,p->cp.minmapsize,
-                                              0, 0);
+          p->operands->data=gal_fits_img_read_mmap(filename, hdu,
+                                                   p->cp.numthreads,
+                                                   p->cp.minmapsize, 0, 0);
           p->refdata.wcs=p->operands->data->wcs;
           p->refdata.nwcs=p->operands->data->nwcs;
           p->operands->data->wcs=NULL;
@@ -708,7 +733,14 @@ reversepolish(struct arithmeticparams *p)
   /* If the final data structure has more than one element, write it as a
      FITS file. Otherwise, print it in the standard output. */
   d1=p->operands->data;
-  if(d1->size==1)
+  if(d1==NULL)
+    {
+      /* The output was already written while streaming. */
+      wcsfree(p->refdata.wcs);
+      if(!p->cp.quiet)
+        printf(" - Output written to %s\n", p->cp.output);
+    }
+  else if(d1->size==1)
     {
       /* To simplify the printing process, we will first change it to
          double, then use printf's `%g' to print it, so integers will be
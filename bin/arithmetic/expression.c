@@ -0,0 +1,845 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gnuastro/fits.h>
+#include <gnuastro/list.h>
+#include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
+#include <gnuastro/arithmetic.h>
+
+#include <gnuastro-internal/checkset.h>
+
+#include "main.h"
+
+#include "expression.h"
+
+
+
+
+
+/* Evaluating one operator at a time over the full datasets, means that a
+   long expression will read and write the full datasets into memory once
+   for every operator and will need a full-sized output for most of
+   them. However, most operators are pixel-wise: the output pixel only
+   depends on the same pixel of the inputs. So in Arithmetic, the
+   pixel-wise operators are not evaluated as soon as they are read. They
+   are kept in a tree (with the already evaluated datasets as its
+   leaves). When the result of the expression is needed, the full tree is
+   evaluated on small blocks of the datasets (that fit in the CPU cache)
+   on multiple threads.
+
+   On each block, the operators are evaluated with the same library
+   function (`gal_arithmetic') that is used on the full datasets, so the
+   result is the same as evaluating each operator separately. Operators
+   that need the full dataset (for example `medianvalue') are evaluated
+   as soon as they are read (their input expression is first evaluated
+   as described above). */
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***************************************************************/
+/*************            Building the tree        *************/
+/***************************************************************/
+/* Allocate a node, with space for `numin' inputs. */
+static struct expression_node *
+expression_node_alloc(int operator, size_t numin)
+{
+  struct expression_node *node;
+
+  /* Allocate the node. */
+  errno=0;
+  node=malloc(sizeof *node);
+  if(node==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `node'",
+          __func__, sizeof *node);
+
+  /* Allocate the inputs. */
+  if(numin)
+    {
+      errno=0;
+      node->in=malloc(numin * sizeof *node->in);
+      if(node->in==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+              "`node->in'", __func__, numin * sizeof *node->in);
+    }
+  else
+    node->in=NULL;
+
+  /* Initialize the rest of the elements. */
+  node->data=NULL;
+  node->fptr=NULL;
+  node->offset=0;
+  node->output=0;
+  node->numin=numin;
+  node->multioperand=0;
+  node->operator=operator;
+  return node;
+}
+
+
+
+
+
+/* Put an already evaluated dataset into a leaf node. */
+struct expression_node *
+expression_leaf(gal_data_t *data)
+{
+  struct expression_node *node=expression_node_alloc(0, 0);
+  node->data=data;
+  return node;
+}
+
+
+
+
+
+/* Return 1 if any of the leaves under this node is an array (not a single
+   number). */
+static int
+expression_has_array(struct expression_node *node)
+{
+  size_t i;
+
+  if(node->operator==0) return node->fptr || node->data->size>1;
+
+  for(i=0;i<node->numin;++i)
+    if( expression_has_array(node->in[i]) )
+      return 1;
+  return 0;
+}
+
+
+
+
+
+/* Operators that need the full dataset can't be evaluated on blocks. */
+static int
+expression_is_pixelwise(int operator)
+{
+  switch(operator)
+    {
+    case GAL_ARITHMETIC_OP_MINVAL:
+    case GAL_ARITHMETIC_OP_MAXVAL:
+    case GAL_ARITHMETIC_OP_NUMVAL:
+    case GAL_ARITHMETIC_OP_SUMVAL:
+    case GAL_ARITHMETIC_OP_MEANVAL:
+    case GAL_ARITHMETIC_OP_STDVAL:
+    case GAL_ARITHMETIC_OP_MEDIANVAL:
+      return 0;
+    default:
+      return 1;
+    }
+  return 1;
+}
+
+
+
+
+
+/* Free the tree below (and including) `node'. The datasets of the leaves
+   are also freed, unless they are used to keep the output. */
+static void
+expression_free(struct expression_node *node)
+{
+  size_t i;
+  int status=0;
+
+  if(node->operator==0)
+    {
+      if(node->output==0) gal_data_free(node->data);
+      if(node->fptr)
+        {
+          fits_close_file(node->fptr, &status);
+          gal_fits_io_error(status, NULL);
+        }
+    }
+  else
+    for(i=0;i<node->numin;++i)
+      expression_free(node->in[i]);
+
+  free(node->in);
+  free(node);
+}
+
+
+
+
+
+/* Read the full image of a leaf that was opened for streaming (when the
+   full image is necessary). */
+static void
+expression_read_full(struct arithmeticparams *p,
+                     struct expression_node *node)
+{
+  void *blank;
+  gal_data_t *data;
+  int status=0, anyblank;
+  uint8_t type=node->data->type;
+
+  /* Allocate the full dataset. */
+  data=gal_data_alloc(NULL, type, p->refdata.ndim, p->refdata.dsize, NULL,
+                      0, p->cp.minmapsize, node->data->name,
+                      node->data->unit, NULL);
+
+  /* Read the image into it. */
+  blank=gal_blank_alloc_write(type);
+  fits_read_img(node->fptr, gal_fits_type_to_datatype(type), 1, data->size,
+                blank, data->array, &anyblank, &status);
+  gal_fits_io_error(status, NULL);
+  free(blank);
+
+  /* Close the file and replace the leaf's dataset. */
+  fits_close_file(node->fptr, &status);
+  gal_fits_io_error(status, NULL);
+  gal_data_free(node->data);
+  node->fptr=NULL;
+  node->data=data;
+}
+
+
+
+
+
+/* Read all the leaves under `node' that are still in a file. */
+static void
+expression_read_files(struct arithmeticparams *p,
+                      struct expression_node *node)
+{
+  size_t i;
+
+  if(node->operator==0)
+    { if(node->fptr) expression_read_full(p, node); }
+  else
+    for(i=0;i<node->numin;++i)
+      expression_read_files(p, node->in[i]);
+}
+
+
+
+
+
+/* Call the arithmetic library on the given inputs. */
+static gal_data_t *
+expression_call_arithmetic(int operator, int multioperand, gal_data_t **in,
+                           size_t numin, size_t numthreads)
+{
+  size_t i;
+  gal_data_t *list=NULL;
+  unsigned char flags = ( GAL_ARITHMETIC_INPLACE | GAL_ARITHMETIC_FREE
+                          | GAL_ARITHMETIC_NUMOK );
+
+  /* Operators that take any number of operands, need them as a list. Note
+     that the inputs are kept in the same order that they were popped, so
+     they have to be added to the list in the same order. */
+  if(multioperand)
+    {
+      for(i=0;i<numin;++i) gal_list_data_add(&list, in[i]);
+      return gal_arithmetic(operator, numthreads, flags, list);
+    }
+
+  /* Note that `gal_arithmetic' is a variable argument function (like
+     printf). So when the operator doesn't need three operands, the extra
+     arguments will be ignored. */
+  return gal_arithmetic(operator, numthreads, flags, in[0],
+                        numin>1 ? in[1] : NULL, numin>2 ? in[2] : NULL);
+}
+
+
+
+
+
+/* Evaluate the operator of the given node on the full datasets of its
+   inputs. */
+static gal_data_t *
+expression_evaluate_full(struct arithmeticparams *p,
+                         struct expression_node *node)
+{
+  size_t i;
+  gal_data_t *out, **in;
+
+  /* Evaluate all the inputs. */
+  errno=0;
+  in=malloc(node->numin * sizeof *in);
+  if(in==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `in'",
+          __func__, node->numin * sizeof *in);
+  for(i=0;i<node->numin;++i)
+    in[i]=expression_evaluate(p, node->in[i]);
+
+  /* Call the arithmetic library. */
+  out=expression_call_arithmetic(node->operator, node->multioperand, in,
+                                 node->numin, p->cp.numthreads);
+
+  /* Clean up and return (the inputs have already been freed). */
+  free(in);
+  free(node->in);
+  free(node);
+  return out;
+}
+
+
+
+
+
+/* Make a node for the operator with the given inputs (`numin' of them in
+   `in', which is not used after this function). If the operator can't be
+   evaluated over blocks, or if none of its inputs are arrays (there is no
+   benefit in keeping them), it is evaluated immediately and the output is
+   a leaf. */
+struct expression_node *
+expression_make(struct arithmeticparams *p, int operator, int multioperand,
+                struct expression_node **in, size_t numin)
+{
+  size_t i;
+  struct expression_node *node=expression_node_alloc(operator, numin);
+
+  /* Set the inputs. */
+  node->multioperand=multioperand;
+  for(i=0;i<numin;++i) node->in[i]=in[i];
+
+  /* See if it should be evaluated now. */
+  if( p->nofuse
+      || expression_is_pixelwise(operator)==0
+      || expression_has_array(node)==0 )
+    return expression_leaf( expression_evaluate_full(p, node) );
+
+  /* Return the node. */
+  return node;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***************************************************************/
+/*************           Evaluating the tree       *************/
+/***************************************************************/
+struct expression_params
+{
+  struct arithmeticparams *p;     /* Program's parameters.             */
+  struct expression_node *node;   /* Root of the expression's tree.    */
+  gal_data_t             *out;    /* Output dataset.                   */
+  size_t                start;    /* Index of first output element.    */
+  size_t                 size;    /* Number of elements to evaluate.   */
+  size_t              nblocks;    /* Number of blocks.                 */
+};
+
+
+
+
+
+/* Find the first element and number of elements in the given block. To
+   avoid having a block with only one element (which will be treated as a
+   number by the arithmetic library), any remaining element is added to
+   the last block. */
+static void
+expression_block_range(size_t size, size_t block, size_t nblocks,
+                       size_t *start, size_t *len)
+{
+  *start = block * ARITHMETIC_BLOCK_SIZE;
+  *len   = block==nblocks-1 ? size-*start : ARITHMETIC_BLOCK_SIZE;
+}
+
+
+
+
+
+/* Evaluate the tree below `node' on one block (`start' is the index of the
+   first element in the full dataset). Each array leaf is copied into a
+   new (small) dataset, so it can be freely modified or freed by the
+   arithmetic library. */
+static gal_data_t *
+expression_evaluate_block(struct expression_node *node, size_t start,
+                          size_t len)
+{
+  size_t i;
+  gal_data_t *in[3], **inall, *out, *leaf=node->data;
+
+  /* For a leaf, copy the respective region of the dataset. */
+  if(node->operator==0)
+    {
+      if(leaf->size==1 && node->fptr==NULL) return gal_data_copy(leaf);
+      out=gal_data_alloc(NULL, leaf->type, 1, &len, NULL, 0, -1,
+                         leaf->name, leaf->unit, leaf->comment);
+      memcpy(out->array, gal_data_ptr_increment(leaf->array,
+                                                start-node->offset,
+                                                leaf->type),
+             len*gal_type_sizeof(leaf->type));
+      return out;
+    }
+
+  /* Evaluate the inputs on this block. */
+  if(node->numin>3)
+    {
+      errno=0;
+      inall=malloc(node->numin * sizeof *inall);
+      if(inall==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `inall'",
+              __func__, node->numin * sizeof *inall);
+    }
+  else inall=in;
+  for(i=0;i<node->numin;++i)
+    inall[i]=expression_evaluate_block(node->in[i], start, len);
+
+  /* Call the arithmetic library (on one thread: each block is already
+     being evaluated on its own thread), clean up and return. */
+  out=expression_call_arithmetic(node->operator, node->multioperand, inall,
+                                 node->numin, 1);
+  if(inall!=in) free(inall);
+  return out;
+}
+
+
+
+
+
+/* Evaluate one block and put the result in the output. */
+static void
+expression_block_to_out(struct expression_params *eprm, size_t block)
+{
+  gal_data_t *result, *out=eprm->out;
+  size_t start, len, typesize=gal_type_sizeof(out->type);
+
+  /* Evaluate the expression on this block. */
+  expression_block_range(eprm->size, block, eprm->nblocks, &start, &len);
+  result=expression_evaluate_block(eprm->node, eprm->start+start, len);
+
+  /* Small sanity check. */
+  if(result->type!=out->type || result->size!=len)
+    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
+          "problem. The result on block %zu has a different type or size "
+          "(%s, %zu) compared to the output (%s, %zu)", __func__,
+          PACKAGE_BUGREPORT, block, gal_type_name(result->type, 1),
+          result->size, gal_type_name(out->type, 1), len);
+
+  /* Copy the result into the output and clean up. */
+  memcpy(gal_data_ptr_increment(out->array, start, out->type),
+         result->array, len*typesize);
+  gal_data_free(result);
+}
+
+
+
+
+
+/* Function to run on each thread. */
+static void *
+expression_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct expression_params *eprm=(struct expression_params *)tprm->params;
+
+  size_t i;
+
+  /* Go over all the blocks given to this thread. Note that the first
+     block has already been evaluated, so the indexs start from the second
+     block. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    expression_block_to_out(eprm, tprm->indexs[i]+1);
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Prepare the blocks of the `eprm->size' elements (starting from
+   `eprm->start') and evaluate the first block. The first block is
+   evaluated separately because its result is necessary to know the type of
+   the output. */
+static gal_data_t *
+expression_first_block(struct expression_params *eprm)
+{
+  size_t start, len;
+
+  /* Set the number of blocks (see `expression_block_range'). */
+  eprm->nblocks = ( eprm->size/ARITHMETIC_BLOCK_SIZE
+                    + (eprm->size%ARITHMETIC_BLOCK_SIZE > 1 ? 1 : 0) );
+  if(eprm->nblocks==0) eprm->nblocks=1;
+
+  /* Evaluate the first block. */
+  expression_block_range(eprm->size, 0, eprm->nblocks, &start, &len);
+  return expression_evaluate_block(eprm->node, eprm->start, len);
+}
+
+
+
+
+
+/* Put the result of the first block in the output and evaluate the rest
+   of the blocks on separate threads. */
+static void
+expression_other_blocks(struct expression_params *eprm, gal_data_t *first)
+{
+  memcpy(eprm->out->array, first->array,
+         first->size*gal_type_sizeof(first->type));
+  gal_threads_spin_off(expression_on_thread, eprm, eprm->nblocks-1,
+                       eprm->p->cp.numthreads);
+}
+
+
+
+
+
+/* Find the first array leaf (to use as a reference for the size) and make
+   sure that all the arrays have the same size. The leaves that are read
+   from files (when streaming) have already been checked. */
+static void
+expression_check_arrays(struct expression_node *node, gal_data_t **ref)
+{
+  size_t i;
+
+  if(node->operator==0)
+    {
+      if(node->data->size>1 && node->fptr==NULL)
+        {
+          if(*ref==NULL) *ref=node->data;
+          else if( gal_data_dsize_is_different(*ref, node->data) )
+            error(EXIT_FAILURE, 0, "the non-number inputs to operators "
+                  "must have the same size");
+        }
+    }
+  else
+    for(i=0;i<node->numin;++i)
+      expression_check_arrays(node->in[i], ref);
+}
+
+
+
+
+
+/* The output can be written in the array of one of the array leaves (that
+   have the same type as the output): the pixels of a block in the leaf
+   are not needed after the block has been evaluated. This is similar to
+   the `GAL_ARITHMETIC_INPLACE' flag when evaluating the operators
+   separately. Return NULL if no such leaf exists. */
+static gal_data_t *
+expression_output_leaf(struct expression_node *node, uint8_t type)
+{
+  size_t i;
+  gal_data_t *out;
+
+  if(node->operator==0)
+    {
+      if( node->data->size>1 && node->data->type==type
+          && node->data->block==NULL )
+        {
+          node->output=1;
+          return node->data;
+        }
+    }
+  else
+    for(i=0;i<node->numin;++i)
+      if( (out=expression_output_leaf(node->in[i], type)) )
+        return out;
+  return NULL;
+}
+
+
+
+
+
+/* Evaluate the full expression under `node', free the tree and return the
+   result. */
+gal_data_t *
+expression_evaluate(struct arithmeticparams *p, struct expression_node *node)
+{
+  gal_data_t *out, *ref=NULL, *first;
+  struct expression_params eprm={0};
+
+  /* If the node is a leaf, just return its dataset. */
+  if(node->operator==0)
+    {
+      if(node->fptr) expression_read_full(p, node);
+      out=node->data;
+      free(node);
+      return out;
+    }
+
+  /* When streaming, the full result is necessary here, so read all the
+     images that are still in a file. */
+  expression_read_files(p, node);
+
+  /* Find the size of the arrays (`expression_make' only keeps nodes that
+     have atleast one array under them). */
+  expression_check_arrays(node, &ref);
+  if(ref==NULL)
+    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
+          "problem. The expression has no arrays", __func__,
+          PACKAGE_BUGREPORT);
+
+  /* Evaluate the first block to find the type of the output. */
+  eprm.p=p;
+  eprm.node=node;
+  eprm.size=ref->size;
+  first=expression_first_block(&eprm);
+
+  /* Set the output: use one of the leaves if possible, otherwise allocate
+     it. In both cases, the meta-data should be the same as the output of
+     the operators. */
+  out=expression_output_leaf(node, first->type);
+  if(out)
+    {
+      free(out->name);
+      free(out->unit);
+      free(out->comment);
+      gal_checkset_allocate_copy(first->name, &out->name);
+      gal_checkset_allocate_copy(first->unit, &out->unit);
+      gal_checkset_allocate_copy(first->comment, &out->comment);
+    }
+  else
+    out=gal_data_alloc(NULL, first->type, ref->ndim, ref->dsize, NULL, 0,
+                       p->cp.minmapsize, first->name, first->unit,
+                       first->comment);
+
+  /* Evaluate the rest of the blocks. */
+  eprm.out=out;
+  expression_other_blocks(&eprm, first);
+  gal_data_free(first);
+
+  /* Clean up and return. */
+  expression_free(node);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***************************************************************/
+/*************              Streaming              *************/
+/***************************************************************/
+/* When streaming, the images are not read into memory. The expression is
+   evaluated on chunks of the images (a group of rows): all the images
+   that are still in a file are read over the chunk, the expression is
+   evaluated on the chunk (in blocks and on multiple threads, like above)
+   and the chunk of the output is written into the output file. So the used
+   memory is bounded by the `--streammem' option. */
+
+/* Add all the leaves that are still in a file to the list. */
+static void
+expression_stream_files(struct expression_node *node,
+                        gal_list_void_t **files)
+{
+  size_t i;
+
+  if(node->operator==0)
+    { if(node->fptr) gal_list_void_add(files, node); }
+  else
+    for(i=0;i<node->numin;++i)
+      expression_stream_files(node->in[i], files);
+}
+
+
+
+
+
+/* Find the number of elements in each chunk: the number of elements that
+   can be kept in `--streammem' bytes, rounded to a full row (the first
+   FITS axis). */
+static size_t
+expression_stream_chunk(struct arithmeticparams *p, gal_list_void_t *files)
+{
+  gal_list_void_t *tmp;
+  struct expression_node *leaf;
+  size_t chunk, size=1, bytes=8;   /* Largest type for output. */
+  size_t i, row=p->refdata.dsize[p->refdata.ndim-1];
+
+  /* Find the total number of bytes that are needed for each element. */
+  for(tmp=files;tmp!=NULL;tmp=tmp->next)
+    {
+      leaf=tmp->v;
+      bytes+=gal_type_sizeof(leaf->data->type);
+    }
+
+  /* Find the number of elements in each chunk. */
+  for(i=0;i<p->refdata.ndim;++i) size*=p->refdata.dsize[i];
+  chunk = p->streammem/bytes;
+  chunk = chunk<row ? row : chunk/row*row;
+  return chunk<size ? chunk : size;
+}
+
+
+
+
+
+/* Evaluate the expression under `node' over chunks of the inputs and
+   write the output into `p->cp.output' (chunk by chunk). The tree will be
+   freed after this function. */
+void
+expression_stream(struct arithmeticparams *p, struct expression_node *node)
+{
+  void *blank;
+  fitsfile *ofptr=NULL;
+  gal_data_t *first, *out=NULL, *ref=NULL;
+  struct expression_node *leaf;
+  struct expression_params eprm={0};
+  gal_list_void_t *tmp, *files=NULL;
+  int status=0, anyblank, hasblank=0;
+  size_t i, size=1, chunk, nchunks, buffsize, start, len;
+
+  /* Make sure any array that is already in memory has the same size as
+     the images. */
+  ref=&p->refdata;
+  expression_check_arrays(node, &ref);
+
+  /* Set the number of elements in each chunk. Like the blocks, to avoid
+     having a chunk with only one element, a remaining element is added to
+     the last chunk, so the buffers need one extra element. */
+  expression_stream_files(node, &files);
+  for(i=0;i<p->refdata.ndim;++i) size*=p->refdata.dsize[i];
+  chunk=expression_stream_chunk(p, files);
+  nchunks = size/chunk + (size%chunk > 1 ? 1 : 0);
+  buffsize = chunk+1;
+
+  /* Allocate the buffers to keep each chunk of the input images (the
+     name and units of the images are kept in the placeholder dataset). */
+  for(tmp=files;tmp!=NULL;tmp=tmp->next)
+    {
+      leaf=tmp->v;
+      first=leaf->data;
+      leaf->data=gal_data_alloc(NULL, first->type, 1, &buffsize, NULL, 0,
+                                -1, first->name, first->unit, NULL);
+      gal_data_free(first);
+    }
+
+  /* Go over the chunks. */
+  eprm.p=p;
+  eprm.node=node;
+  for(i=0;i<nchunks;++i)
+    {
+      /* Set the range of this chunk. */
+      start = i*chunk;
+      len   = i==nchunks-1 ? size-start : chunk;
+
+      /* Read this chunk of all the images. */
+      for(tmp=files;tmp!=NULL;tmp=tmp->next)
+        {
+          leaf=tmp->v;
+          leaf->offset=start;
+          leaf->data->size=leaf->data->dsize[0]=len;
+          blank=gal_blank_alloc_write(leaf->data->type);
+          fits_read_img(leaf->fptr,
+                        gal_fits_type_to_datatype(leaf->data->type),
+                        start+1, len, blank, leaf->data->array, &anyblank,
+                        &status);
+          gal_fits_io_error(status, NULL);
+          free(blank);
+        }
+
+      /* Evaluate the first block of this chunk. */
+      eprm.start=start;
+      eprm.size=len;
+      first=expression_first_block(&eprm);
+
+      /* For the first chunk, create the output image (with the
+         dimensions of the inputs) and allocate the buffer of the output
+         chunks (which also keeps the output's metadata, to be written
+         after the data). */
+      if(out==NULL)
+        {
+          ofptr=gal_fits_img_write_create(p->cp.output, first->type,
+                                          p->refdata.ndim,
+                                          p->refdata.dsize);
+          out=gal_data_alloc(NULL, first->type, 1, &buffsize,
+                             p->refdata.wcs, 0, -1, first->name,
+                             first->unit, first->comment);
+        }
+
+      /* Evaluate the rest of the blocks and write the output. */
+      eprm.out=out;
+      out->size=out->dsize[0]=len;
+      expression_other_blocks(&eprm, first);
+      gal_data_free(first);
+      hasblank |= gal_fits_img_write_part(ofptr, out, start);
+    }
+
+  /* Write the keywords that can only be written after the data, then the
+     version information and close the output. */
+  gal_fits_img_write_keys(ofptr, out, hasblank);
+  gal_fits_key_write_version(ofptr, NULL, PROGRAM_NAME);
+  fits_close_file(ofptr, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Clean up. */
+  gal_list_void_free(files, 0);
+  expression_free(node);
+  gal_data_free(out);
+}
@@ -0,0 +1,39 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+struct expression_node *
+expression_leaf(gal_data_t *data);
+
+struct expression_node *
+expression_make(struct arithmeticparams *p, int operator, int multioperand,
+                struct expression_node **in, size_t numin);
+
+gal_data_t *
+expression_evaluate(struct arithmeticparams *p, struct expression_node *node);
+
+void
+expression_stream(struct arithmeticparams *p, struct expression_node *node);
+
+#endif
@@ -41,19 +41,43 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 /* Constants: */
 #define NEG_DASH_REPLACE 11 /* Vertical tab (ASCII=11) for negative dash */
+#define ARITHMETIC_BLOCK_SIZE 16384 /* Elements in each block of fused ops.*/
 
 
 
 
 
-/* In every node of the operand linked list, only one of the `filename' or
-   `data' should be non-NULL. Otherwise it will be a bug and will cause
-   problems. All the operands operate on this premise. */
+/* Pixel-wise operators are not evaluated as soon as they are read, they
+   are kept in a tree so a full expression can be evaluated in one pass
+   over the data (see `expression.c'). When `operator' is zero, the node
+   is a leaf and only `data' is set. When streaming, the leaves that are
+   read from a file also have `fptr' and `data' only keeps the part of the
+   image that is currently read (starting from element `offset'). */
+struct expression_node
+{
+  int                operator;  /* Operator code (0 for a leaf).        */
+  gal_data_t            *data;  /* Dataset (only for a leaf).           */
+  fitsfile              *fptr;  /* Streaming: file to read data from.   */
+  size_t               offset;  /* Index of first element in `data'.    */
+  size_t                numin;  /* Number of input operands.            */
+  struct expression_node **in;  /* Input operands (in popped order).    */
+  uint8_t        multioperand;  /* Inputs given as a list to operator.  */
+  uint8_t              output;  /* ==1: leaf is used to keep output.    */
+};
+
+
+
+
+
+/* In every node of the operand linked list, only one of the `filename',
+   `data' or `node' should be non-NULL. Otherwise it will be a bug and will
+   cause problems. All the operands operate on this premise. */
 struct operand
 {
   char       *filename;    /* !=NULL if the operand is a filename. */
   char            *hdu;    /* !=NULL if the operand is a filename. */
   gal_data_t     *data;    /* !=NULL if the operand is a dataset.  */
+  struct expression_node *node; /* !=NULL: expression to evaluate. */
   struct operand *next;    /* Pointer to next operand.             */
 };
 
@@ -76,6 +100,8 @@ struct arithmeticparams
   char          *globalhdu;  /* Single HDU for all inputs.              */
 
   /* Operating mode: */
+  uint8_t           nofuse;  /* Evaluate each operator over full data.  */
+  size_t         streammem;  /* Stream the inputs with this many bytes. */
 
   /* Internal: */
   struct operand *operands;  /* The operands linked list.               */
@@ -36,6 +36,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include "main.h"
 
 #include "operands.h"
+#include "expression.h"
 
 
 
@@ -74,6 +75,7 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data)
               __func__, sizeof *newnode);
 
       /* Fill in the values. */
+      newnode->node=NULL;
       newnode->data=data;
       newnode->filename=filename;
 
@@ -99,10 +101,105 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data)
 
 
 
+/* Add an expression (that hasn't been evaluated yet) to the stack of
+   operands. If the expression is only a leaf (an already evaluated
+   dataset), its dataset will be added. */
+void
+operands_add_node(struct arithmeticparams *p, struct expression_node *node)
+{
+  struct operand *newnode;
+
+  /* If the node is a leaf, just add its dataset. */
+  if(node->operator==0)
+    {
+      operands_add(p, NULL, node->data);
+      free(node);
+      return;
+    }
+
+  /* Allocate space for the new operand. */
+  errno=0;
+  newnode=malloc(sizeof *newnode);
+  if(newnode==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `newnode'",
+          __func__, sizeof *newnode);
+
+  /* Fill in the values and make the link to the previous list. */
+  newnode->hdu=NULL;
+  newnode->data=NULL;
+  newnode->node=node;
+  newnode->filename=NULL;
+  newnode->next=p->operands;
+  p->operands=newnode;
+}
+
+
+
+
+
+/* Keep the WCS of the first image that is read and make sure all the
+   images have the same size as it. */
+static void
+operands_check_ref(struct arithmeticparams *p, char *filename, char *hdu,
+                   size_t ndim, size_t *dsize, struct wcsprm *wcs, int nwcs)
+{
+  size_t i;
+  gal_data_t tmp;
+
+  /* In case this is the first image that is read, then keep the WCS
+     information in the `refdata' structure. Otherwise, the WCS is not
+     necessary and we can safely free it. */
+  if(p->popcounter==0)
+    {
+      p->refdata.wcs=wcs;
+      p->refdata.nwcs=nwcs;
+    }
+  else
+    wcsfree(wcs);
+
+  /* When the reference data structure's dimensionality is non-zero, it
+     means that this is not the first image read. So, write its basic
+     information into the reference data structure for future
+     checks. */
+  if(p->refdata.ndim)
+    {
+      tmp.ndim=ndim;
+      tmp.dsize=dsize;
+      if(gal_data_dsize_is_different(&p->refdata, &tmp))
+        error(EXIT_FAILURE, 0, "%s (hdu=%s): has a different size "
+              "compared to previous images. All the images must be "
+              "the same size in order for Arithmetic to work",
+              filename, hdu);
+    }
+  else
+    {
+      /* Set the dimensionality. */
+      p->refdata.ndim=ndim;
+
+      /* Allocate the dsize array. */
+      errno=0;
+      p->refdata.dsize=malloc(p->refdata.ndim * sizeof *p->refdata.dsize);
+      if(p->refdata.dsize==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+              "p->refdata.dsize", __func__,
+              p->refdata.ndim * sizeof *p->refdata.dsize);
+
+      /* Write the values into it. */
+      for(i=0;i<p->refdata.ndim;++i)
+        p->refdata.dsize[i]=dsize[i];
+    }
+
+  /* Add to the number of popped FITS images: */
+  ++p->popcounter;
+}
+
+
+
+
+
 gal_data_t *
 operands_pop(struct arithmeticparams *p, char *operator)
 {
-  size_t i;
   gal_data_t *data;
   char *filename, *hdu;
   struct operand *operands=p->operands;
@@ -121,62 +218,23 @@ operands_pop(struct arithmeticparams *p, char *operator)
       hdu=operands->hdu;
       filename=operands->filename;
 
-      /* Read the dataset. */
-      data=gal_fits_img_read(filename, hdu, p->cp.minmapsize, 0, 0);
-
-      /* In case this is the first image that is read, then keep the WCS
-         information in the `refdata' structure. Otherwise, the WCS is not
-         necessary and we can safely free it. In any case, `data' must not
-         have a WCS structure. */
-      if(p->popcounter==0)
-        {
-          p->refdata.wcs=data->wcs;
-          p->refdata.nwcs=data->nwcs;
-        }
-      else
-        wcsfree(data->wcs);
+      /* Read the dataset and check it with the reference. In any case,
+         `data' must not have a WCS structure. */
+      data=gal_fits_img_read_mmap(filename, hdu, p->cp.numthreads,
+                                  p->cp.minmapsize, 0, 0);
+      operands_check_ref(p, filename, hdu, data->ndim, data->dsize,
+                         data->wcs, data->nwcs);
       data->wcs=NULL;
       data->nwcs=0;
 
-      /* When the reference data structure's dimensionality is non-zero, it
-         means that this is not the first image read. So, write its basic
-         information into the reference data structure for future
-         checks. */
-      if(p->refdata.ndim)
-        {
-          if(gal_data_dsize_is_different(&p->refdata, data))
-            error(EXIT_FAILURE, 0, "%s (hdu=%s): has a different size "
-                  "compared to previous images. All the images must be "
-                  "the same size in order for Arithmetic to work",
-                  filename, hdu);
-        }
-      else
-        {
-          /* Set the dimensionality. */
-          p->refdata.ndim=(data)->ndim;
-
-          /* Allocate the dsize array. */
-          errno=0;
-          p->refdata.dsize=malloc(p->refdata.ndim * sizeof *p->refdata.dsize);
-          if(p->refdata.dsize==NULL)
-            error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
-                  "p->refdata.dsize", __func__,
-                  p->refdata.ndim * sizeof *p->refdata.dsize);
-
-          /* Write the values into it. */
-          for(i=0;i<p->refdata.ndim;++i)
-            p->refdata.dsize[i]=data->dsize[i];
-        }
-
       /* Report the read image if desired: */
       if(!p->cp.quiet) printf(" - %s (hdu %s) is read.\n", filename, hdu);
 
       /* Free the HDU string: */
       free(hdu);
-
-      /* Add to the number of popped FITS images: */
-      ++p->popcounter;
     }
+  else if(operands->node)
+    data=expression_evaluate(p, operands->node);
   else
     data=operands->data;
 
@@ -185,3 +243,77 @@ operands_pop(struct arithmeticparams *p, char *operator)
   free(operands);
   return data;
 }
+
+
+
+
+
+/* When streaming, the images aren't read when they are popped. Only the
+   file is opened and its basic information is read into a leaf. */
+static struct expression_node *
+operands_pop_stream(struct arithmeticparams *p)
+{
+  int type, nwcs;
+  fitsfile *fptr;
+  struct wcsprm *wcs;
+  struct expression_node *node;
+  size_t one=1, ndim, *dsize=NULL;
+  char *name=NULL, *unit=NULL, *hdu, *filename;
+  struct operand *operands=p->operands;
+
+  /* Open the file and read its basic information. */
+  hdu=operands->hdu;
+  filename=operands->filename;
+  fptr=gal_fits_hdu_open_format(filename, hdu, 0);
+  gal_fits_img_info(fptr, &type, &ndim, &dsize, &name, &unit);
+  if(ndim==0)
+    error(EXIT_FAILURE, 0, "%s (hdu: %s) has 0 dimensions", filename, hdu);
+  wcs=gal_wcs_read_fitsptr(fptr, 0, 0, &nwcs);
+  operands_check_ref(p, filename, hdu, ndim, dsize, wcs, nwcs);
+
+  /* Put the information in a leaf. Until the first part of the image is
+     read, the dataset only has one element. */
+  node=expression_leaf(gal_data_alloc(NULL, type, 1, &one, NULL, 0, -1,
+                                      name, unit, NULL));
+  node->fptr=fptr;
+
+  /* Report the opened image if desired: */
+  if(!p->cp.quiet)
+    printf(" - %s (hdu %s) is opened for streaming.\n", filename, hdu);
+
+  /* Clean up, remove this operand from the queue and return the node. */
+  free(hdu);
+  free(name);
+  free(unit);
+  free(dsize);
+  p->operands=operands->next;
+  free(operands);
+  return node;
+}
+
+
+
+
+
+/* Pop the top operand as an expression node: if it is an expression that
+   hasn't been evaluated yet, it will be returned without evaluation. */
+struct expression_node *
+operands_pop_node(struct arithmeticparams *p, char *operator)
+{
+  struct expression_node *node;
+  struct operand *operands=p->operands;
+
+  /* When streaming, images shouldn't be read here. */
+  if(p->streammem && operands && operands->filename)
+    return operands_pop_stream(p);
+
+  /* If the top operand isn't an expression, put it in a leaf. */
+  if(operands==NULL || operands->node==NULL)
+    return expression_leaf(operands_pop(p, operator));
+
+  /* Remove this node from the queue and return the expression. */
+  node=operands->node;
+  p->operands=operands->next;
+  free(operands);
+  return node;
+}
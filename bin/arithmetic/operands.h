@@ -29,8 +29,14 @@ operands_num(struct arithmeticparams *p);
 void
 operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data);
 
+void
+operands_add_node(struct arithmeticparams *p, struct expression_node *node);
+
 gal_data_t *
 operands_pop(struct arithmeticparams *p, char *operator);
 
+struct expression_node *
+operands_pop_node(struct arithmeticparams *p, char *operator);
+
 
 #endif
@@ -296,6 +296,13 @@ ui_check_options_and_arguments(struct arithmeticparams *p)
               "specify a single HDU to be used for any number of input "
               "files", numfits, numfits);
     }
+
+  /* Streaming is only possible when the operators are evaluated together
+     (over parts of the images). */
+  if(p->nofuse && p->streammem)
+    error(EXIT_FAILURE, 0, "`--nofuse' and `--streammem' cannot be called "
+          "together: when streaming, the images are never fully read, so "
+          "each operator can't be evaluated over the full images");
 }
 
 
@@ -71,12 +71,12 @@ convertt_change(struct converttparams *p)
       {
         /* Make a condition array: all pixels with a value equal to
            `change->from' will be set as 1 in this array. */
-        cond=gal_arithmetic(GAL_ARITHMETIC_OP_EQ, GAL_ARITHMETIC_NUMOK,
-                            channel, change->from);
+        cond=gal_arithmetic(GAL_ARITHMETIC_OP_EQ, p->cp.numthreads,
+                            GAL_ARITHMETIC_NUMOK, channel, change->from);
 
         /* Now, use the condition array to set the proper values. */
-        channel=gal_arithmetic(GAL_ARITHMETIC_OP_WHERE, flags, channel,
-                               cond, change->to);
+        channel=gal_arithmetic(GAL_ARITHMETIC_OP_WHERE, p->cp.numthreads,
+                               flags, channel, cond, change->to);
 
         /* Clean up, since we set the free flag, all extra arrays have been
            freed.*/
@@ -92,7 +92,8 @@ convertt_change(struct converttparams *p)
 
 
 static void
-convertt_trunc_function(int operator, gal_data_t *data, gal_data_t *value)
+convertt_trunc_function(int operator, gal_data_t *data, gal_data_t *value,
+                        size_t numthreads)
 {
   gal_data_t *cond, *out;
 
@@ -103,11 +104,13 @@ convertt_trunc_function(int operator, gal_data_t *data, gal_data_t *value)
 
   /* Make a condition array: all pixels with a value equal to
      `change->from' will be set as 1 in this array. */
-  cond=gal_arithmetic(operator, GAL_ARITHMETIC_NUMOK, data, value);
+  cond=gal_arithmetic(operator, numthreads, GAL_ARITHMETIC_NUMOK, data,
+                      value);
 
 
   /* Now, use the condition array to set the proper values. */
-  out=gal_arithmetic(GAL_ARITHMETIC_OP_WHERE, flags, data, cond, value);
+  out=gal_arithmetic(GAL_ARITHMETIC_OP_WHERE, numthreads, flags, data, cond,
+                     value);
 
 
   /* A small sanity check. The process must be in-place so the original
@@ -139,9 +142,11 @@ convertt_truncate(struct converttparams *p)
   for(channel=p->chll; channel!=NULL; channel=channel->next)
     {
       if(p->fluxlow)
-        convertt_trunc_function(GAL_ARITHMETIC_OP_LT, channel, p->fluxlow);
+        convertt_trunc_function(GAL_ARITHMETIC_OP_LT, channel, p->fluxlow,
+                                p->cp.numthreads);
       if(p->fluxhigh)
-        convertt_trunc_function(GAL_ARITHMETIC_OP_GT, channel, p->fluxhigh);
+        convertt_trunc_function(GAL_ARITHMETIC_OP_GT, channel, p->fluxhigh,
+                                p->cp.numthreads);
     }
 }
 
@@ -251,8 +256,8 @@ convertt_scale_to_uchar(struct converttparams *p)
             }
 
           /* Calculate the minimum and maximum. */
-          mind = gal_arithmetic(GAL_ARITHMETIC_OP_MINVAL, 0, channel);
-          maxd = gal_arithmetic(GAL_ARITHMETIC_OP_MAXVAL, 0, channel);
+          mind = gal_arithmetic(GAL_ARITHMETIC_OP_MINVAL, 1, 0, channel);
+          maxd = gal_arithmetic(GAL_ARITHMETIC_OP_MAXVAL, 1, 0, channel);
           tmin = *((float *)(mind->array));
           tmax = *((float *)(maxd->array));
           gal_data_free(mind);
@@ -223,7 +223,7 @@ eps_convert_to_bitstream(struct converttparams *p)
               bits[i*bytesinrow+j]=byte;
             }
         }
-      free(channel->array);
+      gal_data_release_array(channel);
       channel->array=bits;
       channel->type=GAL_TYPE_BIT;
     }
@@ -161,6 +161,45 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "singleprecision",
+      UI_KEY_SINGLEPRECISION,
+      0,
+      0,
+      "Frequency domain: use 32-bit floats in FFT.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->singleprecision,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "blocksize",
+      UI_KEY_BLOCKSIZE,
+      "INT",
+      0,
+      "Frequency domain: convolve in INT-wide blocks.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->blocksize,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "kernelcache",
+      UI_KEY_KERNELCACHE,
+      "STR",
+      0,
+      "Frequency domain: cache kernel's transform here.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->kernelcache,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
     {0}
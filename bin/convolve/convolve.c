@@ -27,14 +27,19 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <error.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
 #include <gsl/gsl_errno.h>
 
 #include <gnuastro/wcs.h>
 #include <gnuastro/tile.h>
+#include <gnuastro/type.h>
 #include <gnuastro/fits.h>
 #include <gnuastro/threads.h>
 #include <gnuastro/convolve.h>
 
+#include <gnuastro-internal/checkset.h>
 #include <gnuastro-internal/timing.h>
 
 #include "main.h"
@@ -46,39 +51,69 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /*************           Complex numbers          *****************/
 /******************************************************************/
 
+/* Value of element `I' of an array in the precision of the Fourier
+   transforms (which can be 32-bit or 64-bit floating point). */
+#define FFT_VALUE(P, A, I) ( (P)->ffttype==GAL_TYPE_FLOAT32             \
+                             ? (double)(((float *)(A))[I])              \
+                             : ((double *)(A))[I] )
+
+
+
+
+
 /* We have a complex (R+iI) array and we want to display it. But we
    can only do that either with the spectrum, or the phase:
 
    Spectrum: sqrt(R^2+I^2)
    Phase:    arctan(I/R)
-*/
+
+   Since the inputs are real, only the first `p->ph1' elements of each
+   row of the Fourier transform are kept (see `frequency_make_padded'),
+   the rest are the complex conjugate of the kept ones:
+   X[i][j]=conj(X[-i][-j]). So the full spectrum is built here to make it
+   easy to inspect.
+
+   With COMPLEX_TO_REAL_REAL, the array is not a Fourier transform, but a
+   real image that is stored in the same layout (each row is `2*p->ph1'
+   elements, but only the first `p->ps1' are used). */
 void
-complextoreal(double *c, size_t size, int action, double **output)
+complextoreal(struct convolveparams *p, void *c, int action,
+              double **output)
 {
-  double *out, *o, *of;
+  double re, im, *out;
+  size_t i, j, ii, jj, ps0=p->ps0, ps1=p->ps1, ph1=p->ph1;
 
   /* Allocate the space for the real array. */
-  *output=out=gal_data_malloc_array(GAL_TYPE_FLOAT64, size, __func__,
+  *output=out=gal_data_malloc_array(GAL_TYPE_FLOAT64, ps0*ps1, __func__,
                                     "output");
 
   /* Fill the real array with the derived value from the complex array. */
-  of=(o=out)+size;
-  switch(action)
-    {
-    case COMPLEX_TO_REAL_SPEC:
-      do { *o++ = sqrt( *c**c + *(c+1)**(c+1) ); c+=2; } while(o<of);
-      break;
-    case COMPLEX_TO_REAL_PHASE:
-      do { *o++ = atan2( *(c+1), *c );           c+=2; } while(o<of);
-      break;
-    case COMPLEX_TO_REAL_REAL:
-      do { *o++ = *c;                            c+=2; } while(o<of);
-      break;
-    default:
-      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can "
-            "correct it. The `action' code %d is not recognized", __func__,
-            PACKAGE_BUGREPORT, action);
-    }
+  for(i=0;i<ps0;++i)
+    for(j=0;j<ps1;++j)
+      {
+        if(action==COMPLEX_TO_REAL_REAL)
+          {
+            *out++ = FFT_VALUE(p, c, i*2*ph1+j);
+            continue;
+          }
+
+        /* Find the stored element that corresponds to this one. */
+        if(j<ph1) { ii=i;             jj=j;     }
+        else      { ii=(ps0-i)%ps0;   jj=ps1-j; }
+        re = FFT_VALUE(p, c, ii*2*ph1+2*jj);
+        im = FFT_VALUE(p, c, ii*2*ph1+2*jj+1);
+        if(j>=ph1) im*=-1;
+
+        switch(action)
+          {
+          case COMPLEX_TO_REAL_SPEC:  *out++ = sqrt( re*re + im*im ); break;
+          case COMPLEX_TO_REAL_PHASE: *out++ = atan2( im, re );       break;
+          default:
+            error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so "
+                  "we can correct it. The `action' code %d is not "
+                  "recognized", __func__, PACKAGE_BUGREPORT, action);
+          }
+      }
 }
 
 
@@ -98,20 +133,30 @@ complextoreal(double *c, size_t size, int action, double **output)
    output. Then we find and replace the imaginary component, finally,
    we put the new real component in the image.
  */
+#define COMPLEX_MULTIPLY(IT) {                                          \
+    IT r, *a=ina, *b=inb, *af=a+2*size;                                 \
+    do                                                                  \
+      {                                                                 \
+        r      = (*a * *b) - (*(a+1) * *(b+1));                         \
+        *(a+1) = (*(a+1) * *b) + (*a * *(b+1));                         \
+        *a++=r;            /* Go onto (set) the imaginary part of a. */ \
+        b+=2;                                                           \
+      }                                                                 \
+    while(++a<af);  /* Go onto the next complex number. */              \
+  }
+
 void
-complexarraymultiply(double *a, double *b, size_t size)
+complexarraymultiply(void *ina, void *inb, size_t size, uint8_t type)
 {
-  double r, *af;
-
-  af=a+2*size;
-  do
+  switch(type)
     {
-      r      = (*a * *b) - (*(a+1) * *(b+1));
-      *(a+1) = (*(a+1) * *b) + (*a * *(b+1));
-      *a++=r;            /* Go onto (set) the imaginary part of a. */
-      b+=2;
+    case GAL_TYPE_FLOAT32: COMPLEX_MULTIPLY(float);  break;
+    case GAL_TYPE_FLOAT64: COMPLEX_MULTIPLY(double); break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we "
+            "can correct it. Type code %d is not recognized", __func__,
+            PACKAGE_BUGREPORT, type);
     }
-  while(++a<af);  /* Go onto the next complex number. */
 }
 
 
@@ -128,37 +173,48 @@ complexarraymultiply(double *a, double *b, size_t size)
    See the explanations above complexarraymultiply for an explanation
    on the loop.
  */
+#define COMPLEX_DIVIDE(IT) {                                            \
+    IT r, *a=ina, *b=inb, *af=a+2*size;                                 \
+    do                                                                  \
+      {                                                                 \
+        if (sqrt(*b**b + *(b+1)**(b+1))>minsharpspec)                   \
+          {                                                             \
+            r      = ( ( (*a * *b) + (*(a+1) * *(b+1)) )                \
+                       / ( *b * *b + *(b+1) * *(b+1) ) );               \
+            *(a+1) = ( ( (*(a+1) * *b) - (*a * *(b+1)) )                \
+                       / ( *b * *b + *(b+1) * *(b+1) ) );               \
+            *a=r;                                                       \
+                                                                        \
+            /* Just as a sanity check (the result should never be */    \
+            /* larger than one. */                                      \
+            if(sqrt(*a**a + *(a+1)**(a+1))>1.00001f)                    \
+              *a=*(a+1)=0.0f;                                           \
+          }                                                             \
+        else                                                            \
+          {                                                             \
+            *a=0;                                                       \
+            *(a+1)=0;                                                   \
+          }                                                             \
+                                                                        \
+        a+=2;                                                           \
+        b+=2;                                                           \
+      }                                                                 \
+    while(a<af);  /* Go onto the next complex number. */                \
+  }
+
 void
-complexarraydivide(double *a, double *b, size_t size, double minsharpspec)
+complexarraydivide(void *ina, void *inb, size_t size, uint8_t type,
+                   double minsharpspec)
 {
-  double r, *af;
-
-  af=a+2*size;
-  do
+  switch(type)
     {
-      if (sqrt(*b**b + *(b+1)**(b+1))>minsharpspec)
-        {
-          r      = ( ( (*a * *b) + (*(a+1) * *(b+1)) )
-                     / ( *b * *b + *(b+1) * *(b+1) ) );
-          *(a+1) = ( ( (*(a+1) * *b) - (*a * *(b+1)) )
-                     / ( *b * *b + *(b+1) * *(b+1) ) );
-          *a=r;
-
-          /* Just as a sanity check (the result should never be larger than
-             one. */
-          if(sqrt(*a**a + *(a+1)**(a+1))>1.00001f)
-            *a=*(a+1)=0.0f;
-        }
-      else
-        {
-          *a=0;
-          *(a+1)=0;
-        }
-
-      a+=2;
-      b+=2;
+    case GAL_TYPE_FLOAT32: COMPLEX_DIVIDE(float);  break;
+    case GAL_TYPE_FLOAT64: COMPLEX_DIVIDE(double); break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we "
+            "can correct it. Type code %d is not recognized", __func__,
+            PACKAGE_BUGREPORT, type);
     }
-  while(a<af);  /* Go onto the next complex number. */
 }
 
 
@@ -183,56 +239,235 @@ complexarraydivide(double *a, double *b, size_t size, double minsharpspec)
 /******************************************************************/
 /*************      Padding and initializing      *****************/
 /******************************************************************/
-void
-frequency_make_padded_complex(struct convolveparams *p)
+/* GSL's mixed-radix FFT is much faster when the length of the transform
+   only has small prime factors (it has optimized routines for 2, 3 and
+   5). So for each side, we'll use the smallest even length that is
+   larger or equal to the necessary length and only has these factors. */
+static size_t
+frequency_fft_size(size_t n)
 {
-  size_t i, ps0, ps1;
-  double *o, *op, *pimg, *pker;
-  size_t is0=p->input->dsize[0],  is1=p->input->dsize[1];
-  size_t ks0=p->kernel->dsize[0], ks1=p->kernel->dsize[1];
-  float *f, *ff, *input=p->input->array, *kernel=p->kernel->array;
+  size_t m, r;
 
+  for(m=n+n%2; ; m+=2)
+    {
+      r=m;
+      while(r%2==0) r/=2;
+      while(r%3==0) r/=3;
+      while(r%5==0) r/=5;
+      if(r==1) return m;
+    }
+}
 
-  /* Find the sizes of the padded image, note that since the kernel
-     sizes are always odd, the extra padding on the input image is
-     always going to be an even number (clearly divisable). */
-  ps0=p->ps0 = p->makekernel ? is0 : is0 + ks0 - 1;
-  ps1=p->ps1 = p->makekernel ? is1 : is1 + ks1 - 1;
 
 
-  /* The Discrete Fourier transforms operate faster on even-sized
-     arrays. So if the padded sides are not even, make them so: */
-  if(ps0%2) ps0=p->ps0=ps0+1;
-  if(ps1%2) ps1=p->ps1=ps1+1;
 
 
-  /* Allocate the space for the padded input image and fill it. */
-  pimg=p->pimg=gal_data_malloc_array(GAL_TYPE_FLOAT64, 2*ps0*ps1, __func__,
-                                     "pimg");
-  for(i=0;i<ps0;++i)
+/* The transformed kernel only depends on the kernel and the padded size,
+   so when many images of the same size are convolved with one kernel, it
+   can be kept in a cache file (`--kernelcache') and read in later runs
+   instead of being padded and transformed again. The cached spectrum is
+   written as a 2D image in the first extension of the cache file: each
+   row is the half-spectrum of the row (real and imaginary parts
+   interleaved), so it has `2*p->ph1' columns and `p->ps0' rows. Its type
+   is the type of the Fourier transforms. The kernel that it was made from
+   is identified by a hash of its pixels (after flipping and
+   normalization) in the `KERNHASH' keyword.
+
+   The GSL wavetables aren't kept: they are only one 1D array for each
+   dimension and are much faster to make than reading from a file. */
+static char *
+frequency_kernel_hash(struct convolveparams *p)
+{
+  char *out;
+  size_t i, nbytes;
+  uint64_t hash=14695981039346656037ULL;      /* 64-bit FNV-1a offset. */
+  unsigned char *c=p->kernel->array;
+
+  /* Include the kernel's size, then its pixels. */
+  for(i=0;i<p->kernel->ndim;++i)
+    hash = (hash ^ p->kernel->dsize[i]) * 1099511628211ULL;
+  nbytes=p->kernel->size*gal_type_sizeof(p->kernel->type);
+  for(i=0;i<nbytes;++i)
+    hash = (hash ^ c[i]) * 1099511628211ULL;
+
+  /* Return it as a string (to be written/compared as a keyword). */
+  if( asprintf(&out, "%016"PRIx64, hash)<0 )
+    error(EXIT_FAILURE, errno, "%s: asprintf allocation", __func__);
+  return out;
+}
+
+
+
+
+
+/* If the cache file exists and its spectrum was made from this kernel
+   with the same padded size and type, then read it into `p->pker' and
+   return 1. Otherwise, return 0. */
+static int
+frequency_kernel_cache_read(struct convolveparams *p)
+{
+  int out=0;
+  char *hash;
+  gal_data_t *keys, *spec;
+
+  /* When the steps are to be checked, the padded kernel is necessary. */
+  p->kernelcached=0;
+  if(p->kernelcache==NULL || p->checkfreqsteps
+     || access(p->kernelcache, F_OK)==-1)
+    return 0;
+
+  /* Read the hash of the kernel that the cache was made with. */
+  hash=frequency_kernel_hash(p);
+  keys=gal_data_array_calloc(1);
+  keys->name="KERNHASH";
+  keys->type=GAL_TYPE_STRING;
+  gal_fits_key_read(p->kernelcache, "1", keys, 0, 0);
+
+  /* If it is the same kernel, read the spectrum and check its size and
+     type. Note that the array shouldn't be memory-mapped, it will be
+     freed like the padded kernel. */
+  if( keys->status==0 && !strcmp( ((char **)(keys->array))[0], hash ) )
     {
-      op=(o=pimg+i*2*ps1)+2*ps1; /* pimg is complex.            */
-      if(i<is0)
+      spec=gal_fits_img_read(p->kernelcache, "1", -1, 0, 0);
+      if( spec->type==p->ffttype && spec->ndim==2
+          && spec->dsize[0]==p->ps0 && spec->dsize[1]==2*p->ph1 )
         {
-          ff=(f=input+i*is1)+is1;
-          do {*o++=*f; *o++=0.0f;} while(++f<ff);
+          p->pker=spec->array;
+          spec->array=NULL;
+          out=p->kernelcached=1;
         }
-      do *o++=0.0f; while(o<op);
+      gal_data_free(spec);
     }
 
+  /* Clean up and return. */
+  free(hash);
+  keys->name=NULL;
+  gal_data_array_free(keys, 1, 1);
+  return out;
+}
+
 
-  /* Allocate the space for the padded Kernel and fill it. */
-  pker=p->pker=gal_data_malloc_array(GAL_TYPE_FLOAT64, 2*ps0*ps1, __func__,
-                                     "pker");
-  for(i=0;i<ps0;++i)
+
+
+
+/* Write the kernel's spectrum (in `p->pker') into the cache file. To
+   avoid other programs reading a half-written cache (for example when
+   many images are convolved in parallel), it is first written into a
+   temporary file that is then renamed to the cache file. */
+static void
+frequency_kernel_cache_write(struct convolveparams *p)
+{
+  char *tmpname;
+  gal_data_t *spec;
+  gal_fits_list_key_t *keys=NULL;
+  size_t dsize[2]={p->ps0, 2*p->ph1};
+
+  /* Only when a cache is requested and it wasn't read from it. */
+  if(p->kernelcache==NULL || p->kernelcached) return;
+
+  /* Keywords to identify the kernel. */
+  gal_fits_key_list_add(&keys, GAL_TYPE_STRING, "KERNHASH", 0,
+                        frequency_kernel_hash(p), 1,
+                        "Hash of kernel pixels (after flip and norm).", 0,
+                        NULL);
+  gal_fits_key_list_add(&keys, GAL_TYPE_STRING, "KHDU", 0, p->khdu, 0,
+                        "HDU of kernel.", 0, NULL);
+  gal_fits_key_list_add(&keys, GAL_TYPE_STRING, "KERNEL", 0,
+                        p->kernelname, 0, "Kernel file name.", 0, NULL);
+
+  /* Write the spectrum (without copying it). */
+  spec=gal_data_alloc(p->pker, p->ffttype, 2, dsize, NULL, 0, -1,
+                      "kernel spectrum", NULL, NULL);
+  if( asprintf(&tmpname, "%s.%ld.tmp", p->kernelcache, (long)getpid())<0 )
+    error(EXIT_FAILURE, errno, "%s: asprintf allocation", __func__);
+  gal_checkset_writable_remove(tmpname, 0, 0);
+  gal_fits_img_write(spec, tmpname, keys, PROGRAM_NAME);
+  errno=0;
+  if( rename(tmpname, p->kernelcache) )
+    error(EXIT_FAILURE, errno, "%s: renaming `%s' to `%s'", __func__,
+          tmpname, p->kernelcache);
+
+  /* Clean up. */
+  spec->array=NULL;
+  gal_data_free(spec);
+  free(tmpname);
+}
+
+
+
+
+
+/* Since the input image and kernel are real, their Fourier transforms
+   are Hermitian and only `p->ps1/2+1' (`p->ph1') complex elements of
+   each row need to be kept. So each padded row has space for `2*p->ph1'
+   floating point numbers (two more than the padded width). The real
+   values are initially put in the first `p->ps1' elements of each row
+   and the transform is done in place (see `onedimensionfft'). */
+#define PAD_IMAGE(IT, OUT, IN, IS0, IS1) {                              \
+    IT *o, *op, *pad=OUT;                                               \
+    for(i=0;i<ps0;++i)                                                  \
+      {                                                                 \
+        op=(o=pad+i*2*ph1)+2*ph1;                                       \
+        if(i<IS0)                                                       \
+          {                                                             \
+            ff=(f=IN+i*IS1)+IS1;                                        \
+            do *o++=*f; while(++f<ff);                                  \
+          }                                                             \
+        do *o++=0.0f; while(o<op);                                      \
+      }                                                                 \
+  }
+
+void
+frequency_make_padded(struct convolveparams *p)
+{
+  size_t i, ps0, ps1, ph1;
+  size_t is0=p->input->dsize[0],  is1=p->input->dsize[1];
+  size_t ks0=p->kernel->dsize[0], ks1=p->kernel->dsize[1];
+  float *f, *ff, *input=p->input->array, *kernel=p->kernel->array;
+
+
+  /* Find the sizes of the padded image, note that since the kernel sizes
+     are always odd, the extra padding on the input image is always going
+     to be an even number (clearly divisable). The Discrete Fourier
+     transforms operate faster on even-sized arrays (and the storage of
+     the half-spectrum assumes even sides). So if the padded sides are not
+     even, make them so. When convolving, any extra padding will just add
+     zeros around the image, so we also expand the sides to a length that
+     has small prime factors. In deconvolution the sizes are not changed,
+     because the output kernel depends on them. */
+  if(p->makekernel)
     {
-      op=(o=pker+i*2*ps1)+2*ps1; /* pker is complex.            */
-      if(i<ks0)
-        {
-          ff=(f=kernel+i*ks1)+ks1;
-          do {*o++=*f; *o++=0.0f;} while(++f<ff);
-        }
-      do *o++=0.0f; while(o<op);
+      ps0 = is0 + is0%2;
+      ps1 = is1 + is1%2;
+    }
+  else
+    {
+      ps0 = frequency_fft_size(is0 + ks0 - 1);
+      ps1 = frequency_fft_size(is1 + ks1 - 1);
+    }
+  p->ps0=ps0;
+  p->ps1=ps1;
+  ph1=p->ph1=ps1/2+1;
+
+
+  /* Allocate the space for the padded input image and fill it. */
+  p->pimg=gal_data_malloc_array(p->ffttype, 2*ps0*ph1, __func__, "pimg");
+  if(p->ffttype==GAL_TYPE_FLOAT32)
+    { PAD_IMAGE(float,  p->pimg, input,  is0, is1); }
+  else
+    { PAD_IMAGE(double, p->pimg, input,  is0, is1); }
+
+
+  /* Do the same for the kernel, unless its transform is already
+     cached. */
+  if( frequency_kernel_cache_read(p)==0 )
+    {
+      p->pker=gal_data_malloc_array(p->ffttype, 2*ps0*ph1, __func__,
+                                    "pker");
+      if(p->ffttype==GAL_TYPE_FLOAT32)
+        { PAD_IMAGE(float,  p->pker, kernel, ks0, ks1); }
+      else
+        { PAD_IMAGE(double, p->pker, kernel, ks0, ks1); }
     }
 }
 
@@ -241,18 +476,37 @@ frequency_make_padded_complex(struct convolveparams *p)
 
 
 /*  Remove the padding from the final convolved image and also correct for
-    roundoff errors.
+    roundoff errors. `rpad' is the real padded image (of type `type') and
+    each of its rows has `rowsize' elements.
 
     NOTE: The padding to the input image (on the first axis for example)
           was `p->kernel->dsize[0]-1'. Since `p->kernel->dsize[0]' is
           always odd, the padding will always be even.  */
+#define REMOVE_PADDING(IT) {                                            \
+    IT *d, *df, *start;                                                 \
+                                                                        \
+    /* To start with, `start' points to the first pixel in the final */ \
+    /* image: */                                                        \
+    start=(IT *)rpad + hi0*rowsize + hi1;                               \
+    for(i=0;i<isize[0];++i)                                             \
+      {                                                                 \
+        o = &input[ i * isize[1] ];                                     \
+                                                                        \
+        df = ( d = start + i * rowsize ) + isize[1];                    \
+        do                                                              \
+          *o++ = ( *d<-CONVFLOATINGPOINTERR || *d>CONVFLOATINGPOINTERR ) \
+            ? *d                                                        \
+            : 0.0f;                                                     \
+        while (++d<df);                                                 \
+      }                                                                 \
+  }
+
 void
-removepaddingcorrectroundoff(struct convolveparams *p)
+removepaddingcorrectroundoff(struct convolveparams *p, void *rpad,
+                             uint8_t type, size_t rowsize)
 {
-  size_t ps1=p->ps1;
-  size_t *isize=p->input->dsize;
   float *o, *input=p->input->array;
-  double *d, *df, *start, *rpad=p->rpad;
+  size_t *isize=p->input->dsize;
   size_t i, hi0, hi1, mkwidth=2*p->makekernel-1;
 
   /* Set all the necessary parameters to crop the desired region. hi0 and
@@ -273,19 +527,15 @@ removepaddingcorrectroundoff(struct convolveparams *p)
       hi1 = ( p->kernel->dsize[1] - 1 )/2;
     }
 
-  /* To start with, `start' points to the first pixel in the final
-     image: */
-  start=&rpad[hi0*ps1+hi1];
-  for(i=0;i<isize[0];++i)
+  /* Crop the region. */
+  switch(type)
     {
-      o = &input[ i * isize[1] ];
-
-      df = ( d = start + i * ps1 ) + isize[1];
-      do
-        *o++ = ( *d<-CONVFLOATINGPOINTERR || *d>CONVFLOATINGPOINTERR )
-          ? *d
-          : 0.0f;
-      while (++d<df);
+    case GAL_TYPE_FLOAT32: REMOVE_PADDING(float);  break;
+    case GAL_TYPE_FLOAT64: REMOVE_PADDING(double); break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we "
+            "can correct it. Type code %d is not recognized", __func__,
+            PACKAGE_BUGREPORT, type);
     }
 }
 
@@ -297,12 +547,17 @@ removepaddingcorrectroundoff(struct convolveparams *p)
    first element of the fftonthreadparams structure array. All the
    other elements will point to this one later. This structure will be
    given to threads to run two times with a fixed set of parameters,
-   that is why we are doing this here to facilitate the job. */
+   that is why we are doing this here to facilitate the job.
+
+   The rows are transformed with GSL's real (forward) and halfcomplex
+   (backward) routines and the columns (of the half-spectrum) with its
+   complex routines. */
 void
 fftinitializer(struct convolveparams *p, struct fftonthreadparams **outfp)
 {
   size_t i;
   struct fftonthreadparams *fp;
+  int f32=p->ffttype==GAL_TYPE_FLOAT32;
 
   /* Allocate the fftonthreadparams array.  */
   errno=0;
@@ -313,8 +568,18 @@ fftinitializer(struct convolveparams *p, struct fftonthreadparams **outfp)
 
   /* Initialize the gsl_fft_wavetable structures (these are thread
      safe): */
-  fp[0].ps0wave=gsl_fft_complex_wavetable_alloc(p->ps0);
-  fp[0].ps1wave=gsl_fft_complex_wavetable_alloc(p->ps1);
+  if(f32)
+    {
+      fp[0].ps0wave  = gsl_fft_complex_wavetable_float_alloc(p->ps0);
+      fp[0].ps1wave  = gsl_fft_real_wavetable_float_alloc(p->ps1);
+      fp[0].ps1hwave = gsl_fft_halfcomplex_wavetable_float_alloc(p->ps1);
+    }
+  else
+    {
+      fp[0].ps0wave  = gsl_fft_complex_wavetable_alloc(p->ps0);
+      fp[0].ps1wave  = gsl_fft_real_wavetable_alloc(p->ps1);
+      fp[0].ps1hwave = gsl_fft_halfcomplex_wavetable_alloc(p->ps1);
+    }
 
   /* Set the values for all the other threads: */
   for(i=0;i<p->cp.numthreads;++i)
@@ -322,8 +587,17 @@ fftinitializer(struct convolveparams *p, struct fftonthreadparams **outfp)
       fp[i].p=p;
       fp[i].ps0wave=fp[0].ps0wave;
       fp[i].ps1wave=fp[0].ps1wave;
-      fp[i].ps0work=gsl_fft_complex_workspace_alloc(p->ps0);
-      fp[i].ps1work=gsl_fft_complex_workspace_alloc(p->ps1);
+      fp[i].ps1hwave=fp[0].ps1hwave;
+      if(f32)
+        {
+          fp[i].ps0work=gsl_fft_complex_workspace_float_alloc(p->ps0);
+          fp[i].ps1work=gsl_fft_real_workspace_float_alloc(p->ps1);
+        }
+      else
+        {
+          fp[i].ps0work=gsl_fft_complex_workspace_alloc(p->ps0);
+          fp[i].ps1work=gsl_fft_real_workspace_alloc(p->ps1);
+        }
     }
 }
 
@@ -335,12 +609,27 @@ void
 freefp(struct fftonthreadparams *fp)
 {
   size_t i;
-  gsl_fft_complex_wavetable_free(fp[0].ps0wave);
-  gsl_fft_complex_wavetable_free(fp[0].ps1wave);
-  for(i=0;i<fp->p->cp.numthreads;++i)
+  if(fp->p->ffttype==GAL_TYPE_FLOAT32)
     {
-      gsl_fft_complex_workspace_free(fp[i].ps0work);
-      gsl_fft_complex_workspace_free(fp[i].ps1work);
+      gsl_fft_complex_wavetable_float_free(fp[0].ps0wave);
+      gsl_fft_real_wavetable_float_free(fp[0].ps1wave);
+      gsl_fft_halfcomplex_wavetable_float_free(fp[0].ps1hwave);
+      for(i=0;i<fp->p->cp.numthreads;++i)
+        {
+          gsl_fft_complex_workspace_float_free(fp[i].ps0work);
+          gsl_fft_real_workspace_float_free(fp[i].ps1work);
+        }
+    }
+  else
+    {
+      gsl_fft_complex_wavetable_free(fp[0].ps0wave);
+      gsl_fft_real_wavetable_free(fp[0].ps1wave);
+      gsl_fft_halfcomplex_wavetable_free(fp[0].ps1hwave);
+      for(i=0;i<fp->p->cp.numthreads;++i)
+        {
+          gsl_fft_complex_workspace_free(fp[i].ps0work);
+          gsl_fft_real_workspace_free(fp[i].ps1work);
+        }
     }
   free(fp);
 }
@@ -365,8 +654,9 @@ correctdeconvolve(struct convolveparams *p, double **spatial)
     error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s. The padded "
           "image sides are not an even number", __func__, PACKAGE_BUGREPORT);
 
-  /* First convert the complex image to a real image: */
-  complextoreal(p->pimg, ps0*ps1, COMPLEX_TO_REAL_SPEC, &s);
+  /* First get the real image (the inverse transform of a Hermitian array
+     is real, so its spectrum is just the absolute value): */
+  complextoreal(p, p->pimg, COMPLEX_TO_REAL_REAL, &s);
 
   /* Allocate the array to keep the new values */
   errno=0;
@@ -401,7 +691,7 @@ correctdeconvolve(struct convolveparams *p, double **spatial)
           jj = j>ps1/2 ? j-(ps1/2+1) : j+ps1/2-1;
 
           r=sqrt( (ii-ci)*(ii-ci) + (jj-cj)*(jj-cj) );
-          sum += n[ii*ps1+jj] = r < p->makekernel ? s[i*ps1+j] : 0;
+          sum += n[ii*ps1+jj] = r < p->makekernel ? fabs(s[i*ps1+j]) : 0;
 
           /*printf("(%zu, %zu) --> (%zu, %zu)\n", i, j, ii, jj);*/
         }
@@ -437,42 +727,129 @@ correctdeconvolve(struct convolveparams *p, double **spatial)
 /******************************************************************/
 /*************    Frequency domain convolution    *****************/
 /******************************************************************/
+/* GSL's real FFT keeps its output in the `halfcomplex' format: for an
+   even length N, it is r0, r1, i1, r2, i2, ..., r(N/2-1), i(N/2-1),
+   r(N/2) (the imaginary parts of the first and last are zero). To
+   multiply the arrays and transform the columns, we need a standard
+   complex array of N/2+1 elements, so the rows are converted in place
+   (each row has space for two extra elements). */
+#define HALFCOMPLEX_UNPACK(IT) {                                        \
+    IT *d=data;                                                         \
+    d[ps1+1]=0.0f;                                                      \
+    d[ps1]=d[ps1-1];                                                    \
+    for(k=ps1/2-1; k>0; --k) { d[2*k+1]=d[2*k]; d[2*k]=d[2*k-1]; }      \
+    d[1]=0.0f;                                                          \
+  }
+
+#define HALFCOMPLEX_PACK(IT) {                                          \
+    IT *d=data;                                                         \
+    for(k=1; k<ps1/2; ++k) { d[2*k-1]=d[2*k]; d[2*k]=d[2*k+1]; }        \
+    d[ps1-1]=d[ps1];                                                    \
+  }
+
+
+
+
+
+/* Do the 1D FFT on one row (when `stride==1') or column that starts at
+   `data'. Each row is a real array that is transformed with GSL's real
+   FFT routines, but the columns are complex (within the half-spectrum of
+   `p->ph1' complex numbers on each row). */
+static void
+onedimensionfft_line(struct fftonthreadparams *fp, void *data,
+                     size_t stride, int forward1backwardn1)
+{
+  size_t k;
+  struct convolveparams *p=fp->p;
+  size_t ps1=p->ps1;
+
+  /* Rows: */
+  if(stride==1)
+    {
+      if(forward1backwardn1==1)
+        {
+          if(p->ffttype==GAL_TYPE_FLOAT32)
+            {
+              gsl_fft_real_float_transform(data, 1, ps1, fp->ps1wave,
+                                           fp->ps1work);
+              HALFCOMPLEX_UNPACK(float);
+            }
+          else
+            {
+              gsl_fft_real_transform(data, 1, ps1, fp->ps1wave,
+                                     fp->ps1work);
+              HALFCOMPLEX_UNPACK(double);
+            }
+        }
+      else
+        {
+          if(p->ffttype==GAL_TYPE_FLOAT32)
+            {
+              HALFCOMPLEX_PACK(float);
+              gsl_fft_halfcomplex_float_inverse(data, 1, ps1, fp->ps1hwave,
+                                                fp->ps1work);
+            }
+          else
+            {
+              HALFCOMPLEX_PACK(double);
+              gsl_fft_halfcomplex_inverse(data, 1, ps1, fp->ps1hwave,
+                                          fp->ps1work);
+            }
+        }
+    }
+
+  /* Columns (note that the inverse transforms also normalize the
+     output). */
+  else
+    {
+      if(forward1backwardn1==1)
+        {
+          if(p->ffttype==GAL_TYPE_FLOAT32)
+            gsl_fft_complex_float_forward(data, stride, p->ps0, fp->ps0wave,
+                                          fp->ps0work);
+          else
+            gsl_fft_complex_forward(data, stride, p->ps0, fp->ps0wave,
+                                    fp->ps0work);
+        }
+      else
+        {
+          if(p->ffttype==GAL_TYPE_FLOAT32)
+            gsl_fft_complex_float_inverse(data, stride, p->ps0, fp->ps0wave,
+                                          fp->ps0work);
+          else
+            gsl_fft_complex_inverse(data, stride, p->ps0, fp->ps0wave,
+                                    fp->ps0work);
+        }
+    }
+}
+
+
+
+
+
 /* The indexs array specifies the row or column numbers for this
   thread to work on. If forward1backwardn1 is one, then this is the
   forward transform, meaning that in convolution there are two
   images. If it is -1, then this is the final backward transform and
-  there is only one image to run FFTW on and the values in indexs will
-  always be smaller than p->s0 and p->s1. When there are two images,
-  then the index numbers are going to be at most double p->s0 and
-  p->s1. In this case, those index values which are smaller than p->s0
-  or p->s1 belong to the input image and those which are equal or
-  larger than larger belong to the kernel image (after subtraction for
-  p->s0 or p->s1).*/
+  there is only one image to transform and the values in indexs will
+  always be smaller than p->ps0 (for rows) and p->ph1 (for columns). When
+  there are two images, then the index numbers are going to be at most
+  double these. In this case, those index values which are smaller than
+  them belong to the input image and those which are equal or larger
+  belong to the kernel image (after subtraction).*/
 void *
 onedimensionfft(void *inparam)
 {
   struct fftonthreadparams *fp = (struct fftonthreadparams *)inparam;
   struct convolveparams *p=fp->p;
 
-  double *d, *df;
-  size_t indmultip, maxindex;
-  gsl_fft_complex_workspace *work;
-  gsl_fft_complex_wavetable *wavetable;
-  double *data, *pimg=p->pimg, *pker=p->pker;
-  int forward1backwardn1=fp->forward1backwardn1;
-  size_t i, size, stride=fp->stride, *indexs=fp->indexs;
+  void *data;
+  size_t i, ind, maxindex, ph1=p->ph1;
+  size_t stride=fp->stride, *indexs=fp->indexs;
+  size_t esize=gal_type_sizeof(p->ffttype);
 
-  /* Set the number of points to transform,
-
-     indmultip: The value to be multiplied by the value in indexs to
-     specify the first pixel of the row or column.
-   */
-  if(stride==1)
-    { size=p->ps1; wavetable=fp->ps1wave; work=fp->ps1work;
-      maxindex=p->ps0; indmultip=p->ps1; }
-  else
-    { size=p->ps0; wavetable=fp->ps0wave; work=fp->ps0work;
-      maxindex=p->ps1; indmultip=1;      }
+  /* Set the number of rows or columns in each image. */
+  maxindex = stride==1 ? p->ps0 : ph1;
 
 
   /* Go over all the rows or columns given for this thread.
@@ -483,19 +860,12 @@ onedimensionfft(void *inparam)
   */
   for(i=0; indexs[i]!=GAL_BLANK_SIZE_T; ++i)
     {
-      data = ( indexs[i]<maxindex
-               ? &pimg[ 2*indexs[i]*indmultip ]   /* *2 because complex. */
-               : &pker[ 2*(indexs[i]-maxindex)*indmultip ] );
-
-      gsl_fft_complex_transform(data, stride, size, wavetable, work,
-                                forward1backwardn1);
-
-      /* Normalize in the backward transform: */
-      if(forward1backwardn1==-1)
-        {
-          df=(d=data)+2*size*stride;
-          do {*d/=size; *(d+1)/=size; d+=2*stride;} while(d<df);
-        }
+      /* Pointer to the first element of this row or column (each row has
+         `2*ph1' elements and columns are complex). */
+      ind = indexs[i]<maxindex ? indexs[i] : indexs[i]-maxindex;
+      data = (char *)(indexs[i]<maxindex ? p->pimg : p->pker)
+             + esize * ( stride==1 ? 2*ind*ph1 : 2*ind );
+      onedimensionfft_line(fp, data, stride, fp->forward1backwardn1);
     }
 
   /* Wait until all other threads finish. */
@@ -508,40 +878,24 @@ onedimensionfft(void *inparam)
 
 
 
-/* Do the forward Fast Fourier Transform either on two input images
-   (the padded image and kernel) or on one image (the multiplication
-   of the FFT of the two). In the second case, it is assumed that we
-   are looking at the complex conjugate of the array so in practice
-   this will be a backward transform. */
-void
-twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
-                int forward1backwardn1)
+/* Do the 1D FFT on `numactions' rows (when `stride==1') or columns of the
+   padded image(s), using all the threads. */
+static void
+onedimensionfft_threads(struct convolveparams *p,
+                        struct fftonthreadparams *fp, size_t numactions,
+                        size_t stride, int forward1backwardn1)
 {
   int err;
   pthread_t t;          /* All thread ids saved in this, not used. */
   pthread_attr_t attr;
   pthread_barrier_t b;
   size_t i, nb, *indexs, thrdcols;
-  size_t nt=p->cp.numthreads, multiple=0;
-
-  /* First we are going to get the 1D fourier transform on the rows of
-     both images. */
-  if(forward1backwardn1==1)       multiple=2;
-  else if(forward1backwardn1==-1) multiple=1;
-  else
-    error(EXIT_FAILURE, 0, "%s: a bug! The value of the variable "
-          "`forward1backwardn1' is %d not 1 or 2. Please contact us at %s "
-          "so we can find the cause of the problem and fix it", __func__,
-          forward1backwardn1, PACKAGE_BUGREPORT);
-
+  size_t nt=p->cp.numthreads;
 
-  /* ==================== */
-  /* 1D FFT on each row. */
-  /* ==================== */
-  gal_threads_dist_in_threads(multiple*p->ps0, nt, &indexs, &thrdcols);
+  gal_threads_dist_in_threads(numactions, nt, &indexs, &thrdcols);
   if(nt==1)
     {
-      fp[0].stride=1;
+      fp[0].stride=stride;
       fp[0].indexs=&indexs[0];
       fp[0].forward1backwardn1=forward1backwardn1;
       onedimensionfft(&fp[0]);
@@ -552,7 +906,7 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
          (that spinns off the nt threads) is also a thread, so the
          number the barrier should be one more than the number of
          threads spinned off. */
-      if( multiple*p->ps0 < nt ) nb=multiple*p->ps0+1;
+      if( numactions < nt ) nb=numactions+1;
       else nb=nt+1;
       gal_threads_attr_barrier_init(&attr, &b, nb);
 
@@ -562,13 +916,13 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
           {
             fp[i].id=i;
             fp[i].b=&b;
-            fp[i].stride=1; /* On each row, stride=1 */
+            fp[i].stride=stride;
             fp[i].indexs=&indexs[i*thrdcols];
             fp[i].forward1backwardn1=forward1backwardn1;
             err=pthread_create(&t, &attr, onedimensionfft, &fp[i]);
             if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu for rows",
-                    __func__, i);
+              error(EXIT_FAILURE, 0, "%s: can't create thread %zu for %s",
+                    __func__, i, stride==1 ? "rows" : "columns");
           }
 
       /* Wait for all threads to finish and free the spaces. */
@@ -577,43 +931,44 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
       pthread_barrier_destroy(&b);
     }
   free(indexs);
+}
 
 
 
-  /* ====================== */
-  /* 1D FFT on each column. */
-  /* ====================== */
-  /* No comments, exact duplicate, except the p->ps1s! */
-  gal_threads_dist_in_threads(multiple*p->ps1, nt, &indexs, &thrdcols);
-  if(nt==1)
-    {
-      fp[0].stride=p->ps1;
-      fp[0].indexs=indexs;
-      fp[0].forward1backwardn1=forward1backwardn1;
-      onedimensionfft(&fp[0]);
-    }
-  else
+
+
+/* Do the forward Fast Fourier Transform either on two input images
+   (the padded image and kernel, or only the image when the kernel's
+   transform was read from the cache) or the backward transform on one
+   image (the multiplication of the FFT of the two). In the forward
+   transform, the real rows are transformed first, then the complex
+   columns of the half-spectrum, in the backward transform the order is
+   reversed. */
+void
+twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
+                int forward1backwardn1)
+{
+  size_t nimg=p->kernelcached ? 1 : 2;
+
+  switch(forward1backwardn1)
     {
-      if( multiple*p->ps1 < nt ) nb=multiple*p->ps1+1;
-      else nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            fp[i].b=&b;
-            fp[i].stride=p->ps1; /* On each column, stride is p->ps1 */
-            fp[i].indexs=&indexs[i*thrdcols];
-            fp[i].forward1backwardn1=forward1backwardn1;
-            err=pthread_create(&t, &attr, onedimensionfft, &fp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu for columns",
-                    __func__, i);
-          }
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
+    case 1:
+      onedimensionfft_threads(p, fp, nimg*p->ps0, 1,   forward1backwardn1);
+      onedimensionfft_threads(p, fp, nimg*p->ph1, p->ph1,
+                              forward1backwardn1);
+      break;
+
+    case -1:
+      onedimensionfft_threads(p, fp, p->ph1,   p->ph1, forward1backwardn1);
+      onedimensionfft_threads(p, fp, p->ps0,   1,      forward1backwardn1);
+      break;
+
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! The value of the variable "
+            "`forward1backwardn1' is %d not 1 or -1. Please contact us at "
+            "%s so we can find the cause of the problem and fix it",
+            __func__, forward1backwardn1, PACKAGE_BUGREPORT);
     }
-  free(indexs);
 }
 
 
@@ -623,16 +978,16 @@ twodimensionfft(struct convolveparams *p, struct fftonthreadparams *fp,
 void
 convolve_frequency(struct convolveparams *p)
 {
-  double *tmp;
   size_t dsize[2];
   struct timeval t1;
   gal_data_t *data=NULL;
+  double *tmp, *rpad=NULL;
   struct fftonthreadparams *fp;
 
 
   /* Make the padded arrays. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  frequency_make_padded_complex(p);
+  frequency_make_padded(p);
   if(!p->cp.quiet)
     gal_timing_report(&t1, "Input and Kernel images padded.", 1);
   if(p->checkfreqsteps)
@@ -642,16 +997,16 @@ convolve_frequency(struct convolveparams *p)
       dsize[0]=p->ps0; dsize[1]=p->ps1;
       data=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize, NULL, 0,
                           p->cp.minmapsize, NULL, NULL, NULL);
-      free(data->array);
+      gal_data_release_array(data);
 
       /* Save the padded input image. */
-      complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_REAL, &tmp);
+      complextoreal(p, p->pimg, COMPLEX_TO_REAL_REAL, &tmp);
       data->array=tmp; data->name="input padded";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
 
       /* Save the padded kernel image. */
-      complextoreal(p->pker, p->ps0*p->ps1, COMPLEX_TO_REAL_REAL, &tmp);
+      complextoreal(p, p->pker, COMPLEX_TO_REAL_REAL, &tmp);
       data->array=tmp; data->name="kernel padded";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
@@ -666,72 +1021,310 @@ convolve_frequency(struct convolveparams *p)
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
   twodimensionfft(p, fp, 1);
   if(!p->cp.quiet)
-    gal_timing_report(&t1, "Images converted to frequency domain.", 1);
+    gal_timing_report(&t1, ( p->kernelcached
+                             ? "Image converted to frequency domain "
+                             "(kernel read from cache)."
+                             : "Images converted to frequency domain." ),
+                      1);
+  frequency_kernel_cache_write(p);
   if(p->checkfreqsteps)
     {
-      complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
+      complextoreal(p, p->pimg, COMPLEX_TO_REAL_SPEC, &tmp);
       data->array=tmp; data->name="input transformed";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
 
-      complextoreal(p->pker, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
+      complextoreal(p, p->pker, COMPLEX_TO_REAL_SPEC, &tmp);
       data->array=tmp; data->name="kernel transformed";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
     }
 
-  /* Multiply or divide the two arrays and save them in the output.*/
+  /* Multiply or divide the two arrays and save them in the output. The
+     transformed kernel is no longer needed after this. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
   if(p->makekernel)
     {
-      complexarraydivide(p->pimg, p->pker, p->ps0*p->ps1, p->minsharpspec);
+      complexarraydivide(p->pimg, p->pker, p->ps0*p->ph1, p->ffttype,
+                         p->minsharpspec);
       if(!p->cp.quiet)
         gal_timing_report(&t1, "Divided in the frequency domain.", 1);
     }
   else
     {
-      complexarraymultiply(p->pimg, p->pker, p->ps0*p->ps1);
+      complexarraymultiply(p->pimg, p->pker, p->ps0*p->ph1, p->ffttype);
       if(!p->cp.quiet)
         gal_timing_report(&t1, "Multiplied in the frequency domain.", 1);
     }
+  free(p->pker);
+  p->pker=NULL;
   if(p->checkfreqsteps)
     {
-      complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_SPEC, &tmp);
+      complextoreal(p, p->pimg, COMPLEX_TO_REAL_SPEC, &tmp);
       data->array=tmp; data->name=p->makekernel ? "Divided" : "Multiplied";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
       free(tmp); data->name=NULL;
     }
 
-  /* Forward (in practice inverse) 2D FFT on each image. */
+  /* Backward 2D FFT. After it, the rows of `p->pimg' contain the real
+     padded output (in their first `p->ps1' elements). */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
   twodimensionfft(p, fp, -1);
   if(p->makekernel)
-    correctdeconvolve(p, &p->rpad);
-  else
-    complextoreal(p->pimg, p->ps0*p->ps1, COMPLEX_TO_REAL_REAL, &p->rpad);
+    correctdeconvolve(p, &rpad);
   if(!p->cp.quiet)
     gal_timing_report(&t1, "Converted back to the spatial domain.", 1);
   if(p->checkfreqsteps)
     {
-      data->array=p->rpad; data->name="padded output";
+      if(rpad) tmp=rpad;
+      else complextoreal(p, p->pimg, COMPLEX_TO_REAL_REAL, &tmp);
+      data->array=tmp; data->name="padded output";
       gal_fits_img_write(data, p->freqstepsname, NULL, PROGRAM_NAME);
+      if(tmp!=rpad) free(tmp);
       data->name=NULL; data->array=NULL;
     }
-
-  /* Free the padded arrays (they are no longer needed) and put the
-     converted array (that is real, not complex) in p->pimg. */
   gal_data_free(data);
-  free(p->pimg);
-  free(p->pker);
 
   /* Crop out the center, numbers smaller than 10^{-17} are errors,
      remove them. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  removepaddingcorrectroundoff(p);
+  if(rpad)
+    removepaddingcorrectroundoff(p, rpad, GAL_TYPE_FLOAT64, p->ps1);
+  else
+    removepaddingcorrectroundoff(p, p->pimg, p->ffttype, 2*p->ph1);
   if(!p->cp.quiet) gal_timing_report(&t1, "Padded parts removed.", 1);
 
 
   /* Free all the allocated space. */
+  free(rpad);
+  free(p->pimg);
+  freefp(fp);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/******************************************************************/
+/*************  Frequency domain, in blocks       *****************/
+/******************************************************************/
+/* For large images, the padded image (and its transform) may not fit in
+   memory. So the image can also be convolved in blocks (overlap-save
+   method): each block of `t0*t1' output pixels is convolved with an
+   independent padded array of `p->ps0*p->ps1' pixels that contains the
+   block and its surrounding pixels (`p->kernel->dsize[i]-1' more on each
+   dimension). The circular convolution of this padded array doesn't
+   affect the pixels of the block, so they are identical to the pixels of
+   a convolution over the full image. Since the blocks are independent,
+   they are done in parallel (one block per thread) and the kernel only
+   needs to be transformed once. */
+struct frequency_blocks_params
+{
+  struct convolveparams   *p;  /* Pointer to main program structure.    */
+  struct fftonthreadparams *fp; /* Per-thread FFT structures.           */
+  float                 *out;  /* Output (convolved) array.             */
+  size_t                  t0;  /* Output pixels in a block (1st dim).   */
+  size_t                  t1;  /* Output pixels in a block (2nd dim).   */
+  size_t                 nb1;  /* Number of blocks along 2nd dimension. */
+};
+
+
+
+
+
+/* 2D Fourier transform of a single padded array on one thread. */
+static void
+frequency_block_fft(struct fftonthreadparams *fp, void *block,
+                    int forward1backwardn1)
+{
+  size_t i;
+  char *b=block;
+  struct convolveparams *p=fp->p;
+  size_t ph1=p->ph1, esize=gal_type_sizeof(p->ffttype);
+
+  if(forward1backwardn1==1)
+    {
+      for(i=0;i<p->ps0;++i) onedimensionfft_line(fp, b+esize*2*i*ph1, 1,  1);
+      for(i=0;i<ph1;++i)    onedimensionfft_line(fp, b+esize*2*i,   ph1,  1);
+    }
+  else
+    {
+      for(i=0;i<ph1;++i)    onedimensionfft_line(fp, b+esize*2*i,   ph1, -1);
+      for(i=0;i<p->ps0;++i) onedimensionfft_line(fp, b+esize*2*i*ph1, 1, -1);
+    }
+}
+
+
+
+
+
+/* Fill the padded array with the pixels around the block that starts at
+   (`y0',`x0'). Pixels outside the image are zero (like the padding of
+   the full image). */
+#define BLOCK_FILL(IT) {                                                \
+    IT *o, *op;                                                         \
+    for(r=0;r<ps0;++r)                                                  \
+      {                                                                 \
+        op=(o=(IT *)block+r*2*ph1)+2*ph1;                               \
+        if(y0+r>=h0 && y0+r-h0<is0)                                     \
+          {                                                             \
+            f=input+(y0+r-h0)*is1;                                      \
+            for(c=0;c<ps1;++c)                                          \
+              *o++ = x0+c>=h1 && x0+c-h1<is1 ? f[x0+c-h1] : 0.0f;       \
+          }                                                             \
+        do *o++=0.0f; while(o<op);                                      \
+      }                                                                 \
+  }
+
+/* Put the convolved pixels of the block in the output (and correct for
+   round-off errors, see `removepaddingcorrectroundoff'). */
+#define BLOCK_OUTPUT(IT) {                                              \
+    IT *d;                                                              \
+    for(r=0; r<bs0; ++r)                                                \
+      {                                                                 \
+        o=out+(y0+r)*is1+x0;                                            \
+        d=(IT *)block+(r+2*h0)*2*ph1+2*h1;                              \
+        for(c=0; c<bs1; ++c, ++d)                                       \
+          *o++ = ( *d<-CONVFLOATINGPOINTERR || *d>CONVFLOATINGPOINTERR ) \
+            ? *d                                                        \
+            : 0.0f;                                                     \
+      }                                                                 \
+  }
+
+static void *
+convolve_frequency_blocks_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct frequency_blocks_params *bprm=tprm->params;
+  struct fftonthreadparams *fp=&bprm->fp[tprm->id];
+  struct convolveparams *p=bprm->p;
+
+  void *block;
+  float *f, *o, *out=bprm->out, *input=p->input->array;
+  size_t ps0=p->ps0, ps1=p->ps1, ph1=p->ph1, t0=bprm->t0, t1=bprm->t1;
+  size_t is0=p->input->dsize[0], is1=p->input->dsize[1];
+  size_t h0=(p->kernel->dsize[0]-1)/2, h1=(p->kernel->dsize[1]-1)/2;
+  size_t i, r, c, y0, x0, bs0, bs1;
+
+  /* Allocate the padded array for this thread. */
+  block=gal_data_malloc_array(p->ffttype, 2*ps0*ph1, __func__, "block");
+
+  /* Go over all the blocks given to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* First pixel and size of this block in the output. */
+      y0  = ( tprm->indexs[i] / bprm->nb1 ) * t0;
+      x0  = ( tprm->indexs[i] % bprm->nb1 ) * t1;
+      bs0 = y0+t0 < is0 ? t0 : is0-y0;
+      bs1 = x0+t1 < is1 ? t1 : is1-x0;
+
+      /* Convolve the padded block. */
+      if(p->ffttype==GAL_TYPE_FLOAT32) { BLOCK_FILL(float);  }
+      else                             { BLOCK_FILL(double); }
+      frequency_block_fft(fp, block, 1);
+      complexarraymultiply(block, p->pker, ps0*ph1, p->ffttype);
+      frequency_block_fft(fp, block, -1);
+
+      /* Write the block's pixels into the output. */
+      if(p->ffttype==GAL_TYPE_FLOAT32) { BLOCK_OUTPUT(float);  }
+      else                             { BLOCK_OUTPUT(double); }
+    }
+
+  /* Clean up and wait for other threads to finish, then return. */
+  free(block);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+void
+convolve_frequency_blocks(struct convolveparams *p)
+{
+  size_t i;
+  float *f, *ff;
+  gal_data_t *out;
+  struct timeval t1;
+  struct fftonthreadparams *fp;
+  struct frequency_blocks_params bprm;
+  size_t ps0, ps1, ph1, nb0, bsize[2];
+  size_t is0=p->input->dsize[0],  is1=p->input->dsize[1];
+  size_t ks0=p->kernel->dsize[0], ks1=p->kernel->dsize[1];
+  float *kernel=p->kernel->array;
+
+
+  /* Set the sizes of the padded blocks: the blocks will have at least
+     `p->blocksize' pixels on each side (unless the image is smaller),
+     then they are expanded to have small prime factors after padding. */
+  if(!p->cp.quiet) gettimeofday(&t1, NULL);
+  bsize[0] = p->blocksize < is0 ? p->blocksize : is0;
+  bsize[1] = p->blocksize < is1 ? p->blocksize : is1;
+  ps0=p->ps0=frequency_fft_size(bsize[0] + ks0 - 1);
+  ps1=p->ps1=frequency_fft_size(bsize[1] + ks1 - 1);
+  ph1=p->ph1=ps1/2+1;
+  bprm.t0  = ps0 - ks0 + 1;
+  bprm.t1  = ps1 - ks1 + 1;
+  nb0      = (is0 + bprm.t0 - 1)/bprm.t0;
+  bprm.nb1 = (is1 + bprm.t1 - 1)/bprm.t1;
+
+
+  /* Pad the kernel and transform it (on this thread), unless its
+     transform is already cached. */
+  fftinitializer(p, &fp);
+  if( frequency_kernel_cache_read(p)==0 )
+    {
+      p->pker=gal_data_malloc_array(p->ffttype, 2*ps0*ph1, __func__,
+                                    "pker");
+      if(p->ffttype==GAL_TYPE_FLOAT32)
+        { PAD_IMAGE(float,  p->pker, kernel, ks0, ks1); }
+      else
+        { PAD_IMAGE(double, p->pker, kernel, ks0, ks1); }
+      frequency_block_fft(fp, p->pker, 1);
+      frequency_kernel_cache_write(p);
+    }
+  if(!p->cp.quiet)
+    gal_timing_report(&t1, ( p->kernelcached
+                             ? "Kernel's transform read from cache."
+                             : "Kernel padded and converted to frequency "
+                             "domain." ), 1);
+
+
+  /* Convolve the blocks. The output is allocated like the input (so it
+     will be memory-mapped when the input is too large for the RAM). */
+  if(!p->cp.quiet) gettimeofday(&t1, NULL);
+  bprm.p=p;
+  bprm.fp=fp;
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, p->input->dsize,
+                     p->input->wcs, 0, p->cp.minmapsize, NULL,
+                     p->input->unit, NULL);
+  bprm.out=out->array;
+  gal_threads_spin_off(convolve_frequency_blocks_on_thread, &bprm,
+                       nb0*bprm.nb1, p->cp.numthreads);
+  if(!p->cp.quiet)
+    gal_timing_report(&t1, "Blocks convolved in the frequency domain.", 1);
+
+
+  /* Replace the input with the convolved dataset and clean up. */
+  gal_data_free(p->input);
+  p->input=out;
+  free(p->pker);
+  p->pker=NULL;
   freefp(fp);
 }
 
@@ -790,6 +1383,8 @@ convolve(struct convolveparams *p)
       gal_data_free(p->input);
       p->input=out;
     }
+  else if(p->blocksize)
+    convolve_frequency_blocks(p);
   else
     convolve_frequency(p);
 
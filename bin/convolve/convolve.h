@@ -24,7 +24,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #define CONVOLVE_H
 
 #include <gnuastro/threads.h>
+#include <gsl/gsl_fft_real.h>
 #include <gsl/gsl_fft_complex.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include <gsl/gsl_fft_real_float.h>
+#include <gsl/gsl_fft_complex_float.h>
+#include <gsl/gsl_fft_halfcomplex_float.h>
 
 struct fftonthreadparams
 {
@@ -34,11 +39,13 @@ struct fftonthreadparams
   int   forward1backwardn1; /* Operate on one or two images.            */
   size_t            stride; /* 1D FFT on rows or columns?               */
 
-  /* Pointers to GSL FFT structures: */
-  gsl_fft_complex_wavetable *ps0wave;
-  gsl_fft_complex_wavetable *ps1wave;
-  gsl_fft_complex_workspace *ps0work;
-  gsl_fft_complex_workspace *ps1work;
+  /* Pointers to GSL FFT structures (the `_float' versions when the
+     transforms are in single precision): */
+  void             *ps0wave; /* Complex wavetable (columns).            */
+  void             *ps1wave; /* Real wavetable (rows, forward).         */
+  void            *ps1hwave; /* Halfcomplex wavetable (rows, backward). */
+  void             *ps0work; /* Complex workspace (columns).            */
+  void             *ps1work; /* Real workspace (rows).                  */
 
   /* Thread parameters. */
   size_t          *indexs;  /* Indexs to be used in this thread.        */
@@ -82,16 +82,21 @@ struct convolveparams
   char            *domainstr;  /* String value specifying domain.         */
   size_t          makekernel;  /* Make a kernel to create input.          */
   uint8_t   noedgecorrection;  /* Do not correct spatial edge effects.    */
+  uint8_t    singleprecision;  /* Frequency domain: 32-bit FFT.           */
+  size_t           blocksize;  /* Frequency domain: convolve in blocks.   */
+  char          *kernelcache;  /* Frequency domain: kernel spectrum file. */
 
   /* Internal */
   int                 domain;  /* Frequency or spatial domain conv.       */
   gal_data_t          *input;  /* Input image array.                      */
   gal_data_t         *kernel;  /* Input Kernel array.                     */
-  double               *pimg;  /* Padded image array.                     */
-  double               *pker;  /* Padded kernel array.                    */
-  double               *rpad;  /* Real final image before removing pad'd. */
+  uint8_t            ffttype;  /* Type of FFT arrays (float32 or 64).     */
+  void                 *pimg;  /* Padded image array (half-spectrum).     */
+  void                 *pker;  /* Padded kernel array (half-spectrum).    */
   size_t                 ps0;  /* Padded size along first C axis.         */
   size_t                 ps1;  /* Padded size along second C axis.        */
+  size_t                 ph1;  /* Complex elements in each row: ps1/2+1.  */
+  uint8_t       kernelcached;  /* Kernel's spectrum read from cache.      */
   char        *freqstepsname;  /* Name of file to check frequency steps.  */
   time_t             rawtime;  /* Starting time of the program.           */
 };
@@ -227,6 +227,34 @@ ui_read_check_only_options(struct convolveparams *p)
           "either `spatial' or `frequency'", p->domainstr);
 
 
+  /* Precision of the frequency domain arrays. */
+  p->ffttype = p->singleprecision ? GAL_TYPE_FLOAT32 : GAL_TYPE_FLOAT64;
+
+
+  /* Convolution in blocks is only for frequency domain convolution. */
+  if( p->blocksize && p->domain==CONVOLVE_DOMAIN_FREQUENCY )
+    {
+      if(p->makekernel)
+        error(EXIT_FAILURE, 0, "`--blocksize' cannot be used with "
+              "`--makekernel': the kernel is found from the whole image");
+      if(p->checkfreqsteps)
+        error(EXIT_FAILURE, 0, "`--checkfreqsteps' cannot be used with "
+              "`--blocksize': the blocks are convolved independently");
+    }
+
+
+  /* The kernel cache is a FITS file and is only for convolution. */
+  if( p->kernelcache && p->domain==CONVOLVE_DOMAIN_FREQUENCY )
+    {
+      if(p->makekernel)
+        error(EXIT_FAILURE, 0, "`--kernelcache' cannot be used with "
+              "`--makekernel'");
+      if( gal_fits_name_is_fits(p->kernelcache)==0 )
+        error(EXIT_FAILURE, 0, "`%s' (value to `--kernelcache') is not a "
+              "recognized FITS file name", p->kernelcache);
+    }
+
+
   /* If we are in the spatial domain, make sure that the necessary
      parameters are set. */
   if( p->domain==CONVOLVE_DOMAIN_SPATIAL )
@@ -399,11 +427,11 @@ ui_preparations(struct convolveparams *p)
          meaningful. */
       sum=gal_statistics_sum(p->input);
       sum=gal_data_copy_to_new_type_free(sum, GAL_TYPE_FLOAT32);
-      p->input = gal_arithmetic(GAL_ARITHMETIC_OP_DIVIDE,
+      p->input = gal_arithmetic(GAL_ARITHMETIC_OP_DIVIDE, p->cp.numthreads,
                                 GAL_ARITHMETIC_FLAGS_ALL, p->input, sum);
       sum=gal_statistics_sum(p->kernel);
       sum=gal_data_copy_to_new_type_free(sum, GAL_TYPE_FLOAT32);
-      p->kernel = gal_arithmetic(GAL_ARITHMETIC_OP_DIVIDE,
+      p->kernel = gal_arithmetic(GAL_ARITHMETIC_OP_DIVIDE, 1,
                                 GAL_ARITHMETIC_FLAGS_ALL, p->kernel, sum);
     }
 
@@ -431,7 +459,7 @@ ui_preparations(struct convolveparams *p)
           if( !p->nokernelnorm )
             {
               sum=gal_statistics_sum(p->kernel);
-              p->kernel = gal_arithmetic(GAL_ARITHMETIC_OP_DIVIDE,
+              p->kernel = gal_arithmetic(GAL_ARITHMETIC_OP_DIVIDE, 1,
                                          GAL_ARITHMETIC_FLAGS_ALL,
                                          p->kernel, sum);
             }
@@ -573,6 +601,7 @@ ui_free_report(struct convolveparams *p, struct timeval *t1)
   /* Free the allocated arrays: */
   free(p->khdu);
   free(p->cp.hdu);
+  free(p->kernelcache);
   free(p->cp.output);
   gal_data_free(p->input);
   gal_data_free(p->kernel);
@@ -63,6 +63,9 @@ enum option_keys_enum
   UI_KEY_NOKERNELFLIP = 1000,
   UI_KEY_NOKERNELNORM,
   UI_KEY_NOEDGECORRECTION,
+  UI_KEY_SINGLEPRECISION,
+  UI_KEY_BLOCKSIZE,
+  UI_KEY_KERNELCACHE,
 };
 
 
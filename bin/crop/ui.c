@@ -599,7 +599,8 @@ ui_read_cols(struct cropparams *p)
 
   /* Read the desired columns from the file. */
   cols=gal_table_read(p->catname, p->cathdu, colstrs, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize);
+                      p->cp.ignorecase, p->cp.numthreads,
+                      p->cp.minmapsize);
 
 
   /* Set the number of objects (rows in each column). */
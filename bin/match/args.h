@@ -113,6 +113,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_SET,
       gal_options_parse_csv_float64
     },
+    {
+      "index2",
+      UI_KEY_INDEX2,
+      "STR",
+      0,
+      "Index file to keep/reuse sorted second input.",
+      UI_GROUP_CATALOGMATCH,
+      &p->index2,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
     {0}
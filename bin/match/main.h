@@ -57,6 +57,7 @@ struct matchparams
   gal_list_str_t       *ccol2;  /* Column names/numbers of first cat.   */
   gal_data_t        *aperture;  /* Acceptable matching aperture.        */
   uint8_t         logasoutput;  /* Don't rearrange inputs, out is log.  */
+  char                *index2;  /* Index file of sorted second input.   */
 
   /* Internal */
   int                    mode;  /* Mode of operation: image or catalog. */
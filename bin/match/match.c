@@ -46,7 +46,7 @@ match_catalog_write(struct matchparams *p, char *filename, char *hdu,
 
   /* Read the full table. */
   cat=gal_table_read(filename, hdu, NULL,p->cp.searchin, p->cp.ignorecase,
-                     p->cp.minmapsize);
+                     p->cp.numthreads, p->cp.minmapsize);
 
   /* Go over each column and make a new copy. */
   for(tmp=cat; tmp!=NULL; tmp=tmp->next)
@@ -93,7 +93,8 @@ match_catalog(struct matchparams *p)
 
   /* Find the matching coordinates. */
   mcols=gal_match_coordinates(p->cols1, p->cols2, p->aperture, 0, 1,
-                              p->cp.minmapsize);
+                              p->cp.minmapsize, p->cp.numthreads,
+                              p->index2);
 
   /* Read all the first catalog columns. */
   if(p->logasoutput==0)
@@ -440,7 +440,8 @@ ui_read_columns(struct matchparams *p)
     {
       /* Read the first dataset. */
       p->cols1=gal_table_read(p->input1name, cp->hdu, p->ccol1, cp->searchin,
-                              cp->ignorecase, cp->minmapsize);
+                              cp->ignorecase, cp->numthreads,
+                              cp->minmapsize);
       if(gal_list_data_number(p->cols1)!=ccol1n)
         error(EXIT_FAILURE, 0, diff_cols_error,
               gal_checkset_dataset_name(p->input1name, cp->hdu),
@@ -448,7 +449,8 @@ ui_read_columns(struct matchparams *p)
 
       /* Read the second dataset. */
       p->cols2=gal_table_read(p->input2name, p->hdu2, p->ccol2, cp->searchin,
-                              cp->ignorecase, cp->minmapsize);
+                              cp->ignorecase, cp->numthreads,
+                              cp->minmapsize);
       if(gal_list_data_number(p->cols2)!=ccol2n)
         error(EXIT_FAILURE, 0, diff_cols_error,
               gal_checkset_dataset_name(p->input2name, p->hdu2),
@@ -656,6 +658,7 @@ ui_free_report(struct matchparams *p, struct timeval *t1)
 {
   /* Free the allocated arrays: */
   free(p->cp.hdu);
+  free(p->index2);
   free(p->out1name);
   free(p->out2name);
   free(p->cp.output);
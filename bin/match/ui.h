@@ -54,6 +54,7 @@ enum option_keys_enum
      automatically). */
   UI_KEY_CCOL1           = 1000,
   UI_KEY_CCOL2,
+  UI_KEY_INDEX2,
 };
 
 
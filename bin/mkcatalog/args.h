@@ -208,6 +208,23 @@ struct argp_option program_options[] =
 
 
 
+    /* Operating mode. */
+    {
+      "singlepass",
+      UI_KEY_SINGLEPASS,
+      0,
+      0,
+      "Measure all labels in one pass over the image.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->singlepass,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+
+
+
     /* Upper limit magnitude configurations. */
     {
       0, 0, 0, 0,
@@ -40,6 +40,9 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #define MKCATALOG_UPPERLIMIT_STOP_MULTIP 50
 #define MKCATALOG_UPPERLIMIT_MINIMUM_NUM 20
 
+/* Number of stripes (per thread) in the single-pass mode. */
+#define MKCATALOG_SINGLEPASS_STRIPES     4
+
 
 
 /* Intermediate/raw array elements
@@ -160,6 +163,7 @@ struct mkcatalogparams
   uint8_t             envseed;  /* Use the environment for random seed. */
   double       upsigmaclip[2];  /* Sigma clip to measure upper limit.   */
   float              upnsigma;  /* Multiple of sigma to define up-lim.  */
+  uint8_t          singlepass;  /* Measure in one pass over the image.  */
 
   /* Internal. */
   time_t              rawtime;  /* Starting time of the program.        */
@@ -176,6 +180,7 @@ struct mkcatalogparams
   size_t           numobjects;  /* Number of object labels in image.    */
   float               clumpsn;  /* Clump S/N threshold.                 */
   size_t            numclumps;  /* Number of clumps in image.           */
+  size_t         *clumpsinobj;  /* Number of clumps in each object.     */
   gal_data_t      *objectcols;  /* Output columns for the objects.      */
   gal_data_t       *clumpcols;  /* Output columns for the clumps.       */
   gal_data_t           *tiles;  /* Tiles to cover each object.          */
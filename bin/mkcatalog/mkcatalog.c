@@ -61,14 +61,6 @@ mkcatalog_initialize_params(struct mkcatalog_passparams *pp)
 {
   struct mkcatalogparams *p=pp->p;
 
-  /* Initialize the number of clumps in this object. */
-  pp->clumpsinobj=0;
-
-
-  /* Initialize the intermediate values. */
-  memset(pp->oi, 0, OCOL_NUMCOLS * sizeof *pp->oi);
-
-
   /* Set the shifts in every dimension to avoid round-off errors in large
      numbers for the non-linear calculations. We are using the first pixel
      of each object's tile as the shift parameter to keep the mean
@@ -457,7 +449,7 @@ mkcatalog_single_object(void *in_prm)
   struct mkcatalogparams *p=(struct mkcatalogparams *)(tprm->params);
   size_t ndim=p->input->ndim;
 
-  size_t i;
+  size_t index;
   struct mkcatalog_passparams pp;
 
   /* Initialize the mkcatalog_passparams elements. */
@@ -477,13 +469,17 @@ mkcatalog_single_object(void *in_prm)
                                               NULL) : NULL;
 
   /* Fill the desired columns for all the objects given to this thread. */
-  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+  while( (index=gal_threads_next_action(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* For easy reading, Note that the object IDs start from one while
          the array positions start from 0. */
       pp.ci=NULL;
-      pp.object = tprm->indexs[i] + 1;
-      pp.tile   = &p->tiles[ tprm->indexs[i] ];
+      pp.object = index + 1;
+      pp.tile   = &p->tiles[ index ];
+
+      /* Initialize the number of clumps and the intermediate values. */
+      pp.clumpsinobj=0;
+      memset(pp.oi, 0, OCOL_NUMCOLS * sizeof *pp.oi);
 
       /* Initialize the parameters for this object/tile. */
       mkcatalog_initialize_params(&pp);
@@ -549,6 +545,397 @@ mkcatalog_single_object(void *in_prm)
 
 
 
+/*********************************************************************/
+/*****************       Single pass over image      *****************/
+/*********************************************************************/
+/* In the passes above, each object's tile is parsed separately and only
+   the pixels with the object's label are used. When the tiles of many
+   objects overlap (for example large galaxies in a crowded field), most
+   of the pixels in each tile belong to other objects, so the image is
+   effectively read many times. In the single-pass mode, the image is
+   parsed only once (in stripes along its slowest dimension) and the values
+   of each pixel are added to the intermediate values of its label. Each
+   thread has its own intermediate arrays for all the objects and clumps,
+   so no locking is necessary. They are summed after all the stripes have
+   been parsed. */
+struct mkcatalog_singlepass
+{
+  struct mkcatalogparams *p;    /* Main MakeCatalog parameters.         */
+  size_t         numstripes;    /* Number of stripes to parse.          */
+  size_t             *shift;    /* Shift of each object (`ndim' each).  */
+  size_t            *cstart;    /* Index of first clump of each object. */
+  double               **oi;    /* Objects' intermediate values/thread. */
+  double               **ci;    /* Clumps' intermediate values/thread.  */
+};
+
+
+
+
+
+/* Parse the stripes of the image that are given to this thread. The
+   measurements are the same as `mkcatalog_first_pass' and
+   `mkcatalog_second_pass', see the comments there. */
+static void *
+mkcatalog_single_pass_stripe(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct mkcatalog_singlepass *sp=(struct mkcatalog_singlepass *)
+                                  (tprm->params);
+  struct mkcatalogparams *p=sp->p;
+  size_t ndim=p->input->ndim, *dsize=p->input->dsize;
+
+  double *oi, *ci;
+  float ss, *I, *II, *SK, *ST;
+  size_t s, i, ii, d, *shift, first;
+  int32_t *O, *C=NULL, nlab, *ngblabs=NULL;
+  size_t *dinc=NULL, nngb=gal_dimension_num_neighbors(ndim);
+  size_t rowsize=p->input->size/dsize[0];
+  double *toi=sp->oi[tprm->id], *tci=p->clumps ? sp->ci[tprm->id] : NULL;
+  float *input=p->input->array, *sky=p->sky->array, *std=p->std->array;
+  int32_t *objects=p->objects->array;
+  int32_t *clumps=p->clumps ? p->clumps->array : NULL;
+  size_t *c=gal_data_malloc_array(GAL_TYPE_SIZE_T, ndim, __func__, "c");
+  size_t *fc=gal_data_malloc_array(GAL_TYPE_SIZE_T, ndim, __func__, "fc");
+  size_t *sc=gal_data_malloc_array(GAL_TYPE_SIZE_T, ndim, __func__, "sc");
+
+  /* Necessary arrays for the rivers. */
+  if(clumps)
+    {
+      dinc=gal_dimension_increment(ndim, dsize);
+      ngblabs=gal_data_malloc_array(GAL_TYPE_INT32, nngb, __func__,
+                                    "ngblabs");
+    }
+
+  /* Go over all the stripes given to this thread. */
+  while( (s=gal_threads_next_action(tprm)) != GAL_BLANK_SIZE_T )
+    {
+      /* Set the first and last (exclusive) pixels of this stripe. */
+      first = ( s     * dsize[0] / sp->numstripes ) * rowsize;
+      I     = input + first;
+      II    = input + ( (s+1) * dsize[0] / sp->numstripes ) * rowsize;
+      if(I==II) continue;
+      O  = objects + first;
+      SK = sky     + first;
+      ST = std     + first;
+      if(clumps) C = clumps + first;
+
+      /* The coordinates are only calculated once in each stripe, for the
+         next pixels, they are just incremented. */
+      gal_dimension_index_to_coord(first, ndim, dsize, c);
+
+      /* Parse the stripe. */
+      do
+        {
+          if(*O>0)
+            {
+              /* Intermediate values of this pixel's object. */
+              oi    = toi      + (*O-1) * OCOL_NUMCOLS;
+              shift = sp->shift + (*O-1) * ndim;
+
+              /* FITS (`fc') and shifted (`sc') coordinates. */
+              for(d=0;d<ndim;++d)
+                {
+                  sc[d] = c[d] - shift[d];
+                  fc[d] = c[d] + 1;
+                }
+
+              /* Geometric measurements of the object. */
+              oi[ OCOL_NUMALL ]++;
+              oi[ OCOL_GX     ] += fc[1];
+              oi[ OCOL_GY     ] += fc[0];
+              oi[ OCOL_GXX    ] += sc[1] * sc[1];
+              oi[ OCOL_GYY    ] += sc[0] * sc[0];
+              oi[ OCOL_GXY    ] += sc[1] * sc[0];
+
+              /* Pointer to this clump's intermediate values (if we are
+                 on a clump), note that the clump labels start from 1. */
+              if(clumps && *C>0)
+                {
+                  ci = tci + ( sp->cstart[*O-1] + *C-1 ) * CCOL_NUMCOLS;
+                  oi[ OCOL_C_GX   ] += fc[1];
+                  oi[ OCOL_C_GY   ] += fc[0];
+                  ci[ CCOL_NUMALL ]++;
+                  ci[ CCOL_GX     ] += fc[1];
+                  ci[ CCOL_GY     ] += fc[0];
+                  ci[ CCOL_GXX    ] += sc[1] * sc[1];
+                  ci[ CCOL_GYY    ] += sc[0] * sc[0];
+                  ci[ CCOL_GXY    ] += sc[1] * sc[0];
+                }
+              else ci=NULL;
+
+              /* Pixel value related measurements. */
+              if( !( p->hasblank && isnan(*I) )
+                  && !( (ss = *I - *SK) < p->threshold * *ST ) )
+                {
+                  oi[ OCOL_NUM    ]++;
+                  oi[ OCOL_SUM    ] += ss;
+                  oi[ OCOL_SUMSKY ] += *SK;
+                  oi[ OCOL_SUMSTD ] += *ST;
+                  if(ci)
+                    {
+                      oi[ OCOL_C_NUM  ]++;
+                      oi[ OCOL_C_SUM  ] += ss;
+                      ci[ CCOL_NUM    ]++;
+                      ci[ CCOL_SUM    ] += ss;
+                      ci[ CCOL_SUMSKY ] += *SK;
+                      ci[ CCOL_SUMSTD ] += *ST;
+                    }
+
+                  /* Flux weighted measurements. */
+                  if( ss > 0.0f )
+                    {
+                      oi[ OCOL_NUMWHT ]++;
+                      oi[ OCOL_SUMWHT ] += ss;
+                      oi[ OCOL_VX     ] += ss * fc[1];
+                      oi[ OCOL_VY     ] += ss * fc[0];
+                      oi[ OCOL_VXX    ] += ss * sc[1] * sc[1];
+                      oi[ OCOL_VYY    ] += ss * sc[0] * sc[0];
+                      oi[ OCOL_VXY    ] += ss * sc[1] * sc[0];
+                      if(ci)
+                        {
+                          oi[ OCOL_C_NUMWHT ]++;
+                          oi[ OCOL_C_SUMWHT ] += ss;
+                          oi[ OCOL_C_VX     ] += ss * fc[1];
+                          oi[ OCOL_C_VY     ] += ss * fc[0];
+                          ci[ CCOL_NUMWHT   ]++;
+                          ci[ CCOL_SUMWHT   ] += ss;
+                          ci[ CCOL_VX       ] += ss * fc[1];
+                          ci[ CCOL_VY       ] += ss * fc[0];
+                          ci[ CCOL_VXX      ] += ss * sc[1] * sc[1];
+                          ci[ CCOL_VYY      ] += ss * sc[0] * sc[0];
+                          ci[ CCOL_VXY      ] += ss * sc[1] * sc[0];
+                        }
+                    }
+                }
+
+              /* A diffuse (river) pixel in an object with clumps: add its
+                 value to all the clumps of this object that it touches
+                 (only once for each clump). */
+              if( clumps && ci==NULL && p->clumpsinobj[*O-1] )
+                {
+                  ii=0;
+                  memset(ngblabs, 0, nngb*sizeof *ngblabs);
+                  GAL_DIMENSION_NEIGHBOR_OP(I-input, ndim, dsize, ndim, dinc,
+                     {
+                       nlab=clumps[nind];
+                       if( nlab>0 && objects[nind]==*O )
+                         {
+                           for(i=0;i<ii;++i) if(ngblabs[i]==nlab) break;
+                           if(i==ii)
+                             {
+                               ngblabs[ii++] = nlab;
+                               ci = tci + ( sp->cstart[*O-1] + nlab-1 )
+                                          * CCOL_NUMCOLS;
+                               ++ci[ CCOL_RIV_NUM ];
+                               ci[ CCOL_RIV_SUM ] += *I-*SK;
+                             }
+                         }
+                     });
+                }
+            }
+
+          /* Increment the other pointers and the coordinates. */
+          ++O; ++SK; ++ST; if(clumps) ++C;
+          d=ndim-1;
+          while( ++c[d]==dsize[d] && d>0 ) c[d--]=0;
+        }
+      while(++I<II);
+    }
+
+  /* Clean up. */
+  free(c);
+  free(fc);
+  free(sc);
+  free(dinc);
+  free(ngblabs);
+
+  /* Wait until all the threads finish and return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* After the single pass, the upper-limit measurements (that need the
+   object's tile) are done and the columns are filled for each object. */
+static void *
+mkcatalog_single_pass_fill(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct mkcatalog_singlepass *sp=(struct mkcatalog_singlepass *)
+                                  (tprm->params);
+  struct mkcatalogparams *p=sp->p;
+  size_t ndim=p->input->ndim;
+
+  size_t index;
+  struct mkcatalog_passparams pp;
+
+  /* Initialize the mkcatalog_passparams elements. */
+  pp.p       = p;
+  pp.rng     = p->rng ? gsl_rng_clone(p->rng) : NULL;
+  pp.up_vals = p->upperlimit ? gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1,
+                                              &p->upnum, NULL, 0,
+                                              p->cp.minmapsize, NULL, NULL,
+                                              NULL) : NULL;
+
+  /* Fill the columns of all the objects given to this thread. */
+  while( (index=gal_threads_next_action(tprm)) != GAL_BLANK_SIZE_T )
+    {
+      /* The measurements of this object (and its clumps). */
+      pp.object          = index + 1;
+      pp.tile            = &p->tiles[ index ];
+      pp.shift           = &sp->shift[ index * ndim ];
+      pp.oi              = &sp->oi[0][ index * OCOL_NUMCOLS ];
+      pp.clumpsinobj     = p->clumps ? p->clumpsinobj[index] : 0;
+      pp.clumpstartindex = p->clumps ? sp->cstart[index]     : 0;
+      pp.ci              = ( pp.clumpsinobj
+                             ? &sp->ci[0][ sp->cstart[index] * CCOL_NUMCOLS ]
+                             : NULL );
+
+      /* The upper limit measurements need the pixels around each object,
+         so they are done on its tile. */
+      if(p->upperlimit)
+        {
+          mkcatalog_initialize_params(&pp);
+          upperlimit_calculate(&pp);
+        }
+
+      /* Write the measurements into the columns. */
+      columns_fill(&pp);
+    }
+
+  /* Clean up. */
+  gal_data_free(pp.up_vals);
+  if(pp.rng) gsl_rng_free(pp.rng);
+
+  /* Wait until all the threads finish and return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+static void
+mkcatalog_single_pass(struct mkcatalogparams *p)
+{
+  size_t ndim=p->input->ndim, *dsize=p->input->dsize;
+
+  struct mkcatalog_singlepass sp;
+  size_t i, t, nt, onum, cnum, *costs=NULL;
+
+  /* Set the number of stripes: a few stripes for every thread, so the
+     threads finish at similar times even if some parts of the image have
+     more labeled pixels. */
+  sp.p=p;
+  sp.numstripes = ( dsize[0] < MKCATALOG_SINGLEPASS_STRIPES*p->cp.numthreads
+                    ? dsize[0]
+                    : MKCATALOG_SINGLEPASS_STRIPES*p->cp.numthreads );
+  nt = sp.numstripes < p->cp.numthreads ? sp.numstripes : p->cp.numthreads;
+
+  /* The shifts of each object are set from the first pixel of its tile,
+     like `mkcatalog_initialize_params'. */
+  sp.shift=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numobjects*ndim,
+                                 __func__, "sp.shift");
+  for(i=0;i<p->numobjects;++i)
+    gal_dimension_index_to_coord( ( (float *)(p->tiles[i].array)
+                                    - (float *)(p->tiles[i].block->array) ),
+                                  ndim, dsize, &sp.shift[i*ndim] );
+
+  /* The clumps of each object are placed after those of the previous
+     objects (which is also their row in the clumps catalog). */
+  sp.cstart=NULL;
+  if(p->clumps)
+    {
+      sp.cstart=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numobjects+1,
+                                      __func__, "sp.cstart");
+      sp.cstart[0]=0;
+      for(i=0;i<p->numobjects;++i)
+        sp.cstart[i+1] = sp.cstart[i] + p->clumpsinobj[i];
+      if(sp.cstart[p->numobjects]>p->numclumps)
+        error(EXIT_FAILURE, 0, "%s: the objects contain %zu clumps, but "
+              "the clumps image has %zu", __func__, sp.cstart[p->numobjects],
+              p->numclumps);
+    }
+
+  /* Allocate the intermediate arrays of each thread. */
+  onum = p->numobjects * OCOL_NUMCOLS;
+  cnum = p->clumps ? sp.cstart[p->numobjects] * CCOL_NUMCOLS : 0;
+  errno=0;
+  sp.oi=malloc(nt * sizeof *sp.oi);
+  sp.ci=malloc(nt * sizeof *sp.ci);
+  if(sp.oi==NULL || sp.ci==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate the per-thread "
+          "pointers", __func__);
+  for(t=0;t<nt;++t)
+    {
+      sp.oi[t]=gal_data_calloc_array(GAL_TYPE_FLOAT64, onum, __func__,
+                                     "sp.oi[t]");
+      sp.ci[t] = ( cnum
+                   ? gal_data_calloc_array(GAL_TYPE_FLOAT64, cnum, __func__,
+                                           "sp.ci[t]")
+                   : NULL );
+    }
+
+  /* Parse the image. */
+  gal_threads_spin_off_sched(mkcatalog_single_pass_stripe, &sp,
+                             sp.numstripes, nt, GAL_THREADS_SCHEDULE_DYNAMIC,
+                             NULL);
+
+  /* Add the measurements of the other threads to the first. */
+  for(t=1;t<nt;++t)
+    {
+      for(i=0;i<onum;++i) sp.oi[0][i] += sp.oi[t][i];
+      for(i=0;i<cnum;++i) sp.ci[0][i] += sp.ci[t][i];
+      free(sp.oi[t]);
+      free(sp.ci[t]);
+    }
+
+  /* Fill the columns. When upper limit measurements are necessary, their
+     cost depends on the size of each tile, so like `mkcatalog', the
+     largest tiles are given out first. */
+  if(p->upperlimit)
+    {
+      costs=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numobjects,
+                                  __func__, "costs");
+      for(i=0;i<p->numobjects;++i) costs[i]=p->tiles[i].size;
+    }
+  gal_threads_spin_off_sched(mkcatalog_single_pass_fill, &sp, p->numobjects,
+                             p->cp.numthreads, GAL_THREADS_SCHEDULE_DYNAMIC,
+                             costs);
+
+  /* Clean up. */
+  free(costs);
+  free(sp.oi[0]);
+  free(sp.ci[0]);
+  free(sp.oi);
+  free(sp.ci);
+  free(sp.shift);
+  free(sp.cstart);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*********************************************************************/
 /********         Processing after threads finish        *************/
 /*********************************************************************/
@@ -935,14 +1322,32 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
 void
 mkcatalog(struct mkcatalogparams *p)
 {
+  size_t i, *costs;
+
   /* When more than one thread is to be used, initialize the mutex: we need
      it to assign a column to the clumps in the final catalog. */
   if( p->cp.numthreads > 1 ) pthread_mutex_init(&p->mutex, NULL);
 
 
-  /* Do the processing on each thread. */
-  gal_threads_spin_off(mkcatalog_single_object, p, p->numobjects,
-                       p->cp.numthreads);
+  /* Do the processing on each thread. In the single-pass mode, the image
+     is parsed once for all the labels. Otherwise, the time to process
+     each object depends on the size of its tile, which can differ greatly
+     between objects. So the objects are scheduled dynamically between the
+     threads, with the largest tiles first. */
+  if(p->singlepass)
+    mkcatalog_single_pass(p);
+  else
+    {
+      costs = ( p->numobjects
+                ? gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numobjects,
+                                        __func__, "costs")
+                : NULL );
+      for(i=0;i<p->numobjects;++i) costs[i]=p->tiles[i].size;
+      gal_threads_spin_off_sched(mkcatalog_single_object, p, p->numobjects,
+                                 p->cp.numthreads,
+                                 GAL_THREADS_SCHEDULE_DYNAMIC, costs);
+      free(costs);
+    }
 
 
   /* Post-thread processing, for example to convert image coordinates to RA
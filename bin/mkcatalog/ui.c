@@ -433,7 +433,7 @@ ui_preparations_read_inputs(struct mkcatalogparams *p)
          pixels. */
       zero=gal_data_alloc(NULL, GAL_TYPE_UINT8, 1, &one, NULL, 1, -1,
                           NULL, NULL, NULL);
-      p->upmask=gal_arithmetic(GAL_ARITHMETIC_OP_NE,
+      p->upmask=gal_arithmetic(GAL_ARITHMETIC_OP_NE, p->cp.numthreads,
                                ( GAL_ARITHMETIC_INPLACE | GAL_ARITHMETIC_FREE
                                  | GAL_ARITHMETIC_NUMOK ), p->upmask, zero);
     }
@@ -641,7 +641,7 @@ ui_one_tile_per_object(struct mkcatalogparams *p)
 {
   size_t ndim=p->input->ndim;
 
-  int32_t *l, *lf, *start;
+  int32_t *l, *lf, *start, *clumps=NULL;
   size_t i, d, *min, *max, width=2*ndim;
   size_t *minmax=gal_data_malloc_array(GAL_TYPE_SIZE_T,
                                        width*p->numobjects, __func__,
@@ -660,6 +660,17 @@ ui_one_tile_per_object(struct mkcatalogparams *p)
         minmax[ i * width + ndim + d ] = 0;                /* Maximum. */
       }
 
+  /* In single-pass mode, the clumps of all objects are measured together,
+     so we need to know how many clumps each object has before the pass
+     (to allocate space for them). Since this is the only other place that
+     we go over the labels, we'll also count them here. */
+  if(p->singlepass && p->clumps)
+    {
+      clumps=p->clumps->array;
+      p->clumpsinobj=gal_data_calloc_array(GAL_TYPE_SIZE_T, p->numobjects,
+                                           __func__, "p->clumpsinobj");
+    }
+
   /* Go over the objects label image and correct the minimum and maximum
      coordinates. */
   start=p->objects->array;
@@ -680,6 +691,12 @@ ui_one_tile_per_object(struct mkcatalogparams *p)
             if( coord[d] < min[d] ) min[d] = coord[d];
             if( coord[d] > max[d] ) max[d] = coord[d];
           }
+
+        /* The number of clumps in an object is the largest clump label
+           within it. */
+        if( clumps && clumps[l-start]>0
+            && (size_t)clumps[l-start] > p->clumpsinobj[*l-1] )
+          p->clumpsinobj[*l-1] = clumps[l-start];
       }
   while(++l<lf);
 
@@ -1081,6 +1098,7 @@ ui_free_report(struct mkcatalogparams *p, struct timeval *t1)
   free(p->oiflag);
   free(p->ciflag);
   free(p->skyfile);
+  free(p->clumpsinobj);
   free(p->stdfile);
   free(p->clumpshdu);
   free(p->objectshdu);
@@ -94,6 +94,7 @@ enum option_keys_enum
   UI_KEY_UPRANGE,
   UI_KEY_UPSIGMACLIP,
   UI_KEY_UPNSIGMA,
+  UI_KEY_SINGLEPASS,
 
   UI_KEY_OBJID,                         /* Catalog columns. */
   UI_KEY_IDINHOSTOBJ,
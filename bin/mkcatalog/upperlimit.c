@@ -22,6 +22,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
@@ -261,6 +262,144 @@ upperlimit_random_position(struct mkcatalog_passparams *pp, gal_data_t *tile,
 
 
 
+/* The footprint of the object/clump is kept as a list of runs (contiguous
+   pixels along the fastest dimension). Each run takes two elements in the
+   output: its offset from the first pixel of the tile and its length. The
+   random tiles have the same size as the original tile, so the same
+   offsets can be used in any random position and we don't need to parse
+   the labels of the original tile again for every random position. */
+static size_t *
+upperlimit_footprint_runs(struct mkcatalog_passparams *pp, gal_data_t *tile,
+                          int32_t clumplab, size_t *numruns)
+{
+  struct mkcatalogparams *p=pp->p;
+  size_t ndim=p->input->ndim, *dsize=p->input->dsize;
+
+  int32_t *O, *OO, *C=NULL, *st_o, *st_c=NULL;
+  size_t *runs=NULL, size=0, nruns=0, offset, se_inc[2];
+  size_t increment=0, num_increment=1;
+
+  /* Starting pointers of the tile. */
+  st_o = gal_tile_start_end_ind_inclusive(tile, p->objects, se_inc);
+  if(clumplab) st_c = (int32_t *)(p->clumps->array) + se_inc[0];
+
+  /* Parse the tile. */
+  while( se_inc[0] + increment <= se_inc[1] )
+    {
+      OO = ( O = st_o + increment ) + tile->dsize[ndim-1];
+      if(clumplab) C = st_c + increment;
+      do
+        {
+          if( *O==pp->object && ( clumplab==0 || *C==clumplab ) )
+            {
+              /* If this pixel is immediately after the previous run, just
+                 add it to that run. */
+              offset = O - st_o;
+              if( nruns && runs[2*nruns-2] + runs[2*nruns-1] == offset )
+                ++runs[2*nruns-1];
+              else
+                {
+                  /* Allocate more space if necessary. */
+                  if(nruns==size)
+                    {
+                      size = size ? 2*size : 64;
+                      errno=0;
+                      runs=realloc(runs, 2*size*sizeof *runs);
+                      if(runs==NULL)
+                        error(EXIT_FAILURE, errno, "%s: couldn't allocate "
+                              "%zu bytes for `runs'", __func__,
+                              2*size*sizeof *runs);
+                    }
+
+                  /* Start the new run. */
+                  runs[2*nruns  ] = offset;
+                  runs[2*nruns+1] = 1;
+                  ++nruns;
+                }
+            }
+          if(clumplab) ++C;
+        }
+      while(++O<OO);
+
+      /* Increment to the next contiguous region of this tile. */
+      increment += ( gal_tile_block_increment(p->input, dsize,
+                                              num_increment++, NULL) );
+    }
+
+  /* Return the runs. */
+  *numruns=nruns;
+  return runs;
+}
+
+
+
+
+
+/* Sum of the sky-subtracted values over the footprint when its tile
+   starts at the `start' index of the input. If any of the footprint's
+   pixels are on a label, masked or blank, this position isn't usable and
+   zero is returned (otherwise 1). In each run, the pixels are first
+   checked without any dependency between them (so the compiler can
+   vectorize the loops), then they are added. */
+static int
+upperlimit_footprint_sum(struct mkcatalogparams *p, size_t *runs,
+                         size_t nruns, size_t start, double *out)
+{
+  int bad;
+  int32_t *O;
+  float *I, *SK;
+  uint8_t *M=NULL;
+  double sum=0.0f;
+  size_t r, i, len;
+
+  for(r=0;r<nruns;++r)
+    {
+      /* Pointers to the start of this run. */
+      len = runs[2*r+1];
+      I   = (float   *)(p->input->array)   + start + runs[2*r];
+      SK  = (float   *)(p->sky->array)     + start + runs[2*r];
+      O   = (int32_t *)(p->objects->array) + start + runs[2*r];
+      if(p->upmask) M = (uint8_t *)(p->upmask->array) + start + runs[2*r];
+
+      /* See if this run is usable. */
+      bad=0;
+      for(i=0;i<len;++i) bad |= O[i]!=0;
+      if(M)           for(i=0;i<len;++i) bad |= M[i]!=0;
+      if(p->hasblank) for(i=0;i<len;++i) bad |= isnan(I[i]) ? 1 : 0;
+      if(bad) return 0;
+
+      /* Add the values. */
+      for(i=0;i<len;++i) sum += I[i]-SK[i];
+    }
+
+  /* Return the sum. */
+  *out=sum;
+  return 1;
+}
+
+
+
+
+
+/* For sorting the random positions by their place in the image. */
+struct upperlimit_position
+{
+  size_t start;                 /* Index of the tile's first pixel.     */
+  size_t    id;                 /* Order in the random positions.       */
+};
+
+static int
+upperlimit_position_cmp(const void *a, const void *b)
+{
+  size_t sa=((struct upperlimit_position *)a)->start;
+  size_t sb=((struct upperlimit_position *)b)->start;
+  return sa<sb ? -1 : (sa>sb ? 1 : 0);
+}
+
+
+
+
+
 static double
 upperlimit_one_tile(struct mkcatalog_passparams *pp, gal_data_t *tile,
                     unsigned long seed, int32_t clumplab)
@@ -268,109 +407,69 @@ upperlimit_one_tile(struct mkcatalog_passparams *pp, gal_data_t *tile,
   struct mkcatalogparams *p=pp->p;
   size_t ndim=p->input->ndim, *dsize=p->input->dsize;
 
-  void *tarray;
-  double sum, out;
-  int continueparse;
+  double out;
   gal_data_t *sigclip;
-  uint8_t *M=NULL, *st_m=NULL;
+  size_t min[2], max[2];
   float *uparr=pp->up_vals->array;
-  float *I, *II, *SK, *st_i, *st_sky;
-  size_t d, tcounter=0, counter=0, se_inc[2];
-  size_t min[2], max[2], increment, num_increment;
-  int32_t *O, *oO, *st_o, *st_oo, *st_oc, *oC=NULL;
+  struct upperlimit_position *pos;
+  size_t d, i, n, nruns, *runs, tcounter=0, counter=0;
   size_t maxcount = p->upnum * MKCATALOG_UPPERLIMIT_STOP_MULTIP;
+  uint8_t *good=gal_data_malloc_array(GAL_TYPE_UINT8, p->upnum, __func__,
+                                      "good");
+  double *sums=gal_data_malloc_array(GAL_TYPE_FLOAT64, p->upnum, __func__,
+                                     "sums");
   size_t *rcoord=gal_data_malloc_array(GAL_TYPE_SIZE_T, ndim, __func__,
                                        "rcoord");
 
+  /* Allocate space for the random positions. */
+  errno=0;
+  pos=malloc(p->upnum * sizeof *pos);
+  if(pos==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for `pos'",
+          __func__, p->upnum * sizeof *pos);
+
   /* Initializations. */
-  tarray=tile->array;
   gsl_rng_set(pp->rng, seed);
+  runs=upperlimit_footprint_runs(pp, tile, clumplab, &nruns);
 
 
   /* Set the range of random values for this tile. */
   upperlimit_random_range(pp, tile, min, max, clumplab);
 
 
-  /* `se_inc' is just used temporarily, the important thing here is
-     `st_oo'. */
-  st_oo = ( clumplab
-            ? gal_tile_start_end_ind_inclusive(tile, p->objects, se_inc)
-            : pp->st_o );
-  st_oc = clumplab ? (int32_t *)(p->clumps->array) + se_inc[0] : NULL;
-
-
-  /* Continue measuring randomly until we get the desired total number. */
+  /* Continue measuring randomly until we get the desired total number. In
+     each round, we only take as many random positions as are still
+     necessary. So the random positions (and thus the result) are the same
+     as taking them one by one. */
   while(tcounter<maxcount && counter<p->upnum)
     {
-      /* Get the random coordinates. */
-      for(d=0;d<ndim;++d)
-        rcoord[d] = upperlimit_random_position(pp, tile, d, min, max);
-
-      /* Set the tile's new starting pointer. */
-      tile->array = gal_data_ptr_increment(p->input->array,
-                          gal_dimension_coord_to_index(ndim, dsize, rcoord),
-                                           p->input->type);
-
-      /* Starting and ending coordinates for this random position, note
-         that in `pp' we have the starting and ending coordinates of the
-         actual tile. */
-      increment     = 0;
-      num_increment = 1;
-      continueparse = 1;
-      sum           = 0.0f;
-
-      /* Starting pointers for the random tile. */
-      st_i   = gal_tile_start_end_ind_inclusive(tile, p->input, se_inc);
-      st_o               = (int32_t *)(p->objects->array) + se_inc[0];
-      st_sky             = (float   *)(p->sky->array)     + se_inc[0];
-      if(p->upmask) st_m = (uint8_t *)(p->upmask->array)  + se_inc[0];
-
-      /* Parse over this object/clump. */
-      while( se_inc[0] + increment <= se_inc[1] )
-        {
-          /* Set the pointers. */
-          I                = st_i   + increment;    /* Random tile.   */
-          SK               = st_sky + increment;    /* Random tile.   */
-          O                = st_o   + increment;    /* Random tile.   */
-          if(st_m) M       = st_m   + increment;    /* Random tile.   */
-          oO               = st_oo  + increment;    /* Original tile. */
-          if(clumplab) oC  = st_oc  + increment;    /* Original tile. */
-
-
-          /* Parse over this contiguous region, similar to the first and
-             second pass functions. */
-          II = I + tile->dsize[ndim-1];
-          do
-            {
-              /* Only use pixels over this object/clump. */
-              if( *oO==pp->object
-                  && ( oC==NULL || clumplab==0 || *oC==clumplab ) )
-                {
-                  if( *O || (M && *M) || ( p->hasblank && isnan(*I) ) )
-                    continueparse=0;
-                  else
-                    sum += *I-*SK;
-                }
-
-              /* Increment the other pointers. */
-              ++SK; ++O; ++oO; if(oC) ++oC;
-            }
-          while(continueparse && ++I<II);
+      /* Number of random positions in this round. */
+      n = p->upnum - counter;
+      if( n > maxcount-tcounter ) n = maxcount-tcounter;
 
-
-          /* Increment to the next contiguous region of this tile. */
-          if(continueparse)
-            increment += ( gal_tile_block_increment(p->input, dsize,
-                                                    num_increment++, NULL) );
-          else break;
+      /* Get the starting index of all the random tiles. */
+      for(i=0;i<n;++i)
+        {
+          for(d=0;d<ndim;++d)
+            rcoord[d] = upperlimit_random_position(pp, tile, d, min, max);
+          pos[i].start = gal_dimension_coord_to_index(ndim, dsize, rcoord);
+          pos[i].id    = i;
         }
 
-      /* Further processing is only necessary if this random tile
-         actually covered the sky region. */
-      if(continueparse) uparr[ counter++ ] = sum;
+      /* Measure the sums in the order of their position in the image
+         (not the random order), so nearby tiles are read together. */
+      qsort(pos, n, sizeof *pos, upperlimit_position_cmp);
+      for(i=0;i<n;++i)
+        good[ pos[i].id ] = upperlimit_footprint_sum(p, runs, nruns,
+                                                     pos[i].start,
+                                                     &sums[ pos[i].id ]);
+
+      /* Keep the usable sums (in the random order). */
+      for(i=0;i<n;++i)
+        if(good[i]) uparr[ counter++ ] = sums[i];
 
       /* Increment the total-counter. */
-      ++tcounter;
+      tcounter += n;
     }
 
   /* Calculate the standard deviation of this distribution. */
@@ -382,8 +481,11 @@ upperlimit_one_tile(struct mkcatalog_passparams *pp, gal_data_t *tile,
     }
   else out=NAN;
 
-  /* Reset the tile's array pointer, clean up and return. */
-  tile->array=tarray;
+  /* Clean up and return. */
+  free(pos);
+  free(runs);
+  free(good);
+  free(sums);
   free(rcoord);
   return out;
 }
@@ -620,7 +620,8 @@ ui_read_cols(struct mkprofparams *p)
 
   /* Read the desired columns from the file. */
   cols=gal_table_read(p->catname, p->cp.hdu, colstrs, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize);
+                      p->cp.ignorecase, p->cp.numthreads,
+                      p->cp.minmapsize);
 
   /* Set the number of objects. */
   p->num=cols->size;
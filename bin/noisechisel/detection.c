@@ -78,7 +78,8 @@ detection_initial(struct noisechiselparams *p)
 
   /* Erode the image. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  gal_binary_erode(p->binary, p->erode, p->erodengb==4 ? 1 : 2, 1);
+  gal_binary_erode(p->binary, p->erode, p->erodengb==4 ? 1 : 2, 1,
+                   p->cp.numthreads);
   if(!p->cp.quiet)
     {
       asprintf(&msg, "Eroded %zu time%s (%zu-connectivity).", p->erode,
@@ -101,7 +102,8 @@ detection_initial(struct noisechiselparams *p)
 
   /* Do the opening. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  gal_binary_open(p->binary, p->opening, p->openingngb==4 ? 1 : 2, 1);
+  gal_binary_open(p->binary, p->opening, p->openingngb==4 ? 1 : 2, 1,
+                  p->cp.numthreads);
   if(!p->cp.quiet)
     {
       asprintf(&msg, "Opened (depth: %zu, %s connectivity).",
@@ -113,7 +115,8 @@ detection_initial(struct noisechiselparams *p)
 
   /* Label the connected components. */
   p->numinitialdets=gal_binary_connected_components(p->binary, &p->olabel,
-                                                    p->binary->ndim);
+                                                    p->binary->ndim,
+                                                    p->cp.numthreads);
   if(p->detectionname)
     {
       p->olabel->name="OPENED_AND_LABELED";
@@ -220,7 +223,7 @@ detection_fill_holes_open(void *in_prm)
      the initially allocated space for this tile is only 1 pixel! */
   copy=gal_data_alloc(NULL, GAL_TYPE_UINT8, p->input->ndim, dsize,
                       NULL, 0, -1, NULL, NULL, NULL);
-  free(copy->array);
+  gal_data_release_array(copy);
   copy->array=&fho_prm->copyspace[p->maxltcontig*tprm->id];
 
 
@@ -254,7 +257,7 @@ detection_fill_holes_open(void *in_prm)
         }
 
       /* Open all the regions. */
-      gal_binary_open(copy, 1, 1, 1);
+      gal_binary_open(copy, 1, 1, 1, 1);
 
       /* Write the copied region back into the large input and AFTERWARDS,
          correct the tile's pointers, the pointers must not be corrected
@@ -285,6 +288,8 @@ static size_t
 detection_pseudo_find(struct noisechiselparams *p, gal_data_t *workbin,
                       gal_data_t *worklab, int s0d1)
 {
+  void *tmparray;
+  char *tmpname;
   gal_data_t *bin;
   struct fho_params fho_prm={0, NULL, workbin, worklab, p};
 
@@ -356,20 +361,14 @@ detection_pseudo_find(struct noisechiselparams *p, gal_data_t *workbin,
         }
 
       /* Clean up: the array in `bin' should just be replaced with that in
-         `workbin' because it is used in later steps. */
-      if(workbin->mmapname)
-        {
-          /* Delete the memory mapped file and set the filename of `bin'
-             for `workbin'. */
-          remove(workbin->mmapname);
-          free(workbin->mmapname);
-          workbin->mmapname=bin->mmapname;
-          bin->mmapname=NULL;
-        }
-      else
-        free(workbin->array);
-      workbin->array=bin->array;
-      bin->name=bin->array=NULL;
+         `workbin' because it is used in later steps. The two arrays (and
+         their possible memory-mapped files) are swapped, so the old array
+         of `workbin' is freed (or unmapped) along with `bin'. */
+      tmparray=workbin->array;     workbin->array=bin->array;
+      bin->array=tmparray;
+      tmpname=workbin->mmapname;   workbin->mmapname=bin->mmapname;
+      bin->mmapname=tmpname;
+      bin->name=NULL;
       gal_data_free(bin);
     }
   else
@@ -392,7 +391,8 @@ detection_pseudo_find(struct noisechiselparams *p, gal_data_t *workbin,
       do if(*b==GAL_BLANK_UINT8) *b = !s0d1; while(++b<bf);
     }
   */
-  return gal_binary_connected_components(workbin, &worklab, 1);
+  return gal_binary_connected_components(workbin, &worklab, 1,
+                                         p->cp.numthreads);
 }
 
 
@@ -977,12 +977,13 @@ detection_quantile_expand(struct noisechiselparams *p, gal_data_t *workbin)
   o=p->olabel->array;
   bf=(b=workbin->array)+workbin->size;
   do *b = (*o++ == 1); while(++b<bf);
-  workbin=gal_binary_dilate(workbin, 1, 1, 1);
+  workbin=gal_binary_dilate(workbin, 1, 1, 1, p->cp.numthreads);
   gal_binary_fill_holes(workbin, 1, p->detgrowmaxholesize);
 
   /* Get the labeled image. */
   numexpanded=gal_binary_connected_components(workbin, &p->olabel,
-                                              workbin->ndim);
+                                              workbin->ndim,
+                                              p->cp.numthreads);
 
   /* Set all the input's blank pixels to blank in the labeled and binary
      arrays. */
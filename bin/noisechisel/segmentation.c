@@ -375,7 +375,7 @@ segmentation_on_threads(void *in_prm)
   struct clumps_params *clprm=(struct clumps_params *)(tprm->params);
   struct noisechiselparams *p=clprm->p;
 
-  size_t i, *s, *sf;
+  size_t index, *s, *sf;
   gal_data_t *topinds;
   struct clumps_thread_params cltprm;
   int32_t *clabel=p->clabel->array, *olabel=p->olabel->array;
@@ -383,13 +383,15 @@ segmentation_on_threads(void *in_prm)
   /* Initialize the general parameters for this thread. */
   cltprm.clprm   = clprm;
 
-  /* Go over all the detections given to this thread (counting from zero.) */
-  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+  /* Go over all the detections given to this thread (counting from zero.)
+     The detections are scheduled dynamically (largest first), see
+     `segmentation_detections'. */
+  while( (index=gal_threads_next_action(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* Set the ID of this detection, note that for the threads, we
          counted from zero, but the IDs start from 1, so we'll add a 1 to
          the ID given to this thread. */
-      cltprm.id     = tprm->indexs[i]+1;
+      cltprm.id     = index+1;
       cltprm.indexs = &clprm->labindexs[ cltprm.id ];
 
 
@@ -630,6 +632,7 @@ static void
 segmentation_detections(struct noisechiselparams *p)
 {
   char *msg;
+  size_t i, *costs;
   struct clumps_params clprm;
   gal_data_t *labindexs, *claborig, *demo=NULL;
 
@@ -638,6 +641,18 @@ segmentation_detections(struct noisechiselparams *p)
   labindexs=clumps_det_label_indexs(p);
 
 
+  /* The processing time of each detection strongly depends on its area
+     and a few detections can be much larger than the rest. So the
+     detections are scheduled dynamically between the threads with the
+     largest ones first (so a thread working on a large detection doesn't
+     hold back the others). */
+  costs = ( p->numdetections
+            ? gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numdetections,
+                                    __func__, "costs")
+            : NULL );
+  for(i=0;i<p->numdetections;++i) costs[i]=labindexs[i+1].size;
+
+
   /* Initialize the necessary thread parameters. Note that since the object
      labels begin from one, the `sn' array will have one extra element.*/
   clprm.p=p;
@@ -676,8 +691,9 @@ segmentation_detections(struct noisechiselparams *p)
                    claborig->size*gal_type_sizeof(claborig->type));
 
           /* (Re-)do everything until this step. */
-          gal_threads_spin_off(segmentation_on_threads, &clprm,
-                               p->numdetections, p->cp.numthreads);
+          gal_threads_spin_off_sched(segmentation_on_threads, &clprm,
+                                     p->numdetections, p->cp.numthreads,
+                                     GAL_THREADS_SCHEDULE_DYNAMIC, costs);
 
           /* Set the extension name. */
           switch(clprm.step)
@@ -797,8 +813,9 @@ segmentation_detections(struct noisechiselparams *p)
   else
     {
       clprm.step=0;
-      gal_threads_spin_off(segmentation_on_threads, &clprm, p->numdetections,
-                           p->cp.numthreads);
+      gal_threads_spin_off_sched(segmentation_on_threads, &clprm,
+                                 p->numdetections, p->cp.numthreads,
+                                 GAL_THREADS_SCHEDULE_DYNAMIC, costs);
     }
 
 
@@ -811,6 +828,7 @@ segmentation_detections(struct noisechiselparams *p)
 
 
   /* Clean up allocated structures and destroy the mutex. */
+  free(costs);
   gal_data_array_free(clprm.sn, p->numdetections+1, 1);
   gal_data_array_free(labindexs, p->numdetections+1, 1);
   if( p->cp.numthreads>1 ) pthread_mutex_destroy(&clprm.labmutex);
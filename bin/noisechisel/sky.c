@@ -58,9 +58,16 @@ sky_mean_std_undetected(void *in_prm)
   double *darr, s, s2;
   int type=p->sky->type;
   size_t i, tind, numsky, dsize=2;
+  gal_data_pool_t *pool, *prevpool;
   gal_data_t *tile, *meanstd_d, *meanstd, *bintile;
 
 
+  /* The converted mean and STD of each tile are re-allocated from this
+     thread's pool. */
+  pool=gal_data_pool_alloc(dsize*sizeof *darr);
+  prevpool=gal_data_pool_use(pool);
+
+
   /* A dataset to keep the mean and STD in double type. */
   meanstd_d=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &dsize,
                            NULL, 0, -1, NULL, NULL, NULL);
@@ -70,7 +77,7 @@ sky_mean_std_undetected(void *in_prm)
   /* An empty dataset to replicate a tile on the binary array. */
   bintile=gal_data_alloc(NULL, GAL_TYPE_UINT8, 1, &dsize,
                          NULL, 0, -1, NULL, NULL, NULL);
-  free(bintile->array);
+  gal_data_release_array(bintile);
   free(bintile->dsize);
   bintile->block=p->binary;
   bintile->ndim=p->binary->ndim;
@@ -136,6 +143,8 @@ sky_mean_std_undetected(void *in_prm)
   bintile->dsize=NULL;
   gal_data_free(bintile);
   gal_data_free(meanstd_d);
+  gal_data_pool_use(prevpool);
+  gal_data_pool_free(pool);
   if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
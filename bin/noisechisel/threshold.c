@@ -387,10 +387,18 @@ qthresh_on_tile(void *in_prm)
   double *darr;
   void *tarray=NULL;
   int type=qprm->erode_th->type;
+  size_t numq = p->detgrowquant!=1.0f ? 3 : 2;
+  double quants[3]={p->qthresh, p->noerodequant, p->detgrowquant};
+  gal_data_pool_t *pool, *prevpool;
   gal_data_t *modeconv = p->wconv ? p->wconv : p->conv;
   gal_data_t *tile, *mode, *qvalue, *usage, *tblock=NULL;
   size_t i, tind, twidth=gal_type_sizeof(type), ndim=p->input->ndim;
 
+  /* The temporary datasets of each tile are re-allocated from this
+     thread's pool (the tile's values are copied into `usage'). */
+  pool=gal_data_pool_alloc(p->maxtcontig*twidth);
+  prevpool=gal_data_pool_use(pool);
+
   /* Put the temporary usage space for this thread into a data set for easy
      processing. */
   usage=gal_data_alloc(gal_data_ptr_increment(qprm->usage,
@@ -424,8 +432,20 @@ qthresh_on_tile(void *in_prm)
 
 
       /* Find the mode on this tile, note that we have set the `inplace'
-         flag to `1' to avoid extra allocation. */
-      mode=gal_statistics_mode(usage, p->mirrordist, 1);
+         flag to `1' to avoid extra allocation. When the mode and the
+         quantiles are found on the same image, they are all found
+         together, so the tile is only sorted once. */
+      if(modeconv==p->conv)
+        {
+          qvalue=gal_statistics_quantiles(usage, quants, numq,
+                                          p->mirrordist, 1);
+          mode=qvalue->next;
+        }
+      else
+        {
+          qvalue=NULL;
+          mode=gal_statistics_mode(usage, p->mirrordist, 1);
+        }
 
 
       /* Check the mode value. Note that if the mode is not accurate, then
@@ -440,8 +460,9 @@ qthresh_on_tile(void *in_prm)
              with a wider kernel, helping us find tiles with no data more
              easily. But for the quantile threshold, we want to use the
              sharper convolved image to loose less of the spatial
-             information. */
-          if(modeconv!=p->conv)
+             information. All the quantiles are found with one call, so
+             the tile's elements are only ordered once. */
+          if(qvalue==NULL)
             {
               tarray=tile->array; tblock=tile->block;
               tile->array=gal_tile_block_relative_to_other(tile, p->conv);
@@ -450,30 +471,20 @@ qthresh_on_tile(void *in_prm)
               usage->size=p->maxtcontig;    /* place, it needs to be       */
               gal_data_copy_to_allocated(tile, usage);  /* re-initialized. */
               tile->array=tarray; tile->block=tblock;
+              qvalue=gal_statistics_quantiles(usage, quants, numq, 0, 1);
             }
 
-          /* Get the erosion quantile for this tile and save it. Note that
-             the type of `qvalue' is the same as the input dataset. */
-          qvalue=gal_statistics_quantile(usage, p->qthresh, 1);
+          /* Save the erosion, no-erode and (if necessary) expansion
+             quantiles of this tile. Note that the type of `qvalue' is the
+             same as the input dataset. */
           memcpy(gal_data_ptr_increment(qprm->erode_th->array, tind, type),
-                 qvalue->array, twidth);
-          gal_data_free(qvalue);
-
-          /* Same for the no-erode quantile. */
-          qvalue=gal_statistics_quantile(usage, p->noerodequant, 1);
+                 gal_data_ptr_increment(qvalue->array, 0, type), twidth);
           memcpy(gal_data_ptr_increment(qprm->noerode_th->array, tind, type),
-                 qvalue->array, twidth);
-          gal_data_free(qvalue);
-
-          /* Same for the expansion quantile. */
+                 gal_data_ptr_increment(qvalue->array, 1, type), twidth);
           if(p->detgrowquant!=1.0f)
-            {
-              qvalue=gal_statistics_quantile(usage, p->detgrowquant, 1);
-              memcpy(gal_data_ptr_increment(qprm->expand_th->array, tind,
-                                            type),
-                     qvalue->array, twidth);
-              gal_data_free(qvalue);
-            }
+            memcpy(gal_data_ptr_increment(qprm->expand_th->array, tind,
+                                          type),
+                   gal_data_ptr_increment(qvalue->array, 2, type), twidth);
         }
       else
         {
@@ -486,13 +497,16 @@ qthresh_on_tile(void *in_prm)
                                                    tind, type), type);
         }
 
-      /* Clean up and fix the tile's pointers. */
+      /* Clean up. */
+      if(qvalue) { qvalue->next=NULL; gal_data_free(qvalue); }
       gal_data_free(mode);
     }
 
   /* Clean up and wait for the other threads to finish, then return. */
   usage->array=NULL;  /* Not allocated here. */
   gal_data_free(usage);
+  gal_data_pool_use(prevpool);
+  gal_data_pool_free(pool);
   if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
@@ -54,8 +54,18 @@ sky_on_thread(void *in_prm)
   double *darr;
   int stype=p->sky_t->type;
   void *tblock=NULL, *tarray=NULL;
+  gal_data_pool_t *pool, *prevpool;
   gal_data_t *tile, *mode, *sigmaclip;
-  size_t i, tind, twidth=gal_type_sizeof(stype);
+  size_t i, tind, maxtsize=0, twidth=gal_type_sizeof(stype);
+
+
+  /* The temporary datasets of each tile (most importantly the copies of
+     its values) are re-allocated from this thread's pool. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    if(p->cp.tl.tiles[tprm->indexs[i]].size > maxtsize)
+      maxtsize=p->cp.tl.tiles[tprm->indexs[i]].size;
+  pool=gal_data_pool_alloc(maxtsize*gal_type_sizeof(p->input->type));
+  prevpool=gal_data_pool_use(pool);
 
 
   /* Find the Sky and its standard deviation on the tiles given to this
@@ -116,7 +126,9 @@ sky_on_thread(void *in_prm)
     }
 
 
-  /* Wait for all threads to finish and return. */
+  /* Clean up, wait for all threads to finish and return. */
+  gal_data_pool_use(prevpool);
+  gal_data_pool_free(pool);
   if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
@@ -261,15 +261,111 @@ statistics_interpolate_and_write(struct statisticsparams *p,
 
 
 
+/* The quantiles and the mode need the order of each tile's elements. So
+   when they are requested, they are all found in one pass over the tiles
+   before the other operations (with `gal_statistics_quantiles'), so each
+   tile is only ordered once. The output has one row for each tile: the
+   requested quantiles (in the order of the operations) are the first
+   columns and when any of the mode operations is requested, the four
+   outputs of `gal_statistics_mode' are the last four columns. */
+static gal_data_t *
+statistics_on_tile_ordered(struct statisticsparams *p, size_t *numcols)
+{
+  int withmode=0;
+  double *o, *q=NULL;
+  gal_list_f64_t *arg;
+  gal_list_i32_t *operation;
+  gal_data_t *tile, *qval, *mode, *out;
+  size_t i, numq=0, dsize[2];
+  struct gal_tile_two_layer_params *tl=&p->cp.tl;
+
+  /* Count the quantiles and see if the mode is necessary. */
+  for(operation=p->singlevalue; operation!=NULL; operation=operation->next)
+    switch(operation->v)
+      {
+      case UI_KEY_QUANTILE:      ++numq;      break;
+      case UI_KEY_MODE:
+      case UI_KEY_MODESYM:
+      case UI_KEY_MODEQUANT:
+      case UI_KEY_MODESYMVALUE:  withmode=1;  break;
+      }
+  if(numq==0 && withmode==0) return NULL;
+
+  /* Read the quantiles. The arguments are in the same order as the
+     operations that need them (quantiles and quantile functions). They
+     are only popped from the list in `statistics_on_tile'. */
+  if(numq)
+    {
+      i=0;
+      arg=p->tp_args;
+      q=gal_data_malloc_array(GAL_TYPE_FLOAT64, numq, __func__, "q");
+      for(operation=p->singlevalue; operation!=NULL;
+          operation=operation->next)
+        if(operation->v==UI_KEY_QUANTILE || operation->v==UI_KEY_QUANTFUNC)
+          {
+            if(arg==NULL)
+              error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s "
+                    "so we can address the problem. Not enough arguments "
+                    "for the requested single measurement options",
+                    __func__, PACKAGE_BUGREPORT);
+            if(operation->v==UI_KEY_QUANTILE) q[i++]=arg->v;
+            arg=arg->next;
+          }
+    }
+
+  /* Allocate the output. */
+  dsize[0]=tl->tottiles;
+  dsize[1]=*numcols=numq+(withmode ? 4 : 0);
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize, NULL, 0,
+                     p->input->minmapsize, NULL, NULL, NULL);
+
+  /* Find the values on each tile. */
+  o=out->array;
+  for(tile=tl->tiles; tile!=NULL; tile=tile->next)
+    {
+      /* Do the measurements. */
+      if(numq)
+        {
+          qval=gal_statistics_quantiles(tile, q, numq,
+                                        withmode ? p->mirrordist : NAN, 1);
+          mode=qval->next;
+          qval->next=NULL;
+          qval=gal_data_copy_to_new_type_free(qval, GAL_TYPE_FLOAT64);
+          memcpy(o, qval->array, numq*sizeof *o);
+          gal_data_free(qval);
+        }
+      else
+        mode=gal_statistics_mode(tile, p->mirrordist, 1);
+
+      /* Write the mode's outputs. */
+      if(mode)
+        {
+          memcpy(o+numq, mode->array, 4*sizeof *o);
+          gal_data_free(mode);
+        }
+
+      /* Go onto the next row. */
+      o+=*numcols;
+    }
+
+  /* Clean up and return. */
+  free(q);
+  return out;
+}
+
+
+
+
+
 static void
 statistics_on_tile(struct statisticsparams *p)
 {
   double arg=0;
   gal_list_i32_t *operation;
-  gal_data_t *tile, *values;
-  size_t tind, dsize=1, mind=-1;
+  gal_data_t *tile, *values, *ordered;
+  size_t tind, dsize=1, mind=-1, qind=0, numcols=0;
   uint8_t type=GAL_TYPE_INVALID;
-  gal_data_t *tmp=NULL, *tmpv=NULL, *ttmp;
+  gal_data_t *tmp=NULL, *tmpv=NULL;
   struct gal_options_common_params *cp=&p->cp;
   struct gal_tile_two_layer_params *tl=&p->cp.tl;
   char *output=gal_checkset_automatic_output(cp, cp->output
@@ -277,6 +373,9 @@ statistics_on_tile(struct statisticsparams *p)
                                              : p->inputname,
                                              "_ontile.fits");
 
+  /* Find the values that need the tiles to be ordered. */
+  ordered=statistics_on_tile_ordered(p, &numcols);
+
   /* Do the operation on each tile. */
   for(operation=p->singlevalue; operation!=NULL; operation=operation->next)
     {
@@ -315,8 +414,8 @@ statistics_on_tile(struct statisticsparams *p)
          here, because below, the functions are repeated on each tile. */
       switch(operation->v)
         {
-        case UI_KEY_QUANTILE:
-          arg = statistics_read_check_args(p);
+        case UI_KEY_QUANTILE:   /* Already used in `ordered'. */
+          statistics_read_check_args(p);
           break;
         case UI_KEY_QUANTFUNC:
           arg = statistics_read_check_args(p);
@@ -358,7 +457,8 @@ statistics_on_tile(struct statisticsparams *p)
               tmp=gal_statistics_std(tile);                         break;
 
             case UI_KEY_QUANTILE:
-              tmp=gal_statistics_quantile(tile, arg, 1);            break;
+              tmp=statistics_pull_out_element(ordered,
+                                              tind*numcols+qind);   break;
 
             case UI_KEY_MODE:
             case UI_KEY_MODESYM:
@@ -371,10 +471,8 @@ statistics_on_tile(struct statisticsparams *p)
                 case UI_KEY_MODEQUANT:    mind=1;  break;
                 case UI_KEY_MODESYMVALUE: mind=3;  break;
                 }
-              tmp=gal_statistics_mode(tile, p->mirrordist, 1);
-              ttmp=statistics_pull_out_element(tmp, mind);
-              gal_data_free(tmp);
-              tmp=ttmp;
+              tmp=statistics_pull_out_element(ordered,
+                                              tind*numcols+numcols-4+mind);
               break;
 
             default:
@@ -396,10 +494,12 @@ statistics_on_tile(struct statisticsparams *p)
 
       /* Clean up. */
       gal_data_free(values);
+      if(operation->v==UI_KEY_QUANTILE) ++qind;
       if(operation->v==UI_KEY_QUANTFUNC) gal_data_free(tmpv);
     }
 
   /* Clean up. */
+  gal_data_free(ordered);
   free(output);
 }
 
@@ -612,7 +612,8 @@ ui_out_of_range_to_blank(struct statisticsparams *p)
       tmp=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &one, NULL, 0, -1,
                         NULL, NULL, NULL);
       *((float *)(tmp->array)) = p->greaterequal;
-      cond_g=gal_arithmetic(GAL_ARITHMETIC_OP_LT, flags, ref, tmp);
+      cond_g=gal_arithmetic(GAL_ARITHMETIC_OP_LT, p->cp.numthreads, flags,
+                            ref, tmp);
       gal_data_free(tmp);
     }
 
@@ -623,7 +624,8 @@ ui_out_of_range_to_blank(struct statisticsparams *p)
       tmp=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &one, NULL, 0, -1,
                         NULL, NULL, NULL);
       *((float *)(tmp->array)) = p->lessthan;
-      cond_l=gal_arithmetic(GAL_ARITHMETIC_OP_GE, flags, ref, tmp);
+      cond_l=gal_arithmetic(GAL_ARITHMETIC_OP_GE, p->cp.numthreads, flags,
+                            ref, tmp);
       gal_data_free(tmp);
     }
 
@@ -637,7 +639,8 @@ ui_out_of_range_to_blank(struct statisticsparams *p)
       cond = isnan(p->greaterequal) ? cond_l : cond_g;
       break;
     case 2:
-      cond = gal_arithmetic(GAL_ARITHMETIC_OP_OR, flagsor, cond_l, cond_g);
+      cond = gal_arithmetic(GAL_ARITHMETIC_OP_OR, p->cp.numthreads, flagsor,
+                            cond_l, cond_g);
       break;
     }
 
@@ -652,7 +655,8 @@ ui_out_of_range_to_blank(struct statisticsparams *p)
   /* Set all the pixels that satisfy the condition to blank. Note that a
      blank value will be used in the proper type of the input in the
      `where' operator.*/
-  gal_arithmetic(GAL_ARITHMETIC_OP_WHERE, flagsor, p->input, cond, blank);
+  gal_arithmetic(GAL_ARITHMETIC_OP_WHERE, p->cp.numthreads, flagsor, p->input,
+                 cond, blank);
 }
 
 
@@ -694,7 +698,7 @@ ui_make_sorted_if_necessary(struct statisticsparams *p)
       else
         {
           p->sorted=gal_data_copy(p->input);
-          gal_statistics_sort_increasing(p->sorted);
+          gal_statistics_sort_increasing(p->sorted, p->cp.numthreads);
         }
     }
 }
@@ -719,7 +723,8 @@ ui_read_columns(struct statisticsparams *p)
 
   /* Read the desired column(s). */
   cols=gal_table_read(p->inputname, p->cp.hdu, column, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize);
+                      p->cp.ignorecase, p->cp.numthreads,
+                      p->cp.minmapsize);
 
   /* Put the columns into the proper gal_data_t. */
   size=cols->size;
@@ -782,7 +787,8 @@ ui_preparations(struct statisticsparams *p)
   if(p->isfits && p->hdu_type==IMAGE_HDU)
     {
       p->inputformat=INPUT_FORMAT_IMAGE;
-      p->input=gal_fits_img_read(p->inputname, cp->hdu, cp->minmapsize, 0, 0);
+      p->input=gal_fits_img_read_mmap(p->inputname, cp->hdu, cp->numthreads,
+                                      cp->minmapsize, 0, 0);
     }
   else
     {
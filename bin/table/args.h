@@ -62,6 +62,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "cache",
+      UI_KEY_CACHE,
+      0,
+      0,
+      "Write columnar cache of input for fast reading.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->cache,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
     {0}
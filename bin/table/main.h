@@ -47,6 +47,7 @@ struct tableparams
   char              *filename;  /* Input filename.                      */
   gal_list_str_t     *columns;  /* List of given columns.               */
   uint8_t         information;  /* ==1, only print FITS information.    */
+  uint8_t               cache;  /* ==1, write columnar cache of input.  */
 
   /* Output: */
   gal_data_t           *table;  /* Linked list of output table columns. */
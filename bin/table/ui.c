@@ -317,9 +317,16 @@ ui_preparations(struct tableparams *p)
   if(p->information)
     ui_print_info_exit(p);
 
+  /* Write the columnar cache of the input table if requested. It is
+     written before reading the columns, so they are read from it. */
+  if(p->cache)
+    gal_table_cache_write(p->filename, cp->hdu, cp->numthreads,
+                          cp->minmapsize);
+
   /* Read in the table columns. */
   p->table=gal_table_read(p->filename, cp->hdu, p->columns, cp->searchin,
-                          cp->ignorecase, cp->minmapsize);
+                          cp->ignorecase, cp->numthreads,
+                          cp->minmapsize);
 
   /* If there was no actual data in the file, then inform the user and
      abort. */
@@ -43,6 +43,7 @@ enum option_keys_enum
 
   /* Only with long version (start with a value 1000, the rest will be set
      automatically). */
+  UI_KEY_CACHE       = 1000,
 };
 
 
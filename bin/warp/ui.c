@@ -418,7 +418,7 @@ ui_matrix_prepare_raw(struct warpparams *p)
       final[6]=0.0f;     final[7]=0.0f;    final[8]=1.0f;
 
       /* Free the old matrix array and put in the new one. */
-      free(p->matrix->array);
+      gal_data_release_array(p->matrix);
       p->matrix->size=9;
       p->matrix->array=final;
     }
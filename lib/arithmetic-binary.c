@@ -28,6 +28,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 
 #include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/arithmetic.h>
 
 #include <gnuastro-internal/arithmetic-internal.h>
@@ -196,34 +197,68 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /************************************************************************/
 /*************              High level macros           *****************/
 /************************************************************************/
-/* Final step to be used by all operators and all types. */
+/* Final step to be used by all operators and all types. Each call only
+   works on the elements from `start' to `end' (a contiguous range of the
+   output) so it can be run on multiple threads. The loops are written
+   over indexs (with the checks outside of them) so the compiler can
+   vectorize them. */
 #define BINARY_OP_OT_RT_LT_SET(OP, OT, RT, LT) {                        \
-    LT lb, *la=l->array;                                                \
-    RT rb, *ra=r->array;                                                \
-    OT ob, *oa=o->array, *of=oa + o->size;                              \
+    size_t i;                                                           \
+    LT lb, lv, *la=l->array;                                            \
+    RT rb, rv, *ra=r->array;                                            \
+    OT ob, *oa=o->array;                                                \
     if(checkblank)                                                      \
       {                                                                 \
         gal_blank_write(&lb, l->type);                                  \
         gal_blank_write(&rb, r->type);                                  \
         gal_blank_write(&ob, o->type);                                  \
-        do                                                              \
+        if(l->size==r->size)                                            \
           {                                                             \
             if(lb==lb && rb==rb)/* Both are integers.                */ \
-              *oa = (*la!=lb  && *ra!=rb)  ? *la OP *ra : ob ;          \
+              for(i=start;i<end;++i)                                    \
+                oa[i] = (la[i]!=lb && ra[i]!=rb) ? la[i] OP ra[i] : ob; \
             else if(lb==lb)     /* Only left operand is an integer.  */ \
-              *oa = (*la!=lb  && *ra==*ra) ? *la OP *ra : ob;           \
+              for(i=start;i<end;++i)                                    \
+                oa[i] = (la[i]!=lb && ra[i]==ra[i])                     \
+                  ? la[i] OP ra[i] : ob;                                \
             else                /* Only right operand is an integer. */ \
-              *oa = (*la==*la && *ra!=rb)  ? *la OP *ra : ob;           \
-            if(l->size>1) ++la;                                         \
-            if(r->size>1) ++ra;                                         \
+              for(i=start;i<end;++i)                                    \
+                oa[i] = (la[i]==la[i] && ra[i]!=rb)                     \
+                  ? la[i] OP ra[i] : ob;                                \
+          }                                                             \
+        else if(l->size==1)                                             \
+          {                                                             \
+            lv=*la;                                                     \
+            if( lb==lb ? lv==lb : lv!=lv )                              \
+              for(i=start;i<end;++i) oa[i]=ob;                          \
+            else if(rb==rb)                                             \
+              for(i=start;i<end;++i)                                    \
+                oa[i] = ra[i]!=rb    ? lv OP ra[i] : ob;                \
+            else                                                        \
+              for(i=start;i<end;++i)                                    \
+                oa[i] = ra[i]==ra[i] ? lv OP ra[i] : ob;                \
+          }                                                             \
+        else                                                            \
+          {                                                             \
+            rv=*ra;                                                     \
+            if( rb==rb ? rv==rb : rv!=rv )                              \
+              for(i=start;i<end;++i) oa[i]=ob;                          \
+            else if(lb==lb)                                             \
+              for(i=start;i<end;++i)                                    \
+                oa[i] = la[i]!=lb    ? la[i] OP rv : ob;                \
+            else                                                        \
+              for(i=start;i<end;++i)                                    \
+                oa[i] = la[i]==la[i] ? la[i] OP rv : ob;                \
           }                                                             \
-        while(++oa<of);                                                 \
       }                                                                 \
     else                                                                \
       {                                                                 \
-        if(l->size==r->size) do *oa = *la++ OP *ra++; while(++oa<of);   \
-        else if(l->size==1)  do *oa = *la   OP *ra++; while(++oa<of);   \
-        else                 do *oa = *la++ OP *ra;   while(++oa<of);   \
+        if(l->size==r->size)                                            \
+          for(i=start;i<end;++i) oa[i] = la[i] OP ra[i];                \
+        else if(l->size==1)                                             \
+          { lv=*la; for(i=start;i<end;++i) oa[i] = lv OP ra[i]; }       \
+        else                                                            \
+          { rv=*ra; for(i=start;i<end;++i) oa[i] = la[i] OP rv; }       \
       }                                                                 \
   }
 
@@ -233,12 +268,16 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /* This is for operators like `&&' and `||', where the right operator is
    not necessarily read (and thus incremented). */
 #define BINARY_OP_INCR_OT_RT_LT_SET(OP, OT, RT, LT) {                   \
+    size_t i;                                                           \
     LT *la=l->array;                                                    \
     RT *ra=r->array;                                                    \
-    OT *oa=o->array, *of=oa + o->size;                                  \
-    if(l->size==r->size) do {*oa = *la++ OP *ra; ++ra;} while(++oa<of); \
-    else if(l->size==1)  do {*oa = *la   OP *ra; ++ra;} while(++oa<of); \
-    else                 do  *oa = *la++ OP *ra;        while(++oa<of); \
+    OT *oa=o->array;                                                    \
+    if(l->size==r->size)                                                \
+      for(i=start;i<end;++i) oa[i] = la[i] OP ra[i];                    \
+    else if(l->size==1)                                                 \
+      for(i=start;i<end;++i) oa[i] = *la   OP ra[i];                    \
+    else                                                                \
+      for(i=start;i<end;++i) oa[i] = la[i] OP *ra;                      \
   }
 
 
@@ -344,20 +383,106 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/************************************************************************/
+/*************            Multi-threaded operation      *****************/
+/************************************************************************/
+struct arithmetic_binary_params
+{
+  int               operator;  /* The operator code.                     */
+  int             checkblank;  /* If blanks should be checked.           */
+  gal_data_t              *l;  /* Left operand.                          */
+  gal_data_t              *r;  /* Right operand.                         */
+  gal_data_t              *o;  /* Output.                                */
+  size_t             nchunks;  /* Number of chunks to divide output in.  */
+};
+
+
+
+
+
+/* Do the operation on one chunk of the output. */
+static void
+arithmetic_binary_chunk(struct arithmetic_binary_params *bprm, size_t chunk)
+{
+  int operator=bprm->operator, checkblank=bprm->checkblank;
+  gal_data_t *l=bprm->l, *r=bprm->r, *o=bprm->o;
+  size_t start = chunk     * o->size / bprm->nchunks;
+  size_t end   = (chunk+1) * o->size / bprm->nchunks;
+
+  /* Start setting the operator and operands. */
+  switch(l->type)
+    {
+      BINARY_LT_IS_UINT8;
+      BINARY_LT_IS_INT8;
+      BINARY_LT_IS_UINT16;
+      BINARY_LT_IS_INT16;
+      BINARY_LT_IS_UINT32;
+      BINARY_LT_IS_INT32;
+      BINARY_LT_IS_UINT64;
+      BINARY_LT_IS_INT64;
+      BINARY_LT_IS_FLOAT32;
+      BINARY_LT_IS_FLOAT64;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, l->type);
+    }
+}
+
+
+
+
+
+/* Worker function for each thread. */
+static void *
+arithmetic_binary_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct arithmetic_binary_params *bprm=tprm->params;
+
+  size_t i;
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    arithmetic_binary_chunk(bprm, tprm->indexs[i]);
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /************************************************************************/
 /*************              Top level function          *****************/
 /************************************************************************/
 gal_data_t *
-arithmetic_binary(int operator, uint8_t flags, gal_data_t *lo,
-                  gal_data_t *ro)
+arithmetic_binary(int operator, size_t numthreads, uint8_t flags,
+                  gal_data_t *lo, gal_data_t *ro)
 {
   /* Read the variable arguments. `lo' and `ro' keep the original data, in
      case their type isn't built (based on configure options are configure
      time). */
-  int checkblank;
   int32_t otype, final_otype;
   size_t out_size, minmapsize;
   gal_data_t *l, *r, *o=NULL, *tmp_o;
+  struct arithmetic_binary_params bprm;
 
 
   /* Simple sanity check on the input sizes */
@@ -426,29 +551,27 @@ arithmetic_binary(int operator, uint8_t flags, gal_data_t *lo,
      for us). It is also not necessary to check blanks in bitwise
      operators, but bitwise operators have their own macro
      (`BINARY_OP_INCR_OT_RT_LT_SET') which doesn' use `checkblanks'.*/
-  checkblank = ((((l->type!=GAL_TYPE_FLOAT32    && l->type!=GAL_TYPE_FLOAT64)
-                  || (r->type!=GAL_TYPE_FLOAT32 && r->type!=GAL_TYPE_FLOAT64))
-                 && (gal_blank_present(l, 1) || gal_blank_present(r, 1)))
-                ? 1 : 0 );
-
-
-  /* Start setting the operator and operands. */
-  switch(l->type)
-    {
-      BINARY_LT_IS_UINT8;
-      BINARY_LT_IS_INT8;
-      BINARY_LT_IS_UINT16;
-      BINARY_LT_IS_INT16;
-      BINARY_LT_IS_UINT32;
-      BINARY_LT_IS_INT32;
-      BINARY_LT_IS_UINT64;
-      BINARY_LT_IS_INT64;
-      BINARY_LT_IS_FLOAT32;
-      BINARY_LT_IS_FLOAT64;
-    default:
-      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
-            __func__, l->type);
-    }
+  bprm.checkblank = ((((l->type!=GAL_TYPE_FLOAT32
+                        && l->type!=GAL_TYPE_FLOAT64)
+                       || (r->type!=GAL_TYPE_FLOAT32
+                           && r->type!=GAL_TYPE_FLOAT64))
+                      && (gal_blank_present(l, 1) || gal_blank_present(r, 1)))
+                     ? 1 : 0 );
+
+
+  /* Do the operation. Small arrays aren't worth the overhead of spinning
+     off threads, the output is divided into one chunk per thread. */
+  bprm.l=l;
+  bprm.r=r;
+  bprm.o=o;
+  bprm.operator=operator;
+  bprm.nchunks = ( numthreads>1 && o->size>=GAL_ARITHMETIC_THREADS_MIN_SIZE
+                   ? numthreads : 1 );
+  if(bprm.nchunks==1)
+    arithmetic_binary_chunk(&bprm, 0);
+  else
+    gal_threads_spin_off(arithmetic_binary_on_thread, &bprm, bprm.nchunks,
+                         numthreads);
 
 
   /* Clean up. Note that if the input arrays can be freed, and any of right
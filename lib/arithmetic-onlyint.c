@@ -27,6 +27,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <error.h>
 #include <stdlib.h>
 
+#include <gnuastro/threads.h>
 #include <gnuastro/arithmetic.h>
 
 #include <gnuastro-internal/arithmetic-onlyint.h>
@@ -168,14 +169,20 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /************************************************************************/
 /*************              High level macros           *****************/
 /************************************************************************/
-/* Final step to be used by all operators and all types. */
+/* Final step to be used by all operators and all types. Each call only
+   works on the elements from `start' to `end' of the output, see
+   `arithmetic-binary.c'. */
 #define BINOIN_OP_OT_RT_LT_SET(OP, OT, RT, LT) {                   \
+    size_t i;                                                      \
     LT *la=l->array;                                               \
     RT *ra=r->array;                                               \
-    OT *oa=o->array, *of=oa + o->size;                             \
-    if(l->size==r->size) do *oa = *la++ OP *ra++; while(++oa<of);  \
-    else if(l->size==1)  do *oa = *la   OP *ra++; while(++oa<of);  \
-    else                 do *oa = *la++ OP *ra;   while(++oa<of);  \
+    OT *oa=o->array;                                               \
+    if(l->size==r->size)                                           \
+      for(i=start;i<end;++i) oa[i] = la[i] OP ra[i];               \
+    else if(l->size==1)                                            \
+      for(i=start;i<end;++i) oa[i] = *la   OP ra[i];               \
+    else                                                           \
+      for(i=start;i<end;++i) oa[i] = la[i] OP *ra;                 \
   }
 
 
@@ -261,12 +268,97 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/************************************************************************/
+/*************            Multi-threaded operation      *****************/
+/************************************************************************/
+struct arithmetic_onlyint_params
+{
+  int               operator;  /* The operator code.                     */
+  gal_data_t              *l;  /* Left operand.                          */
+  gal_data_t              *r;  /* Right operand.                         */
+  gal_data_t              *o;  /* Output.                                */
+  size_t             nchunks;  /* Number of chunks to divide output in.  */
+};
+
+
+
+
+
+/* Do the operation on one chunk of the output. */
+static void
+arithmetic_onlyint_chunk(struct arithmetic_onlyint_params *bprm,
+                         size_t chunk)
+{
+  int operator=bprm->operator;
+  gal_data_t *l=bprm->l, *r=bprm->r, *o=bprm->o;
+  size_t start = chunk     * o->size / bprm->nchunks;
+  size_t end   = (chunk+1) * o->size / bprm->nchunks;
+
+  /* Start setting the operator and operands. */
+  switch(l->type)
+    {
+      BINOIN_LT_IS_UINT8;
+      BINOIN_LT_IS_INT8;
+      BINOIN_LT_IS_UINT16;
+      BINOIN_LT_IS_INT16;
+      BINOIN_LT_IS_UINT32;
+      BINOIN_LT_IS_INT32;
+      BINOIN_LT_IS_UINT64;
+      BINOIN_LT_IS_INT64;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, l->type);
+    }
+}
+
+
+
+
+
+/* Worker function for each thread. */
+static void *
+arithmetic_onlyint_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct arithmetic_onlyint_params *bprm=tprm->params;
+
+  size_t i;
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    arithmetic_onlyint_chunk(bprm, tprm->indexs[i]);
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /************************************************************************/
 /*************              Top level function          *****************/
 /************************************************************************/
 gal_data_t *
-arithmetic_onlyint_binary(int operator, unsigned char flags,
-                          gal_data_t *lo, gal_data_t *ro)
+arithmetic_onlyint_binary(int operator, size_t numthreads,
+                          unsigned char flags, gal_data_t *lo,
+                          gal_data_t *ro)
 {
   /* Read the variable arguments. `lo' and `ro' keep the original data, in
      case their type isn't built (based on configure options are configure
@@ -274,6 +366,7 @@ arithmetic_onlyint_binary(int operator, unsigned char flags,
   int otype, final_otype;
   size_t out_size, minmapsize;
   gal_data_t *l, *r, *o=NULL, *tmp_o;
+  struct arithmetic_onlyint_params bprm;
   char *opstring=gal_arithmetic_operator_string(operator);
 
 
@@ -351,21 +444,18 @@ arithmetic_onlyint_binary(int operator, unsigned char flags,
                        0, minmapsize, NULL, NULL, NULL );
 
 
-  /* Start setting the operator and operands. */
-  switch(l->type)
-    {
-      BINOIN_LT_IS_UINT8;
-      BINOIN_LT_IS_INT8;
-      BINOIN_LT_IS_UINT16;
-      BINOIN_LT_IS_INT16;
-      BINOIN_LT_IS_UINT32;
-      BINOIN_LT_IS_INT32;
-      BINOIN_LT_IS_UINT64;
-      BINOIN_LT_IS_INT64;
-    default:
-      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
-            __func__, l->type);
-    }
+  /* Do the operation (see `arithmetic_binary' for the chunks). */
+  bprm.l=l;
+  bprm.r=r;
+  bprm.o=o;
+  bprm.operator=operator;
+  bprm.nchunks = ( numthreads>1 && o->size>=GAL_ARITHMETIC_THREADS_MIN_SIZE
+                   ? numthreads : 1 );
+  if(bprm.nchunks==1)
+    arithmetic_onlyint_chunk(&bprm, 0);
+  else
+    gal_threads_spin_off(arithmetic_onlyint_on_thread, &bprm, bprm.nchunks,
+                         numthreads);
 
 
   /* Clean up. Note that if the input arrays can be freed, and any of right
@@ -1408,7 +1408,7 @@ arithmetic_from_statistics(int operator, unsigned char flags,
 
 
 gal_data_t *
-gal_arithmetic(int operator, unsigned char flags, ...)
+gal_arithmetic(int operator, size_t numthreads, unsigned char flags, ...)
 {
   va_list va;
   gal_data_t *d1, *d2, *d3, *out=NULL;
@@ -1435,7 +1435,7 @@ gal_arithmetic(int operator, unsigned char flags, ...)
     case GAL_ARITHMETIC_OP_OR:
       d1 = va_arg(va, gal_data_t *);
       d2 = va_arg(va, gal_data_t *);
-      out=arithmetic_binary(operator, flags, d1, d2);
+      out=arithmetic_binary(operator, numthreads, flags, d1, d2);
       break;
 
     case GAL_ARITHMETIC_OP_NOT:
@@ -1515,7 +1515,7 @@ gal_arithmetic(int operator, unsigned char flags, ...)
     case GAL_ARITHMETIC_OP_MODULO:
       d1 = va_arg(va, gal_data_t *);
       d2 = va_arg(va, gal_data_t *);
-      out=arithmetic_onlyint_binary(operator, flags, d1, d2);
+      out=arithmetic_onlyint_binary(operator, numthreads, flags, d1, d2);
       break;
 
     case GAL_ARITHMETIC_OP_BITNOT:
@@ -32,6 +32,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/tile.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/binary.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/dimension.h>
 
 
@@ -43,177 +44,248 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 /*********************************************************************/
-/*****************      Erosion and dilation      ********************/
+/*****************         Neighboring rows        *******************/
 /*********************************************************************/
-static void
-binary_erode_dilate_2d_4con(gal_data_t *input, int dilate0_erode1)
+/* Some operations here are done over the rows of the dataset (along its
+   fastest dimension). The neighboring rows of a row are identified by
+   their increment (-1, 0 or 1) along each of the slower dimensions. A row
+   is a neighbor when at most `connectivity' of its increments are
+   non-zero. The diagonal pixels (along the fastest dimension) of a
+   neighboring row are only connected when less of its increments are
+   non-zero. If `previous' is non-zero, only the neighboring rows before
+   the row (with a first non-zero increment of -1) are kept.
+
+   The increments of each neighboring row (`ndim-1' values) are put in
+   `inc' and if its diagonal pixels are connected in `diag' (both are
+   allocated here). The number of neighboring rows is returned. */
+static size_t
+binary_neighbor_rows(size_t ndim, int connectivity, int previous,
+                     int32_t **inc, uint8_t **diag)
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
+  int32_t *in;
+  size_t i, j, c, nz, out=0, num=1, nd=ndim-1;
+
+  /* Sanity check. */
+  if(connectivity<1 || connectivity>ndim)
+    error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity in a "
+          "%zu dimensional dataset", __func__, connectivity, ndim);
+
+  /* Allocate the space for all the possible rows (3^nd, one extra element
+     is allocated for 1D datasets, that have no neighboring rows). */
+  for(j=0;j<nd;++j) num*=3;
+  *inc=gal_data_malloc_array(GAL_TYPE_INT32, num*nd+1, __func__, "inc");
+  *diag=gal_data_malloc_array(GAL_TYPE_UINT8, num, __func__, "diag");
+
+  /* Go over all the possible increments and keep the desired ones. */
+  for(i=0;i<num;++i)
+    {
+      in=&(*inc)[out*nd];
+      for(c=i, nz=0, j=nd; j>0; --j)
+        {
+          in[j-1] = (int32_t)(c%3) - 1;
+          nz += in[j-1]!=0;
+          c /= 3;
+        }
+      for(j=0; j<nd && in[j]==0; ++j) {}
+      if( nz && nz<=connectivity && (previous==0 || in[j]==-1) )
+        (*diag)[out++] = nz<connectivity;
+    }
+  return out;
+}
 
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can "
-          "fix this problem. The value to `dilate0_erode1' is %u while it "
-          "should be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
 
-  /* Set the foreground and background values. */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
 
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f || byt[nc]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[nc-1]==b && (byt[nc-2]==f || byt[2*nc-1]==f))
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[(nr-1)*nc]==b
-     && (byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
+/* Put the coordinates of row `r' (along the slower dimensions) in
+   `coord'. */
+static void
+binary_row_coord(size_t r, size_t ndim, size_t *dsize, size_t *coord)
+{
+  size_t j;
+  for(j=ndim-1; j>0; --j)
+    {
+      coord[j-1] = r % dsize[j-1];
+      r         /= dsize[j-1];
+    }
+}
+
 
-  if(byt[nr*nc-1]==b
-     && (byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
 
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && (byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
 
-  for(j=1;j<nc-1;++j)
-    {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  for(i=1;i<nr-1;++i)
-    {
-      ind=i*nc;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
+/* If the neighboring row (with increments `inc') of a row with
+   coordinates `coord' exists, put its index in `rn' and return 1,
+   otherwise, return 0. */
+static int
+binary_row_neighbor(size_t ndim, size_t *dsize, size_t *coord, int32_t *inc,
+                    size_t *rn)
+{
+  size_t j;
 
-  for(i=1;i<nr-1;++i)
+  *rn=0;
+  for(j=0;j<ndim-1;++j)
     {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      if( (inc[j]<0 && coord[j]==0)
+          || (inc[j]>0 && coord[j]==dsize[j]-1) )
+        return 0;
+      *rn = *rn * dsize[j] + coord[j] + inc[j];
     }
+  return 1;
+}
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
-      {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f     || byt[ind+1]==f
-               || byt[ind+nc]==f || byt[ind-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
-      }
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
-}
 
 
 
 
 
-/* 8 connected dilation and erosion. b0_f1==0: Dilate the
-   foreground. b0_f1==1: Erode the foreground. */
-static void
-binary_erode_dilate_2d_8con(gal_data_t *input, unsigned char dilate0_erode1)
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*********************************************************************/
+/*****************      Erosion and dilation      ********************/
+/*********************************************************************/
+/* Erosion and dilation are the same operation: the pixels with a value of
+   `b' (0 for dilation and 1 for erosion) that are connected to a pixel
+   with a value of `f' (1 for dilation and 0 for erosion) are changed to
+   `f'. All other values (for example blank) are left unchanged and don't
+   affect their neighbors.
+
+   To do many iterations over large datasets efficiently, each row (along
+   the fastest dimension) is packed into 64-bit words (one bit per pixel):
+   one array for the pixels that have a value of `f' and one for the
+   candidates (pixels with a value of `b'). In each iteration, a word of
+   the output is the bitwise OR of its (shifted) neighbors in its own and
+   neighboring rows, masked by the candidates. The rows are divided
+   between the threads and the iterations stop when nothing changes. */
+struct binary_morph_params
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
-
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can fix "
-          "this problem. The value to dilate0_erode1 is %u while it should "
-          "be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
-
-  /* Set the foreground and background values: */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else         {f=0; b=1;}
-
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f
-                   || byt[nc]==f || byt[nc+1]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nc-1]==b && (byt[nc-2]==f
-                      || byt[2*nc-1]==f
-                      || byt[2*nc-2]==f) )
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[(nr-1)*nc]==b
-     && ( byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f
-          || byt[(nr-2)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nr*nc-1]==b
-     && ( byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f
-          || byt[nr*nc-2-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
-
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && ( byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f
-            || byt[j-1+nc]==f || byt[j+1+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
-
-  for(j=1;j<nc-1;++j)
-    {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f
-              || byt[ind-1-nc]==f || byt[ind+1-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
+  uint8_t            *byt;  /* Input (and output) array.                  */
+  uint8_t               f;  /* Value that grows into its neighbors.       */
+  uint8_t               b;  /* Value that changes to `f' (if connected).  */
+  size_t             ndim;  /* Number of dimensions.                      */
+  size_t           *dsize;  /* Size of dataset along each dimension.      */
+  size_t           rowlen;  /* Number of pixels in each row.              */
+  size_t          numrows;  /* Number of rows.                            */
+  size_t           nwords;  /* Number of words in each packed row.        */
+  size_t       numstripes;  /* Number of stripes (rows for each thread).  */
+  uint64_t            *in;  /* Packed `f' pixels before this iteration.   */
+  uint64_t           *out;  /* Packed `f' pixels after this iteration.    */
+  uint64_t          *cand;  /* Packed `b' pixels (candidates to change).  */
+  size_t          numngbs;  /* Number of neighboring rows.                */
+  int32_t         *ngbinc;  /* Increment in slower dims for each ngb row. */
+  uint8_t        *ngbdiag;  /* Diagonal pixels in ngb row are connected.  */
+  uint8_t        *changed;  /* If anything changed in each stripe.        */
+  int               phase;  /* 0: pack, 1: one iteration, 2: unpack.      */
+};
+
+
+
+
+
+/* The bits of the two (horizontal) neighbors of each bit in word `w' of a
+   packed row `x' with `n' words (bit `i' of word `w' is pixel `64w+i'). */
+#define BINARY_MORPH_HORIZ(x, w, n)                                     \
+  ( (x)[w]<<1 | (x)[w]>>1                                               \
+    | ( (w)>0     ? (x)[(w)-1]>>63 : 0 )                                \
+    | ( (w)+1<(n) ? (x)[(w)+1]<<63 : 0 ) )
+
+static void *
+binary_morph_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_morph_params *prm=(struct binary_morph_params *)tprm->params;
 
-  for(i=1;i<nr-1;++i)
-    {
-      ind=i*nc;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-              || byt[ind+1-nc]==f || byt[ind+1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
+  uint8_t *byt;
+  size_t i, j, p, r, rn, rf, rl, pf, nw=prm->nwords, nd=prm->ndim-1;
+  uint64_t bits, *in, *out, *cand, *ngb;
+  size_t *coord;
+
+  /* Space for the coordinates of each row. */
+  coord=gal_data_malloc_array(GAL_TYPE_SIZE_T, prm->ndim, __func__,
+                              "coord");
 
-  for(i=1;i<nr-1;++i)
+  /* Go over all the stripes assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
     {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-             || byt[ind-1-nc]==f || byt[ind-1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      rf = tprm->indexs[i]     * prm->numrows / prm->numstripes;
+      rl = (tprm->indexs[i]+1) * prm->numrows / prm->numstripes;
+      prm->changed[ tprm->indexs[i] ]=0;
+      for(r=rf; r<rl; ++r)
+        {
+          in   = prm->in   + r*nw;
+          out  = prm->out  + r*nw;
+          cand = prm->cand + r*nw;
+          byt  = prm->byt  + r*prm->rowlen;
+          switch(prm->phase)
+            {
+            /* Pack the row (64 pixels into each word). */
+            case 0:
+              for(j=0;j<nw;++j)
+                {
+                  in[j]=cand[j]=0;
+                  pf = prm->rowlen < 64*(j+1) ? prm->rowlen-64*j : 64;
+                  for(p=0;p<pf;++p)
+                    {
+                      in[j]   |= (uint64_t)(byt[64*j+p]==prm->f) << p;
+                      cand[j] |= (uint64_t)(byt[64*j+p]==prm->b) << p;
+                    }
+                }
+              break;
+
+            /* One iteration: first the neighbors in the same row, then the
+               neighboring rows. */
+            case 1:
+              for(j=0;j<nw;++j) out[j]=BINARY_MORPH_HORIZ(in, j, nw);
+              binary_row_coord(r, prm->ndim, prm->dsize, coord);
+              for(p=0;p<prm->numngbs;++p)
+                if( binary_row_neighbor(prm->ndim, prm->dsize, coord,
+                                        &prm->ngbinc[p*nd], &rn) )
+                  {
+                    ngb=prm->in+rn*nw;
+                    if(prm->ngbdiag[p])
+                      for(j=0;j<nw;++j)
+                        out[j] |= ngb[j] | BINARY_MORPH_HORIZ(ngb, j, nw);
+                    else
+                      for(j=0;j<nw;++j) out[j] |= ngb[j];
+                  }
+              for(j=0;j<nw;++j)
+                {
+                  out[j] = in[j] | (cand[j] & out[j]);
+                  if(out[j]!=in[j]) prm->changed[ tprm->indexs[i] ]=1;
+                }
+              break;
+
+            /* Write the changed pixels into the row. */
+            case 2:
+              for(j=0;j<nw;++j)
+                for(bits=in[j]&cand[j], p=64*j; bits; bits>>=1, ++p)
+                  if(bits & 1) byt[p]=prm->f;
+              break;
+
+            default:
+              error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s "
+                    "to fix the problem. Phase %d not recognized",
+                    __func__, PACKAGE_BUGREPORT, prm->phase);
+            }
+        }
     }
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
-      {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f        || byt[ind+1]==f
-               || byt[ind+nc]==f    || byt[ind-nc]==f
-               || byt[ind-1-nc]==f  || byt[ind+1+nc]==f
-               || byt[ind-1+nc]==f  || byt[ind+1-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
-      }
-
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+  /* Clean up and wait for all the other threads to finish. */
+  free(coord);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
 }
 
 
@@ -231,11 +303,12 @@ binary_erode_dilate_2d_8con(gal_data_t *input, unsigned char dilate0_erode1)
    when the input's type isn't `uint8_t', `inplace' is irrelevant. */
 static gal_data_t *
 binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
-                    int inplace, int d0e1)
+                    int inplace, int d0e1, size_t numthreads)
 {
-  size_t counter;
+  size_t i, s;
+  uint64_t *tmp;
   gal_data_t *binary;
-  size_t *dinc=gal_dimension_increment(input->ndim, input->dsize);
+  struct binary_morph_params prm;
 
   /* Currently this only works on blocks. */
   if(input->block)
@@ -247,29 +320,58 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
   binary = ( (inplace && input->type==GAL_TYPE_UINT8)
              ? input :
              gal_data_copy_to_new_type(input, GAL_TYPE_UINT8) );
-
-  /* Go over every element and do the erosion. */
-  switch(binary->ndim)
+  if(num==0 || binary->size==0) return binary;
+
+  /* Set the parameters. */
+  prm.f          = !d0e1;
+  prm.b          = d0e1;
+  prm.byt        = binary->array;
+  prm.ndim       = binary->ndim;
+  prm.dsize      = binary->dsize;
+  prm.rowlen     = binary->dsize[binary->ndim-1];
+  prm.numrows    = binary->size / prm.rowlen;
+  prm.nwords     = (prm.rowlen+63)/64;
+  prm.numstripes = numthreads < prm.numrows ? numthreads : prm.numrows;
+  prm.numngbs    = binary_neighbor_rows(prm.ndim, connectivity, 0,
+                                        &prm.ngbinc, &prm.ngbdiag);
+  prm.in   = gal_data_malloc_array(GAL_TYPE_UINT64, prm.numrows*prm.nwords,
+                                   __func__, "prm.in");
+  prm.out  = gal_data_malloc_array(GAL_TYPE_UINT64, prm.numrows*prm.nwords,
+                                   __func__, "prm.out");
+  prm.cand = gal_data_malloc_array(GAL_TYPE_UINT64, prm.numrows*prm.nwords,
+                                   __func__, "prm.cand");
+  prm.changed = gal_data_malloc_array(GAL_TYPE_UINT8, prm.numstripes,
+                                      __func__, "prm.changed");
+
+  /* Pack the dataset. */
+  prm.phase=0;
+  gal_threads_spin_off(binary_morph_on_thread, &prm, prm.numstripes,
+                       numthreads);
+
+  /* Do the iterations (until nothing changes). After each iteration, the
+     output becomes the input of the next. */
+  prm.phase=1;
+  for(i=0;i<num;++i)
     {
-    case 2:
-      for(counter=0;counter<num;++counter)
-        switch(connectivity)
-          {
-          case 1: binary_erode_dilate_2d_4con(binary, d0e1); break;
-          case 2: binary_erode_dilate_2d_8con(binary, d0e1); break;
-          default:
-            error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity "
-                  "in a 2D dataset", __func__, connectivity);
-          }
-      break;
-
-    default:
-      error(EXIT_FAILURE, 0, "%s: currently doesn't work on %zu "
-            "dimensional datasets", __func__, binary->ndim);
+      gal_threads_spin_off(binary_morph_on_thread, &prm, prm.numstripes,
+                           numthreads);
+      tmp=prm.in; prm.in=prm.out; prm.out=tmp;
+      for(s=0; s<prm.numstripes && prm.changed[s]==0; ++s) {}
+      if(s==prm.numstripes) break;
     }
 
+  /* Write the changed pixels into the dataset. */
+  prm.phase=2;
+  gal_threads_spin_off(binary_morph_on_thread, &prm, prm.numstripes,
+                       numthreads);
+
   /* Clean up and return. */
-  free(dinc);
+  free(prm.in);
+  free(prm.out);
+  free(prm.cand);
+  free(prm.ngbinc);
+  free(prm.ngbdiag);
+  free(prm.changed);
   return binary;
 }
 
@@ -279,9 +381,10 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
 
 gal_data_t *
 gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
-                 int inplace)
+                 int inplace, size_t numthreads)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 1);
+  return binary_erode_dilate(input, num, connectivity, inplace, 1,
+                             numthreads);
 }
 
 
@@ -290,9 +393,10 @@ gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
 
 gal_data_t *
 gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
-                  int inplace)
+                  int inplace, size_t numthreads)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 0);
+  return binary_erode_dilate(input, num, connectivity, inplace, 0,
+                             numthreads);
 }
 
 
@@ -301,17 +405,17 @@ gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
 
 gal_data_t *
 gal_binary_open(gal_data_t *input, size_t num, int connectivity,
-                int inplace)
+                int inplace, size_t numthreads)
 {
   gal_data_t *out;
 
   /* First do the necessary number of erosions. */
-  out=gal_binary_erode(input, num, connectivity, inplace);
+  out=gal_binary_erode(input, num, connectivity, inplace, numthreads);
 
   /* If `inplace' was called, then `out' is the same as `input', if it
      wasn't, then `out' is a newly allocated array. In any case, we should
      dilate in the same allocated space. */
-  gal_binary_dilate(input, num, connectivity, 1);
+  gal_binary_dilate(out, num, connectivity, 1, numthreads);
 
   /* Return the output dataset. */
   return out;
@@ -339,17 +443,214 @@ gal_binary_open(gal_data_t *input, size_t num, int connectivity,
 /*********************************************************************/
 /*****************      Connected components      ********************/
 /*********************************************************************/
+/* Connected components are labeled with a two-pass union-find over the
+   runs (contiguous foreground pixels) of each row (along the fastest
+   dimension):
+
+     1. The number of runs in each row is counted (in parallel), so every
+        run gets a global index (in the order of their first pixel in the
+        dataset).
+
+     2. The runs are found and every run is merged (through union-find)
+        with the connected runs of its previous neighboring rows. The rows
+        are divided into one stripe per thread, each stripe only merges
+        runs within itself. The runs of the first rows of each stripe are
+        then merged with those of the previous stripe(s) afterwards.
+
+     3. Since the root of each set is always its run with the smallest
+        index, the final labels are given in order of the roots, so an
+        object's label only depends on the position of its first pixel
+        (same as a breadth-first search over the dataset). These labels are
+        then written into the pixels of each run (in parallel). */
+struct binary_cc_params
+{
+  uint8_t              *b;  /* Binary array.                              */
+  int32_t              *l;  /* Labels array.                              */
+  size_t             ndim;  /* Number of dimensions.                      */
+  size_t           *dsize;  /* Size of dataset along each dimension.      */
+  int            hasblank;  /* The binary array has blank pixels.         */
+  size_t           rowlen;  /* Number of pixels in each row.              */
+  size_t          numrows;  /* Number of rows.                            */
+  size_t       numstripes;  /* Number of stripes (rows for each thread).  */
+  size_t        *rowstart;  /* Index of first run of each row (+1 row).   */
+  size_t         *runfrom;  /* First pixel of each run (within its row).  */
+  size_t           *runto;  /* Last pixel of each run (within its row).   */
+  size_t          *parent;  /* Union-find parent of each run.             */
+  int32_t         *runlab;  /* Final label of each run.                   */
+  size_t          numngbs;  /* Number of previous neighboring rows.       */
+  int32_t         *ngbinc;  /* Increment in slower dims for each ngb row. */
+  uint8_t        *ngbdiag;  /* Diagonal pixels in ngb row are connected.  */
+  int               phase;  /* 0: count, 1: runs and merge, 2: labels.    */
+};
+
+
+
+
+
+/* Union-find: return the root of the set containing `i' (with path
+   halving). */
+static size_t
+binary_cc_find(size_t *parent, size_t i)
+{
+  while(parent[i]!=i)
+    {
+      parent[i]=parent[parent[i]];
+      i=parent[i];
+    }
+  return i;
+}
+
+
+
+
+
+/* Union-find: merge the sets of `a' and `b'. The root with the smaller
+   index is kept as the root. */
+static void
+binary_cc_union(size_t *parent, size_t a, size_t b)
+{
+  a=binary_cc_find(parent, a);
+  b=binary_cc_find(parent, b);
+  if(a<b)      parent[b]=a;
+  else if(b<a) parent[a]=b;
+}
+
+
+
+
+
+/* Merge the runs of row `r' with the connected runs of row `rn'. Since the
+   runs of each row are sorted, the rows are parsed together, going to the
+   next run in the row whose current run ends first. */
+static void
+binary_cc_merge_rows(struct binary_cc_params *prm, size_t r, size_t rn,
+                     size_t diag)
+{
+  size_t a=prm->rowstart[r],  af=prm->rowstart[r+1];
+  size_t c=prm->rowstart[rn], cf=prm->rowstart[rn+1];
+
+  while(a<af && c<cf)
+    {
+      if( prm->runto[c]+diag >= prm->runfrom[a]
+          && prm->runfrom[c] <= prm->runto[a]+diag )
+        binary_cc_union(prm->parent, a, c);
+      if(prm->runto[a] < prm->runto[c]) ++a; else ++c;
+    }
+}
+
+
+
+
+
+/* Merge the runs of row `r' with the runs of its previous neighboring rows
+   that are not before `firstrow'. `coord' is space to keep the coordinates
+   of the row in the slower dimensions. */
+static void
+binary_cc_merge_ngbs(struct binary_cc_params *prm, size_t r,
+                     size_t firstrow, size_t *coord)
+{
+  size_t i, rn, nd=prm->ndim-1;
+
+  binary_row_coord(r, prm->ndim, prm->dsize, coord);
+  for(i=0;i<prm->numngbs;++i)
+    if( binary_row_neighbor(prm->ndim, prm->dsize, coord,
+                            &prm->ngbinc[i*nd], &rn)
+        && rn>=firstrow )
+      binary_cc_merge_rows(prm, r, rn, prm->ngbdiag[i]);
+}
+
+
+
+
+
+/* Is this pixel in the foreground? */
+#define BINARY_CC_FG(B) ( (B) && !(prm->hasblank && (B)==GAL_BLANK_UINT8) )
+
+static void *
+binary_cc_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_cc_params *prm=(struct binary_cc_params *)tprm->params;
+
+  uint8_t *b;
+  int32_t *l;
+  size_t i, k, r, p, n, rf, rl, *coord;
+
+  /* Space for the coordinates of each row. */
+  coord=gal_data_malloc_array(GAL_TYPE_SIZE_T, prm->ndim, __func__,
+                              "coord");
+
+  /* Go over all the stripes assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      rf = tprm->indexs[i]     * prm->numrows / prm->numstripes;
+      rl = (tprm->indexs[i]+1) * prm->numrows / prm->numstripes;
+      for(r=rf; r<rl; ++r)
+        {
+          b = prm->b + r*prm->rowlen;
+          switch(prm->phase)
+            {
+            /* Count the runs in this row (`rowstart' is later changed to
+               the cumulative sum). */
+            case 0:
+              for(n=0, p=0; p<prm->rowlen; ++p)
+                if( BINARY_CC_FG(b[p])
+                    && ( p==0 || !BINARY_CC_FG(b[p-1]) ) )
+                  ++n;
+              prm->rowstart[r+1]=n;
+              break;
+
+            /* Find the runs of this row and merge them with the previous
+               rows in this stripe. */
+            case 1:
+              k=prm->rowstart[r];
+              for(p=0; p<prm->rowlen; ++p)
+                if( BINARY_CC_FG(b[p]) )
+                  {
+                    prm->parent[k]=k;
+                    prm->runfrom[k]=p;
+                    while( p+1<prm->rowlen && BINARY_CC_FG(b[p+1]) ) ++p;
+                    prm->runto[k++]=p;
+                  }
+              binary_cc_merge_ngbs(prm, r, rf, coord);
+              break;
+
+            /* Write the final label of each run into its pixels. */
+            case 2:
+              l = prm->l + r*prm->rowlen;
+              for(k=prm->rowstart[r]; k<prm->rowstart[r+1]; ++k)
+                for(p=prm->runfrom[k]; p<=prm->runto[k]; ++p)
+                  l[p]=prm->runlab[k];
+              break;
+
+            default:
+              error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s "
+                    "to fix the problem. Phase %d not recognized",
+                    __func__, PACKAGE_BUGREPORT, prm->phase);
+            }
+        }
+    }
+
+  /* Clean up and wait for all the other threads to finish. */
+  free(coord);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
 /* Find connected components in an intput dataset. */
 size_t
 gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
-                                int connectivity)
+                                int connectivity, size_t numthreads)
 {
   int32_t *l;
   uint8_t *b, *bf;
   gal_data_t *lab;
-  size_t p, i, curlab=1;
-  gal_list_sizet_t *Q=NULL;
-  size_t *dinc=gal_dimension_increment(binary->ndim, binary->dsize);
+  struct binary_cc_params prm;
+  size_t i, j, r, rf, rl, inc, maxinc, curlab=0, numruns, *coord;
 
   /* Two small sanity checks. */
   if(binary->type!=GAL_TYPE_UINT8)
@@ -390,56 +691,99 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
      array, then give them the blank labeled array. Note that since
      their value will not be 0, they will also not be labeled. */
   l=lab->array;
+  prm.hasblank=0;
   bf=(b=binary->array)+binary->size; /* Library must have no side effect,   */
   if( gal_blank_present(binary, 0) ) /* So blank flag should not be changed.*/
-    do *l++ = *b==GAL_BLANK_UINT8 ? GAL_BLANK_INT32 : 0; while(++b<bf);
+    {
+      prm.hasblank=1;
+      do *l++ = *b==GAL_BLANK_UINT8 ? GAL_BLANK_INT32 : 0; while(++b<bf);
+    }
 
 
-  /* Go over all the pixels and do a breadth-first: any pixel that is not
-     labeled is used to label the full object by checking neighbors before
-     going onto the next pixels. */
-  l=lab->array;
-  b=binary->array;
-  for(i=0;i<binary->size;++i)
-    /* Check if this pixel is already labeled. */
-    if( b[i] && l[i]==0 )
-      {
-        /* This is the first pixel of this connected region that we have
-           got to. */
-        l[i]=curlab;
+  /* Set the basic parameters. */
+  prm.b          = binary->array;
+  prm.l          = lab->array;
+  prm.ndim       = binary->ndim;
+  prm.dsize      = binary->dsize;
+  prm.rowlen     = binary->dsize[binary->ndim-1];
+  prm.numrows    = binary->size / prm.rowlen;
+  prm.numstripes = numthreads < prm.numrows ? numthreads : prm.numrows;
+  prm.rowstart   = gal_data_calloc_array(GAL_TYPE_SIZE_T, prm.numrows+1,
+                                         __func__, "prm.rowstart");
+  prm.numngbs=binary_neighbor_rows(prm.ndim, connectivity, 1, &prm.ngbinc,
+                                   &prm.ngbdiag);
 
-        /* Add this pixel to the queue of pixels to work with. */
-        gal_list_sizet_add(&Q, i);
 
-        /* While a pixel remains in the queue, continue labelling and
-           searching for neighbors. */
-        while(Q!=NULL)
-          {
-            /* Pop an element from the queue. */
-            p=gal_list_sizet_pop(&Q);
+  /* Count the runs in each row and find the index of the first run of
+     each row. */
+  prm.phase=0;
+  gal_threads_spin_off(binary_cc_on_thread, &prm, prm.numstripes,
+                       numthreads);
+  for(r=0;r<prm.numrows;++r) prm.rowstart[r+1]+=prm.rowstart[r];
+  numruns=prm.rowstart[prm.numrows];
 
-            /* Go over all its neighbors and add them to the list if they
-               haven't already been labeled. */
-            GAL_DIMENSION_NEIGHBOR_OP(p, binary->ndim, binary->dsize,
-                                      connectivity, dinc,
-              {
-                if( b[ nind ] && l[ nind ]==0 )
-                  {
-                    l[ nind ] = curlab;
-                    gal_list_sizet_add(&Q, nind);
-                  }
-              } );
-          }
 
-        /* This object has been fully labeled, so increment the current
-           label. */
-        ++curlab;
-      }
+  /* Find the runs and merge them within each stripe. */
+  if(numruns)
+    {
+      prm.runfrom = gal_data_malloc_array(GAL_TYPE_SIZE_T, numruns,
+                                          __func__, "prm.runfrom");
+      prm.runto   = gal_data_malloc_array(GAL_TYPE_SIZE_T, numruns,
+                                          __func__, "prm.runto");
+      prm.parent  = gal_data_malloc_array(GAL_TYPE_SIZE_T, numruns,
+                                          __func__, "prm.parent");
+      prm.runlab  = gal_data_malloc_array(GAL_TYPE_INT32, numruns,
+                                          __func__, "prm.runlab");
+      prm.phase=1;
+      gal_threads_spin_off(binary_cc_on_thread, &prm, prm.numstripes,
+                           numthreads);
+
+      /* Merge the runs of the first rows of each stripe with those of
+         the previous stripes. The furthest previous neighbor of a row is
+         `maxinc' rows before it (one row before along all the slower
+         dimensions). */
+      for(maxinc=0, inc=1, j=prm.ndim-1; j>0; --j)
+        {
+          maxinc += inc;
+          inc    *= prm.dsize[j-1];
+        }
+      coord=gal_data_malloc_array(GAL_TYPE_SIZE_T, prm.ndim, __func__,
+                                  "coord");
+      for(i=1;i<prm.numstripes;++i)
+        {
+          rf = i     * prm.numrows / prm.numstripes;
+          rl = (i+1) * prm.numrows / prm.numstripes;
+          for(r=rf; r<rl && r<rf+maxinc; ++r)
+            binary_cc_merge_ngbs(&prm, r, 0, coord);
+        }
+      free(coord);
+
+      /* Give the final labels in order of the roots. Since the parent of
+         every run has a smaller (or equal) index, going up in the runs,
+         the parent of each run is already labeled. */
+      for(i=0;i<numruns;++i)
+        prm.runlab[i] = ( prm.parent[i]==i
+                          ? ++curlab
+                          : prm.runlab[ binary_cc_find(prm.parent, i) ] );
+
+      /* Write the labels into the pixels. */
+      prm.phase=2;
+      gal_threads_spin_off(binary_cc_on_thread, &prm, prm.numstripes,
+                           numthreads);
+
+      /* Clean up. */
+      free(prm.runfrom);
+      free(prm.runto);
+      free(prm.parent);
+      free(prm.runlab);
+    }
 
 
   /* Clean up and return the total number. */
-  free(dinc);
-  return curlab-1;
+  free(prm.ngbinc);
+  free(prm.ngbdiag);
+  free(prm.rowstart);
+  return curlab;
 }
 
 
@@ -660,7 +1004,8 @@ gal_binary_fill_holes(gal_data_t *input, int connectivity, size_t maxsize)
 
 
   /* Label the holes */
-  numholes=gal_binary_connected_components(inv, &holelabs, connectivity);
+  numholes=gal_binary_connected_components(inv, &holelabs, connectivity,
+                                           1);
 
 
   /* Any pixel with a label larger than 1 is a hole in the input image and
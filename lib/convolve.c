@@ -22,6 +22,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
+#include <float.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
@@ -119,6 +121,8 @@ struct spatial_params
   gal_data_t *tocorrect;     /* (possible) convolved image to correct.   */
   int        convoverch;     /* Ignore channel edges in convolution.     */
   int    edgecorrection;     /* Correct convolution's edge effects.      */
+  double           ksum;     /* Sum of all the kernel's pixels.          */
+  float           *ksep;     /* 1D kernels of a separable kernel.        */
   struct per_thread_spatial_prm *pprm; /* Array of per-thread parameters.*/
 };
 
@@ -290,6 +294,159 @@ convolve_spatial_overlap(struct per_thread_spatial_prm *pprm, int tocorrect)
 
 
 
+/* A 2D kernel is separable (has a rank of 1) when it can be written as
+   the product of two 1D kernels: K[a][b]=u[a]*v[b]. Convolution with such
+   a kernel can be done with two 1D convolutions (one on each dimension),
+   so for a kernel of width `w', each pixel needs `2w' multiplications
+   instead of `w*w'. If the kernel is separable (every element of the
+   product differs from the kernel by no more than the 32-bit floating
+   point round-off error of the kernel's largest element, which is less
+   than that of its sum), this function returns an array with the `u'
+   values followed by the `v' values. Otherwise, it returns NULL. With this
+   tolerance, the convolved values on interior tiles (that use the
+   separable kernel) and other tiles only differ by round-off errors. */
+static float *
+convolve_spatial_separable(gal_data_t *kernel)
+{
+  float *sep, *k=kernel->array;
+  double max=0.0f, tolerance;
+  size_t a, b, a0=0, b0=0, k0, k1;
+
+  /* This is only for 2D kernels. */
+  if(kernel->ndim!=2) return NULL;
+  k0=kernel->dsize[0];
+  k1=kernel->dsize[1];
+
+  /* Use the element with the largest absolute value as the pivot. */
+  for(a=0;a<k0;++a)
+    for(b=0;b<k1;++b)
+      if( fabs(k[a*k1+b]) > max )
+        { max=fabs(k[a*k1+b]); a0=a; b0=b; }
+  if(max==0.0f) return NULL;
+
+  /* Set the two 1D kernels: the pivot's column and row (with the row
+     divided by the pivot). */
+  sep=gal_data_malloc_array(GAL_TYPE_FLOAT32, k0+k1, __func__, "sep");
+  for(a=0;a<k0;++a) sep[a]    = k[a*k1+b0];
+  for(b=0;b<k1;++b) sep[k0+b] = k[a0*k1+b] / k[a0*k1+b0];
+
+  /* Check if their product is the kernel. The division and product above
+     each add at most half a unit of round-off, hence the factor of two.
+     Note that the condition is written such that a NaN value in the
+     kernel will also reject it. */
+  tolerance = 2 * FLT_EPSILON * max;
+  for(a=0;a<k0;++a)
+    for(b=0;b<k1;++b)
+      if( !( fabs(k[a*k1+b] - sep[a]*sep[k0+b]) <= tolerance ) )
+        {
+          free(sep);
+          return NULL;
+        }
+  return sep;
+}
+
+
+
+
+
+/* Convolve a 2D tile that is not on the edge (so the kernel fully
+   overlaps with the image on all its pixels). When there are no blank
+   pixels within the tile or its surrounding half-kernel, there is no
+   need to find the overlap of every pixel or to check every pixel for
+   NaN. So the convolution can be done row by row: each kernel element
+   is multiplied by a full (contiguous) row of the input and added to the
+   output row (which is easily vectorized by the compiler). Note that
+   for each output pixel, the kernel elements are added in the same order
+   as the general case, so the result is identical.
+
+   For a separable kernel (see `convolve_spatial_separable'), the
+   region is first convolved along the first dimension (with `u'), then
+   along the second (with `v').
+
+   If the region has a blank pixel, this function will return 0 and the
+   general method has to be used. */
+static int
+convolve_spatial_tile_fast(struct per_thread_spatial_prm *pprm)
+{
+  struct spatial_params *cprm=pprm->cprm;
+  gal_data_t *tile=pprm->tile, *block=cprm->block, *kernel=cprm->kernel;
+
+  float kv, *row, *o, *in=block->array, *out=cprm->out->array;
+  double *t, *acc, *tmp=NULL, ksum=cprm->edgecorrection ? cprm->ksum : 1.0f;
+  size_t th=tile->dsize[0], tw=tile->dsize[1], bw=block->dsize[1];
+  size_t k0=kernel->dsize[0], k1=kernel->dsize[1], rw=tw+k1-1;
+  size_t a, b, r, x, start, rstart;
+  float *k=kernel->array, *u=cprm->ksep, *v=cprm->ksep+k0;
+
+  /* Index of the tile's first pixel and the first pixel of the region
+     (the tile and its surrounding half-kernel) within the block. */
+  start  = gal_data_ptr_dist(block->array, tile->array, block->type);
+  rstart = start - (k0/2)*bw - k1/2;
+
+  /* If any pixel in the region is blank, then we can't use this
+     method. */
+  for(r=0;r<th+k0-1;++r)
+    {
+      row=in+rstart+r*bw;
+      for(x=0;x<rw;++x) if( isnan(row[x]) ) return 0;
+    }
+
+  /* Allocate the output row (and the intermediate array for a separable
+     kernel). */
+  acc=gal_data_malloc_array(GAL_TYPE_FLOAT64, tw, __func__, "acc");
+  if(cprm->ksep)
+    {
+      /* Convolve with `u' along the first dimension: `tmp' will have the
+         same number of rows as the tile, but it will also contain the
+         surrounding half-kernel on the second dimension. */
+      tmp=gal_data_calloc_array(GAL_TYPE_FLOAT64, th*rw, __func__, "tmp");
+      for(r=0;r<th;++r)
+        {
+          t=tmp+r*rw;
+          for(a=0;a<k0;++a)
+            {
+              kv=u[a];
+              row=in+rstart+(r+a)*bw;
+              for(x=0;x<rw;++x) t[x] += (double)kv * row[x];
+            }
+        }
+    }
+
+  /* Convolve each row of the tile. */
+  for(r=0;r<th;++r)
+    {
+      for(x=0;x<tw;++x) acc[x]=0.0f;
+      if(cprm->ksep)
+        for(b=0;b<k1;++b)
+          {
+            kv=v[b];
+            t=tmp+r*rw+b;
+            for(x=0;x<tw;++x) acc[x] += kv * t[x];
+          }
+      else
+        for(a=0;a<k0;++a)
+          for(b=0;b<k1;++b)
+            {
+              kv=k[a*k1+b];
+              row=in+rstart+(r+a)*bw+b;
+              for(x=0;x<tw;++x) acc[x] += kv * row[x];
+            }
+
+      /* Write the output values. */
+      o=out+start+r*bw;
+      for(x=0;x<tw;++x) o[x] = ksum==0.0f ? NAN : acc[x]/ksum;
+    }
+
+  /* Clean up and return. */
+  free(acc);
+  free(tmp);
+  return 1;
+}
+
+
+
+
+
 /* Convolve over one tile that is not touching the edge. */
 static void
 convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
@@ -339,6 +496,12 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
   if(cprm->tocorrect && pprm->on_edge==0) return;
 
 
+  /* Tiles that are not on the edge can use a faster method (if they don't
+     have any blank pixels). */
+  if( pprm->on_edge==0 && ndim==2 && convolve_spatial_tile_fast(pprm) )
+    return;
+
+
   /* Parse over all the tile elements. */
   i_inc=0; i_ninc=1;
   i_start=gal_tile_start_end_ind_inclusive(tile, block, i_st_en);
@@ -448,8 +611,8 @@ convolve_spatial_on_thread(void *inparam)
   pprm->k_overlap     = gal_data_alloc(NULL, cprm->kernel->type, ndim, dsize,
                                        NULL, 0, -1, NULL, NULL, NULL);
   free(dsize);
-  free(pprm->i_overlap->array);
-  free(pprm->k_overlap->array);
+  gal_data_release_array(pprm->i_overlap);
+  gal_data_release_array(pprm->k_overlap);
   pprm->i_overlap->block = cprm->block;
   pprm->k_overlap->block = cprm->kernel;
 
@@ -489,6 +652,7 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
                              size_t numthreads, int edgecorrection,
                              int convoverch, gal_data_t *tocorrect)
 {
+  float *k, *kf;
   struct spatial_params params;
   gal_data_t *out, *block=gal_tile_block(tiles);
 
@@ -528,6 +692,14 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
   params.edgecorrection=edgecorrection;
 
 
+  /* Sum of the kernel's pixels (the edge correction factor of the pixels
+     that fully overlap with the kernel) and its possible 1D kernels (if
+     it is separable). */
+  params.ksum=0.0f;
+  kf=(k=kernel->array)+kernel->size; do params.ksum += *k; while(++k<kf);
+  params.ksep=convolve_spatial_separable(kernel);
+
+
   /* Allocate the per-thread parameters. */
   errno=0;
   params.pprm=malloc(numthreads * sizeof *params.pprm);
@@ -543,6 +715,7 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
 
   /* Clean up and return the output array. */
   free(params.pprm);
+  free(params.ksep);
   return out;
 }
 
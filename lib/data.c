@@ -31,6 +31,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <inttypes.h>
 #include <sys/mman.h>
 
@@ -61,6 +62,221 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/*********************************************************************/
+/*************       Pool of freed allocations     *******************/
+/*********************************************************************/
+/* In hot loops (for example over the tiles of an image in each thread),
+   many small datasets are allocated and freed. When a pool is attached to
+   a thread (with `gal_data_pool_use'), the blocks that are freed by
+   `gal_data_free' and `gal_data_free_contents' in that thread are kept in
+   the pool, and `gal_data_alloc' and `gal_data_initialize' re-use them
+   instead of going back to `malloc' (which may need a lock that is shared
+   between the threads).
+
+   All the blocks are originally allocated with `malloc', so a block that
+   is taken from a pool can safely be given to `free' (for example if it
+   is freed after the pool is detached). */
+static pthread_key_t data_pool_key;
+static pthread_once_t data_pool_key_once=PTHREAD_ONCE_INIT;
+
+static void
+data_pool_make_key(void)
+{
+  int err=pthread_key_create(&data_pool_key, NULL);
+  if(err)
+    error(EXIT_FAILURE, err, "%s: the thread-specific key for the pools "
+          "couldn't be created", __func__);
+}
+
+
+
+
+
+/* Return the pool attached to the calling thread (NULL if there is
+   none). */
+static gal_data_pool_t *
+data_pool_current(void)
+{
+  pthread_once(&data_pool_key_once, data_pool_make_key);
+  return pthread_getspecific(data_pool_key);
+}
+
+
+
+
+
+/* The size class of a block with `size' bytes: the binary logarithm of its
+   size (rounded down). */
+static size_t
+data_pool_class(size_t size)
+{
+  size_t c=0;
+  while(size>>=1) ++c;
+  return c;
+}
+
+
+
+
+
+/* Allocate an empty pool. Freed blocks that are larger than `maxsize'
+   (in bytes) will not be kept in it. The data structures themselves are
+   always kept, so `maxsize' is never smaller than `gal_data_t'. */
+gal_data_pool_t *
+gal_data_pool_alloc(size_t maxsize)
+{
+  gal_data_pool_t *pool;
+
+  errno=0;
+  pool=calloc(1, sizeof *pool);
+  if(pool==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for the pool", __func__,
+          sizeof *pool);
+  pool->maxsize = maxsize>sizeof(gal_data_t) ? maxsize : sizeof(gal_data_t);
+  return pool;
+}
+
+
+
+
+
+/* Free all the blocks that are kept in the pool. */
+void
+gal_data_pool_reset(gal_data_pool_t *pool)
+{
+  size_t c, i;
+  for(c=0;c<GAL_DATA_POOL_CLASSES;++c)
+    {
+      for(i=0;i<pool->num[c];++i) free(pool->block[c][i]);
+      pool->num[c]=0;
+    }
+}
+
+
+
+
+
+/* Free the pool and all the blocks in it. If it is attached to the
+   calling thread, it is also detached. */
+void
+gal_data_pool_free(gal_data_pool_t *pool)
+{
+  if(pool)
+    {
+      if(data_pool_current()==pool) gal_data_pool_use(NULL);
+      gal_data_pool_reset(pool);
+      free(pool);
+    }
+}
+
+
+
+
+
+/* Attach `pool' to the calling thread (detach any pool if it is NULL)
+   and return the pool that was previously attached to it. A pool should
+   only be attached to one thread at any moment. */
+gal_data_pool_t *
+gal_data_pool_use(gal_data_pool_t *pool)
+{
+  int err;
+  gal_data_pool_t *prev=data_pool_current();
+
+  err=pthread_setspecific(data_pool_key, pool);
+  if(err)
+    error(EXIT_FAILURE, err, "%s: the pool couldn't be attached to the "
+          "thread", __func__);
+  return prev;
+}
+
+
+
+
+
+/* Return a block of `size' bytes from the pool, if there is none (or
+   `pool==NULL'), allocate it. If `clear' is non-zero, the block will be
+   set to zero. */
+void *
+gal_data_pool_malloc(gal_data_pool_t *pool, size_t size, int clear)
+{
+  void *out;
+  size_t c, i=0;
+
+  /* The blocks in the size class of `size' may be smaller than it, but
+     any block in the next class is larger. */
+  if(pool && size<=pool->maxsize)
+    {
+      c=data_pool_class(size);
+      for(i=pool->num[c]; i>0; --i)
+        if(pool->size[c][i-1]>=size) break;
+      if(i==0 && c+1<GAL_DATA_POOL_CLASSES) i=pool->num[++c];
+
+      /* Take the block out of the pool (putting the last block of the
+         class in its place). */
+      if(i)
+        {
+          out=pool->block[c][i-1];
+          --pool->num[c];
+          pool->block[c][i-1]=pool->block[c][pool->num[c]];
+          pool->size[c][i-1]=pool->size[c][pool->num[c]];
+          if(clear) memset(out, 0, size);
+          return out;
+        }
+    }
+
+  /* Allocate a new block. */
+  errno=0;
+  out = clear ? calloc(size, 1) : malloc(size);
+  if(out==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes couldn't be allocated",
+          __func__, size);
+  return out;
+}
+
+
+
+
+
+/* Put a `malloc'd block (with at least `size' bytes) in the pool for
+   later usage. If the pool is full (or `pool==NULL'), it is freed. */
+void
+gal_data_pool_release(gal_data_pool_t *pool, void *block, size_t size)
+{
+  size_t c;
+
+  if(block==NULL) return;
+  if(pool && size && size<=pool->maxsize)
+    {
+      c=data_pool_class(size);
+      if(pool->num[c]<GAL_DATA_POOL_NUM)
+        {
+          pool->block[c][pool->num[c]]=block;
+          pool->size[c][pool->num[c]++]=size;
+          return;
+        }
+    }
+  free(block);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*********************************************************************/
 /*************          Size and allocation        *******************/
 /*********************************************************************/
@@ -178,47 +394,249 @@ gal_data_calloc_array(uint8_t type, size_t size, const char *funcname,
 
 
 
+/* Process-wide settings for keeping arrays out of the RAM: the directory
+   to host the memory-mapped files (`.gnuastro' in the running directory
+   when it is NULL), and the RAM budget (see `gal_data_ram_budget'). These
+   are set once at the start, so they are read without a lock. */
+static char   *data_mmap_dirname=NULL;
+static size_t  data_ram_budget=0;
+
+/* Information that is kept for some arrays outside of their datasets
+   (so `gal_data_t' doesn't have to change). When an array is freed, its
+   pointer is the only thing that can be trusted (for example its size may
+   have been changed since it was allocated), so the information is kept
+   in an open-addressing hash table keyed by the array's pointer (`tsize'
+   is a power of two). */
+struct data_table_entry
+{
+  void  *array;             /* Key: the dataset's array.               */
+  size_t size;              /* Number of bytes (depends on the table). */
+  void  *block;             /* Another allocation that belongs to it.  */
+};
+struct data_table
+{
+  size_t                   num;   /* Number of used entries.           */
+  size_t                 tsize;   /* Number of allocated entries.      */
+  struct data_table_entry *ent;   /* The entries.                      */
+};
+
+/* The arrays that are counted in the RAM budget and their sizes. */
+static size_t data_ram_used=0;
+static struct data_table data_ram_table={0, 0, NULL};
+static pthread_mutex_t data_ram_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+
+/* Set the directory to keep the memory-mapped files in. If `dir' is NULL,
+   the `.gnuastro' directory in the running directory will be used. */
+void
+gal_data_mmap_dir(char *dir)
+{
+  free(data_mmap_dirname);
+  data_mmap_dirname=NULL;
+  if(dir) gal_checkset_allocate_copy(dir, &data_mmap_dirname);
+}
+
+
+
+
+
+/* Set the maximum number of bytes that arrays (that are allocated
+   afterwards) can occupy in RAM. When it is non-zero, an array will only
+   be memory-mapped (kept in a file) when it doesn't fit in the remaining
+   budget, irrespective of its own size (arrays with a `minmapsize' of 0 are
+   always mapped and those with `-1' are always in RAM). */
+void
+gal_data_ram_budget(size_t budget)
+{
+  data_ram_budget=budget;
+}
+
+
+
+
+
+static size_t
+data_table_hash(struct data_table *t, void *array)
+{
+  return ( ((uintptr_t)array>>4) * 2654435761u ) & (t->tsize-1);
+}
+
+
+
+
+
+/* Remove `array' from the table (if it is there), put its entry in `out'
+   and return 1. If it isn't in the table, return 0. The table's mutex
+   must be locked. */
+static int
+data_table_remove(struct data_table *t, void *array,
+                  struct data_table_entry *out)
+{
+  size_t i, j, k, mask=t->tsize-1;
+
+  /* Find the array. */
+  if(t->num==0) return 0;
+  for(i=data_table_hash(t, array); t->ent[i].array!=array; i=(i+1)&mask)
+    if(t->ent[i].array==NULL) return 0;
+  *out=t->ent[i];
+
+  /* Empty its slot: the following entries (until the next empty slot)
+     that would not be reachable any more are shifted back into it. */
+  for(j=(i+1)&mask; t->ent[j].array; j=(j+1)&mask)
+    {
+      k=data_table_hash(t, t->ent[j].array);
+      if( i<=j ? (k<=i || k>j) : (k<=i && k>j) )
+        {
+          t->ent[i]=t->ent[j];
+          i=j;
+        }
+    }
+  t->ent[i].array=NULL;
+  --t->num;
+  return 1;
+}
+
+
+
+
+
+/* Add the entry `in' to the table (its array must not already be in the
+   table). The table's mutex must be locked. */
+static void
+data_table_add(struct data_table *t, struct data_table_entry *in)
+{
+  size_t i, osize=t->tsize;
+  struct data_table_entry *old=t->ent;
+
+  /* If the table is half full, re-build it with twice the size. */
+  if( 2*(t->num+1) > t->tsize )
+    {
+      t->num=0;
+      t->tsize = osize ? 2*osize : 64;
+      errno=0;
+      t->ent=calloc(t->tsize, sizeof *t->ent);
+      if(t->ent==NULL)
+        error(EXIT_FAILURE, errno, "%s: %zu bytes for the table of "
+              "arrays", __func__, t->tsize*sizeof *t->ent);
+      for(i=0;i<osize;++i)
+        if(old[i].array) data_table_add(t, &old[i]);
+      free(old);
+    }
+
+  /* Put it in the first empty slot. */
+  for(i=data_table_hash(t, in->array); t->ent[i].array;
+      i=(i+1)&(t->tsize-1)) ;
+  t->ent[i]=*in;
+  ++t->num;
+}
+
+
+
+
+
+/* If `size' bytes fit in the remaining RAM budget, count them and return
+   1, otherwise, return 0. */
+static int
+data_ram_reserve(size_t size)
+{
+  int fits;
+
+  pthread_mutex_lock(&data_ram_mutex);
+  fits = size <= data_ram_budget - data_ram_used;
+  if(fits) data_ram_used+=size;
+  pthread_mutex_unlock(&data_ram_mutex);
+  return fits;
+}
+
+
+
+
+
+/* Keep the array that was allocated after `data_ram_reserve'. If the same
+   pointer is already in the table, its previous array was freed outside
+   of Gnuastro (so it should not be counted any more). */
+static void
+data_ram_keep(void *array, size_t size)
+{
+  struct data_table_entry e;
+
+  pthread_mutex_lock(&data_ram_mutex);
+  if( data_table_remove(&data_ram_table, array, &e) )
+    data_ram_used -= e.size;
+  e.array=array;
+  e.size=size;
+  e.block=NULL;
+  data_table_add(&data_ram_table, &e);
+  pthread_mutex_unlock(&data_ram_mutex);
+}
+
+
+
+
+
+/* The array is being freed: if it was counted, remove it from the used
+   RAM. */
 static void
-gal_data_mmap(gal_data_t *data, int clear, size_t minmapsize)
+data_ram_release(void *array)
 {
-  int filedes;
-  uint8_t uc=0;
-  char *filename;
+  struct data_table_entry e;
+
+  pthread_mutex_lock(&data_ram_mutex);
+  if( data_table_remove(&data_ram_table, array, &e) )
+    data_ram_used -= e.size;
+  pthread_mutex_unlock(&data_ram_mutex);
+}
+
+
+
+
+
+/* Keep the array in a newly created file that is mapped into memory. The
+   mapping is shared with the file so the pages that are not used can be
+   written to the file (and freed from the RAM) by the kernel. */
+static void
+gal_data_mmap(gal_data_t *data, size_t minmapsize)
+{
+  int err, filedes;
+  char *filename, *dir;
   size_t bsize=data->size*gal_type_sizeof(data->type);
 
 
-  /* Check if the .gnuastro folder exists, write the file there. If it
-     doesn't exist, then make the .gnuastro directory.*/
-  gal_checkset_mkdir(".gnuastro");
+  /* Check if the directory exists, write the file there. If it doesn't
+     exist, then make it. */
+  dir = data_mmap_dirname ? data_mmap_dirname : "./.gnuastro";
+  gal_checkset_mkdir(dir);
 
 
   /* Set the filename */
-  gal_checkset_allocate_copy("./.gnuastro/mmap_XXXXXX", &filename);
+  if( asprintf(&filename, "%s/mmap_XXXXXX", dir)<0 )
+    error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
 
 
   /* Create a zero-sized file and keep its descriptor.  */
   errno=0;
-  /*filedes=open(filename, O_RDWR | O_CREAT | O_EXCL | O_TRUNC );*/
   filedes=mkstemp(filename);
   if(filedes==-1)
     error(EXIT_FAILURE, errno, "%s: %s couldn't be created",
           __func__, filename);
 
 
-  /* Make enough space to keep the array data. */
-  errno=0;
-  if( lseek(filedes, bsize, SEEK_SET) == -1 )
-    error(EXIT_FAILURE, errno, "%s: %s: unable to change file position by "
-          "%zu bytes", __func__, filename, bsize);
-
-
-  /* Write to the newly set file position so the space is allocated. To do
-     this, we are simply writing `uc' (a byte with value 0) into the space
-     we identified by `lseek' (above). This will ensure that this space is
-     set a side for this array and prepare us to use `mmap'. */
-  if( write(filedes, &uc, 1) == -1)
-    error(EXIT_FAILURE, errno, "%s: %s: unable to write one byte at the "
-          "%zu-th position", __func__, filename, bsize);
+  /* Make enough space to keep the array data. When possible, the space is
+     reserved on the disk, so a full disk is reported here (not as a crash
+     when the pages are later written). When the file system doesn't
+     support it, the file is just extended. In both cases, the file will
+     be filled with zeros. */
+#ifdef HAVE_POSIX_FALLOCATE
+  err=posix_fallocate(filedes, 0, bsize);
+  if(err==EINVAL || err==EOPNOTSUPP)
+#endif
+    err = ftruncate(filedes, bsize)==-1 ? errno : 0;
+  if(err)
+    error(EXIT_FAILURE, err, "%s: %s: unable to allocate %zu bytes",
+          __func__, filename, bsize);
 
 
   /* Map the memory. */
@@ -246,12 +664,50 @@ gal_data_mmap(gal_data_t *data, int clear, size_t minmapsize)
           __func__, filename);
 
 
-  /* Keep the filename. */
+  /* Keep the filename. Note that the new file is already filled with
+     zeros, so there is no need to clear the array (which would only make
+     all its pages dirty). */
   data->mmapname=filename;
+}
+
+
+
+
+
+/* Give the kernel a hint on how a memory-mapped array will be used (see
+   `enum gal_data_advise_values'). It is ignored when the array isn't
+   mapped. Arrays that are mapped from existing files may be private
+   copies of the file's pages, so they are never discarded. */
+void
+gal_data_advise(gal_data_t *data, int advice)
+{
+  int adv;
+  size_t shift;
 
+  /* Only mapped arrays are relevant. */
+  if(data->mmapname==NULL || data->array==NULL || data->size==0) return;
 
-  /* If it was supposed to be cleared, then clear the memory. */
-  if(clear) memset(data->array, 0, bsize);
+  /* Set the advice. */
+  switch(advice)
+    {
+    case GAL_DATA_ADVISE_NORMAL:     adv=MADV_NORMAL;       break;
+    case GAL_DATA_ADVISE_SEQUENTIAL: adv=MADV_SEQUENTIAL;   break;
+    case GAL_DATA_ADVISE_WILLNEED:   adv=MADV_WILLNEED;     break;
+    case GAL_DATA_ADVISE_DONTNEED:
+      if(data->flag & GAL_DATA_FLAG_MMAP_KEEP) return;
+      adv=MADV_DONTNEED;
+      break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+            "the problem. The advice code %d is not recognized", __func__,
+            PACKAGE_BUGREPORT, advice);
+      adv=0;
+    }
+
+  /* The advice is only a hint, so its errors are ignored. */
+  shift=(uintptr_t)(data->array) % sysconf(_SC_PAGESIZE);
+  madvise((char *)(data->array)-shift,
+          shift+data->size*gal_type_sizeof(data->type), adv);
 }
 
 
@@ -281,7 +737,9 @@ gal_data_initialize(gal_data_t *data, void *array, uint8_t type,
                     int clear, size_t minmapsize, char *name,
                     char *unit, char *comment)
 {
-  size_t i;
+  int counted;
+  size_t i, bsize;
+  gal_data_pool_t *pool=data_pool_current();
 
   /* Do the simple copying cases. For the display elements, set them all to
      impossible (negative) values so if not explicitly set by later steps,
@@ -309,12 +767,8 @@ gal_data_initialize(gal_data_t *data, void *array, uint8_t type,
      `dsize[0]=1', A 1D array also has `ndim=1', but `dsize[0]>1'. */
   if(ndim)
     {
-      /* Allocate dsize. */
-      errno=0;
-      data->dsize=malloc(ndim*sizeof *data->dsize);
-      if(data->dsize==NULL)
-        error(EXIT_FAILURE, errno, "%s: %zu bytes for data->dsize",
-              __func__, ndim*sizeof *data->dsize);
+      /* Allocate dsize (from this thread's pool if there is one). */
+      data->dsize=gal_data_pool_malloc(pool, ndim*sizeof *data->dsize, 0);
 
 
       /* Fill in the `dsize' array and in the meantime set `size': */
@@ -341,18 +795,22 @@ gal_data_initialize(gal_data_t *data, void *array, uint8_t type,
         {
           if(data->size)
             {
-              if( gal_type_sizeof(type)*data->size > minmapsize )
+              /* When there is a RAM budget, it decides if the array can
+                 be in RAM (unless `minmapsize' is 0 or -1). Otherwise,
+                 the array's size is compared with `minmapsize'. */
+              bsize=gal_type_sizeof(type)*data->size;
+              counted = ( data_ram_budget && minmapsize
+                          && minmapsize!=GAL_BLANK_SIZE_T );
+              if( counted ? !data_ram_reserve(bsize) : bsize>minmapsize )
                 /* Allocate the space into disk (HDD/SSD). */
-                gal_data_mmap(data, clear, minmapsize);
+                gal_data_mmap(data, minmapsize);
               else
-                /* Allocate the space in RAM. */
-                data->array = ( clear
-                                ? gal_data_calloc_array(data->type,
-                                                        data->size, __func__,
-                                                        "data->array")
-                                : gal_data_malloc_array(data->type,
-                                                        data->size, __func__,
-                                                        "data->array") );
+                {
+                  /* Allocate the space in RAM (from this thread's pool if
+                     there is one). */
+                  data->array = gal_data_pool_malloc(pool, bsize, clear);
+                  if(counted) data_ram_keep(data->array, bsize);
+                }
             }
           else data->array=NULL; /* The given size was zero! */
         }
@@ -379,12 +837,9 @@ gal_data_alloc(void *array, uint8_t type, size_t ndim, size_t *dsize,
 {
   gal_data_t *out;
 
-  /* Allocate the space for the actual structure. */
-  errno=0;
-  out=malloc(sizeof *out);
-  if(out==NULL)
-    error(EXIT_FAILURE, errno, "%s: %zu bytes for gal_data_t",
-          __func__, sizeof *out);
+  /* Allocate the space for the actual structure (from this thread's pool
+     if there is one). */
+  out=gal_data_pool_malloc(data_pool_current(), sizeof *out, 0);
 
   /* Initialize the allocated array. */
   gal_data_initialize(out, array, type, ndim, dsize, wcs, clear, minmapsize,
@@ -398,6 +853,171 @@ gal_data_alloc(void *array, uint8_t type, size_t ndim, size_t *dsize,
 
 
 
+/* The strings of a string dataset can be kept in one allocated block, to
+   avoid one allocation for every element. The block (and its size in
+   bytes) is kept in this table, keyed by the dataset's array (of pointers
+   to the strings). The elements of the dataset can later be re-ordered or
+   replaced by separately allocated strings (as in any string dataset). So
+   when it is freed, only the elements that aren't within the block are
+   freed separately. */
+static struct data_table data_str_table={0, 0, NULL};
+static pthread_mutex_t data_str_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+
+/* If the strings of `data' are in a block, remove it from the table, put
+   it in `e' and return 1, otherwise return 0. */
+static int
+data_str_block_remove(gal_data_t *data, struct data_table_entry *e)
+{
+  int found;
+
+  pthread_mutex_lock(&data_str_mutex);
+  found=data_table_remove(&data_str_table, data->array, e);
+  pthread_mutex_unlock(&data_str_mutex);
+  return found;
+}
+
+
+
+
+
+static int
+data_str_in_block(struct data_table_entry *e, char *str)
+{
+  return str>=(char *)(e->block) && str<(char *)(e->block)+e->size;
+}
+
+
+
+
+
+/* Allocate one block for all the strings of `data' (that must be a string
+   dataset without any allocated strings) with `width' bytes for each
+   string (including the final `\0'), and point its elements to their
+   place in the block. If `clear' is non-zero, the block will be filled
+   with zeros. The start of the first string is returned (for example to
+   read all the strings at once). */
+char *
+gal_data_str_block(gal_data_t *data, size_t width, int clear)
+{
+  size_t i;
+  struct data_table_entry e, old;
+  char *start, **strarr=data->array;
+  size_t nbytes=data->size*width;
+
+  /* A small sanity check. */
+  if(data->type!=GAL_TYPE_STRING || data->array==NULL)
+    error(EXIT_FAILURE, 0, "%s: the input must be an allocated string "
+          "dataset", __func__);
+
+  /* Allocate the block (with at least one byte, so it isn't NULL). */
+  errno=0;
+  start = ( clear
+            ? calloc(nbytes ? nbytes : 1, 1)
+            : malloc(nbytes ? nbytes : 1) );
+  if(start==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for the strings",
+          __func__, nbytes);
+
+  /* Keep it in the table. If the array already has a block, the array
+     was freed outside of Gnuastro and re-allocated with the same address,
+     so the old block isn't used any more. */
+  e.array=data->array;
+  e.size=nbytes;
+  e.block=start;
+  pthread_mutex_lock(&data_str_mutex);
+  if( data_table_remove(&data_str_table, data->array, &old) )
+    free(old.block);
+  data_table_add(&data_str_table, &e);
+  pthread_mutex_unlock(&data_str_mutex);
+
+  /* Point the elements to their strings. */
+  for(i=0;i<data->size;++i) strarr[i]=start+i*width;
+  return start;
+}
+
+
+
+
+
+/* Copy the strings of `data' that are in its block of strings (if it has
+   one) into separately allocated strings and free the block. Afterwards,
+   every element can be freed or re-allocated separately. */
+void
+gal_data_str_unblock(gal_data_t *data)
+{
+  size_t i;
+  struct data_table_entry e;
+  char *tmp, **strarr=data->array;
+
+  if( data->type!=GAL_TYPE_STRING || data->array==NULL
+      || data_str_block_remove(data, &e)==0 )
+    return;
+  for(i=0;i<data->size;++i)
+    if( data_str_in_block(&e, strarr[i]) )
+      {
+        gal_checkset_allocate_copy(strarr[i], &tmp);
+        strarr[i]=tmp;
+      }
+  free(e.block);
+}
+
+
+
+
+
+/* Free the array of a dataset (and nothing else), then set it to NULL. It
+   may be in RAM (possibly counted in the RAM budget, or kept in this
+   thread's pool) or memory-mapped to a file, so when a dataset's array has
+   to be freed or replaced (for example with an array of another size),
+   this function should be used, not `free'. Note that the array is freed
+   with the dataset's current size and type, so they should only be changed
+   afterwards. When the dataset is a tile (its `block' isn't NULL), its
+   array belongs to the block and isn't freed. */
+void
+gal_data_release_array(gal_data_t *data)
+{
+  size_t shift;
+
+  if(data->mmapname)
+    {
+      /* Unmap the array (the mapping starts at the start of the page
+         that contains it), then delete the file keeping it (unless it
+         must be kept). Unmapping first, the kernel doesn't have to write
+         the dirty pages of a file that is going to be deleted. */
+      if(data->array)
+        {
+          shift=(uintptr_t)(data->array) % sysconf(_SC_PAGESIZE);
+          munmap((char *)(data->array)-shift,
+                 shift+data->size*gal_type_sizeof(data->type));
+        }
+      if( (data->flag & GAL_DATA_FLAG_MMAP_KEEP)==0 )
+        remove(data->mmapname);
+
+      /* Free the file name space. */
+      free(data->mmapname);
+
+      /* Set the name pointer to NULL since it has been freed. */
+      data->mmapname=NULL;
+      data->flag &= ~GAL_DATA_FLAG_MMAP_KEEP;
+    }
+  else
+    if(data->array && data->block==NULL)
+      {
+        if(data_ram_budget) data_ram_release(data->array);
+        gal_data_pool_release(data_pool_current(), data->array,
+                              data->size*gal_type_sizeof(data->type));
+      }
+  data->array=NULL;
+}
+
+
+
+
+
 /* Free the allocated contents of a data structure, not the structure
    itsself. The reason that this function is separate from `gal_data_free'
    is that the data structure might be allocated as an array (statically
@@ -418,6 +1038,8 @@ gal_data_free_contents(gal_data_t *data)
 {
   size_t i;
   char **strarr;
+  struct data_table_entry e;
+  gal_data_pool_t *pool=data_pool_current();
 
   if(data==NULL)
     error(EXIT_FAILURE, 0, "%s: the input data structure to "
@@ -426,7 +1048,11 @@ gal_data_free_contents(gal_data_t *data)
   /* Free all the possible allocations. */
   if(data->name)    { free(data->name);    data->name    = NULL; }
   if(data->unit)    { free(data->unit);    data->unit    = NULL; }
-  if(data->dsize)   { free(data->dsize);   data->dsize   = NULL; }
+  if(data->dsize)
+    {
+      gal_data_pool_release(pool, data->dsize, data->ndim*sizeof *data->dsize);
+      data->dsize = NULL;
+    }
   if(data->wcs)     { wcsfree(data->wcs);  data->wcs     = NULL; }
   if(data->comment) { free(data->comment); data->comment = NULL; }
 
@@ -436,24 +1062,20 @@ gal_data_free_contents(gal_data_t *data)
   if(data->type==GAL_TYPE_STRING && data->array)
     {
       strarr=data->array;
-      for(i=0;i<data->size;++i) free(strarr[i]);
+      if( data_str_block_remove(data, &e) )
+        {
+          /* Only free the strings that have been replaced (that aren't in
+             the block), then free the block. */
+          for(i=0;i<data->size;++i)
+            if( !data_str_in_block(&e, strarr[i]) ) free(strarr[i]);
+          free(e.block);
+        }
+      else
+        for(i=0;i<data->size;++i) free(strarr[i]);
     }
 
   /* Free the array. */
-  if(data->mmapname)
-    {
-      /* Delete the file keeping the array. */
-      remove(data->mmapname);
-
-      /* Free the file name space. */
-      free(data->mmapname);
-
-      /* Set the name pointer to NULL since it has been freed. */
-      data->mmapname=NULL;
-    }
-  else
-    if(data->array && data->block==NULL) free(data->array);
-  data->array=NULL;
+  gal_data_release_array(data);
 }
 
 
@@ -468,7 +1090,7 @@ gal_data_free(gal_data_t *data)
   if(data)
     {
       gal_data_free_contents(data);
-      free(data);
+      gal_data_pool_release(data_pool_current(), data, sizeof *data);
     }
 }
 
@@ -949,8 +1571,10 @@ gal_data_copy_to_allocated(gal_data_t *in, gal_data_t *out)
           "of dimensions, the dimensions are %zu and %zu respectively",
           __func__, out->ndim, in->ndim);
 
-  /* Write the basic meta-data. */
-  out->flag           = in->flag;
+  /* Write the basic meta-data. The output's array keeps its own
+     allocation. */
+  out->flag           = ( ( in->flag & ~GAL_DATA_FLAG_MMAP_KEEP )
+                          | ( out->flag & GAL_DATA_FLAG_MMAP_KEEP ) );
   out->next           = in->next;
   out->status         = in->status;
   out->disp_width     = in->disp_width;
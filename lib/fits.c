@@ -27,9 +27,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <error.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include <gsl/gsl_version.h>
 
@@ -39,6 +42,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/fits.h>
 #include <gnuastro/tile.h>
 #include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/checkset.h>
 #include <gnuastro-internal/tableintern.h>
@@ -1576,6 +1580,275 @@ gal_fits_img_read(char *filename, char *hdu, size_t minmapsize,
 
 
 
+
+/* Parameters to convert the (big-endian) pixels of a mapped FITS image
+   into the host's format, in an allocated array, on multiple threads. */
+struct fits_img_mmap_params
+{
+  void              *map;   /* The (read-only) mapped pixels.           */
+  gal_data_t        *img;   /* The output image.                        */
+  size_t        numparts;   /* Number of parts to divide the image into.*/
+  int               swap;   /* The bytes have to be swapped.            */
+  uint64_t          flip;   /* Mask of sign bit (unsigned conventions). */
+};
+
+
+#define FITS_BSWAP16(X) ( (uint16_t)( ( (X) >> 8 ) | ( (X) << 8 ) ) )
+#define FITS_BSWAP32(X) ( ( (X) >> 24 ) | ( ( (X) >> 8 ) & 0xff00 )     \
+                          | ( ( (X) << 8 ) & 0xff0000 ) | ( (X) << 24 ) )
+#define FITS_BSWAP64(X) ( ( (uint64_t)FITS_BSWAP32( (uint32_t)(X) ) << 32 ) \
+                          | FITS_BSWAP32( (uint32_t)( (X) >> 32 ) ) )
+
+#define FITS_IMG_MMAP_CONVERT(IT, BSWAP) {                              \
+    IT *a=mprm->img->array, *m=mprm->map, f=mprm->flip;                 \
+    if(mprm->swap) for(j=start;j<end;++j) a[j] = BSWAP(m[j]) ^ f;       \
+    else           for(j=start;j<end;++j) a[j] = m[j] ^ f;              \
+  }
+
+static void *
+fits_img_mmap_convert_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct fits_img_mmap_params *mprm=(struct fits_img_mmap_params *)tprm->params;
+
+  uintptr_t first, last;
+  size_t i, j, start, end, size=mprm->img->size;
+  size_t width=gal_type_sizeof(mprm->img->type);
+  size_t pagesize=sysconf(_SC_PAGESIZE);
+
+  /* Go over all the parts that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      start = tprm->indexs[i]     * size / mprm->numparts;
+      end   = (tprm->indexs[i]+1) * size / mprm->numparts;
+      switch( width )
+        {
+        case 1: FITS_IMG_MMAP_CONVERT(uint8_t,  );             break;
+        case 2: FITS_IMG_MMAP_CONVERT(uint16_t, FITS_BSWAP16); break;
+        case 4: FITS_IMG_MMAP_CONVERT(uint32_t, FITS_BSWAP32); break;
+        case 8: FITS_IMG_MMAP_CONVERT(uint64_t, FITS_BSWAP64); break;
+        default:
+          error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to "
+                "fix the problem. Element size %zu is not recognized",
+                __func__, PACKAGE_BUGREPORT, width);
+        }
+
+      /* The mapped pages that are fully within this part are no longer
+         needed, so they can be dropped from RAM (they are still in the
+         file's cache if other programs need them). */
+      first = ( ( (uintptr_t)mprm->map + start*width + pagesize - 1 )
+                / pagesize * pagesize );
+      last  = ( (uintptr_t)mprm->map + end*width ) / pagesize * pagesize;
+      if(last>first) madvise((void *)first, last-first, MADV_DONTNEED);
+    }
+
+  /* Wait for all the other threads to finish. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Return the mask of the sign bit when the image's type was changed from
+   the FITS standard's type for `bitpix' because of the standard `BZERO'
+   conventions for unsigned (or signed 8-bit) integers (with the bits of
+   each pixel, this is just a flip of the sign bit). If the pixels in the
+   file can't be used as they are (after swapping the bytes), return -1. */
+static int64_t
+fits_img_mmap_flip(fitsfile *fptr, int bitpix, uint8_t type)
+{
+  long long blank;
+  int status=0, istatus;
+  double bscale=1, bzero=0;
+
+  /* Read the scaling keywords (the defaults are used if they don't
+     exist). */
+  fits_read_key(fptr, TDOUBLE, "BSCALE", &bscale, NULL, &status);
+  if(status==KEY_NO_EXIST) status=0;
+  fits_read_key(fptr, TDOUBLE, "BZERO", &bzero, NULL, &status);
+  if(status==KEY_NO_EXIST) status=0;
+  if(status || bscale!=1) return -1;
+
+  /* Blank integer pixels must be replaced by Gnuastro's blank value. */
+  istatus=0;
+  if( bitpix>0
+      && fits_read_key(fptr, TLONGLONG, "BLANK", &blank, NULL,
+                       &istatus)==0 )
+    return -1;
+
+  /* The type must be the standard's type, or one of the conventions. */
+  if(bzero==0)
+    return type==gal_fits_bitpix_to_type(bitpix) ? 0 : -1;
+  switch(type)
+    {
+    case GAL_TYPE_INT8:   return bitpix==BYTE_IMG     && bzero==-128
+                            ? 0x80 : -1;
+    case GAL_TYPE_UINT16: return bitpix==SHORT_IMG    && bzero==32768
+                            ? 0x8000 : -1;
+    case GAL_TYPE_UINT32: return bitpix==LONG_IMG
+                            && bzero==2147483648.0 ? 0x80000000 : -1;
+    case GAL_TYPE_UINT64: return bitpix==LONGLONG_IMG
+                            && bzero==9223372036854775808.0
+                            ? (int64_t)0x8000000000000000ULL : -1;
+    default:              return -1;
+    }
+}
+
+
+
+
+
+/* Map the data unit of an image HDU (that starts at `datastart' in
+   `filename') into memory. The mapping is private (copy-on-write), so the
+   file isn't changed when the array is changed, with `readonly', the
+   mapped pixels can't be changed at all. The mapping has to start
+   on a page boundary, so it starts from the page that contains the first
+   pixel (FITS blocks are 2880 bytes, so the data is always aligned to 64
+   bytes). If the file can't be mapped, or its bytes at `headstart' aren't
+   the start of a FITS header (for example compressed files that CFITSIO
+   reads into memory), this function will return NULL. */
+static void *
+fits_img_mmap_data(char *filename, long long headstart,
+                   long long datastart, size_t nbytes, int readonly)
+{
+  int fd;
+  char start[9];
+  void *map=MAP_FAILED;
+  size_t pagesize=sysconf(_SC_PAGESIZE);
+  size_t shift=(size_t)datastart % pagesize;
+
+  /* Open the file and check the start of the HDU. */
+  fd=open(filename, O_RDONLY);
+  if(fd==-1) return NULL;
+  if( pread(fd, start, sizeof start, headstart)==sizeof start
+      && ( strncmp(start, "SIMPLE  =", sizeof start)==0
+           || strncmp(start, "XTENSION=", sizeof start)==0 ) )
+    map=mmap(NULL, shift+nbytes,
+             readonly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_PRIVATE,
+             fd, datastart-shift);
+  close(fd);
+
+  /* Return the pointer to the first pixel. */
+  return map==MAP_FAILED ? NULL : (char *)map+shift;
+}
+
+
+
+
+
+/* Read a FITS image HDU by mapping its data unit into memory, instead of
+   reading it through CFITSIO. This is only possible when the image isn't
+   compressed, isn't scaled (other than the standard conventions for
+   unsigned integers) and integer images don't have a `BLANK' keyword,
+   otherwise the image is read with `gal_fits_img_read'.
+
+   When the pixels in the file can be used as they are (single-byte types
+   with no conversion, or any type on big-endian hosts), the mapped array
+   is directly used in the output (privately, so changing it doesn't
+   change the file). Otherwise (for example images with more than one byte
+   per pixel on little-endian hosts), the data unit is mapped read-only
+   and its pixels are converted (their bytes swapped and their sign bit
+   flipped for the unsigned conventions) on `numthreads' threads into an
+   array that is allocated like any other array (so it is kept in a file
+   when it is larger than `minmapsize' or the RAM budget). Each thread
+   drops the pages it has converted from RAM, so the mapped file doesn't
+   add to the memory that is used. */
+gal_data_t *
+gal_fits_img_read_mmap(char *filename, char *hdu, size_t numthreads,
+                       size_t minmapsize, size_t hstartwcs, size_t hendwcs)
+{
+  gal_data_t *img;
+  void *map=NULL;
+  size_t i, ndim, size, nbytes, *dsize;
+  char *name=NULL, *unit=NULL;
+  struct fits_img_mmap_params mprm;
+  int64_t flip=-1;
+  const uint16_t endian=1;
+  fitsfile *fptr;
+  int status=0, type, bitpix, convert=0;
+  long long headstart, datastart, dataend;
+  size_t shift, pagesize=sysconf(_SC_PAGESIZE);
+
+  /* Open the HDU and get its basic information. */
+  fptr=gal_fits_hdu_open_format(filename, hdu, 0);
+  gal_fits_img_info(fptr, &type, &ndim, &dsize, &name, &unit);
+
+  /* See if the data unit can be mapped. */
+  if( ndim
+      && fits_get_img_type(fptr, &bitpix, &status)==0
+      && fits_is_compressed_image(fptr, &status)==0
+      && fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend,
+                            &status)==0
+      && (flip=fits_img_mmap_flip(fptr, bitpix, type))!=-1 )
+    {
+      for(size=1, i=0; i<ndim; ++i) size*=dsize[i];
+      nbytes=size*gal_type_sizeof(type);
+      mprm.swap=*(uint8_t *)(&endian)==1 && gal_type_sizeof(type)>1;
+      convert = mprm.swap || flip;
+      map=fits_img_mmap_data(filename, headstart, datastart, nbytes,
+                             convert);
+    }
+  status=0;
+
+  /* If it can't be mapped, read it normally. */
+  if(map==NULL)
+    {
+      fits_close_file(fptr, &status);
+      gal_fits_io_error(status, NULL);
+      free(dsize);
+      free(name);
+      free(unit);
+      return gal_fits_img_read(filename, hdu, minmapsize, hstartwcs,
+                               hendwcs);
+    }
+
+  /* When the pixels have to be converted, allocate the output's array
+     (like any other array) and convert the mapped pixels into it, then
+     unmap the file. */
+  if(convert)
+    {
+      img=gal_data_alloc(NULL, type, ndim, dsize, NULL, 0, minmapsize,
+                         name, unit, NULL);
+      mprm.map=map;
+      mprm.img=img;
+      mprm.flip=flip;
+      mprm.numparts = numthreads > img->size ? img->size : numthreads;
+      gal_threads_spin_off(fits_img_mmap_convert_on_thread, &mprm,
+                           mprm.numparts, numthreads);
+      shift=(uintptr_t)map % pagesize;
+      munmap((char *)map-shift, shift+nbytes);
+    }
+
+  /* Otherwise, put the mapped array into the output. */
+  else
+    {
+      img=gal_data_alloc(map, type, ndim, dsize, NULL, 0, minmapsize,
+                         name, unit, NULL);
+      img->flag |= GAL_DATA_FLAG_MMAP_KEEP;
+      gal_checkset_allocate_copy(filename, &img->mmapname);
+      gal_data_advise(img, GAL_DATA_ADVISE_WILLNEED);
+    }
+  free(dsize);
+  free(name);
+  free(unit);
+
+  /* Read the WCS structure (if the FITS file has any). */
+  img->wcs=gal_wcs_read_fitsptr(fptr, hstartwcs, hendwcs, &img->nwcs);
+
+  /* Close the input FITS file. */
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Return the filled data structure. */
+  return img;
+}
+
+
+
+
+
 /* The user has specified an input file + extension, and your program needs
    this input to be a special type. For such cases, this function can be
    used to convert the input file to the desired type. */
@@ -1659,26 +1932,22 @@ gal_fits_img_read_kernel(char *filename, char *hdu, size_t minmapsize)
 
 
 
-/* This function will write all the data array information (including its
-   WCS information) into a FITS file, but will not close it. Instead it
-   will pass along the FITS pointer for further modification. */
+/* Create an image HDU in `filename' with the given type and dimensions
+   (`dsize' has `ndim' elements, in C order) and return the CFITSIO
+   pointer. The image's data can then be written in parts with
+   `gal_fits_img_write_part' and its keywords with
+   `gal_fits_img_write_keys'. CFITSIO doesn't have a macro for UINT64,
+   TLONGLONG is only for (signed) INT64. So if the dataset has that type,
+   the image will be INT64 with a shifted zero (see
+   `gal_fits_img_write_part'). */
 fitsfile *
-gal_fits_img_write_to_ptr(gal_data_t *input, char *filename)
+gal_fits_img_write_create(char *filename, uint8_t type, size_t ndim,
+                          size_t *dsize)
 {
-  void *blank;
-  int64_t *i64;
+  size_t i;
+  long *naxes;
   fitsfile *fptr;
-  uint64_t *u64, *u64f;
-  long fpixel=1, *naxes;
-  char *wcsstr, *u64key;
-  size_t i, ndim=input->ndim;
-  int nkeyrec, hasblank, status=0, datatype=0;
-  gal_data_t *i64data, *towrite, *block=gal_tile_block(input);
-
-  /* If the input is a tile (isn't a contiguous region of memory), then
-     copy it into a contiguous region. */
-  towrite = input==block ? input : gal_data_copy(input);
-  hasblank=gal_blank_present(towrite, 0);
+  int status=0;
 
   /* Allocate the naxis area. */
   naxes=gal_data_malloc_array( ( sizeof(long)==8
@@ -1691,23 +1960,65 @@ gal_fits_img_write_to_ptr(gal_data_t *input, char *filename)
 
 
   /* Fill the `naxes' array (in opposite order, and `long' type): */
-  for(i=0;i<ndim;++i) naxes[ndim-1-i]=towrite->dsize[i];
+  for(i=0;i<ndim;++i) naxes[ndim-1-i]=dsize[i];
+
+
+  /* Create the image. */
+  fits_create_img(fptr, ( type==GAL_TYPE_UINT64
+                          ? LONGLONG_IMG
+                          : gal_fits_type_to_bitpix(type) ),
+                  ndim, naxes, &status);
+  gal_fits_io_error(status, NULL);
 
 
-  /* Create the FITS file. Unfortunately CFITSIO doesn't have a macro for
-     UINT64, TLONGLONG is only for (signed) INT64. So if the dataset has
-     that type, we'll have to convert it to `INT64' and in the mean-time
-     shift its zero, we will then have to write the BZERO and BSCALE
-     keywords accordingly. */
-  if(block->type==GAL_TYPE_UINT64)
+  /* Remove the two comment lines put by CFITSIO. Note that in some cases,
+     it might not exist. When this happens, the status value will be
+     non-zero. We don't care about this error, so to be safe, we will just
+     reset the status variable after these calls. */
+  fits_delete_key(fptr, "COMMENT", &status);
+  fits_delete_key(fptr, "COMMENT", &status);
+  status=0;
+
+
+  /* Clean up and return. */
+  free(naxes);
+  return fptr;
+}
+
+
+
+
+
+/* Write the elements of `input' (which must be contiguous: not a tile)
+   into the image of `fptr' (created with `gal_fits_img_write_create'),
+   starting from element `start' (counting from zero, in the order of the
+   image in memory). The image can thus be written in parts, for example a
+   range of rows at a time. If any of the written elements were blank,
+   this function will return 1, otherwise 0 (to be given to
+   `gal_fits_img_write_keys' after all the parts are written). */
+int
+gal_fits_img_write_part(fitsfile *fptr, gal_data_t *input, size_t start)
+{
+  int64_t *i64;
+  uint64_t *u64, *u64f;
+  int hasblank, status=0;
+  gal_data_t *i64data=NULL;
+
+  /* See if there are any blank elements. */
+  hasblank=gal_blank_present(input, 0);
+
+  /* If the dataset is UINT64, convert it to INT64 and shift its zero, the
+     BZERO and BSCALE keywords will be written accordingly. */
+  if(input->type==GAL_TYPE_UINT64)
     {
       /* Allocate the necessary space. */
-      i64data=gal_data_alloc(NULL, GAL_TYPE_INT64, ndim, towrite->dsize,
-                             NULL, 0, block->minmapsize, NULL, NULL, NULL);
+      i64data=gal_data_alloc(NULL, GAL_TYPE_INT64, input->ndim,
+                             input->dsize, NULL, 0, input->minmapsize,
+                             NULL, NULL, NULL);
 
       /* Copy the values while making the conversion. */
       i64=i64data->array;
-      u64f=(u64=towrite->array)+towrite->size;
+      u64f=(u64=input->array)+input->size;
       if(hasblank)
         {
           do *i64++ = ( *u64==GAL_BLANK_UINT64
@@ -1719,58 +2030,55 @@ gal_fits_img_write_to_ptr(gal_data_t *input, char *filename)
         do *i64++ = (*u64 + INT64_MIN); while(++u64<u64f);
 
       /* We can now use CFITSIO's signed-int64 type macros. */
-      datatype=TLONGLONG;
-      fits_create_img(fptr, LONGLONG_IMG, ndim, naxes, &status);
-      gal_fits_io_error(status, NULL);
+      fits_write_img(fptr, TLONGLONG, start+1, i64data->size,
+                     i64data->array, &status);
+      gal_data_free(i64data);
+    }
+  else
+    fits_write_img(fptr, gal_fits_type_to_datatype(input->type), start+1,
+                   input->size, input->array, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Return the blank flag. */
+  return hasblank;
+}
+
 
 
-      /* Write the image into the file. */
-      fits_write_img(fptr, datatype, fpixel, i64data->size, i64data->array,
-                     &status);
-      gal_fits_io_error(status, NULL);
 
 
-      /* We need to write the BZERO and BSCALE keywords manually. VERY
-         IMPORTANT: this has to be done after writing the array. We cannot
-         write this huge integer as a variable, so we'll simply write the
-         full record/card. It is just important that the string be larger
-         than 80 characters, CFITSIO will trim the rest of the string. */
+/* Write the keywords of the image in `fptr' that describe `input': the
+   BZERO and BSCALE keywords of UINT64 images, the BLANK keyword if any
+   written element was blank (`hasblank', see `gal_fits_img_write_part'),
+   its name, units, comments and WCS. The BZERO and BSCALE keywords have to
+   be written after the data, so this should be called after all the parts
+   of the image are written. */
+void
+gal_fits_img_write_keys(fitsfile *fptr, gal_data_t *input, int hasblank)
+{
+  void *blank;
+  char *wcsstr, *u64key;
+  int nkeyrec, status=0;
+
+  /* We need to write the BZERO and BSCALE keywords manually. VERY
+     IMPORTANT: this has to be done after writing the array. We cannot
+     write this huge integer as a variable, so we'll simply write the full
+     record/card. It is just important that the string be larger than 80
+     characters, CFITSIO will trim the rest of the string. */
+  if(input->type==GAL_TYPE_UINT64)
+    {
       u64key="BZERO   =  9223372036854775808 / Offset of data                                         ";
       fits_write_record(fptr, u64key, &status);
       u64key="BSCALE  =                    1 / Default scaling factor                                 ";
       fits_write_record(fptr, u64key, &status);
       gal_fits_io_error(status, NULL);
     }
-  else
-    {
-      /* Set the datatype */
-      datatype=gal_fits_type_to_datatype(block->type);
-
-      /* Create the FITS file. */
-      fits_create_img(fptr, gal_fits_type_to_bitpix(towrite->type),
-                      ndim, naxes, &status);
-      gal_fits_io_error(status, NULL);
-
-      /* Write the image into the file. */
-      fits_write_img(fptr, datatype, fpixel, towrite->size, towrite->array,
-                     &status);
-      gal_fits_io_error(status, NULL);
-    }
-
-
-  /* Remove the two comment lines put by CFITSIO. Note that in some cases,
-     it might not exist. When this happens, the status value will be
-     non-zero. We don't care about this error, so to be safe, we will just
-     reset the status variable after these calls. */
-  fits_delete_key(fptr, "COMMENT", &status);
-  fits_delete_key(fptr, "COMMENT", &status);
-  status=0;
 
 
   /* If we have blank pixels, we need to define a BLANK keyword when we are
      dealing with integer types. */
   if(hasblank)
-    switch(towrite->type)
+    switch(input->type)
       {
       case GAL_TYPE_FLOAT32:
       case GAL_TYPE_FLOAT64:
@@ -1779,36 +2087,38 @@ gal_fits_img_write_to_ptr(gal_data_t *input, char *filename)
         break;
 
       default:
-        blank=gal_fits_key_img_blank(towrite->type);
-        if(fits_write_key(fptr, datatype, "BLANK", blank,
-                          "Pixels with no data.", &status) )
+        blank=gal_fits_key_img_blank(input->type);
+        if(fits_write_key(fptr, ( input->type==GAL_TYPE_UINT64
+                                  ? TLONGLONG
+                                  : gal_fits_type_to_datatype(input->type) ),
+                          "BLANK", blank, "Pixels with no data.", &status) )
           gal_fits_io_error(status, "adding the BLANK keyword");
         free(blank);
       }
 
 
   /* Write the extension name to the header. */
-  if(towrite->name)
-    fits_write_key(fptr, TSTRING, "EXTNAME", towrite->name, "", &status);
+  if(input->name)
+    fits_write_key(fptr, TSTRING, "EXTNAME", input->name, "", &status);
 
 
   /* Write the units to the header. */
-  if(towrite->unit)
-    fits_write_key(fptr, TSTRING, "BUNIT", towrite->unit, "", &status);
+  if(input->unit)
+    fits_write_key(fptr, TSTRING, "BUNIT", input->unit, "", &status);
 
 
   /* Write comments if they exist. */
-  if(towrite->comment)
-    fits_write_comment(fptr, towrite->comment, &status);
+  if(input->comment)
+    fits_write_comment(fptr, input->comment, &status);
 
   /* If a WCS structure is present, write it in */
-  if(towrite->wcs)
+  if(input->wcs)
     {
       /* Decompose the `PCi_j' matrix and `CDELTi' vector. */
-      gal_wcs_decompose_pc_cdelt(towrite->wcs);
+      gal_wcs_decompose_pc_cdelt(input->wcs);
 
       /* Convert the WCS information to text. */
-      status=wcshdo(WCSHDO_safe, towrite->wcs, &nkeyrec, &wcsstr);
+      status=wcshdo(WCSHDO_safe, input->wcs, &nkeyrec, &wcsstr);
       if(status)
         error(EXIT_FAILURE, 0, "%s: wcshdo ERROR %d: %s", __func__,
               status, wcs_errmsg[status]);
@@ -1816,8 +2126,34 @@ gal_fits_img_write_to_ptr(gal_data_t *input, char *filename)
     }
 
   /* Report any errors if we had any */
-  free(naxes);
   gal_fits_io_error(status, NULL);
+}
+
+
+
+
+
+/* This function will write all the data array information (including its
+   WCS information) into a FITS file, but will not close it. Instead it
+   will pass along the FITS pointer for further modification. */
+fitsfile *
+gal_fits_img_write_to_ptr(gal_data_t *input, char *filename)
+{
+  int hasblank;
+  fitsfile *fptr;
+  gal_data_t *towrite, *block=gal_tile_block(input);
+
+  /* If the input is a tile (isn't a contiguous region of memory), then
+     copy it into a contiguous region. */
+  towrite = input==block ? input : gal_data_copy(input);
+
+  /* Create the image, write its data, then its keywords. */
+  fptr=gal_fits_img_write_create(filename, towrite->type, towrite->ndim,
+                                 towrite->dsize);
+  hasblank=gal_fits_img_write_part(fptr, towrite, 0);
+  gal_fits_img_write_keys(fptr, towrite, hasblank);
+
+  /* Clean up and return. */
   if(towrite!=input) gal_data_free(towrite);
   return fptr;
 }
@@ -2347,25 +2683,40 @@ gal_fits_tab_info(char *filename, char *hdu, size_t *numcols,
 /* Read the column indexs given in the `indexll' linked list from a FITS
    table into a linked list of data structures, note that this is a
    low-level function, so the output data linked list is the inverse of the
-   input indexs linked list. */
+   input indexs linked list.
+
+   FITS tables are stored row by row, so reading the full length of each
+   column separately would parse the whole table once for every column. To
+   avoid this, the rows are read in blocks that fit in CFITSIO's buffers
+   (with the number that CFITSIO suggests) and all the requested columns
+   are read over each block before going onto the next. */
 gal_data_t *
 gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                   gal_data_t *allcols, gal_list_sizet_t *indexll,
                   int minmapsize)
 {
-  size_t i=0;
-  void *blank;
-  size_t dsize;
-  char **strarr;
+  long nblock;
   fitsfile *fptr;
-  gal_data_t *out=NULL;
-  int status=0, anynul=0;
   gal_list_sizet_t *ind;
+  int status=0, anynul=0;
+  gal_data_t *col, *out=NULL, **cols;
+  size_t i, dsize, numcols, start, num;
+  void **blanks;
 
   /* Open the FITS file */
   fptr=gal_fits_hdu_open_format(filename, hdu, 1);
 
-  /* Pop each index and read/store the array. */
+  /* Allocate the array of pointers to the columns (in the order of
+     `indexll') and their blank values. */
+  numcols=gal_list_sizet_number(indexll);
+  errno=0;
+  cols=malloc(numcols*sizeof *cols);
+  blanks=malloc(numcols*sizeof *blanks);
+  if( numcols && (cols==NULL || blanks==NULL) )
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate the column pointers",
+          __func__);
+
+  /* Allocate each column's dataset (including the array). */
   for(ind=indexll; ind!=NULL; ind=ind->next)
     {
       /* Allocate the necessary data structure (including the array) for
@@ -2378,28 +2729,47 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
       /* For a string column, we need an allocated array for each element,
          even in binary values. This value should be stored in the
          disp_width element of the data structure, which is done
-         automatically in `gal_fits_table_info'. */
-      if(out->type==GAL_TYPE_STRING)
-        for(i=0;i<numrows;++i)
-          {
-            strarr=out->array;
-            errno=0;
-            strarr[i]=calloc(allcols[ind->v].disp_width+1, sizeof *strarr[i]);
-            if(strarr[i]==NULL)
-              error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
-                    "strarr[%zu]", __func__,
-                    (allcols[ind->v].disp_width+1) * sizeof *strarr[i], i);
-          }
+         automatically in `gal_fits_table_info'. To avoid one allocation
+         for every row, the space for all the strings of the column is
+         allocated as one block. */
+      if(out->type==GAL_TYPE_STRING && numrows)
+        gal_data_str_block(out, allcols[ind->v].disp_width+1, 1);
+    }
 
-      /* Allocate a blank value for the given type and read/store the
-         column using CFITSIO. Afterwards, free the blank value. */
-      blank=gal_blank_alloc_write(out->type);
-      fits_read_col(fptr, gal_fits_type_to_datatype(out->type), ind->v+1,
-                    1, 1, out->size, blank, out->array, &anynul, &status);
-      gal_fits_io_error(status, NULL);
-      free(blank);
+  /* The output list is the inverse of `indexll', so put the columns in
+     the same order as `indexll' and allocate a blank value for each. */
+  i=numcols;
+  for(col=out; col!=NULL; col=col->next)
+    {
+      cols[--i]=col;
+      blanks[i]=gal_blank_alloc_write(col->type);
+    }
+
+  /* Number of rows to read in each block. */
+  fits_get_rowsize(fptr, &nblock, &status);
+  gal_fits_io_error(status, NULL);
+  if(nblock<1) nblock=1;
+
+  /* Read all the columns over each block of rows. */
+  for(start=0; start<numrows; start+=nblock)
+    {
+      num = numrows-start < (size_t)nblock ? numrows-start : (size_t)nblock;
+      for(i=0, ind=indexll; ind!=NULL; ++i, ind=ind->next)
+        {
+          fits_read_col(fptr, gal_fits_type_to_datatype(cols[i]->type),
+                        ind->v+1, start+1, 1, num, blanks[i],
+                        gal_data_ptr_increment(cols[i]->array, start,
+                                               cols[i]->type),
+                        &anynul, &status);
+          gal_fits_io_error(status, NULL);
+        }
     }
 
+  /* Clean up. */
+  for(i=0;i<numcols;++i) free(blanks[i]);
+  free(blanks);
+  free(cols);
+
   /* Close the FITS file */
   fits_close_file(fptr, &status);
   gal_fits_io_error(status, NULL);
@@ -2429,6 +2799,10 @@ fits_string_fixed_alloc_size(gal_data_t *data)
   for(i=0;i<data->size;++i)
     maxlen = strlen(strarr[i])>maxlen ? strlen(strarr[i]) : maxlen;
 
+  /* When the strings are in one block, they can't be freed separately,
+     so first give each string its own allocation. */
+  gal_data_str_unblock(data);
+
   /* For all elements, check the length and if they aren't equal to maxlen,
      then allocate a maxlen sized array and put the values in. */
   for(i=0;i<data->size;++i)
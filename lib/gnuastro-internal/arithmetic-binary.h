@@ -25,8 +25,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 gal_data_t *
-arithmetic_binary(int operator, uint8_t flags, gal_data_t *lo,
-                  gal_data_t *ro);
+arithmetic_binary(int operator, size_t numthreads, uint8_t flags,
+                  gal_data_t *lo, gal_data_t *ro);
 
 
 #endif
@@ -58,6 +58,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /* Actual header contants (the above were for the Pre-processor). */
 __BEGIN_C_DECLS  /* From C++ preparations */
 
+/* Operators on arrays with fewer elements than this won't be spun off to
+   multiple threads (the overhead of the threads will be larger). */
+#define GAL_ARITHMETIC_THREADS_MIN_SIZE 100000
+
+
+
 int
 gal_arithmetic_binary_out_type(int operator, gal_data_t *l, gal_data_t *r);
 
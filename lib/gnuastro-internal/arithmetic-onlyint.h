@@ -25,7 +25,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 gal_data_t *
-arithmetic_onlyint_binary(int operator, unsigned char flags, gal_data_t *lo,
+arithmetic_onlyint_binary(int operator, size_t numthreads,
+                          unsigned char flags, gal_data_t *lo,
                           gal_data_t *ro);
 
 gal_data_t *
@@ -323,6 +323,32 @@ struct argp_option gal_commonopts_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "mmapdir",
+      GAL_OPTIONS_KEY_MMAPDIR,
+      "STR",
+      0,
+      "Directory to keep memory-mapped files.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &cp->mmapdir,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "rambudget",
+      GAL_OPTIONS_KEY_RAMBUDGET,
+      "INT",
+      0,
+      "Max. bytes of arrays in RAM (0: no limit).",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &cp->rambudget,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "log",
       GAL_OPTIONS_KEY_LOG,
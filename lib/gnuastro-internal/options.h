@@ -119,6 +119,8 @@ enum options_common_keys
   GAL_OPTIONS_KEY_ONEELEMPERTILE,
   GAL_OPTIONS_KEY_INTERPONLYBLANK,
   GAL_OPTIONS_KEY_INTERPNUMNGB,
+  GAL_OPTIONS_KEY_MMAPDIR,
+  GAL_OPTIONS_KEY_RAMBUDGET,
 };
 
 
@@ -194,6 +196,8 @@ struct gal_options_common_params
   uint8_t                quiet; /* Only print errors.                     */
   size_t            numthreads; /* Number of threads to use.              */
   size_t            minmapsize; /* Minimum bytes necessary to use mmap.   */
+  char                *mmapdir; /* Directory to host memory-mapped files. */
+  size_t             rambudget; /* Maximum bytes of arrays in RAM.        */
   uint8_t                  log; /* Make a log file.                       */
 
   /* Configuration files. */
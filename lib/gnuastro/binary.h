@@ -68,15 +68,15 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 /*********************************************************************/
 gal_data_t *
 gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
-                 int inplace);
+                 int inplace, size_t numthreads);
 
 gal_data_t *
 gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
-                  int inplace);
+                  int inplace, size_t numthreads);
 
 gal_data_t *
 gal_binary_open(gal_data_t *input, size_t num, int connectivity,
-                int inplace);
+                int inplace, size_t numthreads);
 
 
 
@@ -87,7 +87,7 @@ gal_binary_open(gal_data_t *input, size_t num, int connectivity,
 /*********************************************************************/
 size_t
 gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
-                                int connectivity);
+                                int connectivity, size_t numthreads);
 
 gal_data_t *
 gal_binary_connected_adjacency_matrix(gal_data_t *adjacency,
@@ -90,12 +90,31 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 /* Bit 4: Dataset is sorted and decreasing. */
 #define GAL_DATA_FLAG_SORTED_D     0x10
 
+/* Bit 5: The array is mapped from (a part of) an existing file that must
+          be kept, for example a table's columnar cache (`mmapname' is the
+          file's name). When freed, it is only unmapped. */
+#define GAL_DATA_FLAG_MMAP_KEEP    0x20
+
 /* Maximum internal flag value. Higher-level flags can be defined with the
    bitwise shift operators on this value to define internal flags for
    libraries/programs that depend on Gnuastro without causing any possible
    conflict with the internal flags or having to check the values manually
    on every release. */
-#define GAL_DATA_FLAG_MAXFLAG      GAL_DATA_FLAG_SORTED_D
+#define GAL_DATA_FLAG_MAXFLAG      GAL_DATA_FLAG_MMAP_KEEP
+
+
+
+
+/* Hints on how a memory-mapped array will be used (see
+   `gal_data_advise'). */
+enum gal_data_advise_values
+{
+  GAL_DATA_ADVISE_NORMAL,       /* No special treatment.                  */
+  GAL_DATA_ADVISE_SEQUENTIAL,   /* Used in order: read ahead of usage.    */
+  GAL_DATA_ADVISE_WILLNEED,     /* Used soon: start reading it.           */
+  GAL_DATA_ADVISE_DONTNEED,     /* Not used soon: its pages can be freed. */
+};
+
 
 
 
@@ -229,6 +248,48 @@ typedef struct gal_data_t
 
 
 
+/* Pool of freed allocations in one thread (see `gal_data_pool_use'). The
+   blocks in size class `c' have at least `2^c' bytes, and `size' keeps
+   the size (in bytes) that was last used in each block. */
+#define GAL_DATA_POOL_NUM      8
+#define GAL_DATA_POOL_CLASSES  (8*sizeof(size_t))
+typedef struct gal_data_pool_t
+{
+  size_t       maxsize;   /* Largest block to keep in the pool (bytes). */
+  size_t   num[GAL_DATA_POOL_CLASSES];                    /* Num. kept. */
+  size_t  size[GAL_DATA_POOL_CLASSES][GAL_DATA_POOL_NUM]; /* Sizes.     */
+  void  *block[GAL_DATA_POOL_CLASSES][GAL_DATA_POOL_NUM]; /* Blocks.    */
+} gal_data_pool_t;
+
+
+
+
+
+/*********************************************************************/
+/*************       Pool of freed allocations     *******************/
+/*********************************************************************/
+gal_data_pool_t *
+gal_data_pool_alloc(size_t maxsize);
+
+void
+gal_data_pool_reset(gal_data_pool_t *pool);
+
+void
+gal_data_pool_free(gal_data_pool_t *pool);
+
+gal_data_pool_t *
+gal_data_pool_use(gal_data_pool_t *pool);
+
+void *
+gal_data_pool_malloc(gal_data_pool_t *pool, size_t size, int clear);
+
+void
+gal_data_pool_release(gal_data_pool_t *pool, void *block, size_t size);
+
+
+
+
+
 /*********************************************************************/
 /*************         Size and allocation         *******************/
 /*********************************************************************/
@@ -259,12 +320,30 @@ gal_data_alloc(void *array, uint8_t type, size_t ndim, size_t *dsize,
                struct wcsprm *wcs, int clear, size_t minmapsize,
                char *name, char *unit, char *comment);
 
+void
+gal_data_release_array(gal_data_t *data);
+
+char *
+gal_data_str_block(gal_data_t *data, size_t width, int clear);
+
+void
+gal_data_str_unblock(gal_data_t *data);
+
 void
 gal_data_free_contents(gal_data_t *data);
 
 void
 gal_data_free(gal_data_t *data);
 
+void
+gal_data_mmap_dir(char *dir);
+
+void
+gal_data_ram_budget(size_t budget);
+
+void
+gal_data_advise(gal_data_t *data, int advice);
+
 
 
 
@@ -213,6 +213,10 @@ gal_data_t *
 gal_fits_img_read(char *filename, char *hdu, size_t minmapsize,
                   size_t hstartwcs, size_t hendwcs);
 
+gal_data_t *
+gal_fits_img_read_mmap(char *filename, char *hdu, size_t numthreads,
+                       size_t minmapsize, size_t hstartwcs, size_t hendwcs);
+
 gal_data_t *
 gal_fits_img_read_to_type(char *inputname, char *hdu, uint8_t type,
                           size_t minmapsize, size_t hstartwcs,
@@ -221,6 +225,16 @@ gal_fits_img_read_to_type(char *inputname, char *hdu, uint8_t type,
 gal_data_t *
 gal_fits_img_read_kernel(char *filename, char *hdu, size_t minmapsize);
 
+fitsfile *
+gal_fits_img_write_create(char *filename, uint8_t type, size_t ndim,
+                          size_t *dsize);
+
+int
+gal_fits_img_write_part(fitsfile *fptr, gal_data_t *input, size_t start);
+
+void
+gal_fits_img_write_keys(fitsfile *fptr, gal_data_t *input, int hasblank);
+
 fitsfile *
 gal_fits_img_write_to_ptr(gal_data_t *data, char *filename);
 
@@ -129,6 +129,10 @@ gal_statistics_quantile_function(gal_data_t *input, gal_data_t *value,
 gal_data_t *
 gal_statistics_mode(gal_data_t *input, float errorstd, int inplace);
 
+gal_data_t *
+gal_statistics_quantiles(gal_data_t *input, double *quantiles, size_t numq,
+                         float mirrordist, int inplace);
+
 gal_data_t *
 gal_statistics_mode_mirror_plots(gal_data_t *input, gal_data_t *value,
                                  size_t numbins, int inplace,
@@ -146,10 +150,10 @@ int
 gal_statistics_is_sorted(gal_data_t *input);
 
 void
-gal_statistics_sort_increasing(gal_data_t *input);
+gal_statistics_sort_increasing(gal_data_t *input, size_t numthreads);
 
 void
-gal_statistics_sort_decreasing(gal_data_t *input);
+gal_statistics_sort_decreasing(gal_data_t *input, size_t numthreads);
 
 gal_data_t *
 gal_statistics_no_blank_sorted(gal_data_t *input, int inplace);
@@ -121,6 +121,14 @@ enum gal_table_where_to_search
 
 
 
+
+
+/* Suffix (appended to the table's file name) of a table's columnar cache,
+   see `gal_table_cache_write'. */
+#define GAL_TABLE_CACHE_SUFFIX    ".gtc"
+
+
+
 /************************************************************************/
 /***************         Information about a table        ***************/
 /************************************************************************/
@@ -136,9 +144,13 @@ gal_table_print_info(gal_data_t *allcols, size_t numcols, size_t numrows);
 /************************************************************************/
 /***************               Read a table               ***************/
 /************************************************************************/
+char *
+gal_table_cache_name(char *filename, char *hdu);
+
 gal_data_t *
 gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
-               int searchin, int ignorecase, int minmapsize);
+               int searchin, int ignorecase, size_t numthreads,
+               int minmapsize);
 
 
 
@@ -158,6 +170,10 @@ gal_table_write_log(gal_data_t *logll, char *program_string,
                     time_t *rawtime, gal_list_str_t *comments,
                     char *filename, int quiet);
 
+void
+gal_table_cache_write(char *filename, char *hdu, size_t numthreads,
+                      int minmapsize);
+
 
 
 
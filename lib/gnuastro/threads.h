@@ -116,18 +116,48 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 /*******************************************************************/
 /************     Run a function on multiple threads  **************/
 /*******************************************************************/
+/* How the actions are distributed between the threads. */
+enum gal_threads_schedule_types
+{
+  GAL_THREADS_SCHEDULE_STATIC,     /* Fixed list of actions for each thread.*/
+  GAL_THREADS_SCHEDULE_DYNAMIC,    /* Free thread takes the next action.    */
+};
+
+/* Queue of actions that is shared between all threads in dynamic
+   scheduling. */
+struct gal_threads_queue
+{
+  pthread_mutex_t lock; /* Lock to take the next action.                 */
+  size_t       *order;  /* Indexs of the actions in order of execution.  */
+  size_t   numactions;  /* Total number of actions.                      */
+  size_t         next;  /* Position of next action in `order'.           */
+};
+
 struct gal_threads_params
 {
   size_t            id; /* Id of this thread.                            */
   void         *params; /* Input structure for higher-level settings.    */
   size_t       *indexs; /* Indexes of actions to be done in this thread. */
   pthread_barrier_t *b; /* Pointer the barrier for all threads.          */
+  size_t          next; /* Position of next action in `indexs' (static). */
+  struct gal_threads_queue *queue; /* Shared actions (dynamic).          */
 };
 
 void
 gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
                      size_t numactions, size_t numthreads);
 
+void
+gal_threads_spin_off_sched(void *(*worker)(void *), void *caller_params,
+                           size_t numactions, size_t numthreads,
+                           int schedule, size_t *costs);
+
+size_t
+gal_threads_next_action(struct gal_threads_params *tprm);
+
+void
+gal_threads_pool_free(void);
+
 
 __END_C_DECLS    /* From C++ preparations */
 
@@ -83,10 +83,11 @@ gal_txt_table_info(char *filename, size_t *numcols, size_t *numrows);
 
 gal_data_t *
 gal_txt_table_read(char *filename, size_t numrows, gal_data_t *colinfo,
-                   gal_list_sizet_t *indexll, size_t minmapsize);
+                   gal_list_sizet_t *indexll, size_t numthreads,
+                   size_t minmapsize);
 
 gal_data_t *
-gal_txt_image_read(char *filename, size_t minmapsize);
+gal_txt_image_read(char *filename, size_t numthreads, size_t minmapsize);
 
 void
 gal_txt_write(gal_data_t *input, gal_list_str_t *comment, char *filename);
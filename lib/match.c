@@ -22,15 +22,22 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <gsl/gsl_sort.h>
 
 #include <gnuastro/box.h>
 #include <gnuastro/list.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/permutation.h>
 
 
@@ -209,56 +216,236 @@ match_coordinates_prepare_sort(gal_data_t *coords, size_t minmapsize)
 
 
 
-/* Do the preparations for matching of coordinates. */
+/* To avoid sorting a large (reference) catalog every time it is matched,
+   its sorted coordinates and the sorting permutation can be kept in an
+   index file. The file starts with this header, followed by the
+   permutation (`nrows' elements of `size_t') and the sorted coordinates
+   (`ndim' columns of `nrows' elements of `double'). To identify the
+   catalog that the index was built from, the header keeps a checksum of
+   the (unsorted) input coordinates. All values are in the byte order of
+   the system that wrote the file, so it is only used when its byte-order
+   mark is the same as the reading system's. */
+#define MATCH_INDEX_MAGIC "GNUASTROMATCHIDX"
+#define MATCH_INDEX_BOM   0x0102030405060708ULL
+struct match_coordinates_index_header
+{
+  char          magic[16];   /* Identifier of the file format.          */
+  uint64_t            bom;   /* Byte-order mark (`MATCH_INDEX_BOM').    */
+  uint64_t          width;   /* Size of `size_t' when file was written. */
+  uint64_t          nrows;   /* Number of rows in the catalog.          */
+  uint64_t           ndim;   /* Number of coordinate columns.           */
+  uint64_t       checksum;   /* Checksum of the input coordinates.      */
+};
+
+
+
+
+
+/* A fast checksum (64-bit FNV-1a on 8-byte words) of all the coordinate
+   columns (that are all `float64'). */
+static uint64_t
+match_coordinates_checksum(gal_data_t *coords)
+{
+  size_t i;
+  double *d;
+  uint64_t w, h=14695981039346656037ULL;
+
+  for(; coords!=NULL; coords=coords->next)
+    {
+      d=coords->array;
+      for(i=0;i<coords->size;++i)
+        {
+          memcpy(&w, &d[i], sizeof w);
+          h = (h ^ w) * 1099511628211ULL;
+        }
+    }
+  return h;
+}
+
+
+
+
+
+/* Memory-map the index file and use it if it corresponds to the given
+   coordinates. If the file doesn't exist, or corresponds to another
+   catalog (or format), return 0. */
+static int
+match_coordinates_index_read(gal_data_t *coords, char *filename,
+                             uint64_t checksum, gal_data_t **sorted,
+                             size_t **perm, void **map, size_t *mapsize,
+                             size_t minmapsize)
+{
+  int fd;
+  char *base;
+  size_t d, ndim;
+  struct stat st;
+  gal_data_t *tmp, *out=NULL;
+  struct match_coordinates_index_header *h;
+
+  /* Open the file, if it doesn't exist, it must be built. */
+  fd=open(filename, O_RDONLY);
+  if(fd==-1) return 0;
+
+  /* If the size of the file doesn't correspond to the catalog, there is
+     no need to map it. */
+  ndim=gal_list_data_number(coords);
+  if( fstat(fd, &st)==-1
+      || (size_t)st.st_size != ( sizeof *h + coords->size*sizeof(size_t)
+                                 + ndim*coords->size*sizeof(double) ) )
+    { close(fd); return 0; }
+
+  /* Map the file into memory (the file descriptor isn't necessary any
+     more after mapping). */
+  *mapsize=st.st_size;
+  base=mmap(NULL, *mapsize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(base==MAP_FAILED) return 0;
+
+  /* Check the header. */
+  h=(struct match_coordinates_index_header *)base;
+  if( memcmp(h->magic, MATCH_INDEX_MAGIC, sizeof h->magic)
+      || h->bom!=MATCH_INDEX_BOM
+      || h->width!=sizeof(size_t)
+      || h->nrows!=coords->size
+      || h->ndim!=ndim
+      || h->checksum!=checksum )
+    { munmap(base, *mapsize); return 0; }
+
+  /* Point the permutation and columns to the mapped file. */
+  *perm=(size_t *)(base + sizeof *h);
+  for(d=0;d<ndim;++d)
+    {
+      tmp=gal_data_alloc(base + sizeof *h + coords->size*sizeof(size_t)
+                         + d*coords->size*sizeof(double), GAL_TYPE_FLOAT64,
+                         1, &coords->size, NULL, 0, minmapsize, NULL, NULL,
+                         NULL);
+      gal_list_data_add(&out, tmp);
+    }
+  gal_list_data_reverse(&out);
+
+  /* Set the outputs and return. */
+  *map=base;
+  *sorted=out;
+  return 1;
+}
+
+
+
+
+
+/* Write the sorted coordinates and their permutation into the index. Other
+   programs may have the existing index mapped into their memory (or may
+   be reading it), so it is first written into a temporary file that is
+   then renamed to the index. */
+static void
+match_coordinates_index_write(gal_data_t *sorted, size_t *perm,
+                              uint64_t checksum, char *filename)
+{
+  FILE *fp;
+  char *tmpname;
+  gal_data_t *tmp;
+  struct match_coordinates_index_header h;
+
+  /* Set the header. */
+  memcpy(h.magic, MATCH_INDEX_MAGIC, sizeof h.magic);
+  h.bom=MATCH_INDEX_BOM;
+  h.width=sizeof(size_t);
+  h.nrows=sorted->size;
+  h.ndim=gal_list_data_number(sorted);
+  h.checksum=checksum;
+
+  /* Write the temporary file. */
+  if( asprintf(&tmpname, "%s.%ld.tmp", filename, (long)getpid())<0 )
+    error(EXIT_FAILURE, errno, "%s: asprintf allocation", __func__);
+  errno=0;
+  fp=fopen(tmpname, "wb");
+  if(fp==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't open to write match index",
+          tmpname);
+  if( fwrite(&h, sizeof h, 1, fp)!=1
+      || fwrite(perm, sizeof *perm, sorted->size, fp)!=sorted->size )
+    error(EXIT_FAILURE, errno, "%s: couldn't write match index", tmpname);
+  for(tmp=sorted; tmp!=NULL; tmp=tmp->next)
+    if( fwrite(tmp->array, sizeof(double), tmp->size, fp)!=tmp->size )
+      error(EXIT_FAILURE, errno, "%s: couldn't write match index",
+            tmpname);
+  if(fclose(fp)==EOF)
+    error(EXIT_FAILURE, errno, "%s: couldn't close match index", tmpname);
+
+  /* Replace the index with the temporary file. */
+  errno=0;
+  if( rename(tmpname, filename) )
+    error(EXIT_FAILURE, errno, "%s: renaming `%s' to `%s'", __func__,
+          tmpname, filename);
+  free(tmpname);
+}
+
+
+
+
+
+/* Copy the given list of coordinates. */
+static gal_data_t *
+match_coordinates_prepare_copy(gal_data_t *coords)
+{
+  gal_data_t *c, *tmp, *out=NULL;
+
+  /* Copy the list. */
+  for(tmp=coords; tmp!=NULL; tmp=tmp->next)
+    {
+      c=gal_data_copy(tmp);
+      c->next=NULL;
+      gal_list_data_add(&out, c);
+    }
+
+  /* Reverse the list: the copying process reversed the order. */
+  gal_list_data_reverse(&out);
+  return out;
+}
+
+
+
+
+
+/* Do the preparations for matching of coordinates. When `indexfile' is
+   given and corresponds to the second input, the sorted second input
+   will be memory-mapped from it (`B_map' will be the mapped memory).
+   Otherwise, it will be sorted and written into `indexfile'. */
 static void
 match_coordinates_prepare(gal_data_t *coord1, gal_data_t *coord2,
                           int sorted_by_first, int inplace,
                           gal_data_t **A_out, gal_data_t **B_out,
                           size_t **A_perm, size_t **B_perm,
+                          char *indexfile, void **B_map, size_t *B_mapsize,
                           size_t minmapsize)
 {
-  gal_data_t *c, *tmp, *A=NULL, *B=NULL;
+  uint64_t checksum=0;
 
   /* Sort the datasets if they aren't sorted. If the dataset is already
      sorted, then `inplace' is irrelevant. */
   if(!sorted_by_first)
     {
-      /* Allocating a new list is only necessary when  */
-      if(!inplace)
-        {
-          /* Copy the first list. */
-          for(tmp=coord1; tmp!=NULL; tmp=tmp->next)
-            {
-              c=gal_data_copy(tmp);
-              c->next=NULL;
-              gal_list_data_add(&A, c);
-            }
-
-          /* Copy the second list. */
-          for(tmp=coord2; tmp!=NULL; tmp=tmp->next)
-            {
-              c=gal_data_copy(tmp);
-              c->next=NULL;
-              gal_list_data_add(&B, c);
-            }
-
-          /* Reverse both lists: the copying process reversed the order. */
-          gal_list_data_reverse(&A);
-          gal_list_data_reverse(&B);
-
-          /* Set the output pointers. */
-          *A_out=A;
-          *B_out=B;
-        }
-      else
+      /* Allocating a new list is only necessary when the inputs shouldn't
+         be changed. */
+      *A_out = inplace ? coord1 : match_coordinates_prepare_copy(coord1);
+      *A_perm = match_coordinates_prepare_sort(*A_out, minmapsize);
+
+      /* If an index file is given, see if it can be used for the second
+         input (the checksum has to be calculated before sorting). */
+      if(indexfile)
         {
-          *A_out=coord1;
-          *B_out=coord2;
+          checksum=match_coordinates_checksum(coord2);
+          if( match_coordinates_index_read(coord2, indexfile, checksum,
+                                           B_out, B_perm, B_map, B_mapsize,
+                                           minmapsize) )
+            return;
         }
 
-      /* Sort each dataset by the first coordinate. */
-      *A_perm = match_coordinates_prepare_sort(*A_out, minmapsize);
+      /* Sort the second input (and write the index if necessary). */
+      *B_out = inplace ? coord2 : match_coordinates_prepare_copy(coord2);
       *B_perm = match_coordinates_prepare_sort(*B_out, minmapsize);
+      if(indexfile)
+        match_coordinates_index_write(*B_out, *B_perm, checksum, indexfile);
     }
   else
     {
@@ -303,148 +490,315 @@ match_coordinates_elliptical_r(double d1, double d2, double *ellipse,
 
 
 
+/* Spatial index over the second catalog: a uniform grid of cells that
+   covers the range of the coordinates. The rows within each cell are
+   kept in increasing order in `rows', starting from `start[cell]' (cell
+   `i' along the first axis and `j' along the second is `i*num[1]+j'). */
+struct match_coordinates_grid
+{
+  double       min[2];     /* Minimum value along each axis.           */
+  double     width[2];     /* Width of each cell along each axis.      */
+  size_t       num[2];     /* Number of cells along each axis.         */
+  size_t       *start;     /* Index of first row of each cell in rows. */
+  size_t        *rows;     /* Rows in each cell.                       */
+};
+
+
+
+
+
+/* Index of the cell containing the given (non-NaN) point. */
+static size_t
+match_coordinates_grid_cell(struct match_coordinates_grid *grid, double x,
+                            double y)
+{
+  size_t i=(x-grid->min[0])/grid->width[0];
+  size_t j=(y-grid->min[1])/grid->width[1];
+  if(i>=grid->num[0]) i=grid->num[0]-1;
+  if(j>=grid->num[1]) j=grid->num[1]-1;
+  return i*grid->num[1]+j;
+}
+
+
+
+
+
+/* Build the grid over the second catalog. The cells are (at least) as
+   wide as the search box (`dist'), so small search boxes only need to
+   check a few cells. But when the search box is very small compared to
+   the range of the coordinates, the cells are enlarged so their total
+   number doesn't exceed the number of rows. Rows with a NaN coordinate
+   can never be matched, so they aren't put in any cell. */
+static void
+match_coordinates_grid_make(gal_data_t *B, double *dist,
+                            struct match_coordinates_grid *grid)
+{
+  double max[2], scale[2]={1.0f, 1.0f}, dnum[2];
+  size_t i, d, cell, ncells, *pos, br=B->size;
+  double *b[2]={B->array, B->next->array};
+
+  /* Find the range of the coordinates. */
+  for(d=0;d<2;++d)
+    {
+      grid->min[d]=INFINITY; max[d]=-INFINITY;
+      for(i=0;i<br;++i)
+        if( !isnan(b[d][i]) )
+          {
+            if(b[d][i]<grid->min[d]) grid->min[d]=b[d][i];
+            if(b[d][i]>max[d])       max[d]=b[d][i];
+          }
+      if(grid->min[d]>max[d]) grid->min[d]=max[d]=0.0f; /* All NaN. */
+    }
+
+  /* Set the width and number of cells along each dimension. When there
+     are too many cells, they are enlarged by the same factor along both
+     axes. Unless one axis already has too few cells, in that case, only
+     the cells along the other axis are enlarged. */
+  for(d=0;d<2;++d) dnum[d]=(max[d]-grid->min[d])/dist[d]+1;
+  if( dnum[0]*dnum[1] > br )
+    {
+      scale[0]=scale[1]=sqrt( dnum[0]*dnum[1]/br );
+      if(dnum[0]<scale[0])      { scale[0]=1.0f; scale[1]=dnum[0]*dnum[1]/br; }
+      else if(dnum[1]<scale[1]) { scale[1]=1.0f; scale[0]=dnum[0]*dnum[1]/br; }
+    }
+  for(d=0;d<2;++d)
+    {
+      grid->width[d] = dist[d]*scale[d];
+      grid->num[d]   = (max[d]-grid->min[d])/grid->width[d] + 1;
+    }
+  ncells=grid->num[0]*grid->num[1];
+
+  /* Count the number of rows in each cell (`pos' is one element longer,
+     so it can be used to find the starting index of each cell). */
+  errno=0;
+  pos=calloc(ncells+1, sizeof *pos);
+  if(pos==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for `pos'", __func__,
+          (ncells+1)*sizeof *pos);
+  for(i=0;i<br;++i)
+    if( !isnan(b[0][i]) && !isnan(b[1][i]) )
+      ++pos[ match_coordinates_grid_cell(grid, b[0][i], b[1][i]) + 1 ];
+
+  /* Convert the counts into the starting index of each cell, keep a
+     copy of it in the grid (`pos' will be incremented while filling). */
+  for(cell=0;cell<ncells;++cell) pos[cell+1]+=pos[cell];
+  grid->start=gal_data_malloc_array(GAL_TYPE_SIZE_T, ncells+1, __func__,
+                                    "grid->start");
+  memcpy(grid->start, pos, (ncells+1)*sizeof *pos);
+
+  /* Put the rows in each cell (in increasing order). */
+  grid->rows=gal_data_malloc_array(GAL_TYPE_SIZE_T, pos[ncells]
+                                   ? pos[ncells] : 1, __func__,
+                                   "grid->rows");
+  for(i=0;i<br;++i)
+    if( !isnan(b[0][i]) && !isnan(b[1][i]) )
+      grid->rows[ pos[ match_coordinates_grid_cell(grid, b[0][i],
+                                                   b[1][i]) ]++ ] = i;
+
+  /* Clean up. */
+  free(pos);
+}
+
+
+
+
+
+/* Find the range of cells (inclusive) that overlap the search box around
+   the given point along dimension `d'. If the box is outside of the grid
+   (or the point is NaN), return 0. */
+static int
+match_coordinates_grid_range(struct match_coordinates_grid *grid, size_t d,
+                             double x, double dist, size_t *lo, size_t *hi)
+{
+  double flo=floor( (x-dist-grid->min[d]) / grid->width[d] );
+  double fhi=floor( (x+dist-grid->min[d]) / grid->width[d] );
+
+  /* The box is outside the grid (the conditions are also false for
+     NaN, hence the `!'). */
+  if( !(fhi>=0.0f && flo<grid->num[d]) ) return 0;
+
+  /* Set the range. */
+  *lo = flo<0.0f         ? 0              : (size_t)flo;
+  *hi = fhi>=grid->num[d] ? grid->num[d]-1 : (size_t)fhi;
+  return 1;
+}
+
+
+
+
+
+/* Parameters for finding the matches of each record of the first catalog
+   on separate threads. */
+struct match_coordinates_sif_params
+{
+  gal_data_t                          *A;  /* First catalog.             */
+  gal_data_t                          *B;  /* Second catalog.            */
+  double                           *aper;  /* Aperture values.           */
+  double                         dist[2];  /* Search box half-width.     */
+  double                            c, s;  /* Cos and sin of ellipse PA. */
+  int                           iscircle;  /* Aperture is a circle.      */
+  struct match_coordinates_grid    *grid;  /* Spatial index over `B'.    */
+  struct match_coordinate_sfll    **bina;  /* Matches of each `A' row.   */
+};
+
+
+
+
+
+/* Find the records of catalog `b' that are within the acceptable distance
+   of each record of `a' (that are assigned to this thread). */
+static void *
+match_coordinates_second_in_first_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_coordinates_sif_params *p=tprm->params;
+
+  /* To keep things easy to read, all variables related to catalog 1 start
+     with an `a' and things related to catalog 2 are marked with a `b'. */
+  double r;
+  size_t lo[2], hi[2];
+  size_t i, ai, bi, ix, iy, cell, k;
+  double *dist=p->dist, *aper=p->aper;
+  struct match_coordinates_grid *grid=p->grid;
+  double *a[2]={p->A->array, p->A->next->array};
+  double *b[2]={p->B->array, p->B->next->array};
+
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Initialize `bina'. */
+      ai=tprm->indexs[i];
+      p->bina[ai]=NULL;
+
+      /* Find the cells that overlap with the search box of this record. */
+      if( !match_coordinates_grid_range(grid, 0, a[0][ai], dist[0],
+                                        &lo[0], &hi[0])
+          || !match_coordinates_grid_range(grid, 1, a[1][ai], dist[1],
+                                           &lo[1], &hi[1]) )
+        continue;
+
+      /* Go over the records of catalog `b' in those cells. */
+      for(ix=lo[0]; ix<=hi[0]; ++ix)
+        for(iy=lo[1]; iy<=hi[1]; ++iy)
+          {
+            cell=ix*grid->num[1]+iy;
+            for(k=grid->start[cell]; k<grid->start[cell+1]; ++k)
+              {
+                /* Only consider records within the rectangular range of
+                   `ai' along both axes. A cell may be larger than the
+                   search box, so both the lower and higher limits have
+                   to be checked along both axes. */
+                bi=grid->rows[k];
+                if( b[0][bi] >= a[0][ai]-dist[0]
+                    && b[0][bi] <= a[0][ai]+dist[0]
+                    && b[1][bi] >= a[1][ai]-dist[1]
+                    && b[1][bi] <= a[1][ai]+dist[1] )
+                  {
+                    /* Now, `bi' is within the rectangular range of `ai'.
+                       But this is not enough to consider the two objects
+                       matched for the following reasons:
+
+                       1) Until now we have avoided calculations other
+                          than larger or smaller on double precision
+                          floating point variables for efficiency. So the
+                          `bi' is within a rectangle of side
+                          `2*dist[0]*2*dist[1]' around `ai' (not within a
+                          fixed radius).
+
+                       2) Other objects in the `b' catalog may be closer
+                          to `ai' than this `bi'.
+
+                       3) The closest `bi' to `ai' might be closer to
+                          another catalog `a' record.
+
+                       To address these problems, we will use a linked
+                       list to keep the indexes of the `b's near `ai',
+                       along with their distance. We only add the `bi's
+                       to this list that are within the acceptable
+                       distance.
+
+                       Since we are dealing with much fewer objects at
+                       this stage, it is justified to do complex
+                       mathematical operations like square root and
+                       multiplication. This fixes the first problem.
+
+                       The next two problems will be solved with the list
+                       after parsing of the whole catalog is complete.*/
+                    r = ( p->iscircle
+                          ? sqrt( (b[0][bi]-a[0][ai])*(b[0][bi]-a[0][ai])
+                                  + (b[1][bi]-a[1][ai])*(b[1][bi]-a[1][ai]) )
+                          : match_coordinates_elliptical_r(b[0][bi]-a[0][ai],
+                                                           b[1][bi]-a[1][ai],
+                                                           aper, p->c,
+                                                           p->s) );
+                    if(r<aper[0])
+                      match_coordinate_add_to_sfll(&p->bina[ai], bi, r);
+                  }
+              }
+          }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
 /* Go through both catalogs and find which records/rows in the second
    catalog (catalog b) are within the acceptable distance of each record in
-   the first (a). */
+   the first (a). To avoid parsing all of catalog `b' for each record of
+   `a', a spatial index (grid) is first built over `b', so only the
+   records that are near each `a' are checked. Since the records of `a'
+   are independent of each other, they are searched on separate
+   threads. */
 static void
 match_coordinates_second_in_first(gal_data_t *A, gal_data_t *B,
                                   gal_data_t *aperture,
-                                  struct match_coordinate_sfll **bina)
+                                  struct match_coordinate_sfll **bina,
+                                  size_t numthreads)
 {
-  /* To keep things easy to read, all variables related to catalog 1 start
-     with an `a' and things related to catalog 2 are marked with a `b'. The
-     redundant variables (those that equal a previous value) are only
-     defined to make it easy to read the code.*/
-  double dist[2];
-  size_t ar=A->size, br=B->size;
-  size_t ai, bi, blow, prevblow=0;
-  double r, c, s, *aper=aperture->array;
-  double *a[2]={A->array, A->next->array};
-  double *b[2]={B->array, B->next->array};
-  int iscircle=((double *)(aperture->array))[1]==1 ? 1 : 0;
+  struct match_coordinates_grid grid;
+  struct match_coordinates_sif_params p;
+
+  /* Basic settings. */
+  p.A=A;
+  p.B=B;
+  p.grid=&grid;
+  p.bina=bina;
+  p.aper=aperture->array;
+  p.iscircle=p.aper[1]==1 ? 1 : 0;
 
   /* Preparations for the shape of the aperture. */
-  if(iscircle)
-    dist[0]=dist[1]=aper[0];
+  if(p.iscircle)
+    p.dist[0]=p.dist[1]=p.aper[0];
   else
     {
       /* Using the box that encloses the aperture, calculate the distance
          along each axis. */
-      gal_box_bound_ellipse_extent(aper[0], aper[0]*aper[1], aper[2], dist);
+      gal_box_bound_ellipse_extent(p.aper[0], p.aper[0]*p.aper[1],
+                                   p.aper[2], p.dist);
 
       /* Calculate the sin and cos of the given ellipse if necessary for
          ease of processing later. */
-      c = cos( aper[3] * M_PI/180.0 );
-      s = sin( aper[3] * M_PI/180.0 );
+      p.c = cos( p.aper[3] * M_PI/180.0 );
+      p.s = sin( p.aper[3] * M_PI/180.0 );
     }
 
+  /* If either catalog is empty, there is nothing to match (`bina' is
+     already initialized to NULL). */
+  if(A->size==0 || B->size==0) return;
 
-  /* For each row/record of catalog `a', make a list of the nearest records
-     in catalog b within the maximum distance. Note that both catalogs are
-     sorted by their first axis coordinate.*/
-  for(ai=0;ai<ar;++ai)
-    {
-      /* Initialize `bina'. */
-      bina[ai]=NULL;
-
-      /* Find the first (lowest first axis value) row/record in catalog `b'
-	 that is within the search radius for this record of catalog
-	 `a'. `blow' is the index of the first element to start searching
-	 in the catalog `b' for a match to `a[][ai]' (the record in catalog
-	 a that is currently being searched). `blow' is only based on the
-	 first coordinate, not the second.
-
-         Both catalogs are sorted by their first coordinate, so the `blow'
-	 to search for the next record in catalog `a' will be larger or
-	 equal to that of the previous catalog `a' record. To account for
-	 possibly large distances between the records, we do a search here
-	 to change `blow' if necessary before doing further searching.*/
-      for( blow=prevblow; blow<ar && b[0][blow] < a[0][ai]-dist[0]; ++blow)
-	{/* This can be blank, the `for' does all we need :-). */}
-
-
-      /* `blow' is now found for this `ai' and will be used unchanged to
-	 the end of the loop. So keep its value to help the search for the
-	 next entry in catalog `a'. */
-      prevblow=blow;
-
-
-      /* Go through catalog `b' (starting at `blow') with a first axis
-	 value smaller than the maximum acceptable range for `si'. */
-      for( bi=blow; bi<br && b[0][bi] <= a[0][ai] + dist[0]; ++bi )
-	{
-	  /* Only consider records with a second axis value in the
-	     correct range, note that unlike the first axis, the
-	     second axis is no longer sorted. so we have to do both
-	     lower and higher limit checks for each item.
-
-	     Positions can have an accuracy to a much higher order of
-	     magnitude than the search radius. Therefore, it is
-	     meaning-less to sort the second axis (after having sorted
-	     the first). In other words, very rarely can two first
-	     axis coordinates have EXACTLY the same floating point
-	     value as each other to easily define an independent
-	     sorting in the second axis. */
-	  if( b[1][bi] >= a[1][ai]-dist[1] && b[1][bi] <= a[1][ai]+dist[1] )
-	    {
-	      /* Now, `bi' is within the rectangular range of `ai'. But
-		 this is not enough to consider the two objects matched for
-		 the following reasons:
-
-		 1) Until now we have avoided calculations other than
-		    larger or smaller on double precision floating point
-		    variables for efficiency. So the `bi' is within a
-		    square of side `dist[0]*dist[1]' around `ai' (not
-		    within a fixed radius).
-
-		 2) Other objects in the `b' catalog may be closer to `ai'
-		    than this `bi'.
-
-		 3) The closest `bi' to `ai' might be closer to another
-		    catalog `a' record.
-
-		 To address these problems, we will use a linked list to
-		 keep the indexes of the `b's near `ai', along with their
-		 distance. We only add the `bi's to this list that are
-		 within the acceptable distance.
-
-                 Since we are dealing with much fewer objects at this
-		 stage, it is justified to do complex mathematical
-		 operations like square root and multiplication. This fixes
-		 the first problem.
-
-		 The next two problems will be solved with the list after
-		 parsing of the whole catalog is complete.*/
-              r = ( iscircle
-                    ? sqrt( (b[0][bi]-a[0][ai])*(b[0][bi]-a[0][ai])
-                            + (b[1][bi]-a[1][ai])*(b[1][bi]-a[1][ai]) )
-                    : match_coordinates_elliptical_r(b[0][bi]-a[0][ai],
-                                                     b[1][bi]-a[1][ai],
-                                                     aper, c, s));
-	      if(r<aper[0])
-		match_coordinate_add_to_sfll(&bina[ai], bi, r);
-	    }
-	}
-
-
-      /* If there was no objects within the acceptable distance, then the
-	 linked list pointer will be NULL, so go on to the next `ai'. */
-      if(bina[ai]==NULL)
-	continue;
-
-      /* For checking the status of affairs uncomment this block
-      {
-	struct match_coordinate_sfll *tmp;
-	printf("\n\nai: %lu:\n", ai);
-	printf("ax: %f (%f -- %f)\n", a[0][ai], a[0][ai]-dist[0],
-               a[0][ai]+dist[0]);
-	printf("ay: %f (%f -- %f)\n", a[1][ai], a[1][ai]-dist[1],
-               a[1][ai]+dist[1]);
-	for(tmp=bina[ai];tmp!=NULL;tmp=tmp->next)
-	  printf("%lu: %f\n", tmp->v, tmp->f);
-      }
-      */
-    }
+  /* Build the spatial index over the second catalog, then find the
+     matches of each record of the first catalog. */
+  match_coordinates_grid_make(B, p.dist, &grid);
+  gal_threads_spin_off(match_coordinates_second_in_first_on_thread, &p,
+                       A->size, numthreads);
+
+  /* Clean up. */
+  free(grid.rows);
+  free(grid.start);
 }
 
 
@@ -591,24 +945,36 @@ match_coordinates_rearrange(gal_data_t *A, gal_data_t *B,
 
        Node 1: First catalog index (counting from zero).
        Node 2: Second catalog index (counting from zero).
-       Node 3: Distance between the match.                    */
+       Node 3: Distance between the match.
+
+   The search for the matches of each record in the first catalog will be
+   done on `numthreads' threads.
+
+   When `indexfile' isn't NULL (and the inputs aren't already sorted), it
+   is used to avoid sorting the second input in every call: if it exists
+   and was built from the same coordinates, the sorted second input will
+   be memory-mapped from it. Otherwise, the second input will be sorted
+   and written into it for later calls. */
 gal_data_t *
 gal_match_coordinates(gal_data_t *coord1, gal_data_t *coord2,
                       gal_data_t *aperture, int sorted_by_first,
-                      int inplace, size_t minmapsize)
+                      int inplace, size_t minmapsize, size_t numthreads,
+                      char *indexfile)
 {
   float r;
   double *rmatch;
+  void *B_map=NULL;
   size_t *aind, *bind;
-  gal_data_t *A, *B, *out;
+  gal_data_t *A, *B, *out, *tmp;
   struct match_coordinate_sfll **bina;
-  size_t ai, bi, counter=0, *A_perm=NULL, *B_perm=NULL;
+  size_t ai, bi, B_mapsize=0, counter=0, *A_perm=NULL, *B_perm=NULL;
 
   /* Do a small sanity check and make the preparations. After this point,
      we'll call the two arrays `a' and `b'.*/
   match_coordinaes_sanity_check(coord1, coord2, aperture);
   match_coordinates_prepare(coord1, coord2, sorted_by_first, inplace,
-                            &A, &B, &A_perm, &B_perm, minmapsize);
+                            &A, &B, &A_perm, &B_perm, indexfile, &B_map,
+                            &B_mapsize, minmapsize);
 
   /* Allocate the `bina' array (an array of lists). Let's call the first
      catalog `a' and the second `b'. This array has `a->size' elements
@@ -621,7 +987,7 @@ gal_match_coordinates(gal_data_t *coord1, gal_data_t *coord2,
           A->size*sizeof *bina);
 
   /* All records in `b' that match each `a' (possibly duplicate). */
-  match_coordinates_second_in_first(A, B, aperture, bina);
+  match_coordinates_second_in_first(A, B, aperture, bina, numthreads);
 
   /* Two re-arrangings will fix the issue. */
   match_coordinates_rearrange(A, B, bina);
@@ -651,19 +1017,26 @@ gal_match_coordinates(gal_data_t *coord1, gal_data_t *coord2,
       {
         /* Note that the permutation keeps the original indexs. */
         match_coordinate_pop_from_sfll(&bina[ai], &bi, &r);
-        aind[counter]=A_perm[ai];
-        bind[counter]=B_perm[bi];
+        aind[counter] = A_perm ? A_perm[ai] : ai;
+        bind[counter] = B_perm ? B_perm[bi] : bi;
         rmatch[counter++]=r;
       }
 
-  /* Clean up and return. */
+  /* Clean up and return. Note that when the second input was mapped from
+     the index file, its arrays (and permutation) belong to the mapping. */
   free(bina);
   free(A_perm);
-  free(B_perm);
-  if(A!=coord1)
+  if(A!=coord1) gal_list_data_free(A);
+  if(B_map)
     {
-      gal_list_data_free(A);
+      for(tmp=B; tmp!=NULL; tmp=tmp->next) tmp->array=NULL;
       gal_list_data_free(B);
+      munmap(B_map, B_mapsize);
+    }
+  else
+    {
+      free(B_perm);
+      if(B!=coord2) gal_list_data_free(B);
     }
   return out;
 }
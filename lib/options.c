@@ -517,9 +517,8 @@ gal_options_parse_list_of_numbers(char *string, char *filename, size_t lineno)
       i=1;
       out=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &i, NULL, 0,
                          minmapsize, NULL, NULL, NULL);
+      gal_data_release_array(out);
       out->size=out->dsize[0]=0;
-      free(out->array);
-      out->array=NULL;
     }
 
 
@@ -600,9 +599,8 @@ gal_options_parse_csv_strings_raw(char *string, char *filename, size_t lineno)
       i=1;
       out=gal_data_alloc(NULL, GAL_TYPE_STRING, 1, &i, NULL, 0,
                          minmapsize, NULL, NULL, NULL);
+      gal_data_release_array(out);
       out->size=out->dsize[0]=0;
-      free(out->array);
-      out->array=NULL;
     }
 
 
@@ -1072,11 +1070,11 @@ options_sanity_check(struct argp_option *option, char *arg,
      `GAL_ARITHMETIC_INPLACE' flags. But we will do this when there are
      multiple checks so from the two check data structures, we only have
      one remaining. */
-  check1=gal_arithmetic(operator1, GAL_ARITHMETIC_NUMOK, value, ref1);
+  check1=gal_arithmetic(operator1, 1, GAL_ARITHMETIC_NUMOK, value, ref1);
   if(ref2)
     {
-      check2=gal_arithmetic(operator2, GAL_ARITHMETIC_NUMOK, value, ref2);
-      check1=gal_arithmetic(multicheckop, mcflag, check1, check2);
+      check2=gal_arithmetic(operator2, 1, GAL_ARITHMETIC_NUMOK, value, ref2);
+      check1=gal_arithmetic(multicheckop, 1, mcflag, check1, check2);
     }
 
 
@@ -1666,6 +1664,11 @@ gal_options_read_config_set(struct gal_options_common_params *cp)
      system. */
   if(cp->numthreads==0)
     cp->numthreads=gal_threads_number();
+
+  /* Set where (and when) the arrays should be memory-mapped for the
+     rest of the program. */
+  gal_data_mmap_dir(cp->mmapdir);
+  gal_data_ram_budget(cp->rambudget);
 }
 
 
@@ -36,6 +36,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/fits.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/qsort.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/arithmetic.h>
 #include <gnuastro/statistics.h>
 
@@ -259,23 +260,227 @@ statistics_median_in_sorted_no_blank(gal_data_t *sorted, void *median)
 
 
 
+/* Return a dataset that doesn't have blank values. If `inplace' is
+   non-zero, the blank values will be removed from the input array,
+   otherwise (when there are blank values), a new array will be allocated.
+   When the input is a tile, it will first be copied into a contiguous
+   patch of memory, so `inplace' is irrelevant. Therefore, when the output
+   isn't the same pointer as the input, it has been allocated here. */
+static gal_data_t *
+statistics_no_blank(gal_data_t *input, int inplace)
+{
+  gal_data_t *contig, *noblank;
+
+  /* If this is a tile, then first we have to copy it into a contiguous
+     piece of memory. After this step, we will only be dealing with
+     `contig' (for a contiguous patch of memory). */
+  if(input->block)
+    {
+      /* Copy the input into a contiguous patch of memory. */
+      contig=gal_data_copy(input);
+
+      /* When the data was a tile, we have already copied the array into a
+         separate allocated space. So to avoid any further copying, we will
+         just set the `inplace' variable to 1. */
+      inplace=1;
+    }
+  else contig=input;
+
+
+  /* Make sure there is no blanks in the array that will be used. */
+  if( gal_blank_present(contig, inplace) )
+    {
+      /* See if we should allocate a new dataset to remove blanks or if we
+         can use the actual contiguous patch of memory. */
+      noblank = inplace ? contig : gal_data_copy(contig);
+      gal_blank_remove(noblank);
+
+      /* If we are working in place, then mark that there are no blank
+         pixels. */
+      if(inplace)
+        {
+          noblank->flag |= GAL_DATA_FLAG_BLANK_CH;
+          noblank->flag &= ~GAL_DATA_FLAG_HASBLANK;
+        }
+    }
+  else noblank=contig;
+
+  /* Return the dataset without blanks. */
+  return noblank;
+}
+
+
+
+
+
+/* Put the element that would be at index `k' (if the array was sorted in
+   increasing order) into `out', without sorting the whole array. Only the
+   elements from index `start' are checked (the elements before it must
+   all be smaller or equal, for example after a previous selection). This is
+   a median-of-three quickselect: after each partition, only the side
+   containing `k' is kept, so on average it is linear in the size of the
+   array. In case a bad sequence of pivots makes the partitions too
+   unbalanced (quadratic behavior), the remaining range is just sorted.
+   Small ranges are also finished with an insertion sort.
+
+   When `median' is non-zero and the array has an even number of elements,
+   the average of element `k' and the one before it (which is the maximum
+   of everything before `k' after the selection) is returned. Therefore to
+   get the median, `k' should be `size/2'. The input must not have any
+   blank values, its order will be changed: after the selection, no element
+   before `k' is larger than it and no element after it is smaller. */
+#define STATS_SELECT(IT, QSORT_F) {                                     \
+    IT *a=data->array, t, pivot, lmax;                                  \
+    size_t i, j, mid, lo=start, hi=data->size-1;                        \
+                                                                        \
+    while(hi>lo)                                                        \
+      {                                                                 \
+        /* Small range, finish with an insertion sort. */               \
+        if(hi-lo<16)                                                    \
+          {                                                             \
+            for(i=lo+1;i<=hi;++i)                                       \
+              {                                                         \
+                t=a[i];                                                 \
+                for(j=i; j>lo && a[j-1]>t; --j) a[j]=a[j-1];            \
+                a[j]=t;                                                 \
+              }                                                         \
+            break;                                                      \
+          }                                                             \
+                                                                        \
+        /* Too many unbalanced partitions, sort the remaining range. */ \
+        if(depth--==0)                                                  \
+          {                                                             \
+            qsort(a+lo, hi-lo+1, sizeof *a, QSORT_F);                   \
+            break;                                                      \
+          }                                                             \
+                                                                        \
+        /* Median of three: after this, `a[lo]' and `a[hi]' will act */ \
+        /* as sentinels for the two scans of the partitioning. */       \
+        mid=lo+(hi-lo)/2;                                               \
+        if(a[mid]<a[lo]) { t=a[mid]; a[mid]=a[lo]; a[lo]=t; }           \
+        if(a[hi]<a[lo])  { t=a[hi];  a[hi]=a[lo];  a[lo]=t; }           \
+        if(a[hi]<a[mid]) { t=a[hi];  a[hi]=a[mid]; a[mid]=t; }          \
+        pivot=a[mid];                                                   \
+                                                                        \
+        /* Partition: [lo,j] <= pivot, [i,hi] >= pivot and anything */  \
+        /* between the two is equal to the pivot. */                    \
+        i=lo; j=hi;                                                     \
+        while(i<=j)                                                     \
+          {                                                             \
+            while(a[i]<pivot) ++i;                                      \
+            while(a[j]>pivot) --j;                                      \
+            if(i<=j) { t=a[i]; a[i]=a[j]; a[j]=t; ++i; --j; }           \
+          }                                                             \
+                                                                        \
+        /* Only keep the side that contains `k'. */                     \
+        if(k<=j)      hi=j;                                             \
+        else if(k>=i) lo=i;                                             \
+        else          break;                                            \
+      }                                                                 \
+                                                                        \
+    /* Write the output. */                                             \
+    if(median && data->size%2==0)                                       \
+      {                                                                 \
+        lmax=a[0];                                                      \
+        for(i=1;i<k;++i) if(a[i]>lmax) lmax=a[i];                       \
+        *(IT *)out = (a[k]+lmax)/2;                                     \
+      }                                                                 \
+    else *(IT *)out = a[k];                                             \
+  }
+static void
+statistics_select(gal_data_t *data, size_t start, size_t k, int median,
+                  void *out)
+{
+  size_t n, depth=0;
+
+  /* The depth limit is twice the binary logarithm of the size. */
+  for(n=data->size-start; n; n>>=1) depth+=2;
+
+  /* Do the selection. */
+  switch(data->type)
+    {
+    case GAL_TYPE_UINT8:
+      STATS_SELECT( uint8_t,  gal_qsort_uint8_increasing   );  break;
+    case GAL_TYPE_INT8:
+      STATS_SELECT( int8_t,   gal_qsort_int8_increasing    );  break;
+    case GAL_TYPE_UINT16:
+      STATS_SELECT( uint16_t, gal_qsort_uint16_increasing  );  break;
+    case GAL_TYPE_INT16:
+      STATS_SELECT( int16_t,  gal_qsort_int16_increasing   );  break;
+    case GAL_TYPE_UINT32:
+      STATS_SELECT( uint32_t, gal_qsort_uint32_increasing  );  break;
+    case GAL_TYPE_INT32:
+      STATS_SELECT( int32_t,  gal_qsort_int32_increasing   );  break;
+    case GAL_TYPE_UINT64:
+      STATS_SELECT( uint64_t, gal_qsort_uint64_increasing  );  break;
+    case GAL_TYPE_INT64:
+      STATS_SELECT( int64_t,  gal_qsort_int64_increasing   );  break;
+    case GAL_TYPE_FLOAT32:
+      STATS_SELECT( float,    gal_qsort_float32_increasing );  break;
+    case GAL_TYPE_FLOAT64:
+      STATS_SELECT( double,   gal_qsort_float64_increasing );  break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, data->type);
+    }
+}
+
+
+
+
+
+/* Prepare the input for a selection: remove its blank values and see if
+   it is already sorted (the result is put in `status'). When it isn't
+   sorted (`status' is `GAL_STATISTICS_SORTED_NOT'), the output is
+   guaranteed to not be the same pointer as `input' unless `inplace' is
+   non-zero, so it can be freely re-ordered. The `status' element of the
+   output is only set when it may be modified. */
+static gal_data_t *
+statistics_no_blank_for_select(gal_data_t *input, int inplace, int *status)
+{
+  gal_data_t *noblank=statistics_no_blank(input, inplace);
+
+  /* A dataset with less than two elements is already sorted. */
+  *status = ( noblank->size<2
+              ? GAL_STATISTICS_SORTED_INCREASING
+              : gal_statistics_is_sorted(noblank) );
+
+  /* If it isn't sorted and we can't touch the input, make a copy. */
+  if(*status==GAL_STATISTICS_SORTED_NOT && noblank==input && !inplace)
+    noblank=gal_data_copy(input);
+
+  /* Keep the status in the output if it isn't the untouchable input. */
+  if(noblank!=input || inplace) noblank->status=*status;
+  return noblank;
+}
+
+
+
+
+
 /* Return the median value of the dataset in the same type as the input as
    a one element dataset. If the `inplace' flag is set, the input data
-   structure will be modified: it will have no blank values and will be
-   sorted (increasing). */
+   structure will be modified: it will have no blank values and (if it
+   wasn't already sorted) its elements will be re-ordered. */
 gal_data_t *
 gal_statistics_median(gal_data_t *input, int inplace)
 {
+  int status;
   size_t dsize=1;
-  gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);;
-  gal_data_t *out=gal_data_alloc(NULL, nbs->type, 1, &dsize, NULL, 1, -1,
+  gal_data_t *nb=statistics_no_blank_for_select(input, inplace, &status);
+  gal_data_t *out=gal_data_alloc(NULL, nb->type, 1, &dsize, NULL, 1, -1,
                                  NULL, NULL, NULL);
 
-  /* Write the median. */
-  statistics_median_in_sorted_no_blank(nbs, out->array);
+  /* Write the median: when the dataset is already sorted, it can be read
+     directly, otherwise, we'll use selection (which is much faster than
+     sorting). */
+  if(status==GAL_STATISTICS_SORTED_NOT)
+    statistics_select(nb, 0, nb->size/2, 1, out->array);
+  else
+    statistics_median_in_sorted_no_blank(nb, out->array);
 
   /* Clean up (if necessary), then return the output */
-  if(nbs!=input) gal_data_free(nbs);
+  if(nb!=input) gal_data_free(nb);
   return out;
 }
 
@@ -323,28 +528,36 @@ gal_statistics_quantile_index(size_t size, double quantile)
 gal_data_t *
 gal_statistics_quantile(gal_data_t *input, double quantile, int inplace)
 {
+  int status;
   void *blank;
   size_t dsize=1, index;
-  gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);
-  gal_data_t *out=gal_data_alloc(NULL, nbs->type, 1, &dsize,
+  gal_data_t *nb=statistics_no_blank_for_select(input, inplace, &status);
+  gal_data_t *out=gal_data_alloc(NULL, nb->type, 1, &dsize,
                                  NULL, 1, -1, NULL, NULL, NULL);
 
   /* Find the index of the quantile. */
-  index=gal_statistics_quantile_index(nbs->size, quantile);
+  index=gal_statistics_quantile_index(nb->size, quantile);
 
-  /* Write the value at this index into the output. */
+  /* Write the value at this index into the output. If the dataset isn't
+     sorted, we'll only select the element at this index. In a decreasing
+     array, the index is counted from the end. */
   if(index==GAL_BLANK_SIZE_T)
     {
-      blank=gal_data_malloc_array(nbs->type, 1, __func__, "blank");
-      memcpy(out->array, blank, gal_type_sizeof(nbs->type));
+      blank=gal_data_malloc_array(nb->type, 1, __func__, "blank");
+      memcpy(out->array, blank, gal_type_sizeof(nb->type));
       free(blank);
     }
+  else if(status==GAL_STATISTICS_SORTED_NOT)
+    statistics_select(nb, 0, index, 0, out->array);
   else
-    memcpy(out->array, gal_data_ptr_increment(nbs->array, index, nbs->type),
-           gal_type_sizeof(nbs->type));
+    {
+      if(status==GAL_STATISTICS_SORTED_DECREASING) index=nb->size-1-index;
+      memcpy(out->array, gal_data_ptr_increment(nb->array, index, nb->type),
+             gal_type_sizeof(nb->type));
+    }
 
   /* Clean up and return. */
-  if(nbs!=input) gal_data_free(nbs);
+  if(nb!=input) gal_data_free(nb);
   return out;
 }
 
@@ -820,57 +1033,34 @@ mode_symmetricity(struct statistics_mode_params *p, size_t m, void *b_val)
 
 
 
-/* Return the mode and related parameters in a float64 `gal_data_t' with
-   the following elements in its array, the array:
-
-      array[0]: mode
-      array[1]: mode quantile.
-      array[2]: symmetricity.
-      array[3]: value at the end of symmetricity.
-
-  The inputs are:
-
-    - `input' is the input dataset, it doesn't have to be sorted and can
-      have blank values.
-
-    - `mirrordist' is the maximum distance after the mirror point to check
-      as a multiple of sigma.
-
-    - `inplace' is either 0 or 1. If it is 1 and the input array has blank
-      values and is not sorted, then the removal of blank values and
-      sorting will occur in-place (input will be modified): all blank
-      elements in the input array will be removed and it will be sorted. */
-gal_data_t *
-gal_statistics_mode(gal_data_t *input, float mirrordist, int inplace)
+/* Find the mode of a dataset that has no blank values and is already
+   sorted. The output is described in `gal_statistics_mode'. */
+static gal_data_t *
+statistics_mode_no_blank_sorted(gal_data_t *sorted, float mirrordist)
 {
   double *oa;
   size_t modeindex;
   size_t dsize=4, mdsize=1;
   struct statistics_mode_params p;
-  int type=gal_tile_block(input)->type;
-  gal_data_t *tmptype=gal_data_alloc(NULL, type, 1, &mdsize, NULL, 1, -1,
-                                     NULL, NULL, NULL);
-  gal_data_t *b_val=gal_data_alloc(NULL, type, 1, &mdsize, NULL, 1, -1,
-                                   NULL, NULL, NULL);
+  gal_data_t *tmptype=gal_data_alloc(NULL, sorted->type, 1, &mdsize, NULL,
+                                     1, -1, NULL, NULL, NULL);
+  gal_data_t *b_val=gal_data_alloc(NULL, sorted->type, 1, &mdsize, NULL, 1,
+                                   -1, NULL, NULL, NULL);
   gal_data_t *out=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &dsize,
                                  NULL, 1, -1, NULL, NULL, NULL);
 
 
-  /* A small sanity check. */
-  if(mirrordist<=0)
-    error(EXIT_FAILURE, 0, "%s: %f not acceptable as a value to "
-          "`mirrordist'. Only positive values can be given to it",
-          __func__, mirrordist);
-
-
-  /* Make sure the input doesn't have blank values and is sorted.  */
-  p.data=gal_statistics_no_blank_sorted(input, inplace);
-
-
   /* It can happen that the whole array is blank. In such cases,
      `p.data->size==0', so set all output elements to NaN and return. */
+  p.data=sorted;
   oa=out->array;
-  if(p.data->size==0) { oa[0]=oa[1]=oa[2]=oa[3]=NAN; return out; }
+  if(p.data->size==0)
+    {
+      oa[0]=oa[1]=oa[2]=oa[3]=NAN;
+      gal_data_free(tmptype);
+      gal_data_free(b_val);
+      return out;
+    }
 
 
   /* Basic constants. */
@@ -934,8 +1124,7 @@ gal_statistics_mode(gal_data_t *input, float mirrordist, int inplace)
          oa[0], oa[1], oa[2], oa[3]);
   */
 
-  /* Clean up (if necessary), then return the output */
-  if(p.data!=input) gal_data_free(p.data);
+  /* Clean up and return the output. */
   gal_data_free(tmptype);
   gal_data_free(b_val);
   return out;
@@ -945,6 +1134,165 @@ gal_statistics_mode(gal_data_t *input, float mirrordist, int inplace)
 
 
 
+/* Return the mode and related parameters in a float64 `gal_data_t' with
+   the following elements in its array, the array:
+
+      array[0]: mode
+      array[1]: mode quantile.
+      array[2]: symmetricity.
+      array[3]: value at the end of symmetricity.
+
+  The inputs are:
+
+    - `input' is the input dataset, it doesn't have to be sorted and can
+      have blank values.
+
+    - `mirrordist' is the maximum distance after the mirror point to check
+      as a multiple of sigma.
+
+    - `inplace' is either 0 or 1. If it is 1 and the input array has blank
+      values and is not sorted, then the removal of blank values and
+      sorting will occur in-place (input will be modified): all blank
+      elements in the input array will be removed and it will be sorted. */
+gal_data_t *
+gal_statistics_mode(gal_data_t *input, float mirrordist, int inplace)
+{
+  gal_data_t *nbs, *out;
+
+  /* A small sanity check. */
+  if(mirrordist<=0)
+    error(EXIT_FAILURE, 0, "%s: %f not acceptable as a value to "
+          "`mirrordist'. Only positive values can be given to it",
+          __func__, mirrordist);
+
+  /* Make sure the input doesn't have blank values and is sorted, then
+     find the mode. */
+  nbs=gal_statistics_no_blank_sorted(input, inplace);
+  out=statistics_mode_no_blank_sorted(nbs, mirrordist);
+
+  /* Clean up (if necessary), then return the output */
+  if(nbs!=input) gal_data_free(nbs);
+  return out;
+}
+
+
+
+
+
+/* Return the values at several quantiles of the input while only ordering
+   it once. `quantiles' is an array of `numq' quantiles (each between 0 and
+   1, in any order). The output is a `numq' element dataset with the same
+   type as the input, keeping the value of each quantile in the same order
+   as `quantiles' (they will be blank if the input has no usable
+   elements).
+
+   When `mirrordist' is positive, the mode is also found (with the same
+   output as `gal_statistics_mode') and put in the `next' element of the
+   returned dataset. When it is zero or negative, the mode isn't found
+   (and `next' is NULL). The mode needs a sorted array, so in this case the
+   quantiles are simply read from the sorted array. Otherwise, the
+   quantiles are found with successive selections: after selecting the
+   element at the smallest requested index, the array is partitioned
+   around it, so the next index only has to be searched among the elements
+   after it.
+
+   `inplace' has the same meaning as in `gal_statistics_quantile' and
+   `gal_statistics_mode'. */
+gal_data_t *
+gal_statistics_quantiles(gal_data_t *input, double *quantiles, size_t numq,
+                         float mirrordist, int inplace)
+{
+  int status;
+  gal_data_t *nb, *out;
+  size_t i, j, k, t, start, *index, *order, width;
+
+  /* A small sanity check. */
+  if(numq==0)
+    error(EXIT_FAILURE, 0, "%s: no quantiles requested", __func__);
+
+  /* Remove the blank values, and if the mode is also necessary, sort the
+     dataset. */
+  if(mirrordist>0)
+    {
+      nb=gal_statistics_no_blank_sorted(input, inplace);
+      status=nb->status;
+    }
+  else
+    nb=statistics_no_blank_for_select(input, inplace, &status);
+  out=gal_data_alloc(NULL, nb->type, 1, &numq, NULL, 1, -1, NULL, NULL,
+                     NULL);
+  width=gal_type_sizeof(nb->type);
+
+  /* When there are no usable elements, the quantiles are blank. */
+  if(nb->size==0)
+    gal_blank_initialize(out);
+  else
+    {
+      /* Find the index of each quantile and sort the quantiles by their
+         index (there are usually only a few quantiles, so an insertion
+         sort is enough). */
+      index=gal_data_malloc_array(GAL_TYPE_SIZE_T, 2*numq, __func__,
+                                  "index");
+      order=index+numq;
+      for(i=0;i<numq;++i)
+        {
+          index[i]=gal_statistics_quantile_index(nb->size, quantiles[i]);
+          t=order[i]=i;
+          for(j=i; j>0 && index[order[j-1]]>index[t]; --j)
+            order[j]=order[j-1];
+          order[j]=t;
+        }
+
+      /* Write the values at each index into the output. */
+      start=0;
+      for(i=0;i<numq;++i)
+        {
+          k=index[order[i]];
+          switch(status)
+            {
+            case GAL_STATISTICS_SORTED_INCREASING:
+              memcpy(gal_data_ptr_increment(out->array, order[i], nb->type),
+                     gal_data_ptr_increment(nb->array, k, nb->type), width);
+              break;
+
+            case GAL_STATISTICS_SORTED_DECREASING:
+              memcpy(gal_data_ptr_increment(out->array, order[i], nb->type),
+                     gal_data_ptr_increment(nb->array, nb->size-1-k,
+                                            nb->type), width);
+              break;
+
+            /* Not sorted: if this index is the same as the previous one,
+               its element is already in place. */
+            default:
+              if(k<start)
+                memcpy(gal_data_ptr_increment(out->array, order[i],
+                                              nb->type),
+                       gal_data_ptr_increment(nb->array, k, nb->type),
+                       width);
+              else
+                statistics_select(nb, start, k, 0,
+                                  gal_data_ptr_increment(out->array,
+                                                         order[i],
+                                                         nb->type));
+              start=k+1;
+            }
+        }
+      free(index);
+    }
+
+  /* Find the mode if necessary. */
+  if(mirrordist>0)
+    out->next=statistics_mode_no_blank_sorted(nb, mirrordist);
+
+  /* Clean up (if necessary), then return the output. */
+  if(nb!=input) gal_data_free(nb);
+  return out;
+}
+
+
+
+
+
 /* Make the mirror array. */
 #define STATS_MKMIRROR(IT) {                                            \
     IT *a=noblank_sorted->array, *m=mirror->array;                      \
@@ -1111,39 +1459,209 @@ gal_statistics_is_sorted(gal_data_t *input)
 
 
 
-/* This function is ignorant to blank values, if you want to make sure
-   there is no blank values, you can call `gal_blank_remove' first. */
-#define STATISTICS_SORT(QSORT_F) {                                      \
-    qsort(input->array, input->size, gal_type_sizeof(input->type), QSORT_F); \
+/* Sorting is done on unsigned integer keys that have the same order as
+   the values: for signed integers, the sign bit is flipped and for
+   floating point types, the sign bit is flipped for positive values and
+   all the bits are flipped for negative values. Therefore the same
+   comparisons and radix digits can be used for all types. To sort in a
+   decreasing order, all the bits of the key are also flipped (with the
+   `flip' variable in `SORT_K'). */
+#define SORT_KEY_UINT(V, UT) ( (UT)(V) )
+#define SORT_KEY_INT(V, UT)  ( (UT)(V) ^ ((UT)1 << (8*sizeof(UT)-1)) )
+#define SORT_KEY_F32(V, UT)  statistics_sort_key_f32(V)
+#define SORT_KEY_F64(V, UT)  statistics_sort_key_f64(V)
+#define SORT_K(KEY, UT, V)   ( (UT)(KEY(V, UT) ^ flip) )
+
+static inline uint32_t
+statistics_sort_key_f32(float v)
+{
+  union { float f; uint32_t u; } c;
+  c.f=v;
+  return c.u & 0x80000000U ? ~c.u : c.u | 0x80000000U;
+}
+
+static inline uint64_t
+statistics_sort_key_f64(double v)
+{
+  union { double f; uint64_t u; } c;
+  c.f=v;
+  return ( c.u & 0x8000000000000000ULL
+           ? ~c.u
+           : c.u | 0x8000000000000000ULL );
+}
+
+
+
+
+
+/* Sort `size' elements of the array, starting from `start', in place.
+   When the number of elements is less than `STATISTICS_SORT_RADIX_MIN',
+   an introsort is used: a median-of-three quicksort that switches to a
+   heapsort when the partitions become too unbalanced and to an insertion
+   sort for small ranges. Otherwise a least-significant-digit radix sort
+   is used (one byte in each pass): it is linear in the number of
+   elements, but needs `tmp' (an allocated array with the same size and
+   type as the input) for moving the elements between the passes. Passes
+   where all the elements have the same digit are ignored. */
+#define STATISTICS_SORT_RADIX_MIN 256
+#define STATS_SORT_RANGE(IT, UT, KEY) {                                 \
+    UT k, flip = decreasing ? (UT)(-1) : 0;                             \
+    IT *a=(IT *)(data->array)+start, v, *src, *dst, *tt;                \
+    size_t i, j, d, p, s, l, r, lo, hi, mid, sp, depth, stack[192];     \
+    size_t c[sizeof(UT)][256];                                          \
+                                                                        \
+    if(size<STATISTICS_SORT_RADIX_MIN)                                  \
+      {                                                                 \
+        /* Maximum depth of partitioning is twice the binary */         \
+        /* logarithm of the size. Put the full range in the stack. */   \
+        depth=0; for(i=size; i; i>>=1) depth+=2;                        \
+        sp=0;                                                           \
+        stack[sp++]=0; stack[sp++]=size-1; stack[sp++]=depth;           \
+        while(sp)                                                       \
+          {                                                             \
+            depth=stack[--sp]; hi=stack[--sp]; lo=stack[--sp];          \
+            while(hi>lo)                                                \
+              {                                                         \
+                /* Small range: insertion sort. */                      \
+                if(hi-lo<16)                                            \
+                  {                                                     \
+                    for(i=lo+1;i<=hi;++i)                               \
+                      {                                                 \
+                        v=a[i];                                         \
+                        for(j=i; j>lo && SORT_K(KEY,UT,a[j-1])          \
+                              > SORT_K(KEY,UT,v); --j)                  \
+                          a[j]=a[j-1];                                  \
+                        a[j]=v;                                         \
+                      }                                                 \
+                    break;                                              \
+                  }                                                     \
+                                                                        \
+                /* Too many unbalanced partitions: heapsort. */         \
+                if(depth==0)                                            \
+                  {                                                     \
+                    /* Build a max-heap, then move its top to the */    \
+                    /* end of the range, one by one. */                 \
+                    tt=a+lo; s=hi-lo+1;                                 \
+                    for(i=s/2; i-->0;)                                  \
+                      for(j=i; (l=2*j+1)<s; j=l)                        \
+                        {                                               \
+                          if(l+1<s && SORT_K(KEY,UT,tt[l+1])            \
+                             > SORT_K(KEY,UT,tt[l])) ++l;               \
+                          if( SORT_K(KEY,UT,tt[l])                      \
+                              <= SORT_K(KEY,UT,tt[j]) ) break;          \
+                          v=tt[j]; tt[j]=tt[l]; tt[l]=v;                \
+                        }                                               \
+                    for(r=s-1; r>0; --r)                                \
+                      {                                                 \
+                        v=tt[0]; tt[0]=tt[r]; tt[r]=v;                  \
+                        for(j=0; (l=2*j+1)<r; j=l)                      \
+                          {                                             \
+                            if(l+1<r && SORT_K(KEY,UT,tt[l+1])          \
+                               > SORT_K(KEY,UT,tt[l])) ++l;             \
+                            if( SORT_K(KEY,UT,tt[l])                    \
+                                <= SORT_K(KEY,UT,tt[j]) ) break;        \
+                            v=tt[j]; tt[j]=tt[l]; tt[l]=v;              \
+                          }                                             \
+                      }                                                 \
+                    break;                                              \
+                  }                                                     \
+                --depth;                                                \
+                                                                        \
+                /* Median of three, the two ends will be sentinels. */  \
+                mid=lo+(hi-lo)/2;                                       \
+                if( SORT_K(KEY,UT,a[mid]) < SORT_K(KEY,UT,a[lo]) )      \
+                  { v=a[mid]; a[mid]=a[lo]; a[lo]=v; }                  \
+                if( SORT_K(KEY,UT,a[hi]) < SORT_K(KEY,UT,a[lo]) )       \
+                  { v=a[hi]; a[hi]=a[lo]; a[lo]=v; }                    \
+                if( SORT_K(KEY,UT,a[hi]) < SORT_K(KEY,UT,a[mid]) )      \
+                  { v=a[hi]; a[hi]=a[mid]; a[mid]=v; }                  \
+                k=SORT_K(KEY,UT,a[mid]);                                \
+                                                                        \
+                /* Partition. */                                        \
+                i=lo; j=hi;                                             \
+                while(i<=j)                                             \
+                  {                                                     \
+                    while( SORT_K(KEY,UT,a[i]) < k ) ++i;               \
+                    while( SORT_K(KEY,UT,a[j]) > k ) --j;               \
+                    if(i<=j) { v=a[i]; a[i]=a[j]; a[j]=v; ++i; --j; }   \
+                  }                                                     \
+                                                                        \
+                /* Keep the smaller side for later, so the stack */     \
+                /* never gets deeper than the binary logarithm. */      \
+                if(j-lo < hi-i)                                         \
+                  {                                                     \
+                    stack[sp++]=lo; stack[sp++]=j; stack[sp++]=depth;   \
+                    lo=i;                                               \
+                  }                                                     \
+                else                                                    \
+                  {                                                     \
+                    stack[sp++]=i; stack[sp++]=hi; stack[sp++]=depth;   \
+                    hi=j;                                               \
+                  }                                                     \
+              }                                                         \
+          }                                                             \
+      }                                                                 \
+    else                                                                \
+      {                                                                 \
+        /* Histograms of all the digits in one pass over the data. */   \
+        memset(c, 0, sizeof c);                                         \
+        for(i=0;i<size;++i)                                             \
+          {                                                             \
+            k=SORT_K(KEY,UT,a[i]);                                      \
+            for(p=0;p<sizeof(UT);++p) ++c[p][ (k>>(8*p)) & 0xff ];      \
+          }                                                             \
+                                                                        \
+        /* Move the elements between the two arrays in each pass. */    \
+        src=a; dst=(IT *)tmp+start;                                     \
+        for(p=0;p<sizeof(UT);++p)                                       \
+          {                                                             \
+            /* All elements have the same digit: nothing to do. */      \
+            k=SORT_K(KEY,UT,src[0]);                                    \
+            if( c[p][ (k>>(8*p)) & 0xff ]==size ) continue;             \
+                                                                        \
+            /* Starting position of each digit. */                      \
+            for(s=d=0;d<256;++d) { l=c[p][d]; c[p][d]=s; s+=l; }        \
+                                                                        \
+            /* Put each element in its place. */                        \
+            for(i=0;i<size;++i)                                         \
+              {                                                         \
+                k=SORT_K(KEY,UT,src[i]);                                \
+                dst[ c[p][ (k>>(8*p)) & 0xff ]++ ]=src[i];              \
+              }                                                         \
+            tt=src; src=dst; dst=tt;                                    \
+          }                                                             \
+        if(src!=a) memcpy(a, src, size*sizeof *a);                      \
+      }                                                                 \
   }
-void
-gal_statistics_sort_increasing(gal_data_t *input)
+static void
+statistics_sort_range(gal_data_t *data, size_t start, size_t size,
+                      int decreasing, void *tmp)
 {
-  switch(input->type)
+  switch(data->type)
     {
     case GAL_TYPE_UINT8:
-      STATISTICS_SORT(gal_qsort_uint8_increasing);    break;
+      STATS_SORT_RANGE( uint8_t,  uint8_t,  SORT_KEY_UINT );   break;
     case GAL_TYPE_INT8:
-      STATISTICS_SORT(gal_qsort_int8_increasing);     break;
+      STATS_SORT_RANGE( int8_t,   uint8_t,  SORT_KEY_INT  );   break;
     case GAL_TYPE_UINT16:
-      STATISTICS_SORT(gal_qsort_uint16_increasing);   break;
+      STATS_SORT_RANGE( uint16_t, uint16_t, SORT_KEY_UINT );   break;
     case GAL_TYPE_INT16:
-      STATISTICS_SORT(gal_qsort_int16_increasing);    break;
+      STATS_SORT_RANGE( int16_t,  uint16_t, SORT_KEY_INT  );   break;
     case GAL_TYPE_UINT32:
-      STATISTICS_SORT(gal_qsort_uint32_increasing);   break;
+      STATS_SORT_RANGE( uint32_t, uint32_t, SORT_KEY_UINT );   break;
     case GAL_TYPE_INT32:
-      STATISTICS_SORT(gal_qsort_int32_increasing);    break;
+      STATS_SORT_RANGE( int32_t,  uint32_t, SORT_KEY_INT  );   break;
     case GAL_TYPE_UINT64:
-      STATISTICS_SORT(gal_qsort_uint64_increasing);   break;
+      STATS_SORT_RANGE( uint64_t, uint64_t, SORT_KEY_UINT );   break;
     case GAL_TYPE_INT64:
-      STATISTICS_SORT(gal_qsort_int64_increasing);    break;
+      STATS_SORT_RANGE( int64_t,  uint64_t, SORT_KEY_INT  );   break;
     case GAL_TYPE_FLOAT32:
-      STATISTICS_SORT(gal_qsort_float32_increasing);  break;
+      STATS_SORT_RANGE( float,    uint32_t, SORT_KEY_F32  );   break;
     case GAL_TYPE_FLOAT64:
-      STATISTICS_SORT(gal_qsort_float64_increasing);  break;
+      STATS_SORT_RANGE( double,   uint64_t, SORT_KEY_F64  );   break;
     default:
       error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
-            __func__, input->type);
+            __func__, data->type);
     }
 }
 
@@ -1151,36 +1669,197 @@ gal_statistics_sort_increasing(gal_data_t *input)
 
 
 
-/* See explanations above `gal_statistics_sort_increasing'. */
-void
-gal_statistics_sort_decreasing(gal_data_t *input)
+/* Merge the two sorted runs `[l, m)' and `[m, r)' of `src' into the same
+   range of `dst'. */
+#define STATS_SORT_MERGE(IT, UT, KEY) {                                 \
+    UT flip = decreasing ? (UT)(-1) : 0;                                \
+    IT *s=src, *d=dst;                                                  \
+    size_t i=l, j=m, o=l;                                               \
+    while(i<m && j<r)                                                   \
+      d[o++] = ( SORT_K(KEY,UT,s[j]) < SORT_K(KEY,UT,s[i])             \
+                 ? s[j++] : s[i++] );                                   \
+    if(i<m) memcpy(d+o, s+i, (m-i)*sizeof *s);                          \
+    if(j<r) memcpy(d+o, s+j, (r-j)*sizeof *s);                          \
+  }
+static void
+statistics_sort_merge(void *src, void *dst, uint8_t type, size_t l,
+                      size_t m, size_t r, int decreasing)
 {
-  switch(input->type)
+  switch(type)
     {
     case GAL_TYPE_UINT8:
-      STATISTICS_SORT(gal_qsort_uint8_decreasing);    break;
+      STATS_SORT_MERGE( uint8_t,  uint8_t,  SORT_KEY_UINT );   break;
     case GAL_TYPE_INT8:
-      STATISTICS_SORT(gal_qsort_int8_decreasing);     break;
+      STATS_SORT_MERGE( int8_t,   uint8_t,  SORT_KEY_INT  );   break;
     case GAL_TYPE_UINT16:
-      STATISTICS_SORT(gal_qsort_uint16_decreasing);   break;
+      STATS_SORT_MERGE( uint16_t, uint16_t, SORT_KEY_UINT );   break;
     case GAL_TYPE_INT16:
-      STATISTICS_SORT(gal_qsort_int16_decreasing);    break;
+      STATS_SORT_MERGE( int16_t,  uint16_t, SORT_KEY_INT  );   break;
     case GAL_TYPE_UINT32:
-      STATISTICS_SORT(gal_qsort_uint32_decreasing);   break;
+      STATS_SORT_MERGE( uint32_t, uint32_t, SORT_KEY_UINT );   break;
     case GAL_TYPE_INT32:
-      STATISTICS_SORT(gal_qsort_int32_decreasing);    break;
+      STATS_SORT_MERGE( int32_t,  uint32_t, SORT_KEY_INT  );   break;
     case GAL_TYPE_UINT64:
-      STATISTICS_SORT(gal_qsort_uint64_decreasing);   break;
+      STATS_SORT_MERGE( uint64_t, uint64_t, SORT_KEY_UINT );   break;
     case GAL_TYPE_INT64:
-      STATISTICS_SORT(gal_qsort_int64_decreasing);    break;
+      STATS_SORT_MERGE( int64_t,  uint64_t, SORT_KEY_INT  );   break;
     case GAL_TYPE_FLOAT32:
-      STATISTICS_SORT(gal_qsort_float32_decreasing);  break;
+      STATS_SORT_MERGE( float,    uint32_t, SORT_KEY_F32  );   break;
     case GAL_TYPE_FLOAT64:
-      STATISTICS_SORT(gal_qsort_float64_decreasing);  break;
+      STATS_SORT_MERGE( double,   uint64_t, SORT_KEY_F64  );   break;
     default:
       error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
-            __func__, input->type);
+            __func__, type);
+    }
+}
+
+
+
+
+
+/* Parameters for sorting on multiple threads. The array is divided into
+   `numchunks' contiguous chunks (chunk `i' starts at `bounds[i]') that are
+   first sorted independently. Afterwards, in each round, neighboring runs
+   of `width' chunks are merged from `src' into `dst'. */
+struct statistics_sort_params
+{
+  gal_data_t  *data;         /* Dataset to sort.                          */
+  void         *tmp;         /* Array to move elements to.                */
+  int    decreasing;         /* Sort in decreasing order.                 */
+  size_t   *bounds;          /* Starting index of each chunk (+ the end). */
+  size_t  numchunks;         /* Number of chunks.                         */
+  size_t      width;         /* Chunks in each run (0: sort the chunks).  */
+  void        *src;          /* Array containing the runs to merge.       */
+  void        *dst;          /* Array to write the merged runs into.      */
+};
+
+static void *
+statistics_sort_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct statistics_sort_params *p=tprm->params;
+
+  size_t i, a, l, m, r, n=p->numchunks;
+
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      a=tprm->indexs[i];
+      if(p->width)
+        {
+          /* Bounds of the two runs, note that the last run may not have
+             a neighbor to merge with (it will just be copied). */
+          l=p->bounds[ 2*a*p->width ];
+          m=(2*a+1)*p->width; m=p->bounds[ m<n ? m : n ];
+          r=(2*a+2)*p->width; r=p->bounds[ r<n ? r : n ];
+          statistics_sort_merge(p->src, p->dst, p->data->type, l, m, r,
+                                p->decreasing);
+        }
+      else
+        statistics_sort_range(p->data, p->bounds[a],
+                              p->bounds[a+1]-p->bounds[a], p->decreasing,
+                              p->tmp);
     }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Sort the input in place. When there are more than one threads and the
+   array is large enough, each thread will sort one chunk of the array and
+   the chunks will be merged in parallel (doubling in size in each
+   round). */
+#define STATISTICS_SORT_THREADS_MIN 100000
+static void
+statistics_sort(gal_data_t *input, int decreasing, size_t numthreads)
+{
+  void *swap;
+  size_t i, *bounds;
+  struct statistics_sort_params p;
+
+  /* Basic sanity checks. */
+  if(input->size<2) return;
+  if(numthreads==0) numthreads=gal_threads_number();
+  if(input->size<STATISTICS_SORT_THREADS_MIN) numthreads=1;
+
+  /* Space to move the elements into (only necessary for radix sorting or
+     merging). */
+  p.tmp = ( input->size<STATISTICS_SORT_RADIX_MIN
+            ? NULL
+            : gal_data_malloc_array(input->type, input->size, __func__,
+                                    "tmp") );
+
+  /* Single thread: just sort the full range. */
+  if(numthreads==1)
+    statistics_sort_range(input, 0, input->size, decreasing, p.tmp);
+  else
+    {
+      /* Set the bounds of each chunk. */
+      errno=0;
+      bounds=malloc((numthreads+1)*sizeof *bounds);
+      if(bounds==NULL)
+        error(EXIT_FAILURE, errno, "%s: %zu bytes for `bounds'",
+              __func__, (numthreads+1)*sizeof *bounds);
+      for(i=0;i<=numthreads;++i) bounds[i]=i*input->size/numthreads;
+
+      /* Sort each chunk. */
+      p.data=input;
+      p.width=0;
+      p.bounds=bounds;
+      p.numchunks=numthreads;
+      p.decreasing=decreasing;
+      gal_threads_spin_off(statistics_sort_on_thread, &p, numthreads,
+                           numthreads);
+
+      /* Merge the sorted chunks. */
+      p.src=input->array;
+      p.dst=p.tmp;
+      for(p.width=1; p.width<numthreads; p.width*=2)
+        {
+          gal_threads_spin_off(statistics_sort_on_thread, &p,
+                               (numthreads+2*p.width-1)/(2*p.width),
+                               numthreads);
+          swap=p.src; p.src=p.dst; p.dst=swap;
+        }
+
+      /* If the final result is in the temporary array, copy it back. */
+      if(p.src!=input->array)
+        memcpy(input->array, p.src,
+               input->size*gal_type_sizeof(input->type));
+      free(bounds);
+    }
+
+  /* Clean up. */
+  free(p.tmp);
+}
+
+
+
+
+
+/* This function is ignorant to blank values, if you want to make sure
+   there is no blank values, you can call `gal_blank_remove' first. When
+   `numthreads' is larger than one (or zero: all available threads), large
+   arrays will be sorted on multiple threads. */
+void
+gal_statistics_sort_increasing(gal_data_t *input, size_t numthreads)
+{
+  statistics_sort(input, 0, numthreads);
+}
+
+
+
+
+
+/* See explanations above `gal_statistics_sort_increasing'. */
+void
+gal_statistics_sort_decreasing(gal_data_t *input, size_t numthreads)
+{
+  statistics_sort(input, 1, numthreads);
 }
 
 
@@ -1201,44 +1880,11 @@ gal_data_t *
 gal_statistics_no_blank_sorted(gal_data_t *input, int inplace)
 {
   int sortstatus;
-  gal_data_t *contig, *noblank, *sorted;
-
-
-  /* If this is a tile, then first we have to copy it into a contiguous
-     piece of memory. After this step, we will only be dealing with
-     `contig' (for a contiguous patch of memory). */
-  if(input->block)
-    {
-      /* Copy the input into a contiguous patch of memory. */
-      contig=gal_data_copy(input);
+  gal_data_t *noblank, *sorted;
 
-      /* When the data was a tile, we have already copied the array into a
-         separate allocated space. So to avoid any further copying, we will
-         just set the `inplace' variable to 1. */
-      inplace=1;
-    }
-  else contig=input;
-
-
-  /* Make sure there is no blanks in the array that will be used. After
-     this step, we won't be dealing with `input' any more, but with
-     `noblank'. */
-  if( gal_blank_present(contig, inplace) )
-    {
-      /* See if we should allocate a new dataset to remove blanks or if we
-         can use the actual contiguous patch of memory. */
-      noblank = inplace ? contig : gal_data_copy(contig);
-      gal_blank_remove(noblank);
-
-      /* If we are working in place, then mark that there are no blank
-         pixels. */
-      if(inplace)
-        {
-          noblank->flag |= GAL_DATA_FLAG_BLANK_CH;
-          noblank->flag &= ~GAL_DATA_FLAG_HASBLANK;
-        }
-    }
-  else noblank=contig;
+  /* Remove the blank values. After this step, we won't be dealing with
+     `input' any more, but with `noblank'. */
+  noblank=statistics_no_blank(input, inplace);
 
 
   /* Make sure the array is sorted. After this step, we won't be dealing
@@ -1259,7 +1905,7 @@ gal_statistics_no_blank_sorted(gal_data_t *input, int inplace)
           else
             sorted=gal_data_copy(noblank);
         }
-      gal_statistics_sort_increasing(sorted);
+      gal_statistics_sort_increasing(sorted, 1);
       sorted->status=GAL_STATISTICS_SORTED_INCREASING;
     }
 
@@ -1720,7 +2366,109 @@ gal_statistics_cfp(gal_data_t *input, gal_data_t *bins, int normalize)
   (if it isn't sorted). Afterwards, it will recursively change the starting
   point of the array and its size, calcluating the basic statistics in each
   round to define the new starting point and size.
+
+  To avoid parsing the whole remaining array in every round, the sum and
+  sum of squares are only calculated over the full array once. In the
+  next rounds, the sums of the clipped elements (that are on the two ends
+  of the array) are just subtracted from them (with compensated
+  summation). When the clipped elements dominate the sums (so subtracting
+  them would lose precision), or they are more than the remaining
+  elements, the sums are re-calculated over the remaining elements.
 */
+static inline void
+statistics_sum_compensated(double *sum, double *c, double v)
+{
+  double y=v-*c, t=*sum+y;
+  *c=(t-*sum)-y;
+  *sum=t;
+}
+
+#define SIGCLIP_SUMS(IT) {                                              \
+    IT *x=from, *xf=x+n;                                                \
+    for(;x<xf;++x)                                                      \
+      {                                                                 \
+        v=*x;                                                           \
+        statistics_sum_compensated(&sums[0], &sums[1], v);              \
+        statistics_sum_compensated(&sums[2], &sums[3], v*v);            \
+      }                                                                 \
+  }
+static void
+statistics_sigclip_sums(void *from, size_t n, uint8_t type, double *sums)
+{
+  double v;
+
+  /* Initialize the sums and their compensations. */
+  sums[0]=sums[1]=sums[2]=sums[3]=0.0f;
+
+  /* Parse the elements. */
+  switch(type)
+    {
+    case GAL_TYPE_UINT8:     SIGCLIP_SUMS( uint8_t  );   break;
+    case GAL_TYPE_INT8:      SIGCLIP_SUMS( int8_t   );   break;
+    case GAL_TYPE_UINT16:    SIGCLIP_SUMS( uint16_t );   break;
+    case GAL_TYPE_INT16:     SIGCLIP_SUMS( int16_t  );   break;
+    case GAL_TYPE_UINT32:    SIGCLIP_SUMS( uint32_t );   break;
+    case GAL_TYPE_INT32:     SIGCLIP_SUMS( int32_t  );   break;
+    case GAL_TYPE_UINT64:    SIGCLIP_SUMS( uint64_t );   break;
+    case GAL_TYPE_INT64:     SIGCLIP_SUMS( int64_t  );   break;
+    case GAL_TYPE_FLOAT32:   SIGCLIP_SUMS( float    );   break;
+    case GAL_TYPE_FLOAT64:   SIGCLIP_SUMS( double   );   break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, type);
+    }
+}
+
+
+
+
+
+/* Remove the elements that were clipped in this round (`nlow' elements
+   from the start and `nhigh' elements from the end of the `oldsize'
+   elements starting from `oldstart') from the sums. */
+static void
+statistics_sigclip_sums_update(void *oldstart, size_t oldsize, size_t nlow,
+                               size_t nhigh, uint8_t type, double *sums)
+{
+  size_t width=gal_type_sizeof(type), size=oldsize-nlow-nhigh;
+  double low[4]={0.0f, 0.0f, 0.0f, 0.0f}, high[4]={0.0f, 0.0f, 0.0f, 0.0f};
+
+  /* When more elements are clipped than remain, it is cheaper to just
+     re-calculate the sums. */
+  if(nlow+nhigh>size)
+    {
+      statistics_sigclip_sums((char *)oldstart+nlow*width, size, type, sums);
+      return;
+    }
+
+  /* Sums of the clipped elements on each side. */
+  if(nlow)  statistics_sigclip_sums(oldstart, nlow, type, low);
+  if(nhigh) statistics_sigclip_sums((char *)oldstart+(nlow+size)*width,
+                                    nhigh, type, high);
+
+  /* If the squares of the clipped elements are larger than those that
+     remain, subtracting them will lose too much precision. */
+  if( low[2]+high[2] > sums[2]-low[2]-high[2] )
+    {
+      statistics_sigclip_sums((char *)oldstart+nlow*width, size, type, sums);
+      return;
+    }
+
+  /* Subtract the clipped elements (and their compensations). */
+  statistics_sum_compensated(&sums[0], &sums[1], -low[0]);
+  statistics_sum_compensated(&sums[0], &sums[1], low[1]);
+  statistics_sum_compensated(&sums[0], &sums[1], -high[0]);
+  statistics_sum_compensated(&sums[0], &sums[1], high[1]);
+  statistics_sum_compensated(&sums[2], &sums[3], -low[2]);
+  statistics_sum_compensated(&sums[2], &sums[3], low[3]);
+  statistics_sum_compensated(&sums[2], &sums[3], -high[2]);
+  statistics_sum_compensated(&sums[2], &sums[3], high[3]);
+}
+
+
+
+
+
 #define SIGCLIP(IT) {                                                   \
     IT *a  = nbs->array, *af = a  + nbs->size;                          \
     IT *bf = nbs->array, *b  = bf + nbs->size - 1;                      \
@@ -1750,12 +2498,12 @@ gal_data_t *
 gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
                           int inplace, int quiet)
 {
-  void *start, *nbs_array;
-  double *med, *mean, *std;
+  void *start, *oldstart, *nbs_array;
+  double *med, *mean, *std, meanstd[2], sums[4];
   uint8_t bytolerance = param>=1.0f ? 0 : 1;
   double oldmed=NAN, oldmean=NAN, oldstd=NAN;
-  size_t num=0, one=1, four=4, size, oldsize;
-  gal_data_t *median_i, *median_d, *out, *meanstd;
+  size_t num=0, one=1, four=4, size, oldsize, nlow;
+  gal_data_t *median_i, *median_d, *out;
   int sortstatus, type=gal_tile_block(input)->type;
   gal_data_t *nbs=gal_statistics_no_blank_sorted(input, inplace);
   size_t maxnum = param>=1.0f ? param : GAL_STATISTICS_SIG_CLIP_MAX_CONVERGE;
@@ -1799,15 +2547,21 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
       median_d=gal_data_copy_to_new_type(median_i, GAL_TYPE_FLOAT64);
 
       /* Find the average and Standard deviation, note that both `start'
-         and `size' will be different in the next round. */
-      nbs->array = start;
+         and `size' will be different in the next round. The sums are
+         only calculated over all the elements in the first round, in the
+         next rounds, they are updated after the clipping (below). */
+      nbs->array = oldstart = start;
       nbs->size = oldsize = size;
-      meanstd=gal_statistics_mean_std(nbs);
+      if(num==0) statistics_sigclip_sums(start, size, type, sums);
+      meanstd[0] = size ? sums[0]/size : GAL_BLANK_FLOAT64;
+      meanstd[1] = ( size
+                     ? sqrt( (sums[2]-sums[0]*sums[0]/size)/size )
+                     : GAL_BLANK_FLOAT64 );
 
       /* Put the three final values in usable (with a type) pointers. */
       med  = median_d->array;
-      mean = meanstd->array;
-      std  = &((double *)(meanstd->array))[1];
+      mean = &meanstd[0];
+      std  = &meanstd[1];
 
       /* If the user wanted to view the steps, show it to them. */
       if(!quiet)
@@ -1842,6 +2596,11 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
                 __func__, type);
         }
 
+      /* Remove the clipped elements from the sums. */
+      nlow=((char *)start-(char *)oldstart)/gal_type_sizeof(type);
+      statistics_sigclip_sums_update(oldstart, oldsize, nlow,
+                                     oldsize-size-nlow, type, sums);
+
       /* Set the values from this round in the old elements, so the next
          round can compare with, and return then if necessary. */
       oldmed =  *med;
@@ -1850,7 +2609,6 @@ gal_statistics_sigma_clip(gal_data_t *input, float multip, float param,
       ++num;
 
       /* Clean up: */
-      gal_data_free(meanstd);
       gal_data_free(median_d);
     }
 
@@ -25,9 +25,15 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
 #include <regex.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stat-time.h>      /* from Gnulib, in Gnuastro's source */
 
 #include <gnuastro/git.h>
 #include <gnuastro/txt.h>
@@ -41,6 +47,35 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/* Columnar cache of a table: a sidecar file (the table's name with
+   `GAL_TABLE_CACHE_SUFFIX' appended) that keeps each column as one
+   contiguous array in the native byte order, so it can be mapped into
+   memory without any parsing. Its layout is:
+
+     - Magic string (8 bytes), version and byte-order mark (`uint32_t'),
+       number of columns, number of rows, size and modification time
+       (seconds and nanoseconds) of the source when the cache was written
+       (`uint64_t'), HDU of the source if it is a FITS file (string).
+
+     - For each column: type, flag, display format, width and precision
+       (`int32_t'), bytes per element and offset of the column's data
+       from the start of the file (`uint64_t'), name, unit and comment
+       (strings).
+
+     - The column data, each starting on a page boundary (of the system
+       that wrote the cache). String columns are kept as fixed-width
+       records padded with `\0'.
+
+   Strings in the header are written as their length (`uint64_t', zero
+   for a NULL string) followed by their characters. */
+#define TABLE_CACHE_MAGIC      "GALTBLC"
+#define TABLE_CACHE_VERSION    2
+#define TABLE_CACHE_BOM        0x01020304
+#define TABLE_CACHE_ROUND(N,P) ( ( (N) + (P) - 1 ) / (P) * (P) )
+
+
+
+
 
 
 
@@ -380,25 +415,12 @@ make_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
 
 
 
-/* Read the specified columns in a table (named `filename') into a linked
-   list of data structures. If the file is FITS, then `hdu' will also be
-   used, otherwise, `hdu' is ignored. The information to search for columns
-   should be specified by the `cols' linked list as string values in each
-   node of the list, the strings in each node can be a number, an exact
-   match to a column name, or a regular expression (in GNU AWK format)
-   enclosed in `/ /'. The `searchin' value comes from the
-   `gal_table_where_to_search' enumerator and has to be one of its given
-   types. If `cols' is NULL, then this function will read the full table.
-
-   The output is a linked list with the same order of the cols linked
-   list. Note that one column node in the `cols' list might give multiple
-   columns, in this case, the order of output columns that correspond to
-   that one input, are in order of the table (which column was read first).
-   So the first requested column is the first popped data structure and so
-   on. */
-gal_data_t *
-gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
-               int searchin, int ignorecase, int minmapsize)
+/* Read the requested columns from the table's own file (see
+   `gal_table_read'). */
+static gal_data_t *
+table_read_source(char *filename, char *hdu, gal_list_str_t *cols,
+                  int searchin, int ignorecase, size_t numthreads,
+                  int minmapsize)
 {
   int tableformat;
   gal_list_sizet_t *indexll;
@@ -429,7 +451,7 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
     {
     case GAL_TABLE_FORMAT_TXT:
       out=gal_txt_table_read(filename, numrows, allcols, indexll,
-                             minmapsize);
+                             numthreads, minmapsize);
       break;
 
     case GAL_TABLE_FORMAT_AFITS:
@@ -457,6 +479,357 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
 
 
 
+/* Name of the columnar cache of `filename' (allocated). Each HDU of a
+   FITS file has its own cache, so its name also contains the HDU (any
+   `/' in the HDU is replaced with `_'). */
+char *
+gal_table_cache_name(char *filename, char *hdu)
+{
+  char *c, *out;
+  int withhdu = hdu && gal_fits_name_is_fits(filename);
+
+  if( asprintf(&out, "%s%s%s%s", filename, withhdu ? "." : "",
+               withhdu ? hdu : "", GAL_TABLE_CACHE_SUFFIX)<0 )
+    error(EXIT_FAILURE, errno, "%s: asprintf allocation", __func__);
+  if(withhdu)
+    for(c=out+strlen(filename)+1; *c!='\0'; ++c)
+      if(*c=='/') *c='_';
+  return out;
+}
+
+
+
+
+
+/* Read one string of the cache's header (see the comments above
+   `TABLE_CACHE_MAGIC'). A zero length is a NULL string. A length that is
+   larger than the cache (`csize') can only be corrupt, so it isn't
+   allocated. */
+static int
+table_cache_read_str(FILE *fp, char **str, uint64_t csize)
+{
+  uint64_t len;
+
+  *str=NULL;
+  if( fread(&len, sizeof len, 1, fp)!=1 || len>csize ) return 0;
+  if(len)
+    {
+      *str=gal_data_malloc_array(GAL_TYPE_UINT8, len+1, __func__, "str");
+      if( fread(*str, 1, len, fp)!=len ) return 0;
+      (*str)[len]='\0';
+    }
+  return 1;
+}
+
+
+
+
+
+/* Read the header of the cache and return the information of all its
+   columns (like `gal_table_info'). The bytes per element and offset of
+   each column are put in `elsize' and `offset' (allocated). If the cache
+   can't be used for this source (it is corrupted, truncated, from an
+   older version, another byte-order, another HDU or another version of
+   the source), this function will return NULL. `sst' and `cst' are the
+   status of the source and the (opened) cache. */
+static gal_data_t *
+table_cache_info(FILE *fp, struct stat *sst, struct stat *cst,
+                 char *filename, char *hdu, size_t *numcols,
+                 size_t *numrows, uint64_t **elsize, uint64_t **offset)
+{
+  int good=1;
+  size_t i, nc;
+  char magic[8], *chdu;
+  gal_data_t *allcols;
+  int32_t i32[5];
+  uint32_t u32[2];
+  uint64_t u64[5], csize=cst->st_size;
+
+  /* General properties. */
+  if( fread(magic, 1, sizeof magic, fp)!=sizeof magic
+      || memcmp(magic, TABLE_CACHE_MAGIC, sizeof magic)
+      || fread(u32, sizeof *u32, 2, fp)!=2
+      || u32[0]!=TABLE_CACHE_VERSION || u32[1]!=TABLE_CACHE_BOM
+      || fread(u64, sizeof *u64, 5, fp)!=5
+      || u64[0]==0 || u64[1]==0
+      || u64[0]>csize || u64[1]>SIZE_MAX
+      || u64[2]!=(uint64_t)sst->st_size
+      || u64[3]!=(uint64_t)sst->st_mtime
+      || u64[4]!=(uint64_t)get_stat_mtime_ns(sst) )
+    return NULL;
+
+  /* The HDU is only relevant for FITS files. */
+  if( table_cache_read_str(fp, &chdu, csize)==0
+      || ( gal_fits_name_is_fits(filename)
+           && ( chdu==NULL || hdu==NULL || strcmp(chdu, hdu) ) ) )
+    {
+      free(chdu);
+      return NULL;
+    }
+  free(chdu);
+
+  /* Information of each column. */
+  *numcols = nc = u64[0];
+  *numrows = u64[1];
+  allcols=gal_data_array_calloc(nc);
+  *elsize=gal_data_malloc_array(GAL_TYPE_UINT64, nc, __func__, "elsize");
+  *offset=gal_data_malloc_array(GAL_TYPE_UINT64, nc, __func__, "offset");
+  for(i=0; good && i<nc; ++i)
+    if( fread(i32, sizeof *i32, 5, fp)!=5
+        || fread(&(*elsize)[i], sizeof **elsize, 1, fp)!=1
+        || fread(&(*offset)[i], sizeof **offset, 1, fp)!=1
+        || table_cache_read_str(fp, &allcols[i].name, csize)==0
+        || table_cache_read_str(fp, &allcols[i].unit, csize)==0
+        || table_cache_read_str(fp, &allcols[i].comment, csize)==0 )
+      good=0;
+    else
+      {
+        allcols[i].type           = i32[0];
+        allcols[i].flag           = i32[1];
+        allcols[i].disp_fmt       = i32[2];
+        allcols[i].disp_width     = i32[3];
+        allcols[i].disp_precision = i32[4];
+
+        /* The type must be one that can be stored in the cache and the
+           column's data must be within the cache (the multiplication
+           and addition are checked for overflow before they are done). */
+        if( allcols[i].type<=GAL_TYPE_INVALID
+            || allcols[i].type>GAL_TYPE_STRING
+            || allcols[i].type==GAL_TYPE_BIT
+            || (*elsize)[i]==0
+            || ( allcols[i].type!=GAL_TYPE_STRING
+                 && (*elsize)[i]!=gal_type_sizeof(allcols[i].type) )
+            || (*elsize)[i] > csize/u64[1]
+            || (*offset)[i] > csize - u64[1]*(*elsize)[i] )
+          good=0;
+      }
+
+  /* If anything was wrong, clean up and return NULL. */
+  if(good==0)
+    {
+      gal_data_array_free(allcols, nc, 1);
+      free(*elsize);
+      free(*offset);
+      return NULL;
+    }
+  return allcols;
+}
+
+
+
+
+
+/* Read `nbytes' from `offset' in the file. If they can't all be read
+   (for example the cache was truncated after it was opened), return 0,
+   otherwise 1. */
+static int
+table_cache_pread(int fd, void *buf, size_t nbytes, uint64_t offset)
+{
+  ssize_t r;
+  size_t done=0;
+
+  while(done<nbytes)
+    {
+      r=pread(fd, (char *)buf+done, nbytes-done, offset+done);
+      if(r<0 && errno==EINTR) continue;
+      if(r<=0) return 0;
+      done+=r;
+    }
+  return 1;
+}
+
+
+
+
+
+/* Make one column of the output from the cache. Numeric columns that
+   start on a page boundary (of this system) are mapped directly from the
+   file (privately, so changing them doesn't affect the cache), other
+   columns are read into allocated space without any parsing. The column
+   is already known to be within the cache (see `table_cache_info'), if
+   it can't be read, NULL is returned. */
+static gal_data_t *
+table_cache_column(int fd, char *cachename, gal_data_t *info,
+                   size_t numrows, uint64_t elsize, uint64_t offset)
+{
+  size_t i;
+  char *block;
+  gal_data_t *out;
+  int good=1;
+  void *array=MAP_FAILED;
+  size_t nbytes=numrows*elsize;
+
+  /* Map the column if possible. */
+  if( info->type!=GAL_TYPE_STRING && offset%sysconf(_SC_PAGESIZE)==0 )
+    array=mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+               offset);
+
+  /* Allocate the output (only the pointer array for strings). */
+  out=gal_data_alloc(array==MAP_FAILED ? NULL : array, info->type, 1,
+                     &numrows, NULL, 0, -1, info->name, info->unit,
+                     info->comment);
+  out->flag           = info->flag & ~GAL_DATA_FLAG_MMAP_KEEP;
+  out->disp_fmt       = info->disp_fmt;
+  out->disp_width     = info->disp_width;
+  out->disp_precision = info->disp_precision;
+
+  /* Fill the array. */
+  if(array!=MAP_FAILED)
+    {
+      out->flag |= GAL_DATA_FLAG_MMAP_KEEP;
+      gal_checkset_allocate_copy(cachename, &out->mmapname);
+    }
+  else if(info->type==GAL_TYPE_STRING)
+    {
+      /* All the strings are read into one block. Each record is
+         terminated, even if the cache doesn't terminate it. */
+      block=gal_data_str_block(out, elsize, 0);
+      good=table_cache_pread(fd, block, nbytes, offset);
+      for(i=0;i<numrows;++i) block[(i+1)*elsize-1]='\0';
+    }
+  else
+    good=table_cache_pread(fd, out->array, nbytes, offset);
+
+  /* If the column couldn't be read, it isn't usable. */
+  if(good==0)
+    {
+      gal_data_free(out);
+      return NULL;
+    }
+  return out;
+}
+
+
+
+
+
+/* If an up-to-date columnar cache of `filename' exists, read the
+   requested columns from it into `out' and return 1. Otherwise, return 0
+   (the table has to be read from its source). */
+static int
+table_cache_read(char *filename, char *hdu, gal_list_str_t *cols,
+                 int searchin, int ignorecase, gal_data_t **out)
+{
+  FILE *fp;
+  size_t ind;
+  int good=0;
+  char *cachename;
+  struct stat sst, cst;
+  gal_list_sizet_t *indexll;
+  gal_data_t *allcols, *col;
+  size_t i, numcols, numrows;
+  uint64_t *elsize, *offset;
+
+  /* The cache is only relevant if it is newer than the source. The
+     status of the cache is taken from the opened file, so it is the same
+     file that is read below. */
+  cachename=gal_table_cache_name(filename, hdu);
+  if( stat(filename, &sst) || (fp=fopen(cachename, "rb"))==NULL )
+    {
+      free(cachename);
+      return 0;
+    }
+  if( fstat(fileno(fp), &cst) || cst.st_mtime < sst.st_mtime )
+    allcols=NULL;
+  else
+    allcols=table_cache_info(fp, &sst, &cst, filename, hdu, &numcols,
+                             &numrows, &elsize, &offset);
+
+  /* Read the requested columns. */
+  if(allcols)
+    {
+      /* Same as `table_read_source': the list of indexs is reversed, so
+         the output has the same order as the requested columns. */
+      good=1;
+      *out=NULL;
+      indexll=make_list_of_indexs(cols, allcols, numcols, searchin,
+                                  ignorecase, filename, hdu);
+      gal_list_sizet_reverse(&indexll);
+      while(indexll!=NULL)
+        {
+          ind=gal_list_sizet_pop(&indexll);
+          col = ( good
+                  ? table_cache_column(fileno(fp), cachename,
+                                       &allcols[ind], numrows, elsize[ind],
+                                       offset[ind])
+                  : NULL );
+          if(col)
+            {
+              col->status=ind+1;
+              col->next=*out;
+              *out=col;
+            }
+          else good=0;
+        }
+
+      /* If any column couldn't be read, the table has to be read from
+         its source. */
+      if(good==0)
+        {
+          gal_list_data_free(*out);
+          *out=NULL;
+        }
+
+      /* Clean up. */
+      for(i=0;i<numcols;++i)
+        gal_data_free_contents(&allcols[i]);
+      free(allcols);
+      free(elsize);
+      free(offset);
+    }
+
+  /* Clean up and return. */
+  errno=0;
+  if( fclose(fp) )
+    error(EXIT_FAILURE, errno, "%s: %s couldn't be closed", __func__,
+          cachename);
+  free(cachename);
+  return good;
+}
+
+
+
+
+
+/* Read the specified columns in a table (named `filename') into a linked
+   list of data structures. If the file is FITS, then `hdu' will also be
+   used, otherwise, `hdu' is ignored. The information to search for columns
+   should be specified by the `cols' linked list as string values in each
+   node of the list, the strings in each node can be a number, an exact
+   match to a column name, or a regular expression (in GNU AWK format)
+   enclosed in `/ /'. The `searchin' value comes from the
+   `gal_table_where_to_search' enumerator and has to be one of its given
+   types. If `cols' is NULL, then this function will read the full table.
+
+   The output is a linked list with the same order of the cols linked
+   list. Note that one column node in the `cols' list might give multiple
+   columns, in this case, the order of output columns that correspond to
+   that one input, are in order of the table (which column was read first).
+   So the first requested column is the first popped data structure and so
+   on.
+
+   If an up-to-date columnar cache of the table exists (see
+   `gal_table_cache_write'), the columns are read from it instead. */
+gal_data_t *
+gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
+               int searchin, int ignorecase, size_t numthreads,
+               int minmapsize)
+{
+  gal_data_t *out;
+
+  /* If the table has a usable cache, read the columns from there. */
+  if( table_cache_read(filename, hdu, cols, searchin, ignorecase, &out) )
+    return out;
+
+  /* Read the columns from the table itself. */
+  return table_read_source(filename, hdu, cols, searchin, ignorecase,
+                           numthreads, minmapsize);
+}
+
+
+
+
+
 
 
 
@@ -558,3 +931,176 @@ gal_table_write_log(gal_data_t *logll, char *program_string,
       free(msg);
     }
 }
+
+
+
+
+
+/* Write one string into the header of a cache (see the comments above
+   `TABLE_CACHE_MAGIC'). */
+static void
+table_cache_write_str(FILE *fp, char *str, char *cachename)
+{
+  uint64_t len = str ? strlen(str) : 0;
+
+  if( fwrite(&len, sizeof len, 1, fp)!=1
+      || ( len && fwrite(str, 1, len, fp)!=len ) )
+    error(EXIT_FAILURE, errno, "%s: %s: couldn't write string", __func__,
+          cachename);
+}
+
+
+
+
+
+/* Read the full table in `filename' (from its source, not any existing
+   cache) and write it as a columnar cache (named with
+   `gal_table_cache_name'). Afterwards, `gal_table_read' will read this
+   table directly from the cache as long as the source isn't modified. To
+   avoid other programs reading a half-written cache, it is first written
+   into a temporary file that is then renamed to the cache. */
+void
+gal_table_cache_write(char *filename, char *hdu, size_t numthreads,
+                      int minmapsize)
+{
+  FILE *fp;
+  struct stat st;
+  size_t i, j, numcols;
+  uint32_t u32[2];
+  gal_data_t *cols, *col;
+  uint64_t u64[5], *elsize, *offset;
+  char *cachename, *tmpname, *record, **strarr;
+  int32_t i32[5], isfits=gal_fits_name_is_fits(filename);
+  size_t pagesize=sysconf(_SC_PAGESIZE), hsize, recsize=0;
+
+  /* Read the full table. */
+  cols=table_read_source(filename, hdu, NULL, GAL_TABLE_SEARCH_NAME, 0,
+                         numthreads, minmapsize);
+  if(cols==NULL || cols->size==0)
+    error(EXIT_FAILURE, 0, "%s: %s: table has no data to cache", __func__,
+          filename);
+  numcols=gal_list_data_number(cols);
+  errno=0;
+  if( stat(filename, &st) )
+    error(EXIT_FAILURE, errno, "%s: %s", __func__, filename);
+
+  /* Size of the header. */
+  hsize = ( sizeof TABLE_CACHE_MAGIC + 2*sizeof(uint32_t)
+            + 6*sizeof(uint64_t)
+            + ( isfits && hdu ? strlen(hdu) : 0 ) );
+  for(col=cols; col!=NULL; col=col->next)
+    hsize += ( 5*sizeof(int32_t) + 5*sizeof(uint64_t)
+               + ( col->name    ? strlen(col->name)    : 0 )
+               + ( col->unit    ? strlen(col->unit)    : 0 )
+               + ( col->comment ? strlen(col->comment) : 0 ) );
+
+  /* Bytes per element and offset of each column's data. Strings are
+     stored as fixed-width records of the longest string. */
+  elsize=gal_data_malloc_array(GAL_TYPE_UINT64, numcols, __func__, "elsize");
+  offset=gal_data_malloc_array(GAL_TYPE_UINT64, numcols, __func__, "offset");
+  for(i=0, col=cols; col!=NULL; ++i, col=col->next)
+    {
+      if(col->type==GAL_TYPE_STRING)
+        {
+          elsize[i]=1;
+          strarr=col->array;
+          for(j=0;j<col->size;++j)
+            if( strarr[j] && strlen(strarr[j])+1>elsize[i] )
+              elsize[i]=strlen(strarr[j])+1;
+          recsize = recsize>elsize[i] ? recsize : elsize[i];
+        }
+      else
+        elsize[i]=gal_type_sizeof(col->type);
+      offset[i] = ( i
+                    ? TABLE_CACHE_ROUND(offset[i-1]+cols->size*elsize[i-1],
+                                        pagesize)
+                    : TABLE_CACHE_ROUND(hsize, pagesize) );
+    }
+
+  /* Open the temporary file. */
+  cachename=gal_table_cache_name(filename, hdu);
+  if( asprintf(&tmpname, "%s.%ld.tmp", cachename, (long)getpid())<0 )
+    error(EXIT_FAILURE, errno, "%s: asprintf allocation", __func__);
+  errno=0;
+  fp=fopen(tmpname, "wb");
+  if(fp==NULL)
+    error(EXIT_FAILURE, errno, "%s: %s couldn't be opened for writing",
+          __func__, tmpname);
+
+  /* Write the header. */
+  u32[0]=TABLE_CACHE_VERSION;
+  u32[1]=TABLE_CACHE_BOM;
+  u64[0]=numcols;
+  u64[1]=cols->size;
+  u64[2]=st.st_size;
+  u64[3]=st.st_mtime;
+  u64[4]=get_stat_mtime_ns(&st);
+  errno=0;
+  if( fwrite(TABLE_CACHE_MAGIC, 1, sizeof TABLE_CACHE_MAGIC, fp)
+      != sizeof TABLE_CACHE_MAGIC
+      || fwrite(u32, sizeof *u32, 2, fp)!=2
+      || fwrite(u64, sizeof *u64, 5, fp)!=5 )
+    error(EXIT_FAILURE, errno, "%s: %s: couldn't write header", __func__,
+          tmpname);
+  table_cache_write_str(fp, isfits ? hdu : NULL, tmpname);
+  for(i=0, col=cols; col!=NULL; ++i, col=col->next)
+    {
+      i32[0]=col->type;
+      i32[1]=col->flag & ~GAL_DATA_FLAG_MMAP_KEEP;
+      i32[2]=col->disp_fmt;
+      i32[3]=col->disp_width;
+      i32[4]=col->disp_precision;
+      if( fwrite(i32, sizeof *i32, 5, fp)!=5
+          || fwrite(&elsize[i], sizeof *elsize, 1, fp)!=1
+          || fwrite(&offset[i], sizeof *offset, 1, fp)!=1 )
+        error(EXIT_FAILURE, errno, "%s: %s: couldn't write header",
+              __func__, tmpname);
+      table_cache_write_str(fp, col->name, tmpname);
+      table_cache_write_str(fp, col->unit, tmpname);
+      table_cache_write_str(fp, col->comment, tmpname);
+    }
+
+  /* Write the data of each column at its offset. */
+  record = recsize ? gal_data_malloc_array(GAL_TYPE_UINT8, recsize,
+                                           __func__, "record") : NULL;
+  for(i=0, col=cols; col!=NULL; ++i, col=col->next)
+    {
+      errno=0;
+      if( fseek(fp, offset[i], SEEK_SET) )
+        error(EXIT_FAILURE, errno, "%s: %s: couldn't seek to %zu",
+              __func__, tmpname, (size_t)offset[i]);
+      if(col->type==GAL_TYPE_STRING)
+        {
+          strarr=col->array;
+          for(j=0;j<col->size;++j)
+            {
+              memset(record, 0, elsize[i]);
+              if(strarr[j]) strcpy(record, strarr[j]);
+              if( fwrite(record, 1, elsize[i], fp)!=elsize[i] )
+                error(EXIT_FAILURE, errno, "%s: %s: couldn't write "
+                      "column %zu", __func__, tmpname, i+1);
+            }
+        }
+      else if( fwrite(col->array, elsize[i], col->size, fp)!=col->size )
+        error(EXIT_FAILURE, errno, "%s: %s: couldn't write column %zu",
+              __func__, tmpname, i+1);
+    }
+
+  /* Close the file and rename it to the cache. */
+  errno=0;
+  if( fclose(fp) )
+    error(EXIT_FAILURE, errno, "%s: %s couldn't be closed", __func__,
+          tmpname);
+  errno=0;
+  if( rename(tmpname, cachename) )
+    error(EXIT_FAILURE, errno, "%s: renaming `%s' to `%s'", __func__,
+          tmpname, cachename);
+
+  /* Clean up. */
+  free(record);
+  free(elsize);
+  free(offset);
+  free(tmpname);
+  free(cachename);
+  gal_list_data_free(cols);
+}
@@ -257,6 +257,217 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 
 
 
+/*******************************************************************/
+/************         Persistent pool of threads      **************/
+/*******************************************************************/
+/* Creating and destroying threads on every call to `gal_threads_spin_off'
+   is expensive when the jobs are small (for example on small tiles), and
+   many programs call it several times on a single input. So the threads
+   are only created once (the first time they are needed) and kept waiting
+   for new jobs until the program ends. Each job is simply a worker
+   function and the pointer it should be called with. The workers of
+   `gal_threads_spin_off' already wait on a barrier at the end, so the
+   caller can know when they are all finished. */
+struct threads_pool_job
+{
+  void *(*worker)(void *);  /* Function to call on the thread.          */
+  void             *arg;    /* Argument to pass to the function.        */
+};
+
+struct threads_pool
+{
+  pthread_mutex_t     lock; /* Lock to access the contents of the pool. */
+  pthread_cond_t     ready; /* A job has been added (or pool shut down).*/
+  pthread_t       *threads; /* IDs of the threads in the pool.          */
+  size_t        numthreads; /* Number of threads in the pool.           */
+  struct threads_pool_job *jobs; /* Circular queue of waiting jobs.     */
+  size_t             qsize; /* Allocated size of the queue.             */
+  size_t             qhead; /* Index of first waiting job in the queue. */
+  size_t              qnum; /* Number of waiting jobs in the queue.     */
+  size_t              busy; /* Number of threads that are running a job.*/
+  int             shutdown; /* ==1: the threads should return.          */
+  int            atexitset; /* ==1: the `atexit' hook has been set.     */
+};
+
+static struct threads_pool threads_pool={PTHREAD_MUTEX_INITIALIZER,
+                                         PTHREAD_COND_INITIALIZER,
+                                         NULL, 0, NULL, 0, 0, 0, 0, 0, 0};
+
+
+
+
+
+/* Function that each thread of the pool runs: wait until a job is
+   available in the queue, run it and go back to waiting. */
+static void *
+threads_pool_on_thread(void *junk)
+{
+  struct threads_pool *tp=&threads_pool;
+  struct threads_pool_job job;
+
+  pthread_mutex_lock(&tp->lock);
+  while(1)
+    {
+      /* Wait until there is a job (or the pool is being shut down). */
+      while(tp->qnum==0 && tp->shutdown==0)
+        pthread_cond_wait(&tp->ready, &tp->lock);
+      if(tp->qnum==0) break;
+
+      /* Take the first job out of the queue. */
+      job=tp->jobs[tp->qhead];
+      tp->qhead = (tp->qhead+1) % tp->qsize;
+      --tp->qnum;
+      ++tp->busy;
+
+      /* Do the job (without locking the pool). */
+      pthread_mutex_unlock(&tp->lock);
+      job.worker(job.arg);
+      pthread_mutex_lock(&tp->lock);
+      --tp->busy;
+    }
+  pthread_mutex_unlock(&tp->lock);
+  return NULL;
+}
+
+
+
+
+
+/* Return 1 if the calling thread is one of the pool's threads. The pool
+   must be locked before calling this function. */
+static int
+threads_pool_is_member(struct threads_pool *tp)
+{
+  size_t i;
+  pthread_t self=pthread_self();
+  for(i=0;i<tp->numthreads;++i)
+    if( pthread_equal(tp->threads[i], self) )
+      return 1;
+  return 0;
+}
+
+
+
+
+
+/* Make sure the pool has at least `numthreads' threads and that the queue
+   can keep `numjobs' more jobs. The pool must be locked before calling
+   this function. */
+static void
+threads_pool_prepare(struct threads_pool *tp, size_t numthreads,
+                     size_t numjobs)
+{
+  int err;
+  size_t i, qsize;
+  struct threads_pool_job *jobs;
+
+  /* Add threads if necessary. */
+  if(tp->numthreads<numthreads)
+    {
+      errno=0;
+      tp->threads=realloc(tp->threads, numthreads*sizeof *tp->threads);
+      if(tp->threads==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+              "`tp->threads'", __func__, numthreads*sizeof *tp->threads);
+      for(i=tp->numthreads;i<numthreads;++i)
+        {
+          err=pthread_create(&tp->threads[i], NULL, threads_pool_on_thread,
+                             NULL);
+          if(err)
+            error(EXIT_FAILURE, err, "%s: can't create thread %zu",
+                  __func__, i);
+          ++tp->numthreads;
+        }
+
+      /* Threads that are waiting for a job should be cleaned up when the
+         program finishes. */
+      if(tp->atexitset==0)
+        {
+          atexit(gal_threads_pool_free);
+          tp->atexitset=1;
+        }
+    }
+
+  /* Enlarge the queue if necessary. Since it is circular, the waiting
+     jobs are copied to the start of the new queue. */
+  if(tp->qnum+numjobs>tp->qsize)
+    {
+      qsize=tp->qnum+numjobs;
+      errno=0;
+      jobs=malloc(qsize*sizeof *jobs);
+      if(jobs==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+              "`jobs'", __func__, qsize*sizeof *jobs);
+      for(i=0;i<tp->qnum;++i)
+        jobs[i]=tp->jobs[ (tp->qhead+i) % tp->qsize ];
+      free(tp->jobs);
+      tp->jobs=jobs;
+      tp->qsize=qsize;
+      tp->qhead=0;
+    }
+}
+
+
+
+
+
+/* Stop and free all the threads in the pool. This is called automatically
+   when the program exits (through `atexit'), but can also be called
+   manually to free the resources earlier. If the pool is needed again
+   afterwards, it will be re-created. When the pool is still busy (for
+   example when `exit' is called within a worker function), it will be
+   left untouched: the operating system will clean it up with the
+   process. */
+void
+gal_threads_pool_free(void)
+{
+  size_t i;
+  struct threads_pool *tp=&threads_pool;
+
+  /* Only shut down the pool when its threads are all idle. */
+  pthread_mutex_lock(&tp->lock);
+  if( tp->numthreads==0 || tp->busy || tp->qnum
+      || threads_pool_is_member(tp) )
+    {
+      pthread_mutex_unlock(&tp->lock);
+      return;
+    }
+  tp->shutdown=1;
+  pthread_cond_broadcast(&tp->ready);
+  pthread_mutex_unlock(&tp->lock);
+
+  /* Wait for all the threads to return. */
+  for(i=0;i<tp->numthreads;++i)
+    pthread_join(tp->threads[i], NULL);
+
+  /* Clean up and reset the pool so it can be used again. */
+  free(tp->jobs);
+  free(tp->threads);
+  tp->jobs=NULL;
+  tp->threads=NULL;
+  tp->shutdown=0;
+  tp->numthreads=tp->qsize=tp->qhead=tp->qnum=0;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*******************************************************************/
 /************     Run a function on multiple threads  **************/
 /*******************************************************************/
@@ -329,13 +540,129 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 void
 gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
                      size_t numactions, size_t numthreads)
+{
+  gal_threads_spin_off_sched(worker, caller_params, numactions, numthreads,
+                             GAL_THREADS_SCHEDULE_STATIC, NULL);
+}
+
+
+
+
+
+/* Structure to sort the actions by their cost. */
+struct threads_action_cost
+{
+  size_t index;
+  size_t  cost;
+};
+
+
+
+
+
+/* Sort the actions by decreasing cost (and increasing index when the
+   costs are equal, so the order is always the same). */
+static int
+threads_action_cost_decreasing(const void *a, const void *b)
+{
+  struct threads_action_cost *ta=(struct threads_action_cost *)a;
+  struct threads_action_cost *tb=(struct threads_action_cost *)b;
+  return ( ta->cost==tb->cost
+           ? (ta->index > tb->index) - (ta->index < tb->index)
+           : (tb->cost > ta->cost) - (tb->cost < ta->cost) );
+}
+
+
+
+
+
+/* Prepare the shared queue of actions for dynamic scheduling: all the
+   action indexs are put in one array (in decreasing order of cost if
+   `costs' is given) and the threads will take the next action in this
+   array as soon as they finish their previous one. */
+static struct gal_threads_queue *
+threads_queue_prepare(size_t numactions, size_t *costs)
+{
+  int err;
+  size_t i;
+  struct gal_threads_queue *queue;
+  struct threads_action_cost *ac;
+
+  /* Allocate the queue structure and its array of indexs. */
+  errno=0;
+  queue=malloc(sizeof *queue);
+  if(queue==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "`queue'", __func__, sizeof *queue);
+  errno=0;
+  queue->order=malloc(numactions*sizeof *queue->order);
+  if(queue->order==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "`queue->order'", __func__, numactions*sizeof *queue->order);
+  err=pthread_mutex_init(&queue->lock, NULL);
+  if(err) error(EXIT_FAILURE, err, "%s: mutex not initialized", __func__);
+  queue->numactions=numactions;
+  queue->next=0;
+
+  /* Set the order of the actions. */
+  if(costs)
+    {
+      errno=0;
+      ac=malloc(numactions*sizeof *ac);
+      if(ac==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+              "`ac'", __func__, numactions*sizeof *ac);
+      for(i=0;i<numactions;++i) { ac[i].index=i; ac[i].cost=costs[i]; }
+      qsort(ac, numactions, sizeof *ac, threads_action_cost_decreasing);
+      for(i=0;i<numactions;++i) queue->order[i]=ac[i].index;
+      free(ac);
+    }
+  else
+    for(i=0;i<numactions;++i) queue->order[i]=i;
+
+  /* Return the queue. */
+  return queue;
+}
+
+
+
+
+
+/* Similar to `gal_threads_spin_off', but with control over how the actions
+   are distributed between the threads (through `schedule'):
+
+     GAL_THREADS_SCHEDULE_STATIC: The actions are divided between the
+         threads before they start (with `gal_threads_dist_in_threads'), so
+         each thread has a fixed list of actions in `indexs'. This is the
+         cheapest method when all actions take roughly the same time.
+
+     GAL_THREADS_SCHEDULE_DYNAMIC: Each thread takes the next action as
+         soon as it finishes the previous one. This is best when the cost
+         of the actions can vary significantly (for example labels of very
+         different sizes): a thread that is stuck on a large action will
+         not hold back the actions that would otherwise be assigned to
+         it. In this mode, `indexs' will be NULL and the worker must use
+         `gal_threads_next_action' to get the next action.
+
+   When `costs' is not NULL, it must have `numactions' elements and is only
+   used in dynamic scheduling: the actions will be given out in decreasing
+   order of cost. Since the large actions are started first, the threads
+   will finish at close times. */
+void
+gal_threads_spin_off_sched(void *(*worker)(void *), void *caller_params,
+                           size_t numactions, size_t numthreads,
+                           int schedule, size_t *costs)
 {
   int err;
   pthread_t t;          /* All thread ids saved in this, not used. */
   pthread_attr_t attr;
   pthread_barrier_t b;
+  struct threads_pool_job *job;
   struct gal_threads_params *prm;
-  size_t i, *indexs, thrdcols, numbarriers;
+  size_t *indexs=NULL, thrdcols=0;
+  struct gal_threads_queue *queue=NULL;
+  struct threads_pool *tp=&threads_pool;
+  size_t i, numthrdact, numbarriers;
 
   /* If there are no actions, then just return. */
   if(numactions==0) return;
@@ -355,8 +682,35 @@ gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
       exit(EXIT_FAILURE);
     }
 
-  /* Distribute the actions into the threads: */
-  gal_threads_dist_in_threads(numactions, numthreads, &indexs, &thrdcols);
+  /* Distribute the actions into the threads or prepare the shared queue
+     of actions. */
+  switch(schedule)
+    {
+    case GAL_THREADS_SCHEDULE_STATIC:
+      gal_threads_dist_in_threads(numactions, numthreads, &indexs,
+                                  &thrdcols);
+      break;
+    case GAL_THREADS_SCHEDULE_DYNAMIC:
+      queue=threads_queue_prepare(numactions, costs);
+      break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+            "the problem. The value %d is not recognized for `schedule'",
+            __func__, PACKAGE_BUGREPORT, schedule);
+    }
+
+  /* Set the parameters of each thread. In both cases, only the first
+     `numthrdact' threads will have any actions. */
+  numthrdact = numactions<numthreads ? numactions : numthreads;
+  for(i=0;i<numthrdact;++i)
+    {
+      prm[i].id=i;
+      prm[i].next=0;
+      prm[i].queue=queue;
+      prm[i].params=caller_params;
+      prm[i].b = numthreads==1 ? NULL : &b;
+      prm[i].indexs = indexs ? &indexs[i*thrdcols] : NULL;
+    }
 
   /* Do the job: when only one thread is necessary, there is no need to
      spin off one thread, just call the workerfunction directly (spinning
@@ -364,45 +718,105 @@ gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
      function, not this simple function where `numthreads' is a
      constant. */
   if(numthreads==1)
-    {
-      prm[0].id=0;
-      prm[0].b=NULL;
-      prm[0].indexs=indexs;
-      prm[0].params=caller_params;
-      worker(&prm[0]);
-    }
+    worker(&prm[0]);
   else
     {
-      /* Initialize the attributes. Note that this running thread
-         (that spinns off the nt threads) is also a thread, so the
-         number the barriers should be one more than the number of
-         threads spinned off. */
-      numbarriers = (numactions<numthreads ? numactions : numthreads) + 1;
-      gal_threads_attr_barrier_init(&attr, &b, numbarriers);
-
-      /* Spin off the threads: */
-      for(i=0;i<numthreads;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            prm[i].id=i;
-            prm[i].b=&b;
-            prm[i].params=caller_params;
-            prm[i].indexs=&indexs[i*thrdcols];
-            err=pthread_create(&t, &attr, worker, &prm[i]);
-            if(err)
-              {
-                fprintf(stderr, "can't create thread %zu", i);
-                exit(EXIT_FAILURE);
-              }
-          }
+      /* Note that this running thread (that spinns off the nt threads)
+         is also a thread, so the number the barriers should be one more
+         than the number of threads spinned off. */
+      numbarriers = numthrdact + 1;
+
+      /* When this function is called within one of the pool's threads
+         (for example a worker function that itself calls this function),
+         the pool's threads may all be busy waiting for this call to
+         finish. So in such cases, we'll spin off new (detached) threads
+         like before. */
+      pthread_mutex_lock(&tp->lock);
+      if( threads_pool_is_member(tp) )
+        {
+          pthread_mutex_unlock(&tp->lock);
+          gal_threads_attr_barrier_init(&attr, &b, numbarriers);
+          for(i=0;i<numthrdact;++i)
+            {
+              err=pthread_create(&t, &attr, worker, &prm[i]);
+              if(err)
+                error(EXIT_FAILURE, err, "%s: can't create thread %zu",
+                      __func__, i);
+            }
+          pthread_attr_destroy(&attr);
+        }
+      else
+        {
+          /* Add the jobs to the pool's queue (all together, so jobs of
+             different callers don't get mixed). */
+          err=pthread_barrier_init(&b, NULL, numbarriers);
+          if(err) error(EXIT_FAILURE, err, "%s: thread barrier not "
+                        "initialized", __func__);
+          threads_pool_prepare(tp, numthrdact, numthrdact);
+          for(i=0;i<numthrdact;++i)
+            {
+              job=&tp->jobs[ (tp->qhead+tp->qnum) % tp->qsize ];
+              job->worker=worker;
+              job->arg=&prm[i];
+              ++tp->qnum;
+            }
+          pthread_cond_broadcast(&tp->ready);
+          pthread_mutex_unlock(&tp->lock);
+        }
 
       /* Wait for all threads to finish and free the spaces. */
       pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
       pthread_barrier_destroy(&b);
     }
 
   /* Clean up. */
+  if(queue)
+    {
+      pthread_mutex_destroy(&queue->lock);
+      free(queue->order);
+      free(queue);
+    }
   free(prm);
   free(indexs);
 }
+
+
+
+
+
+/* Return the index of the next action that the thread should do, or
+   `GAL_BLANK_SIZE_T' when there are no more actions. This can be used in
+   the worker function with both static and dynamic scheduling (see
+   `gal_threads_spin_off_sched'):
+
+     while( (index=gal_threads_next_action(tprm)) != GAL_BLANK_SIZE_T )
+       {
+         ...
+       }
+*/
+size_t
+gal_threads_next_action(struct gal_threads_params *tprm)
+{
+  size_t out;
+  struct gal_threads_queue *queue=tprm->queue;
+
+  /* Dynamic scheduling: take the next action in the shared queue. */
+  if(queue)
+    {
+      pthread_mutex_lock(&queue->lock);
+      out = ( queue->next < queue->numactions
+              ? queue->order[ queue->next++ ]
+              : GAL_BLANK_SIZE_T );
+      pthread_mutex_unlock(&queue->lock);
+    }
+
+  /* Static scheduling: go to the next element of this thread's
+     `indexs'. */
+  else
+    {
+      out=tprm->indexs[tprm->next];
+      if(out!=GAL_BLANK_SIZE_T) ++tprm->next;
+    }
+
+  return out;
+}
@@ -27,13 +27,18 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <gnuastro/txt.h>
 #include <gnuastro/list.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/table.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/checkset.h>
 #include <gnuastro-internal/tableintern.h>
@@ -61,6 +66,10 @@ enum txt_formats_code
     TXT_FORMAT_IMAGE,
 };
 
+/* Minimum number of bytes for each thread when reading a file: smaller
+   files are read on fewer threads. */
+#define TXT_MIN_CHUNK_SIZE 1048576
+
 
 
 
@@ -656,6 +665,108 @@ gal_txt_image_info(char *filename, size_t *numimg, size_t *dsize)
 /************************************************************************/
 /***************             Read a txt table             ***************/
 /************************************************************************/
+/* Parse a plain decimal integer (an optional sign followed by digits, with
+   no leading zeros). If the token has any other form (for example a
+   hexadecimal or octal number, or too many digits), zero is returned and
+   the caller should use `strtol' (which also reports errors). */
+static int
+txt_parse_int(char *token, int64_t *out)
+{
+  int neg=0;
+  char *c=token;
+  int64_t v=0;
+
+  /* Sign and first digit. */
+  if(*c=='-' || *c=='+') neg = *c++=='-';
+  if( *c<'0' || *c>'9' || (*c=='0' && c[1]!='\0') ) return 0;
+
+  /* Digits (at most 18, so `v' can't overflow). */
+  for(token=c; *c>='0' && *c<='9'; ++c) v = 10*v + (*c-'0');
+  if( *c!='\0' || c-token>18 ) return 0;
+
+  /* Write the output and return. */
+  *out = neg ? -v : v;
+  return 1;
+}
+
+
+
+
+
+/* Parse a decimal floating point number. When the significant digits fit
+   in 53 bits and the power of ten is at most 22, both are exactly
+   representable in a `double', so one multiplication or division gives
+   the correctly rounded result (identical to `strtod'). For any other
+   token, zero is returned and the caller should use `strtod'. */
+static int
+txt_parse_double(char *token, double *out)
+{
+  static const double pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22 };
+  char *c=token;
+  uint64_t m=0;
+  double v;
+  int neg=0, eneg=0;
+  long e=0, exp=0, ndigits=0, nsig=0;
+
+  /* Sign. */
+  if(*c=='-' || *c=='+') neg = *c++=='-';
+
+  /* Integer part. */
+  for(; *c>='0' && *c<='9'; ++c, ++ndigits)
+    if(m || *c!='0') { m = 10*m + (*c-'0'); ++nsig; }
+
+  /* Fractional part. */
+  if(*c=='.')
+    for(++c; *c>='0' && *c<='9'; ++c, ++ndigits, --e)
+      if(m || *c!='0') { m = 10*m + (*c-'0'); ++nsig; }
+
+  /* There must have been a digit and not too many significant digits (so
+     `m' hasn't overflowed). */
+  if(ndigits==0 || nsig>19) return 0;
+
+  /* Exponent. */
+  if(*c=='e' || *c=='E')
+    {
+      ++c;
+      if(*c=='-' || *c=='+') eneg = *c++=='-';
+      if(*c<'0' || *c>'9') return 0;
+      for(; *c>='0' && *c<='9' && exp<10000; ++c) exp = 10*exp + (*c-'0');
+      e += eneg ? -exp : exp;
+    }
+  if(*c!='\0') return 0;
+
+  /* Build the value if it can be done exactly. */
+  if(m==0) v=0.0f;
+  else
+    {
+      if( m > (1ULL<<53) || e < -22 || e > 22 ) return 0;
+      v = e<0 ? (double)m / pow10[-e] : (double)m * pow10[e];
+    }
+  *out = neg ? -v : v;
+  return 1;
+}
+
+
+
+
+
+/* Read an integer, use the fast parser if possible. */
+#define TXT_READ_INT(OUT, FUNC) {                                       \
+    int64_t tv;                                                         \
+    if( txt_parse_int(token, &tv) ) { OUT=tv; tailptr=""; }             \
+    else OUT=FUNC(token, &tailptr, 0);                                  \
+  }
+
+/* Read a floating point number, use the fast parser if possible. */
+#define TXT_READ_FLT(OUT) {                                             \
+    double tv;                                                          \
+    if( txt_parse_double(token, &tv) ) { OUT=tv; tailptr=""; }          \
+    else OUT=strtod(token, &tailptr);                                   \
+  }
+
 static void
 txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
                size_t i, char *filename, size_t lineno, size_t colnum)
@@ -686,49 +797,49 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
       break;
 
     case GAL_TYPE_UINT8:
-      uc[i]=strtol(token, &tailptr, 0);
+      TXT_READ_INT(uc[i], strtol);
       if( (ucb=info->array) && *ucb==uc[i] )
         uc[i]=GAL_BLANK_UINT8;
       break;
 
     case GAL_TYPE_INT8:
-      c[i]=strtol(token, &tailptr, 0);
+      TXT_READ_INT(c[i], strtol);
       if( (cb=info->array) && *cb==c[i] )
         c[i]=GAL_BLANK_INT8;
       break;
 
     case GAL_TYPE_UINT16:
-      us[i]=strtol(token, &tailptr, 0);
+      TXT_READ_INT(us[i], strtol);
       if( (usb=info->array) && *usb==us[i] )
         us[i]=GAL_BLANK_UINT16;
       break;
 
     case GAL_TYPE_INT16:
-      s[i]=strtol(token, &tailptr, 0);
+      TXT_READ_INT(s[i], strtol);
       if( (sb=info->array) && *sb==s[i] )
         s[i]=GAL_BLANK_INT16;
       break;
 
     case GAL_TYPE_UINT32:
-      ui[i]=strtol(token, &tailptr, 0);
+      TXT_READ_INT(ui[i], strtol);
       if( (uib=info->array) && *uib==ui[i] )
         ui[i]=GAL_BLANK_UINT32;
       break;
 
     case GAL_TYPE_INT32:
-      ii[i]=strtol(token, &tailptr, 0);
+      TXT_READ_INT(ii[i], strtol);
       if( (ib=info->array) && *ib==ii[i] )
         ii[i]=GAL_BLANK_INT32;
       break;
 
     case GAL_TYPE_UINT64:
-      ul[i]=strtoul(token, &tailptr, 0);
+      TXT_READ_INT(ul[i], strtoul);
       if( (ulb=info->array) && *ulb==ul[i] )
         ul[i]=GAL_BLANK_UINT64;
       break;
 
     case GAL_TYPE_INT64:
-      l[i]=strtol(token, &tailptr, 0);
+      TXT_READ_INT(l[i], strtol);
       if( (lb=info->array) && *lb==l[i] )
         l[i]=GAL_BLANK_INT64;
       break;
@@ -738,14 +849,14 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
          condition check (even `=='). If it isn't NaN, then we can
          compare the values. */
     case GAL_TYPE_FLOAT32:
-      f[i]=strtod(token, &tailptr);
+      TXT_READ_FLT(f[i]);
       if( (fb=info->array)
           && ( (isnan(*fb) && isnan(f[i])) || *fb==f[i] ) )
         f[i]=GAL_BLANK_FLOAT64;
       break;
 
     case GAL_TYPE_FLOAT64:
-      d[i]=strtod(token, &tailptr);
+      TXT_READ_FLT(d[i]);
       if( (db=info->array)
           && ( (isnan(*db) && isnan(d[i])) || *db==d[i] ) )
         d[i]=GAL_BLANK_FLOAT64;
@@ -854,37 +965,132 @@ txt_fill(char *line, char **tokens, size_t maxcolnum, gal_data_t *info,
 
 
 
+/* Parameters for reading the rows of a text file in parallel. The file is
+   mapped into memory and divided into chunks that start at the start of a
+   line. Each chunk is parsed by one thread: in the first round only the
+   data rows (and lines) are counted, in the second round (when the first
+   row and line number of each chunk are known), the rows are read into the
+   output. */
+struct txt_read_params
+{
+  char              *filename;  /* Name of the file (for error messages). */
+  char                  *text;  /* Start of the mapped file.              */
+  size_t            numchunks;  /* Number of chunks.                      */
+  size_t              *bounds;  /* Starting byte of each chunk (+1).      */
+  size_t              *rowind;  /* Index of the first row of each chunk.  */
+  size_t              *lineno;  /* Lines before each chunk.               */
+  size_t            maxcolnum;  /* Largest column number to read.         */
+  gal_data_t            *info;  /* Information of each column.            */
+  gal_data_t             *out;  /* Output dataset(s).                     */
+  int                   count;  /* ==1: only count the rows of each chunk.*/
+};
+
+
+
+
+
+static void *
+txt_read_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct txt_read_params *rp=(struct txt_read_params *)tprm->params;
+
+  char *line, **tokens, *l, *lf, *nl;
+  size_t i, c, len, linelen=0, rows, lines;
+
+  /* Allocate the space to keep the pointers to each token in the
+     line. Note that the column numbers are counted from one (unlike
+     indexes that are counted from zero), so we need `maxcolnum+1'
+     elements in the array of tokens.*/
+  errno=0;
+  line=NULL;
+  tokens=malloc((rp->maxcolnum+1)*sizeof *tokens);
+  if(tokens==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `tokens'",
+          __func__, (rp->maxcolnum+1)*sizeof *tokens);
+
+  /* Go over all the chunks given to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Initialize. */
+      c=tprm->indexs[i];
+      rows=lines=0;
+      l  = rp->text + rp->bounds[c];
+      lf = rp->text + rp->bounds[c+1];
+
+      /* Parse the lines. */
+      while(l<lf)
+        {
+          /* Find the end of this line (the last line of the file may not
+             have a new-line character). */
+          nl=memchr(l, '\n', lf-l);
+          len = nl ? nl-l : lf-l;
+
+          /* The file is read-only, so copy the line (with its new-line
+             character) into a separate buffer for parsing. */
+          if(len+2>linelen)
+            {
+              linelen=len+2;
+              errno=0;
+              line=realloc(line, linelen*sizeof *line);
+              if(line==NULL)
+                error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+                      "`line'", __func__, linelen*sizeof *line);
+            }
+          memcpy(line, l, len);
+          line[len]='\n';
+          line[len+1]='\0';
+
+          /* Count or read the row. */
+          ++lines;
+          if( gal_txt_line_stat(line) == GAL_TXT_LINESTAT_DATAROW )
+            {
+              if(rp->count==0)
+                txt_fill(line, tokens, rp->maxcolnum, rp->info, rp->out,
+                         rp->rowind[c]+rows, rp->filename,
+                         rp->lineno[c]+lines);
+              ++rows;
+            }
+
+          /* Go to the next line. */
+          l += len+1;
+        }
+
+      /* Keep the number of rows and lines in this chunk. */
+      if(rp->count)
+        {
+          rp->rowind[c+1]=rows;
+          rp->lineno[c+1]=lines;
+        }
+    }
+
+  /* Clean up, wait until all other threads finish, then return. */
+  free(line);
+  free(tokens);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
 static gal_data_t *
 gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
-             gal_list_sizet_t *indexll, int minmapsize, int format)
+             gal_list_sizet_t *indexll, size_t numthreads, int minmapsize,
+             int format)
 {
-  FILE *fp;
-  char *line;
-  char **tokens;
+  int fd;
+  size_t c, ndim;
+  struct stat st;
   gal_data_t *out=NULL;
   gal_list_sizet_t *ind;
-  size_t maxcolnum=0, rowind=0, lineno=0, ndim;
-  size_t linelen=10;        /* `linelen' will be increased by `getline'. */
-
-  /* Open the file. */
-  errno=0;
-  fp=fopen(filename, "r");
-  if(fp==NULL)
-    error(EXIT_FAILURE, errno, "%s: couldn't open to read as a text table "
-          "in %s", filename, __func__);
-
-  /* Allocate the space necessary to keep a copy of each line as we parse
-     it. Note that `getline' is going to later `realloc' this space to fit
-     the line length. */
-  errno=0;
-  line=malloc(linelen*sizeof *line);
-  if(line==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `line'",
-          __func__, linelen*sizeof *line);
+  struct txt_read_params rp;
 
   /* Allocate all the desired columns for output. We will be reading the
      text file line by line, and writing in the necessary values of each
      row individually. */
+  rp.maxcolnum=0;
   switch(format)
     {
 
@@ -893,7 +1099,7 @@ gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
       for(ind=indexll; ind!=NULL; ind=ind->next)
         {
           ndim=1;
-          maxcolnum = maxcolnum>ind->v+1 ? maxcolnum : ind->v+1;
+          rp.maxcolnum = rp.maxcolnum>ind->v+1 ? rp.maxcolnum : ind->v+1;
           gal_list_data_add_alloc(&out, NULL, info[ind->v].type, ndim, dsize,
                                   NULL, 0, minmapsize, info[ind->v].name,
                                   info[ind->v].unit, info[ind->v].comment);
@@ -910,7 +1116,7 @@ gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
               "array) from a text file is possible, the `info' input has "
               "more than one element", __func__);
       ndim=2;
-      maxcolnum=dsize[1];
+      rp.maxcolnum=dsize[1];
       out=gal_data_alloc(NULL, info->type, ndim, dsize, NULL, 0, minmapsize,
                          info->name, info->unit, info->comment);
       break;
@@ -922,33 +1128,78 @@ gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
             __func__, format);
     }
 
-  /* Allocate the space to keep the pointers to each token in the
-     line. This is done here to avoid having to allocate/free this array
-     for each line in `txt_fill_columns'. Note that the column numbers are
-     counted from one (unlike indexes that are counted from zero), so we
-     need `maxcolnum+1' elements in the array of tokens.*/
+  /* Open the file and map it into memory. */
   errno=0;
-  tokens=malloc((maxcolnum+1)*sizeof *tokens);
-  if(tokens==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `tokens'",
-          __func__, (maxcolnum+1)*sizeof *tokens);
+  fd=open(filename, O_RDONLY);
+  if(fd==-1)
+    error(EXIT_FAILURE, errno, "%s: couldn't open to read as a text table "
+          "in %s", filename, __func__);
+  if(fstat(fd, &st))
+    error(EXIT_FAILURE, errno, "%s: couldn't get the size", filename);
+  if(st.st_size==0) { close(fd); return out; }
+  rp.text=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(rp.text==MAP_FAILED)
+    error(EXIT_FAILURE, errno, "%s: couldn't map to memory", filename);
+  madvise(rp.text, st.st_size, MADV_SEQUENTIAL);
+
+  /* Set the number of chunks: small files don't need to be parsed in
+     parallel. */
+  rp.numchunks = st.st_size/TXT_MIN_CHUNK_SIZE + 1;
+  if(rp.numchunks>numthreads) rp.numchunks=numthreads;
+  if(rp.numchunks==0) rp.numchunks=1;
+
+  /* Allocate the arrays. */
+  rp.bounds=gal_data_malloc_array(GAL_TYPE_SIZE_T, rp.numchunks+1, __func__,
+                                  "rp.bounds");
+  rp.rowind=gal_data_malloc_array(GAL_TYPE_SIZE_T, rp.numchunks+1, __func__,
+                                  "rp.rowind");
+  rp.lineno=gal_data_malloc_array(GAL_TYPE_SIZE_T, rp.numchunks+1, __func__,
+                                  "rp.lineno");
+
+  /* Set the chunk boundaries: each chunk should start immediately after a
+     new-line character. */
+  rp.bounds[0]=0;
+  rp.bounds[rp.numchunks]=st.st_size;
+  for(c=1;c<rp.numchunks;++c)
+    {
+      rp.bounds[c] = c * (st.st_size/rp.numchunks);
+      if(rp.bounds[c]<rp.bounds[c-1]) rp.bounds[c]=rp.bounds[c-1];
+      while( rp.bounds[c]<(size_t)st.st_size
+             && rp.bounds[c]>0 && rp.text[rp.bounds[c]-1]!='\n' )
+        ++rp.bounds[c];
+    }
 
-  /* Read the data columns. */
-  while( getline(&line, &linelen, fp) != -1 )
+  /* First count the rows and lines in each chunk, then set the first row
+     index and line number of each chunk. */
+  rp.out=out;
+  rp.info=info;
+  rp.filename=filename;
+  rp.count=1;
+  gal_threads_spin_off(txt_read_on_thread, &rp, rp.numchunks, numthreads);
+  rp.rowind[0]=rp.lineno[0]=0;
+  for(c=1;c<=rp.numchunks;++c)
     {
-      ++lineno;
-      if( gal_txt_line_stat(line) == GAL_TXT_LINESTAT_DATAROW )
-        txt_fill(line, tokens, maxcolnum, info, out, rowind++,
-                 filename, lineno);
+      rp.rowind[c]+=rp.rowind[c-1];
+      rp.lineno[c]+=rp.lineno[c-1];
     }
+  if(rp.rowind[rp.numchunks]!=dsize[0])
+    error(EXIT_FAILURE, 0, "%s: %zu rows were expected, but %zu were found "
+          "(the file may have been changed while it was being read)",
+          filename, dsize[0], rp.rowind[rp.numchunks]);
+
+  /* Read the rows. */
+  rp.count=0;
+  gal_threads_spin_off(txt_read_on_thread, &rp, rp.numchunks, numthreads);
 
   /* Clean up and close the file. */
+  munmap(rp.text, st.st_size);
   errno=0;
-  if(fclose(fp))
+  if(close(fd))
     error(EXIT_FAILURE, errno, "%s: couldn't close file after reading ASCII "
           "table information in %s", filename, __func__);
-  free(tokens);
-  free(line);
+  free(rp.bounds);
+  free(rp.rowind);
+  free(rp.lineno);
 
   /* Return the array of column information. */
   return out;
@@ -960,10 +1211,11 @@ gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
 
 gal_data_t *
 gal_txt_table_read(char *filename, size_t numrows, gal_data_t *colinfo,
-                   gal_list_sizet_t *indexll, size_t minmapsize)
+                   gal_list_sizet_t *indexll, size_t numthreads,
+                   size_t minmapsize)
 {
-  return gal_txt_read(filename, &numrows, colinfo, indexll, minmapsize,
-                      TXT_FORMAT_TABLE);
+  return gal_txt_read(filename, &numrows, colinfo, indexll, numthreads,
+                      minmapsize, TXT_FORMAT_TABLE);
 }
 
 
@@ -971,7 +1223,7 @@ gal_txt_table_read(char *filename, size_t numrows, gal_data_t *colinfo,
 
 
 gal_data_t *
-gal_txt_image_read(char *filename, size_t minmapsize)
+gal_txt_image_read(char *filename, size_t numthreads, size_t minmapsize)
 {
   size_t numimg, dsize[2];
   gal_data_t *img, *imginfo;
@@ -981,8 +1233,8 @@ gal_txt_image_read(char *filename, size_t minmapsize)
   imginfo=gal_txt_image_info(filename, &numimg, dsize);
 
   /* Read the table. */
-  img=gal_txt_read(filename, dsize, imginfo, indexll, minmapsize,
-                   TXT_FORMAT_IMAGE);
+  img=gal_txt_read(filename, dsize, imginfo, indexll, numthreads,
+                   minmapsize, TXT_FORMAT_IMAGE);
 
   /* Clean up and return. */
   gal_data_free(imginfo);
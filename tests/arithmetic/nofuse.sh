@@ -0,0 +1,64 @@
+# Evaluate a chain of pixel-wise operators with and without `--nofuse'
+# and make sure the two outputs are identical.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=arithmetic
+execname=../bin/$prog/ast$prog
+img=convolve_spatial_noised_labeled.fits
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
+compare_skip_without $cmpstats
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The expression is evaluated once in fused blocks (the default) and once
+# operator by operator, the two outputs must be identical.
+$execname $img $img - $img / $img 0 lt nan where                     \
+          --hdu=1 --hdu=4 --hdu=5 --hdu=1                            \
+          --output=nofuse_fused.fits || exit 1
+$execname $img $img - $img / $img 0 lt nan where                     \
+          --hdu=1 --hdu=4 --hdu=5 --hdu=1 --nofuse                   \
+          --output=nofuse_separate.fits || exit 1
+compare_images_identical nofuse_separate.fits nofuse_fused.fits
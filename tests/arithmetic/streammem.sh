@@ -0,0 +1,65 @@
+# Evaluate an expression over streamed chunks of the input images with
+# `--streammem' and make sure the output is identical to reading them.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=arithmetic
+execname=../bin/$prog/ast$prog
+img=convolve_spatial_noised_labeled.fits
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
+compare_skip_without $cmpstats
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The expression (which includes the multi-operand `median' operator) is
+# evaluated once on the fully read images and once over chunks of a few
+# rows, the two outputs must be identical.
+$execname $img $img $img 3 median $img - $img 0 lt nan where            \
+          --hdu=1 --hdu=4 --hdu=5 --hdu=4 --hdu=1                       \
+          --output=streammem_read.fits || exit 1
+$execname $img $img $img 3 median $img - $img 0 lt nan where            \
+          --hdu=1 --hdu=4 --hdu=5 --hdu=4 --hdu=1 --streammem=20000     \
+          --output=streammem_stream.fits || exit 1
+compare_images_identical streammem_stream.fits streammem_read.fits
@@ -0,0 +1,126 @@
+# Functions to compare the outputs of two runs in the tests.
+#
+# Many tests check that an option which only changes how the outputs are
+# made (for example to use less memory or to be faster) doesn't change
+# the outputs themselves. This file is sourced by those tests (with `.
+# $topsrc/tests/compare.sh') to do the comparison. Like the tests, it is
+# run within the `tests' directory of the build tree.
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Programs used in the comparison
+# ===============================
+#
+# The images are compared with Arithmetic and Statistics (and Crop for
+# their interiors), so a test that compares images should call
+# `compare_skip_without' with these programs before running.
+cmparith=../bin/arithmetic/astarithmetic
+cmpstats=../bin/statistics/aststatistics
+cmpcrop=../bin/crop/astcrop
+
+compare_skip_without()
+{
+    for cmpprog in "$@"; do
+        if [ ! -f $cmpprog ]; then echo "$cmpprog not created."; exit 77; fi
+    done
+}
+
+
+
+
+
+# Images
+# ======
+#
+# The image of the first argument is compared with the image of the
+# second (both in HDU 1), the comparison image is written in a file with
+# a `_cmp.fits' suffix (after removing the `.fits' of the first
+# argument). Each function returns a non-zero value if the images differ,
+# so the test can simply end with it.
+
+# The images must be identical, two blank pixels in the same position are
+# not a difference.
+compare_images_identical()
+{
+    cmpout=${1%.fits}_cmp.fits
+    $cmparith $1 $2 ne $1 isblank $2 isblank and not and          \
+              -h1 -h1 -h1 -h1 --output=$cmpout || return 1
+    cmpval=$($cmpstats $cmpout --maximum) || return 1
+    echo "$1: any pixel differing from $2 (1: yes, 0: no): $cmpval"
+    [ $cmpval = 0 ]
+}
+
+# The largest absolute difference between the images must be at most the
+# third argument times the largest absolute value in the second image.
+compare_images_tolerance()
+{
+    cmpout=${1%.fits}_cmp.fits
+    $cmparith $1 $2 - abs -h1 -h1 --output=$cmpout || return 1
+    cmpval=$($cmpstats $cmpout --maximum) || return 1
+    cmpref=$($cmpstats $2 --minimum --maximum) || return 1
+    echo "$1: largest difference from $2: $cmpval (range of $2: $cmpref)"
+    echo $cmpval $cmpref                                         \
+        | awk -v t=$3 'NF==3 { m = -$2>$3 ? -$2 : $3; exit !($1<=t*m) }
+                       { exit 1 }'
+}
+
+# Only the pixels that are more than the third argument's number of
+# pixels away from the edges (in both dimensions) are compared with
+# `compare_images_tolerance' (the fourth argument is its tolerance). For
+# example, in convolution, the edges depend on the method. Both interiors
+# are named after the first argument, since the second may be compared
+# by other tests at the same time.
+compare_interiors_tolerance()
+{
+    cmpmin=$(( $3 + 1 ))
+    cmpint=${1%.fits}_interior.fits
+    cmpintref=${1%.fits}_interior_ref.fits
+    $cmpcrop $1 --mode=img --numthreads=1 --hdu=1                     \
+             --section="$cmpmin:*-$3,$cmpmin:*-$3"                    \
+             --output=$cmpint || return 1
+    $cmpcrop $2 --mode=img --numthreads=1 --hdu=1                     \
+             --section="$cmpmin:*-$3,$cmpmin:*-$3"                    \
+             --output=$cmpintref || return 1
+    compare_images_tolerance $cmpint $cmpintref $4
+}
+
+
+
+
+
+# Plain text tables
+# =================
+#
+# The two tables must have the same number of lines and identical
+# comments (other than the line with the starting time of a program) and
+# any two values that aren't written identically must have a relative
+# difference less than the third argument (so with a third argument of 0,
+# the tables must be identical).
+compare_tables_tolerance()
+{
+    awk -v t=$3 '/^#.* started on / { next }
+         NR==FNR { line[FNR]=$0; n=FNR; next }
+         $0!=line[FNR] {
+           b = ( $0 ~ /^#/ || NF!=split(line[FNR], ref) )
+           for(i=1;i<=NF && !b;++i)
+             if( $i!=ref[i] )
+               {
+                 d = $i>ref[i] ? $i-ref[i] : ref[i]-$i
+                 m = ref[i]<0  ? -ref[i]    : ref[i]
+                 b = d>t*m
+               }
+           if(b) { bad=1; print "Line " FNR " differs:"; print line[FNR]; print }
+         }
+         END { exit ( bad || FNR!=n ) }' $1 $2
+}
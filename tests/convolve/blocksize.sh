@@ -0,0 +1,69 @@
+# Convolve an image in the frequency domain in independent blocks and
+# compare the result with convolving the whole image.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+psf=psf.fits
+prog=convolve
+img=mkprofcat1.fits
+ref=convolve_frequency.fits
+spatial=convolve_spatial.fits
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
+if [ ! -f $psf      ]; then echo "$psf does not exist.";   exit 77; fi
+if [ ! -f $ref      ]; then echo "$ref does not exist.";   exit 77; fi
+if [ ! -f $spatial  ]; then echo "$spatial does not exist."; exit 77; fi
+compare_skip_without $cmparith $cmpstats $cmpcrop
+
+
+
+
+# Actual test script
+# ==================
+#
+# The blocks are padded with their surrounding pixels, so the output is
+# only expected to differ from the whole-image convolution by floating
+# point round-off. Its interior (see `convolve/domains.sh') is also
+# compared with the spatial domain convolution, which is independent of
+# the transforms.
+$execname $img --kernel=$psf --domain=frequency --blocksize=30  \
+          --output=convolve_blocksize.fits || exit 1
+compare_images_tolerance convolve_blocksize.fits $ref 1e-5 || exit 1
+compare_interiors_tolerance convolve_blocksize.fits $spatial 10 1e-5
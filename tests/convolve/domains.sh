@@ -0,0 +1,60 @@
+# Compare the interiors of the spatial and frequency domain convolutions.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+spatial=convolve_spatial.fits
+frequency=convolve_frequency.fits
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $spatial   ]; then echo "$spatial does not exist.";   exit 77; fi
+if [ ! -f $frequency ]; then echo "$frequency does not exist."; exit 77; fi
+compare_skip_without $cmparith $cmpstats $cmpcrop
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The two domains only treat the edges differently (the spatial domain
+# corrects for the kernel pixels that fall outside the image), so the
+# pixels further from the edges than the kernel's half-width (less than
+# 10 pixels for `psf.fits') must only differ by floating point round-off.
+# The frequency domain output is made with the real (half-complex)
+# transforms, so this also checks their packing.
+compare_interiors_tolerance $frequency $spatial 10 1e-5
@@ -0,0 +1,71 @@
+# Convolve an image in the frequency domain with a cached transform of
+# the kernel and make sure the output is identical to not caching it.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+psf=psf.fits
+prog=convolve
+img=mkprofcat1.fits
+ref=convolve_frequency.fits
+cache=convolve_kernelcache_psf.fits
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
+if [ ! -f $psf      ]; then echo "$psf does not exist.";   exit 77; fi
+if [ ! -f $ref      ]; then echo "$ref does not exist.";   exit 77; fi
+compare_skip_without $cmparith $cmpstats
+
+
+
+
+# Actual test script
+# ==================
+#
+# The first run with `--kernelcache' writes the kernel's transform into
+# the cache and the second reads it from there. The transform is stored
+# with its own numeric type, so both outputs must be identical to the
+# output without a cache.
+rm -f $cache
+for run in build use; do
+    out=convolve_kernelcache_$run.fits
+    $execname $img --kernel=$psf --domain=frequency --kernelcache=$cache \
+              --output=$out || exit 1
+    if [ ! -f $cache ]; then echo "$cache was not created."; exit 1; fi
+    compare_images_identical $out $ref || exit 1
+done
@@ -0,0 +1,69 @@
+# Convolve an image in the frequency domain with a small RAM budget (so
+# the large arrays are kept in files) and make sure the output is
+# identical to keeping them in RAM.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+psf=psf.fits
+prog=convolve
+img=mkprofcat1.fits
+ref=convolve_frequency.fits
+mmapdir=convolve_mmap
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
+if [ ! -f $psf      ]; then echo "$psf does not exist.";   exit 77; fi
+if [ ! -f $ref      ]; then echo "$ref does not exist.";   exit 77; fi
+compare_skip_without $cmparith $cmpstats
+
+
+
+
+# Actual test script
+# ==================
+#
+# With a budget of 10kB, the input image and the padded arrays don't fit
+# in RAM and are kept as files within `--mmapdir' (which is only created
+# when the first array is written). Only the storage changes, so the
+# output must be identical to the output without a budget.
+rm -rf $mmapdir
+$execname $img --kernel=$psf --domain=frequency --rambudget=10000   \
+          --mmapdir=$mmapdir --output=convolve_rambudget.fits || exit 1
+if [ ! -d $mmapdir ]; then echo "$mmapdir was not created."; exit 1; fi
+compare_images_identical convolve_rambudget.fits $ref
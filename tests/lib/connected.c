@@ -0,0 +1,165 @@
+/*********************************************************************
+A test program for finding the connected components of a 3D dataset
+with Gnuastro's library.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/blank.h"
+#include "gnuastro/binary.h"
+
+
+/* Size of the dataset along each dimension. */
+#define NZ 13
+#define NY 17
+#define NX 19
+
+
+/* Is this pixel in the foreground? */
+#define FG(B) ( (B) && (B)!=GAL_BLANK_UINT8 )
+
+
+
+
+/* Label the connected components with a breadth-first search, starting
+   from the pixels in raster order (the first pixel of each component gets
+   the next label). Two pixels are neighbors when their coordinates differ
+   by at most one along every dimension and they differ along at most
+   `connectivity' dimensions. Blank pixels get a blank label and the
+   background gets a label of zero. Return the number of components. */
+size_t
+reference_labels(uint8_t *b, int32_t *l, int connectivity)
+{
+  int32_t curlab=0;
+  int dz, dy, dx, z, y, x;
+  size_t i, p, n, qf, ql, size=NZ*NY*NX;
+  size_t *queue=malloc(size*sizeof *queue);
+
+  if(queue==NULL)
+    {
+      fprintf(stderr, "%s: couldn't allocate the queue\n", __func__);
+      exit(EXIT_FAILURE);
+    }
+
+  for(i=0;i<size;++i)
+    l[i] = b[i]==GAL_BLANK_UINT8 ? GAL_BLANK_INT32 : 0;
+
+  for(i=0;i<size;++i)
+    if( FG(b[i]) && l[i]==0 )
+      {
+        l[i]=++curlab;
+        queue[0]=i; qf=0; ql=1;
+        while(qf<ql)
+          {
+            p=queue[qf++];
+            z=p/(NY*NX); y=(p/NX)%NY; x=p%NX;
+            for(dz=-1;dz<=1;++dz)
+              for(dy=-1;dy<=1;++dy)
+                for(dx=-1;dx<=1;++dx)
+                  if( (dz!=0)+(dy!=0)+(dx!=0) <= connectivity
+                      && z+dz>=0 && z+dz<NZ && y+dy>=0 && y+dy<NY
+                      && x+dx>=0 && x+dx<NX )
+                    {
+                      n=((size_t)(z+dz)*NY+(y+dy))*NX+(x+dx);
+                      if( FG(b[n]) && l[n]==0 )
+                        {
+                          l[n]=curlab;
+                          queue[ql++]=n;
+                        }
+                    }
+          }
+      }
+
+  free(queue);
+  return curlab;
+}
+
+
+
+
+/* Find the connected components of random 3D datasets (with blank
+   pixels) with all the connectivities and several numbers of threads and
+   compare them with the breadth-first search above. The threads divide
+   the dataset into stripes of rows, so this also checks the merging of
+   components that cross the stripes. After running `make check' you can
+   see the outputs in `tests/connected.log'.
+
+   Please run the following command for an explanation on easily linking
+   and compiling C programs that use Gnuastro's libraries (without having
+   to worry about the libraries to link to) anywhere on your system:
+
+      $ info gnuastro "Automatic linking script"
+*/
+int
+main(void)
+{
+  uint8_t *b;
+  int32_t *ref;
+  gal_data_t *binary, *lab;
+  int connectivity, numbad=0;
+  size_t i, t, num, refnum, dsize[3]={NZ, NY, NX};
+  int fgpercent[]={40, 13, 9};
+  size_t numthreads[]={1, 2, 3, 4, 7, 16, 1000};
+
+  /* Space for the random binary dataset and the reference labels. */
+  srand(1);
+  binary=gal_data_alloc(NULL, GAL_TYPE_UINT8, 3, dsize, NULL, 0, -1,
+                        NULL, NULL, NULL);
+  b=binary->array;
+  ref=malloc(binary->size * sizeof *ref);
+  if(ref==NULL)
+    {
+      fprintf(stderr, "%s: couldn't allocate the reference\n", __func__);
+      return EXIT_FAILURE;
+    }
+
+  /* Do the checks. */
+  for(connectivity=1; connectivity<=3; ++connectivity)
+    {
+      /* With more neighbors, the foreground must be sparser to have many
+         separate components (with complex shapes) rather than one that
+         fills the dataset. About 5% of the pixels are blank. */
+      for(i=0;i<binary->size;++i)
+        b[i] = ( rand()%20==0
+                 ? GAL_BLANK_UINT8
+                 : rand()%100 < fgpercent[connectivity-1] );
+      refnum=reference_labels(b, ref, connectivity);
+      for(t=0; t<sizeof numthreads/sizeof *numthreads; ++t)
+        {
+          lab=NULL;
+          num=gal_binary_connected_components(binary, &lab, connectivity,
+                                              numthreads[t]);
+          i = ( num==refnum
+                && memcmp(lab->array, ref, lab->size*sizeof *ref)==0 );
+          printf("Connectivity %d, %zu thread(s): %zu components: %s\n",
+                 connectivity, numthreads[t], num,
+                 i ? "passed" : "FAILED");
+          numbad += i==0;
+          gal_data_free(lab);
+        }
+    }
+
+  /* Clean up and return. */
+  free(ref);
+  gal_data_free(binary);
+  return numbad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/*********************************************************************
+A test program for eroding, dilating and opening a 3D dataset with
+Gnuastro's library.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/blank.h"
+#include "gnuastro/binary.h"
+
+
+/* Size of the dataset along each dimension (each row is longer than two
+   64-bit words, so the packed rows have partial words too). */
+#define NZ 6
+#define NY 9
+#define NX 131
+
+
+
+
+/* Print the message and count the check as failed if `condition' is
+   zero. */
+static size_t
+check(int condition, char *message)
+{
+  printf("%s: %s\n", message, condition ? "passed" : "FAILED");
+  return condition==0;
+}
+
+
+
+
+/* Erode (when `d0e1' is 1) or dilate (when it is 0) the array `in' `num'
+   times by directly checking the neighbors of every pixel in each
+   iteration: a pixel with a value of `b' changes to `f' if any of its
+   neighbors had a value of `f' before this iteration. Two pixels are
+   neighbors when their coordinates differ by at most one along every
+   dimension and they differ along at most `connectivity' dimensions. All
+   other values (blank) are left unchanged. The result is written in
+   `out'. */
+void
+reference_morph(uint8_t *in, uint8_t *out, size_t num, int connectivity,
+                int d0e1)
+{
+  size_t i, it, size=NZ*NY*NX;
+  int dz, dy, dx, z, y, x, found;
+  uint8_t f=!d0e1, b=d0e1, *prev=malloc(size);
+
+  if(prev==NULL)
+    {
+      fprintf(stderr, "%s: couldn't allocate the previous array\n",
+              __func__);
+      exit(EXIT_FAILURE);
+    }
+
+  memcpy(out, in, size);
+  for(it=0;it<num;++it)
+    {
+      memcpy(prev, out, size);
+      for(i=0;i<size;++i)
+        if(prev[i]==b)
+          {
+            found=0;
+            z=i/(NY*NX); y=(i/NX)%NY; x=i%NX;
+            for(dz=-1;dz<=1;++dz)
+              for(dy=-1;dy<=1;++dy)
+                for(dx=-1;dx<=1;++dx)
+                  if( (dz!=0)+(dy!=0)+(dx!=0) <= connectivity
+                      && z+dz>=0 && z+dz<NZ && y+dy>=0 && y+dy<NY
+                      && x+dx>=0 && x+dx<NX
+                      && prev[((size_t)(z+dz)*NY+(y+dy))*NX+(x+dx)]==f )
+                    found=1;
+            if(found) out[i]=f;
+          }
+    }
+
+  free(prev);
+}
+
+
+
+
+/* Erode and dilate random 3D datasets (with blank pixels) with all the
+   connectivities, several numbers of iterations and several numbers of
+   threads and compare them with the direct implementation above. Then
+   check that opening a dataset into a new one doesn't change the input
+   and gives the same result as opening it in place. After running `make
+   check' you can see the outputs in `tests/morph.log'.
+
+   Please run the following command for an explanation on easily linking
+   and compiling C programs that use Gnuastro's libraries (without having
+   to worry about the libraries to link to) anywhere on your system:
+
+      $ info gnuastro "Automatic linking script"
+*/
+int
+main(void)
+{
+  char message[200];
+  uint8_t *in, *ref;
+  gal_data_t *input, *out, *copy;
+  int d0e1, same, connectivity, numbad=0;
+  size_t i, n, t, dsize[3]={NZ, NY, NX};
+  size_t num[]={1, 2, 5}, numthreads[]={1, 2, 3, 8, 100};
+
+  /* Make a random binary dataset with some blank pixels: a foreground
+     fraction of about 60% leaves some of it after a few erosions and
+     some background after a few dilations. */
+  srand(1);
+  input=gal_data_alloc(NULL, GAL_TYPE_UINT8, 3, dsize, NULL, 0, -1,
+                       NULL, NULL, NULL);
+  in=input->array;
+  for(i=0;i<input->size;++i)
+    in[i] = rand()%20==0 ? GAL_BLANK_UINT8 : rand()%100 < 60;
+  ref=malloc(input->size);
+  if(ref==NULL)
+    {
+      fprintf(stderr, "%s: couldn't allocate the reference\n", __func__);
+      return EXIT_FAILURE;
+    }
+
+  /* Erosion and dilation (into a new dataset, so the input is kept). */
+  for(d0e1=0; d0e1<=1; ++d0e1)
+    for(connectivity=1; connectivity<=3; ++connectivity)
+      for(n=0; n<sizeof num/sizeof *num; ++n)
+        {
+          reference_morph(in, ref, num[n], connectivity, d0e1);
+          for(t=0; t<sizeof numthreads/sizeof *numthreads; ++t)
+            {
+              out = ( d0e1
+                      ? gal_binary_erode(input, num[n], connectivity, 0,
+                                         numthreads[t])
+                      : gal_binary_dilate(input, num[n], connectivity, 0,
+                                          numthreads[t]) );
+              sprintf(message, "%s %zu time(s), connectivity %d, "
+                      "%zu thread(s)", d0e1 ? "Erode" : "Dilate", num[n],
+                      connectivity, numthreads[t]);
+              numbad += check(memcmp(out->array, ref, input->size)==0,
+                              message);
+              gal_data_free(out);
+            }
+        }
+
+  /* Opening into a new dataset must not change the input and must give
+     the same result as opening a copy of the input in place. */
+  copy=gal_data_copy(input);
+  out=gal_binary_open(input, 2, 2, 0, 4);
+  numbad += check(out!=input && memcmp(in, copy->array, input->size)==0,
+                  "Open into a new dataset keeps the input");
+  gal_binary_open(copy, 2, 2, 1, 4);
+  same=memcmp(out->array, copy->array, input->size)==0;
+  numbad += check(same, "Open into a new dataset same as in place");
+  gal_data_free(out);
+  gal_data_free(copy);
+
+  /* Clean up and return. */
+  free(ref);
+  gal_data_free(input);
+  return numbad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
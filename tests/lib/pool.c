@@ -0,0 +1,188 @@
+/*********************************************************************
+A test program for the pools of freed allocations in Gnuastro's library.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gnuastro/data.h"
+#include "gnuastro/threads.h"
+
+
+/* Number of datasets that are allocated and freed on each thread. */
+#define NUMDATA 1000
+
+
+/* This structure can keep all information you want to pass onto the worker
+   function on each thread. */
+struct params
+{
+  size_t *numbad;               /* Number of failed checks on each thread. */
+};
+
+
+
+
+/* Print the message and count the check as failed if `condition' is
+   zero. */
+static size_t
+check(int condition, char *message)
+{
+  printf("%s: %s\n", message, condition ? "passed" : "FAILED");
+  return condition==0;
+}
+
+
+
+
+/* The worker function on each thread: attach a pool to the thread, then
+   repeatedly allocate datasets (with cleared arrays), fill them and free
+   them, so the later datasets re-use the freed blocks of the earlier
+   ones. Every dataset must start with a cleared array, irrespective of
+   where its block came from. */
+void *
+worker_on_thread(void *in_prm)
+{
+  /* Low-level definitions to be done first. */
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct params *p=(struct params *)tprm->params;
+
+
+  /* Subsequent definitions. */
+  int32_t *arr;
+  gal_data_t *data;
+  size_t i, j, k, size, numbad=0;
+  gal_data_pool_t *pool=gal_data_pool_alloc(10000);
+  gal_data_pool_t *prevpool=gal_data_pool_use(pool);
+
+
+  /* Go over all the jobs that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    for(j=0; j<NUMDATA; ++j)
+      {
+        /* Allocate a cleared dataset (its size changes, so blocks from
+           different size classes are used). */
+        size = 1 + (j*7) % 300;
+        data=gal_data_alloc(NULL, GAL_TYPE_INT32, 1, &size, NULL, 1, -1,
+                            NULL, NULL, NULL);
+
+        /* Check that it is cleared, then fill it. */
+        arr=data->array;
+        for(k=0; k<data->size; ++k)
+          {
+            if(arr[k]) ++numbad;
+            arr[k]=tprm->indexs[i]+1;
+          }
+
+        /* Return the dataset (and its array) to the pool. */
+        gal_data_free(data);
+      }
+
+
+  /* Detach and free the pool, then keep the result. */
+  gal_data_pool_use(prevpool);
+  gal_data_pool_free(pool);
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    p->numbad[ tprm->indexs[i] ] = numbad;
+
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+/* Check the pool functions directly and through `gal_data_alloc' and
+   `gal_data_free' on the main thread, then use separate pools on multiple
+   threads.
+
+   Please run the following command for an explanation on easily linking
+   and compiling C programs that use Gnuastro's libraries (without having
+   to worry about the libraries to link to) anywhere on your system:
+
+      $ info gnuastro "Automatic linking script"
+*/
+int
+main(void)
+{
+  char *c;
+  struct params p;
+  gal_data_t *data;
+  void *block, *array, *reused;
+  size_t i, dsize=50, numbad=0, numjobs;
+  size_t numthreads=gal_threads_number();
+  gal_data_pool_t *pool=gal_data_pool_alloc(1000), *prevpool;
+
+
+  /* A released block is given back for a request of a similar size. */
+  block=gal_data_pool_malloc(pool, 100, 0);
+  gal_data_pool_release(pool, block, 100);
+  reused=gal_data_pool_malloc(pool, 90, 0);
+  numbad += check(reused==block, "Released block re-used");
+
+
+  /* A cleared block from the pool only has zeros. */
+  for(i=0;i<90;++i) ((char *)reused)[i]=1;
+  gal_data_pool_release(pool, reused, 90);
+  c=gal_data_pool_malloc(pool, 80, 1);
+  for(i=0;i<80;++i) if(c[i]) break;
+  numbad += check(i==80, "Cleared block from pool");
+  free(c);
+
+
+  /* Blocks larger than the pool's maximum size are not kept. */
+  block=gal_data_pool_malloc(pool, 2000, 0);
+  gal_data_pool_release(pool, block, 2000);
+  for(i=0;i<GAL_DATA_POOL_CLASSES;++i) if(pool->num[i]) break;
+  numbad += check(i==GAL_DATA_POOL_CLASSES, "Large block not kept");
+
+
+  /* When the pool is attached, the dataset and its array are re-used by
+     the next dataset of the same size. */
+  prevpool=gal_data_pool_use(pool);
+  numbad += check(prevpool==NULL, "No pool attached initially");
+  data=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &dsize, NULL, 0, -1,
+                      NULL, NULL, NULL);
+  block=data; array=data->array;
+  gal_data_free(data);
+  data=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &dsize, NULL, 0, -1,
+                      NULL, NULL, NULL);
+  numbad += check(data==block && data->array==array,
+                  "Dataset re-used through attached pool");
+  gal_data_free(data);
+  numbad += check(gal_data_pool_use(prevpool)==pool, "Pool detached");
+  gal_data_pool_free(pool);
+
+
+  /* Use a separate pool on each thread. */
+  numjobs = 2*numthreads;
+  p.numbad=gal_data_calloc_array(GAL_TYPE_SIZE_T, numjobs, __func__,
+                                 "p.numbad");
+  gal_threads_spin_off(worker_on_thread, &p, numjobs, numthreads);
+  for(i=0;i<numjobs;++i) if(p.numbad[i]) break;
+  numbad += check(i==numjobs, "Separate pools on each thread");
+  free(p.numbad);
+
+
+  /* Return the final status. */
+  return numbad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
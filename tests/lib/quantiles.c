@@ -0,0 +1,176 @@
+/*********************************************************************
+A test program to find several quantiles (and the mode) of a dataset in
+one call using Gnuastro's library.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/fits.h"
+#include "gnuastro/statistics.h"
+
+
+/* Return 1 if the two datasets have the same type, size and elements
+   (the comparison is done on the bytes, so blank elements are also
+   compared), otherwise 0. */
+int
+same_elements(gal_data_t *a, gal_data_t *b)
+{
+  return ( a->type==b->type && a->size==b->size
+           && memcmp(a->array, b->array,
+                     a->size*gal_type_sizeof(a->type))==0 );
+}
+
+
+
+
+/* Find the requested quantiles with one call to `gal_statistics_quantiles'
+   and compare them with separate calls to `gal_statistics_quantile' (and
+   `gal_statistics_mode' when `mirrordist' is positive). Return the number
+   of differing measurements. */
+size_t
+check_quantiles(gal_data_t *image, double *quantiles, size_t numq,
+                float mirrordist)
+{
+  size_t i, numbad=0;
+  void *value;
+  gal_data_t *all, *one, *mode;
+
+  /* Find all the quantiles (and possibly the mode) in one call. */
+  all=gal_statistics_quantiles(image, quantiles, numq, mirrordist, 0);
+
+  /* Compare each quantile with its separate measurement. */
+  for(i=0;i<numq;++i)
+    {
+      one=gal_statistics_quantile(image, quantiles[i], 0);
+      value=gal_data_ptr_increment(all->array, i, all->type);
+      printf("Quantile %-5g: %g\n", quantiles[i], *(float *)(one->array));
+      if( memcmp(value, one->array, gal_type_sizeof(one->type)) )
+        {
+          printf("  ... differs from `gal_statistics_quantiles': %g\n",
+                 *(float *)value);
+          ++numbad;
+        }
+      gal_data_free(one);
+    }
+
+  /* Compare the mode. */
+  if(mirrordist>0)
+    {
+      mode=gal_statistics_mode(image, mirrordist, 0);
+      if( all->next==NULL || same_elements(all->next, mode)==0 )
+        {
+          printf("Mode (mirrordist: %g) differs from "
+                 "`gal_statistics_quantiles'\n", mirrordist);
+          ++numbad;
+        }
+      else
+        printf("Mode (mirrordist: %g): identical\n", mirrordist);
+      gal_data_free(mode);
+      gal_data_free(all->next);
+    }
+  else if(all->next)
+    {
+      printf("Mode was found with a mirrordist of %g\n", mirrordist);
+      ++numbad;
+    }
+
+  /* Clean up and return. */
+  gal_data_free(all);
+  return numbad;
+}
+
+
+
+
+/* Check the quantiles of an already sorted dataset (`order' is only used
+   in the messages): they are found without any ordering, so compare them
+   with the quantiles of the unsorted dataset (in `ref'), then do the
+   checks of `check_quantiles'. Return the number of differing
+   measurements. */
+size_t
+check_sorted(gal_data_t *sorted, gal_data_t *ref, double *quantiles,
+             size_t numq, char *order)
+{
+  size_t numbad;
+  gal_data_t *all=gal_statistics_quantiles(sorted, quantiles, numq, 0, 0);
+
+  printf("Quantiles of the %s sorted dataset.\n", order);
+  numbad = same_elements(all, ref)==0;
+  if(numbad)
+    printf("  ... differ from those of the unsorted dataset\n");
+
+  gal_data_free(all);
+  return numbad + check_quantiles(sorted, quantiles, numq, 0.0f);
+}
+
+
+
+
+/* A simple program to open a FITS image and find several of its quantiles
+   (in an arbitrary order, with repeated values and both ends of the
+   distribution) in one call, once without the mode and once with it. The
+   results are compared with finding each quantile (and the mode)
+   separately, so the program fails if any of them differ. The same
+   quantiles are then found on the dataset after sorting it in increasing
+   and decreasing order (where they are read directly from the sorted
+   array). After running
+   `make check' you can see the outputs in `tests/quantiles.log'.
+
+   Please run the following command for an explanation on easily linking
+   and compiling C programs that use Gnuastro's libraries (without having
+   to worry about the libraries to link to) anywhere on your system:
+
+      $ info gnuastro "Automatic linking script"
+*/
+int
+main(void)
+{
+  gal_data_t *image, *ref, *sorted;
+  size_t numbad, numq=7;
+  double quantiles[]={0.9, 0.1, 0.5, 0.5, 1.0, 0.0, 0.25};
+  char *filename="convolve_spatial_scaled_noised.fits", *hdu="1";
+
+
+  /* Read the image into memory as a float32 data type. */
+  image=gal_fits_img_read_to_type(filename, hdu, GAL_TYPE_FLOAT32, -1,0,0);
+  printf("Quantiles of %s (HDU: %s).\n", filename, hdu);
+
+
+  /* Do the checks. */
+  numbad  = check_quantiles(image, quantiles, numq, 0.0f);
+  numbad += check_quantiles(image, quantiles, numq, 1.5f);
+
+
+  /* Do the checks on sorted copies of the dataset (without blanks). */
+  ref=gal_statistics_quantiles(image, quantiles, numq, 0.0f, 0);
+  sorted=gal_statistics_no_blank_sorted(image, 0);
+  numbad += check_sorted(sorted, ref, quantiles, numq, "increasing");
+  gal_statistics_sort_decreasing(sorted, 1);
+  numbad += check_sorted(sorted, ref, quantiles, numq, "decreasing");
+
+
+  /* Clean up and return. */
+  gal_data_free(ref);
+  gal_data_free(sorted);
+  gal_data_free(image);
+  return numbad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
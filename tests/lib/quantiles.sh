@@ -0,0 +1,51 @@
+# Run the program to test finding several quantiles (and the mode) of a
+# FITS image in one call to the library.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+img=convolve_spatial_scaled_noised.fits
+execname=./quantiles
+
+
+
+
+
+# SKIP or FAIL?
+# =============
+#
+# If the actual executable wasn't built, then this is a hard error and must
+# be FAIL. But if the input doesn't exist, its not this test's fault. So
+# just SKIP this test.
+if [ ! -f $execname ]; then
+    echo "$execname library program not compiled.";
+    exit 99;
+fi;
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi;
+
+
+
+
+
+# Actual test script
+# ==================
+$execname
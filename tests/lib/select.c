@@ -0,0 +1,328 @@
+/*********************************************************************
+A test program for finding the median and quantiles of unsorted datasets
+by selection in Gnuastro's library.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/statistics.h"
+
+
+/* The different orders of the input values. */
+enum patterns
+{
+  PATTERN_RANDOM,           /* Random values (with many duplicates).      */
+  PATTERN_SORTED,           /* Sorted (the median is read directly).      */
+  PATTERN_NEARLY_SORTED,    /* Sorted, but the smallest is at the end.    */
+  PATTERN_REVERSE,          /* Sorted in decreasing order.                */
+  PATTERN_NEARLY_REVERSE,   /* Decreasing, but the largest is at the end. */
+  PATTERN_EQUAL,            /* All elements are equal.                    */
+  PATTERN_NEARLY_EQUAL,     /* All equal, except a larger middle element. */
+  PATTERN_ORGAN_PIPE,       /* Increasing, then decreasing.               */
+  PATTERN_ADVERSARY,        /* Worst case for the median-of-three pivots. */
+
+  PATTERN_NUMBER,           /* Number of patterns (must be last).         */
+};
+
+static char *pattern_names[PATTERN_NUMBER]={"random", "sorted",
+  "nearly sorted", "reverse sorted", "nearly reverse sorted", "all equal",
+  "nearly all equal", "organ pipe", "median-of-three adversary"};
+
+
+
+
+/* Values of the elements for the adversary (see `adversary_fill'). A
+   value of `ADVERSARY_GAS' means its value isn't yet decided. */
+#define ADVERSARY_GAS SIZE_MAX
+static size_t *adversary_val, adversary_nsolid, adversary_candidate;
+
+/* Compare the elements with indexs `x' and `y' (as `strcmp'), deciding
+   their values if necessary. */
+static int
+adversary_cmp(size_t x, size_t y)
+{
+  size_t *v=adversary_val;
+
+  if(v[x]==ADVERSARY_GAS && v[y]==ADVERSARY_GAS)
+    v[ x==adversary_candidate ? x : y ] = adversary_nsolid++;
+  if(v[x]==ADVERSARY_GAS)      adversary_candidate=x;
+  else if(v[y]==ADVERSARY_GAS) adversary_candidate=y;
+
+  return v[x]<v[y] ? -1 : (v[x]>v[y] ? 1 : 0);
+}
+
+
+
+
+/* Fill `a' with `n' values that force the selection of the median in the
+   library to always choose an extreme pivot, so it reaches its depth
+   limit and has to sort the remaining range. This is McIlroy's "A Killer
+   Adversary for Quicksort" (1999): the selection is simulated on the
+   indexs of the elements and the value of an element is only decided
+   when it is compared; undecided elements are larger than all decided
+   ones and one of them is decided as soon as two are compared. Since the
+   library chooses its pivots in the same way, it will do exactly the
+   same comparisons on the final values. So the simulation must follow
+   `STATS_SELECT' in `lib/statistics.c'. */
+static void
+adversary_fill(float *a, size_t n)
+{
+  size_t i, j, t, m, mid, pivot, lo=0, hi=n-1, k=n/2, depth=0;
+  size_t *p=malloc(2*n*sizeof *p);
+
+  if(p==NULL)
+    {
+      fprintf(stderr, "%s: couldn't allocate the indexs\n", __func__);
+      exit(EXIT_FAILURE);
+    }
+
+  /* Initialize the simulation. */
+  adversary_val=p+n;
+  adversary_nsolid=adversary_candidate=0;
+  for(i=0;i<n;++i) { p[i]=i; adversary_val[i]=ADVERSARY_GAS; }
+  for(m=n; m; m>>=1) depth+=2;
+
+  /* Simulate the selection of the median. */
+#define ADV_SWAP(A, B) { t=p[A]; p[A]=p[B]; p[B]=t; }
+  while(hi>lo)
+    {
+      if(hi-lo<16 || depth--==0) break;
+      mid=lo+(hi-lo)/2;
+      if(adversary_cmp(p[mid], p[lo])<0) ADV_SWAP(mid, lo);
+      if(adversary_cmp(p[hi],  p[lo])<0) ADV_SWAP(hi,  lo);
+      if(adversary_cmp(p[hi], p[mid])<0) ADV_SWAP(hi,  mid);
+      pivot=p[mid];
+      i=lo; j=hi;
+      while(i<=j)
+        {
+          while(adversary_cmp(p[i], pivot)<0) ++i;
+          while(adversary_cmp(p[j], pivot)>0) --j;
+          if(i<=j) { ADV_SWAP(i, j); ++i; --j; }
+        }
+      if(k<=j)      hi=j;
+      else if(k>=i) lo=i;
+      else          break;
+    }
+#undef ADV_SWAP
+
+  /* Decide the remaining values and write the output. */
+  for(i=0;i<n;++i)
+    {
+      if(adversary_val[i]==ADVERSARY_GAS)
+        adversary_val[i]=adversary_nsolid++;
+      a[i]=adversary_val[i];
+    }
+  free(p);
+}
+
+
+
+
+/* Allocate a dataset of `n' elements with the given pattern. */
+static gal_data_t *
+make_input(size_t n, int pattern)
+{
+  size_t i;
+  float *a, t;
+  gal_data_t *data=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &n, NULL, 0,
+                                  -1, NULL, NULL, NULL);
+
+  a=data->array;
+  for(i=0;i<n;++i)
+    switch(pattern)
+      {
+      case PATTERN_RANDOM:         a[i]=rand()%1000;                  break;
+      case PATTERN_SORTED:
+      case PATTERN_NEARLY_SORTED:  a[i]=i;                            break;
+      case PATTERN_REVERSE:
+      case PATTERN_NEARLY_REVERSE: a[i]=n-i;                          break;
+      case PATTERN_EQUAL:
+      case PATTERN_NEARLY_EQUAL:   a[i]=7;                            break;
+      case PATTERN_ORGAN_PIPE:     a[i] = i<n/2 ? i : n-i;            break;
+      }
+
+  /* Break the order of the nearly ordered patterns. */
+  switch(pattern)
+    {
+    case PATTERN_NEARLY_SORTED:
+    case PATTERN_NEARLY_REVERSE:
+      t=a[0]; memmove(a, a+1, (n-1)*sizeof *a); a[n-1]=t;
+      break;
+    case PATTERN_NEARLY_EQUAL: a[n/2]=8;                              break;
+    case PATTERN_ADVERSARY:    adversary_fill(a, n);                  break;
+    }
+  return data;
+}
+
+
+
+
+/* Return 1 if the two datasets have the same type, size and elements,
+   otherwise 0. */
+static int
+same_elements(gal_data_t *a, gal_data_t *b)
+{
+  return ( a->type==b->type && a->size==b->size
+           && memcmp(a->array, b->array,
+                     a->size*gal_type_sizeof(a->type))==0 );
+}
+
+
+
+
+/* Find the median and several quantiles of `input' (without changing it)
+   and compare them with the same measurements on a sorted copy (where
+   they are read directly). Return 1 if any of them differ (or if the
+   input was changed), otherwise 0. */
+static size_t
+check_input(gal_data_t *input, char *name)
+{
+  size_t i, numq=6;
+  gal_data_t *copy, *sorted, *a, *b;
+  int same;
+  double quantiles[]={0.9, 0.0, 0.5, 0.25, 1.0, 0.1};
+
+  /* Make the copies. */
+  copy=gal_data_copy(input);
+  sorted=gal_data_copy(input);
+  gal_statistics_sort_increasing(sorted, 1);
+
+  /* The median. */
+  a=gal_statistics_median(input, 0);
+  b=gal_statistics_median(sorted, 0);
+  same=same_elements(a, b);
+  gal_data_free(a);
+  gal_data_free(b);
+
+  /* The quantiles, one by one. */
+  for(i=0;i<numq;++i)
+    {
+      a=gal_statistics_quantile(input, quantiles[i], 0);
+      b=gal_statistics_quantile(sorted, quantiles[i], 0);
+      same = same && same_elements(a, b);
+      gal_data_free(a);
+      gal_data_free(b);
+    }
+
+  /* The quantiles, all together. */
+  a=gal_statistics_quantiles(input, quantiles, numq, 0, 0);
+  b=gal_statistics_quantiles(sorted, quantiles, numq, 0, 0);
+  same = same && same_elements(a, b) && same_elements(input, copy);
+  gal_data_free(a);
+  gal_data_free(b);
+
+  /* Report the result, clean up and return. */
+  printf("%-26s %7zu elements: %s\n", name, input->size,
+         same ? "passed" : "FAILED");
+  gal_data_free(copy);
+  gal_data_free(sorted);
+  return same==0;
+}
+
+
+
+
+/* Print the average time to find the median of a random dataset with `n'
+   elements by selection and by sorting the whole dataset. */
+static void
+benchmark(size_t n)
+{
+  clock_t start;
+  size_t i, numrep=4000000/n+1;
+  double tselect, tsort;
+  gal_data_t *input=make_input(n, PATTERN_RANDOM), *work, *med;
+
+  work=gal_data_copy(input);
+
+  /* With selection (the default when the input isn't sorted). */
+  start=clock();
+  for(i=0;i<numrep;++i)
+    {
+      memcpy(work->array, input->array, n*sizeof(float));
+      med=gal_statistics_median(work, 1);
+      gal_data_free(med);
+    }
+  tselect=(double)(clock()-start)/CLOCKS_PER_SEC/numrep;
+
+  /* By sorting the whole dataset. */
+  start=clock();
+  for(i=0;i<numrep;++i)
+    {
+      memcpy(work->array, input->array, n*sizeof(float));
+      gal_statistics_sort_increasing(work, 1);
+      med=gal_statistics_median(work, 1);
+      gal_data_free(med);
+    }
+  tsort=(double)(clock()-start)/CLOCKS_PER_SEC/numrep;
+
+  printf("Median of %7zu elements: select: %10.3f us, sort: %10.3f us "
+         "(%.1f times faster)\n", n, tselect*1e6, tsort*1e6,
+         tselect>0 ? tsort/tselect : 0.0);
+  gal_data_free(work);
+  gal_data_free(input);
+}
+
+
+
+
+/* Find the median and quantiles of datasets with different orders and
+   sizes (including very small, odd and even sizes). They are compared
+   with the same measurements on sorted copies, so the program fails if
+   any of them differ. The average time to find the median of a random
+   dataset of some typical tile sizes by selection and by sorting is then
+   printed (the timings don't affect the result). After running `make
+   check' you can see the outputs in `tests/select.log'.
+
+   Please run the following command for an explanation on easily linking
+   and compiling C programs that use Gnuastro's libraries (without having
+   to worry about the libraries to link to) anywhere on your system:
+
+      $ info gnuastro "Automatic linking script"
+*/
+int
+main(void)
+{
+  int pattern;
+  gal_data_t *input;
+  size_t s, numbad=0;
+  size_t sizes[]={2, 3, 16, 17, 18, 1000, 1001, 100000};
+  size_t bsizes[]={100, 1000, 10000, 100000, 1000000};
+
+  /* Check the measurements. */
+  srand(1);
+  for(pattern=0; pattern<PATTERN_NUMBER; ++pattern)
+    for(s=0; s<sizeof sizes/sizeof *sizes; ++s)
+      {
+        input=make_input(sizes[s], pattern);
+        numbad += check_input(input, pattern_names[pattern]);
+        gal_data_free(input);
+      }
+
+  /* Print the timings. */
+  for(s=0; s<sizeof bsizes/sizeof *bsizes; ++s)
+    benchmark(bsizes[s]);
+
+  /* Return the final status. */
+  return numbad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+# Match two catalogs with an index file for the second one and make sure
+# the result is the same as matching without it.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=match
+index=match-index2.idx
+execname=../bin/$prog/ast$prog
+cat1=$topsrc/tests/$prog/positions-1.txt
+cat2=$topsrc/tests/$prog/positions-2.txt
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The first run with `--index2' builds the index and the second uses
+# it. Both must give the same matches as a run without the index.
+rm -f $index
+$execname $cat1 $cat2 --aperture=0.5 --logasoutput                    \
+          --output=match-noindex.txt || exit 1
+$execname $cat1 $cat2 --aperture=0.5 --logasoutput --index2=$index    \
+          --output=match-index-build.txt || exit 1
+if [ ! -f $index ]; then echo "$index was not created."; exit 1; fi
+$execname $cat1 $cat2 --aperture=0.5 --logasoutput --index2=$index    \
+          --output=match-index-use.txt || exit 1
+compare_tables_tolerance match-noindex.txt match-index-build.txt 0 || exit 1
+compare_tables_tolerance match-noindex.txt match-index-use.txt 0
@@ -0,0 +1,73 @@
+# Make the catalogs in a single pass over the image and compare them with
+# the catalogs from the default (per-object) measurements.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=mkcatalog
+execname=../bin/$prog/ast$prog
+img=convolve_spatial_noised_labeled.fits
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The two runs may only differ by floating point round-off in the order
+# that the pixels are added, so any two values that aren't written
+# identically must have a relative difference less than 1e-5. The
+# upper-limit columns use random positions, so the random number
+# generator is given a fixed seed (the seed of each object's positions
+# is derived from it and the object's label, so both runs use the same
+# positions).
+export GSL_RNG_SEED=1
+export GSL_RNG_TYPE=ranlxs2
+for mode in perobject singlepass; do
+    if [ $mode = singlepass ]; then opt=--singlepass; else opt=; fi
+    $execname $img --ids --x --y --ra --dec --area --brightness --magnitude \
+              --sn --semimajor --axisratio --upperlimit --upperlimitmag    \
+              --envseed --output=mkcatalog_$mode.txt $opt || exit 1
+done
+for cat in o c; do
+    compare_tables_tolerance mkcatalog_perobject_$cat.txt                \
+                             mkcatalog_singlepass_$cat.txt 1e-5 || exit 1
+done
@@ -0,0 +1,77 @@
+# Read a plain text table through its columnar cache and make sure the
+# output is the same as parsing the table.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=table
+input=table-cache.txt
+execname=../bin/$prog/ast$prog
+table=$topsrc/tests/$prog/table.txt
+. $topsrc/tests/compare.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $table    ]; then echo "$table does not exist."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The cache is written next to the input, so the table is first copied
+# into the build directory. The first run with `--cache' parses the table
+# and writes the cache, the second reads the columns from the cache. Both
+# outputs must be identical to the output without a cache.
+cp $table $input || exit 1
+rm -f $input.gtc
+$execname $input --output=from-table-parsed.txt || exit 1
+$execname $input --cache --output=from-table-cache-write.txt || exit 1
+if [ ! -f $input.gtc ]; then echo "$input.gtc was not created."; exit 1; fi
+$execname $input --cache --output=from-table-cache-read.txt || exit 1
+compare_tables_tolerance from-table-parsed.txt                       \
+                         from-table-cache-write.txt 0 || exit 1
+compare_tables_tolerance from-table-parsed.txt                       \
+                         from-table-cache-read.txt 0 || exit 1
+
+# A truncated cache (its columns are no longer within it) must be ignored
+# and the table read from its source (`--cache' isn't given here, because
+# it would re-write the cache).
+head -c 100 $input.gtc > $input.gtc.part || exit 1
+mv $input.gtc.part $input.gtc || exit 1
+$execname $input --output=from-table-cache-bad.txt || exit 1
+compare_tables_tolerance from-table-parsed.txt from-table-cache-bad.txt 0